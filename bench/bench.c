@@ -0,0 +1,897 @@
+// bench.c - Parser and pipeline benchmark on synthetic traffic
+//
+// Build (Linux; MSYS2/MinGW the same without -I/usr/include/postgresql):
+//   gcc -O2 -Isrc -I/usr/include/postgresql bench/bench.c $(ls src/*.c | grep -v src/main.c)
+//       -o bench_sniffer -lpcap -lpq -lpthread
+// Add -DBENCH_COUNT_ALLOCS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// to count heap allocations per packet (GNU ld).
+//
+// Usage: bench_sniffer [-n packets] [-r reps] [-m mix,...] [-t target,...]
+//                      [-l label] [-o results.csv] [-b baseline.csv]
+//
+// Each mix is generated once from a fixed seed, so runs on different
+// commits see byte-identical traffic. Every repetition starts from a fresh
+// analyzer (created outside the timed loop) so flows, reassembly and DNS
+// state do the same work each time; the median repetition is reported.
+// Cycles and cache misses come from perf_event_open where the kernel
+// allows it (perf_event_paranoid <= 2); otherwise cycles fall back to the
+// TSC on x86 and cache misses are left empty.
+#include "analyzer.h"
+#include "dissect.h"
+#include "dns.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "logger.h"
+#include "platform.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define DEFAULT_PACKETS 200000
+#define DEFAULT_REPS 5
+#define MAX_REPS 31
+#define FRAME_MAX 1600              // Largest synthetic frame
+#define BENCH_FLOWS 262144          // Flow table of the benchmark analyzer
+#define STATS_OPS_PER_PACKET 4      // stats_increment target: layers counted per "packet"
+
+// ---------------------------
+// Allocation counting
+// ---------------------------
+static volatile uint64_t alloc_calls = 0;
+
+#ifdef BENCH_COUNT_ALLOCS
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n) {
+    alloc_calls++;
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    alloc_calls++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+    alloc_calls++;
+    return __real_realloc(p, n);
+}
+#define ALLOCS_COUNTED 1
+#else
+#define ALLOCS_COUNTED 0
+#endif
+
+// ---------------------------
+// Hardware counters
+// ---------------------------
+enum { CTR_CYCLES = 0, CTR_INSTRUCTIONS, CTR_CACHE_MISSES, CTR_BRANCH_MISSES, CTR_COUNT };
+
+static const char *const ctr_names[CTR_COUNT] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+static int ctr_fd[CTR_COUNT] = { -1, -1, -1, -1 };
+
+static void counters_open(void) {
+#ifdef __linux__
+    static const uint64_t configs[CTR_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int c = 0; c < CTR_COUNT; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = configs[c];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        ctr_fd[c] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+static void counters_start(void) {
+#ifdef __linux__
+    for (int c = 0; c < CTR_COUNT; c++) {
+        if (ctr_fd[c] < 0) continue;
+        ioctl(ctr_fd[c], PERF_EVENT_IOC_RESET, 0);
+        ioctl(ctr_fd[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// -1 for counters that are not available
+static void counters_stop(int64_t *out) {
+    for (int c = 0; c < CTR_COUNT; c++) {
+        out[c] = -1;
+#ifdef __linux__
+        uint64_t v;
+        if (ctr_fd[c] < 0) continue;
+        ioctl(ctr_fd[c], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(ctr_fd[c], &v, sizeof(v)) == (ssize_t)sizeof(v)) out[c] = (int64_t)v;
+#endif
+    }
+}
+
+static uint64_t read_tsc(void) {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// ---------------------------
+// Synthetic frames
+// ---------------------------
+typedef struct {
+    uint32_t off;                // Into the mix's slab
+    uint16_t len;
+    uint16_t l3_type;            // Ethertype (0 = not an IP frame)
+    uint16_t dns_off;            // DNS message offset in the frame (0 = none)
+    uint16_t dns_len;
+    uint64_t ts_us;
+} Frame;
+
+typedef struct {
+    const char *name;
+    const char *desc;
+    u_char *slab;
+    size_t slab_used, slab_cap;
+    Frame *frames;
+    uint32_t count, cap;
+} Mix;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 16);
+}
+
+static u_char *put16(u_char *p, uint16_t v) { p[0] = (u_char)(v >> 8); p[1] = (u_char)v; return p + 2; }
+static u_char *put32(u_char *p, uint32_t v) { p = put16(p, (uint16_t)(v >> 16)); return put16(p, (uint16_t)v); }
+
+static u_char *put_eth(u_char *p, uint16_t type) {
+    static const u_char macs[12] = { 0x02, 0, 0, 0, 0, 1, 0x02, 0, 0, 0, 0, 2 };
+    memcpy(p, macs, 12);
+    return put16(p + 12, type);
+}
+
+// frag: flags and offset word (0x4000 = DF, 0x2000 = MF)
+static u_char *put_ipv4(u_char *p, uint8_t proto, uint32_t src, uint32_t dst, int payload, uint16_t id, uint16_t frag) {
+    p[0] = 0x45;
+    p[1] = 0;
+    put16(p + 2, (uint16_t)(20 + payload));
+    put16(p + 4, id);
+    put16(p + 6, frag);
+    p[8] = 64;
+    p[9] = proto;
+    put16(p + 10, 0);
+    put32(p + 12, src);
+    put32(p + 16, dst);
+    return p + 20;
+}
+
+static u_char *put_ipv6(u_char *p, uint8_t next, uint16_t src, uint16_t dst, int payload) {
+    static const u_char prefix[14] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    put32(p, 0x60000000u);
+    put16(p + 4, (uint16_t)payload);
+    p[6] = next;
+    p[7] = 64;
+    memcpy(p + 8, prefix, 14);
+    put16(p + 22, src);
+    memcpy(p + 24, prefix, 14);
+    put16(p + 38, dst);
+    return p + 40;
+}
+
+static u_char *put_udp(u_char *p, uint16_t sport, uint16_t dport, int payload) {
+    put16(p, sport);
+    put16(p + 2, dport);
+    put16(p + 4, (uint16_t)(8 + payload));
+    put16(p + 6, 0);
+    return p + 8;
+}
+
+static u_char *put_tcp(u_char *p, uint16_t sport, uint16_t dport, uint32_t seq, uint32_t ack, uint8_t flags) {
+    put16(p, sport);
+    put16(p + 2, dport);
+    put32(p + 4, seq);
+    put32(p + 8, ack);
+    p[12] = 0x50;
+    p[13] = flags;
+    put16(p + 14, 65535);
+    put32(p + 16, 0);
+    return p + 20;
+}
+
+static int put_qname(u_char *p, const char *name) {
+    u_char *start = p;
+    while (*name) {
+        const char *dot = strchr(name, '.');
+        size_t n = dot ? (size_t)(dot - name) : strlen(name);
+        *p++ = (u_char)n;
+        memcpy(p, name, n);
+        p += n;
+        name += n + (dot ? 1 : 0);
+    }
+    *p++ = 0;
+    return (int)(p - start);
+}
+
+// A query, or its response with one A record
+static int put_dns(u_char *p, uint16_t id, const char *qname, int response) {
+    u_char *start = p;
+    p = put16(p, id);
+    p = put16(p, response ? 0x8180 : 0x0100);
+    p = put16(p, 1);
+    p = put16(p, response ? 1 : 0);
+    p = put32(p, 0);
+    p += put_qname(p, qname);
+    p = put16(p, 1);
+    p = put16(p, 1);
+    if (response) {
+        p = put16(p, 0xC00C);
+        p = put16(p, 1);
+        p = put16(p, 1);
+        p = put32(p, 300);
+        p = put16(p, 4);
+        p = put32(p, 0xC0000200u | (id & 0xFF));
+    }
+    return (int)(p - start);
+}
+
+static int put_client_hello(u_char *p, const char *sni) {
+    int name_len = (int)strlen(sni);
+    int ext_len = 9 + name_len;                  // server_name extension
+    int body = 2 + 32 + 1 + 2 + 4 + 2 + 2 + ext_len;
+    u_char *start = p;
+    *p++ = 0x16; p = put16(p, 0x0301); p = put16(p, (uint16_t)(4 + body));
+    *p++ = 0x01; *p++ = 0; p = put16(p, (uint16_t)body);
+    p = put16(p, 0x0303);
+    for (int i = 0; i < 32; i++) *p++ = (u_char)rnd();
+    *p++ = 0;                                    // Session ID
+    p = put16(p, 4); p = put16(p, 0x1301); p = put16(p, 0x1302);
+    *p++ = 1; *p++ = 0;                          // Compression
+    p = put16(p, (uint16_t)ext_len);
+    p = put16(p, 0x0000); p = put16(p, (uint16_t)(5 + name_len));
+    p = put16(p, (uint16_t)(3 + name_len)); *p++ = 0; p = put16(p, (uint16_t)name_len);
+    memcpy(p, sni, (size_t)name_len);
+    p += name_len;
+    return (int)(p - start);
+}
+
+static int put_server_hello(u_char *p) {
+    int body = 2 + 32 + 1 + 2 + 1 + 2;
+    u_char *start = p;
+    *p++ = 0x16; p = put16(p, 0x0303); p = put16(p, (uint16_t)(4 + body));
+    *p++ = 0x02; *p++ = 0; p = put16(p, (uint16_t)body);
+    p = put16(p, 0x0303);
+    for (int i = 0; i < 32; i++) *p++ = (u_char)rnd();
+    *p++ = 0;
+    p = put16(p, 0x1301);
+    *p++ = 0;
+    p = put16(p, 0);
+    return (int)(p - start);
+}
+
+static int put_app_data(u_char *p, int len) {
+    *p = 0x17;
+    put16(p + 1, 0x0303);
+    put16(p + 3, (uint16_t)(len - 5));
+    for (int i = 5; i < len; i++) p[i] = (u_char)rnd();
+    return len;
+}
+
+static int mix_init(Mix *m, uint32_t packets) {
+    m->cap = packets;
+    m->count = 0;
+    m->slab_cap = (size_t)packets * 256 + FRAME_MAX;
+    m->slab_used = 0;
+    m->frames = (Frame *)calloc(packets, sizeof(Frame));
+    m->slab = (u_char *)malloc(m->slab_cap);
+    return m->frames && m->slab ? 0 : -1;
+}
+
+static int mix_full(const Mix *m) {
+    return m->count == m->cap;
+}
+
+// Room for the next frame (FRAME_MAX bytes); commit with mix_add
+static u_char *mix_next(Mix *m) {
+    if (m->slab_used + FRAME_MAX > m->slab_cap) {
+        u_char *slab = (u_char *)realloc(m->slab, m->slab_cap * 2);
+        if (!slab) {
+            fprintf(stderr, "[!] Out of memory for mix %s\n", m->name);
+            exit(1);
+        }
+        m->slab = slab;
+        m->slab_cap *= 2;
+    }
+    return m->slab + m->slab_used;
+}
+
+// Generators may overshoot inside a connection; extra frames are dropped
+static void mix_add(Mix *m, int len, uint16_t l3_type, int dns_off, int dns_len) {
+    if (mix_full(m)) return;
+    Frame *f = &m->frames[m->count];
+    f->off = (uint32_t)m->slab_used;
+    f->len = (uint16_t)len;
+    f->l3_type = l3_type;
+    f->dns_off = (uint16_t)dns_off;
+    f->dns_len = (uint16_t)dns_len;
+    f->ts_us = 1700000000000000ull + (uint64_t)m->count * 10;   // 100 kpps of packet time
+    m->slab_used += ((size_t)len + 7) & ~(size_t)7;
+    m->count++;
+}
+
+static void add_dns_v4(Mix *m, uint32_t client, uint16_t cport, uint16_t id, const char *qname, int response) {
+    u_char *f = mix_next(m);
+    u_char dns[512];
+    int dlen = put_dns(dns, id, qname, response);
+    uint32_t server = 0x0A000035u;
+    u_char *p = put_eth(f, 0x0800);
+    p = put_ipv4(p, 17, response ? server : client, response ? client : server, 8 + dlen, id, 0);
+    p = put_udp(p, response ? 53 : cport, response ? cport : 53, dlen);
+    memcpy(p, dns, (size_t)dlen);
+    mix_add(m, (int)(p - f) + dlen, 0x0800, (int)(p - f), dlen);
+}
+
+static void add_tcp_v4(Mix *m, uint32_t src, uint32_t dst, uint16_t sport, uint16_t dport,
+                       uint32_t seq, uint32_t ack, uint8_t flags, const u_char *payload, int plen) {
+    u_char *f = mix_next(m);
+    u_char *p = put_eth(f, 0x0800);
+    p = put_ipv4(p, 6, src, dst, 20 + plen, (uint16_t)rnd(), 0x4000);
+    p = put_tcp(p, sport, dport, seq, ack, flags);
+    if (plen) memcpy(p, payload, (size_t)plen);
+    mix_add(m, (int)(p - f) + plen, 0x0800, 0, 0);
+}
+
+// 90% DNS query/response pairs over a few hundred names, 10% TCP ACKs
+static void gen_dns(Mix *m) {
+    char qname[64];
+    uint16_t id = 1;
+    while (!mix_full(m)) {
+        if (rnd() % 10 == 0) {
+            add_tcp_v4(m, 0x0A000001u + rnd() % 256, 0x0A000100u, (uint16_t)(1024 + rnd() % 60000), 22,
+                       rnd(), rnd(), 0x10, NULL, 0);
+            continue;
+        }
+        snprintf(qname, sizeof(qname), "host%u.svc%u.example.com", rnd() % 300, rnd() % 8);
+        uint32_t client = 0x0A000001u + rnd() % 512;
+        uint16_t cport = (uint16_t)(1024 + rnd() % 60000);
+        add_dns_v4(m, client, cport, id, qname, 0);
+        add_dns_v4(m, client, cport, id, qname, 1);
+        id++;
+    }
+}
+
+// TLS connections: handshake, ClientHello/ServerHello, then encrypted records
+static void gen_https(Mix *m) {
+    u_char payload[FRAME_MAX];
+    char sni[64];
+    uint32_t conn = 0;
+    while (!mix_full(m)) {
+        uint32_t client = 0x0A010000u + conn % 4096, server = 0x5DB8D800u + conn % 64;
+        uint16_t cport = (uint16_t)(20000 + conn % 40000);
+        uint32_t cseq = rnd(), sseq = rnd();
+        conn++;
+        add_tcp_v4(m, client, server, cport, 443, cseq++, 0, 0x02, NULL, 0);
+        add_tcp_v4(m, server, client, 443, cport, sseq++, cseq, 0x12, NULL, 0);
+        add_tcp_v4(m, client, server, cport, 443, cseq, sseq, 0x10, NULL, 0);
+        snprintf(sni, sizeof(sni), "api%u.example.net", conn % 200);
+        int n = put_client_hello(payload, sni);
+        add_tcp_v4(m, client, server, cport, 443, cseq, sseq, 0x18, payload, n);
+        cseq += (uint32_t)n;
+        n = put_server_hello(payload);
+        add_tcp_v4(m, server, client, 443, cport, sseq, cseq, 0x18, payload, n);
+        sseq += (uint32_t)n;
+        int records = 4 + (int)(rnd() % 12);
+        for (int r = 0; r < records && !mix_full(m); r++) {
+            n = put_app_data(payload, r & 1 ? 200 + (int)(rnd() % 300) : 1400);
+            if (r & 1) {
+                add_tcp_v4(m, client, server, cport, 443, cseq, sseq, 0x18, payload, n);
+                cseq += (uint32_t)n;
+            } else {
+                add_tcp_v4(m, server, client, 443, cport, sseq, cseq, 0x18, payload, n);
+                sseq += (uint32_t)n;
+            }
+        }
+        add_tcp_v4(m, client, server, cport, 443, cseq, sseq, 0x11, NULL, 0);
+    }
+}
+
+// IPv6 with hop-by-hop, routing and destination options before UDP/DNS or TCP
+static void gen_ipv6_ext(Mix *m) {
+    char qname[64];
+    while (!mix_full(m)) {
+        u_char *f = mix_next(m);
+        int tcp = rnd() & 1;
+        u_char l4[512];
+        int l4_len, dns_len = 0;
+        if (tcp) {
+            l4_len = (int)(put_tcp(l4, (uint16_t)(1024 + rnd() % 60000), 443, rnd(), rnd(), 0x10) - l4);
+        } else {
+            snprintf(qname, sizeof(qname), "v6host%u.example.org", rnd() % 200);
+            dns_len = put_dns(l4 + 8, (uint16_t)rnd(), qname, (int)(rnd() & 1));
+            put_udp(l4, (uint16_t)(1024 + rnd() % 60000), 53, dns_len);
+            l4_len = 8 + dns_len;
+        }
+        int ext_len = 8 + 24 + 8;
+        u_char *p = put_eth(f, 0x86DD);
+        p = put_ipv6(p, 0, (uint16_t)rnd(), (uint16_t)rnd(), ext_len + l4_len);
+        // Hop-by-hop: PadN
+        p[0] = 43; p[1] = 0; p[2] = 1; p[3] = 4; memset(p + 4, 0, 4); p += 8;
+        // Routing (type 0 layout, one address, segments left 0)
+        p[0] = 60; p[1] = 2; p[2] = 0; p[3] = 0; memset(p + 4, 0, 20); p += 24;
+        // Destination options: PadN
+        p[0] = (u_char)(tcp ? 6 : 17); p[1] = 0; p[2] = 1; p[3] = 4; memset(p + 4, 0, 4); p += 8;
+        memcpy(p, l4, (size_t)l4_len);
+        int dns_off = tcp ? 0 : (int)(p - f) + 8;
+        mix_add(m, (int)(p - f) + l4_len, 0x86DD, dns_off, dns_len);
+    }
+}
+
+// IPv4 UDP datagrams of 2-4 fragments (some in reverse order), some IPv6 fragments
+static void gen_fragmented(Mix *m) {
+    u_char datagram[4096];
+    uint16_t id = 1;
+    while (!mix_full(m)) {
+        int size = 1600 + (int)(rnd() % 2400);
+        put_udp(datagram, (uint16_t)(1024 + rnd() % 60000), 5353, size - 8);
+        for (int i = 8; i < size; i++) datagram[i] = (u_char)rnd();
+        int v6 = rnd() % 5 == 0;
+        int chunk = 1280;
+        int nfrags = (size + chunk - 1) / chunk;
+        int reverse = rnd() % 4 == 0;
+        uint32_t src = 0x0A020000u + rnd() % 1024;
+        uint32_t ident = rnd();
+        for (int k = 0; k < nfrags && !mix_full(m); k++) {
+            int i = reverse ? nfrags - 1 - k : k;
+            int off = i * chunk;
+            int len = size - off < chunk ? size - off : chunk;
+            int more = i < nfrags - 1;
+            u_char *f = mix_next(m);
+            u_char *p;
+            if (v6) {
+                p = put_eth(f, 0x86DD);
+                p = put_ipv6(p, 44, (uint16_t)src, 1, 8 + len);
+                p[0] = 17; p[1] = 0; put16(p + 2, (uint16_t)(off | more)); put32(p + 4, ident);
+                p += 8;
+            } else {
+                p = put_eth(f, 0x0800);
+                p = put_ipv4(p, 17, src, 0x0A0000FEu, len, id, (uint16_t)((more ? 0x2000 : 0) | (off / 8)));
+            }
+            memcpy(p, datagram + off, (size_t)len);
+            mix_add(m, (int)(p - f) + len, v6 ? 0x86DD : 0x0800, 0, 0);
+        }
+        id++;
+    }
+}
+
+// Broken headers and lengths at every layer, plus hostile DNS and TLS bytes
+static void gen_malformed(Mix *m) {
+    u_char buf[FRAME_MAX];
+    while (!mix_full(m)) {
+        u_char *f = mix_next(m);
+        u_char *p = put_eth(f, 0x0800);
+        int len, kind = (int)(rnd() % 9), l3 = 0x0800, dns_off = 0, dns_len = 0;
+        switch (kind) {
+        case 0:                                  // Runt frame
+            len = (int)(rnd() % 14);
+            break;
+        case 1:                                  // IHL below 5
+            put_ipv4(p, 6, rnd(), rnd(), 40, 1, 0);
+            p[0] = 0x43;
+            len = 14 + 60;
+            break;
+        case 2:                                  // Total length beyond the frame
+            put_ipv4(p, 17, rnd(), rnd(), 1400, 1, 0);
+            put_udp(p + 20, 1000, 53, 1392);
+            len = 14 + 40;
+            break;
+        case 3:                                  // TCP data offset below 5
+            put_tcp(put_ipv4(p, 6, rnd(), rnd(), 20, 1, 0), 1000, 80, 1, 1, 0x18);
+            p[20 + 12] = 0x30;
+            len = 14 + 40;
+            break;
+        case 4:                                  // UDP length larger than the datagram
+            put_udp(put_ipv4(p, 17, rnd(), rnd(), 8 + 12, 1, 0), 1000, 53, 600);
+            len = 14 + 40;
+            break;
+        case 5: {                                // DNS compression pointer loop, bogus counts
+            int n = 12 + 4;
+            memset(buf, 0, sizeof(buf));
+            put16(buf, (uint16_t)rnd()); put16(buf + 2, 0x8180); put16(buf + 4, 40); put16(buf + 6, 200);
+            put16(buf + 12, 0xC00C);
+            u_char *q = put_udp(put_ipv4(p, 17, rnd(), rnd(), 8 + n, 1, 0), 53, 1000, n);
+            memcpy(q, buf, (size_t)n);
+            dns_off = (int)(q - f);
+            dns_len = n;
+            len = dns_off + n;
+            break;
+        }
+        case 6: {                                // TLS handshake claiming 16 MB
+            u_char *q = put_tcp(put_ipv4(p, 6, rnd(), rnd(), 20 + 64, 1, 0), 40000, 443, rnd(), 0, 0x18);
+            q[0] = 0x16; put16(q + 1, 0x0301); put16(q + 3, 0xFFFF); q[5] = 1; q[6] = 0xFF; q[7] = 0xFF; q[8] = 0xFF;
+            for (int i = 9; i < 64; i++) q[i] = (u_char)rnd();
+            len = (int)(q - f) + 64;
+            break;
+        }
+        case 7: {                                // IPv6 extension chain cut short
+            p = put_eth(f, 0x86DD);
+            u_char *q = put_ipv6(p, 0, 1, 2, 200);
+            q[0] = 60; q[1] = 30;                // Claims 248 bytes
+            len = (int)(q - f) + 16;
+            l3 = 0x86DD;
+            break;
+        }
+        default:                                 // Random bytes after an IPv4 ethertype
+            len = 14 + 20 + (int)(rnd() % 200);
+            for (int i = 14; i < len; i++) f[i] = (u_char)rnd();
+            f[14] = (u_char)(0x40 | (f[14] & 0x0F));
+            break;
+        }
+        mix_add(m, len, len >= 14 ? (uint16_t)l3 : 0, dns_off, dns_len);
+    }
+}
+
+typedef struct {
+    const char *name;
+    const char *desc;
+    void (*gen)(Mix *m);
+} MixDef;
+
+static const MixDef mix_defs[] = {
+    { "dns",        "DNS queries and responses (90%), TCP ACKs",              gen_dns },
+    { "https",      "TLS connections: handshake, hellos, encrypted records",  gen_https },
+    { "ipv6-ext",   "IPv6 with hop-by-hop, routing and destination options",  gen_ipv6_ext },
+    { "fragmented", "IPv4 and IPv6 UDP datagrams in 2-4 fragments",           gen_fragmented },
+    { "malformed",  "Broken lengths and headers at every layer",              gen_malformed },
+};
+#define MIX_COUNT ((int)(sizeof(mix_defs) / sizeof(mix_defs[0])))
+
+// ---------------------------
+// Targets
+// ---------------------------
+typedef enum { TARGET_ANALYZE = 0, TARGET_ETHERNET, TARGET_IP, TARGET_DNS, TARGET_STATS, TARGET_COUNT } target_t;
+
+static const char *const target_names[TARGET_COUNT] = { "analyze_packet", "parse_ethernet", "parse_ip", "parse_dns", "stats_increment" };
+
+static AnalyzerConfig bench_cfg;
+
+// What analyze_packet sets up before parse_ethernet
+static void ctx_init(packet_ctx_t *pkt, analyzer_t *an, const Frame *f) {
+    memset(pkt, 0, sizeof(*pkt));
+    pkt->an = an;
+    pkt->ts_us = f->ts_us;
+    pkt->wire_len = pkt->cap_len = f->len;
+    pkt->flow_dir = FLOW_DIR_FORWARD;
+}
+
+// Packets the target would touch in this mix
+static uint32_t eligible(target_t t, const Mix *m) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < m->count; i++) {
+        const Frame *f = &m->frames[i];
+        if (t == TARGET_IP ? f->l3_type != 0 : t == TARGET_DNS ? f->dns_off != 0 : 1) n++;
+    }
+    return n;
+}
+
+// One timed pass over the mix; returns the packets processed
+static uint32_t run_pass(target_t t, const Mix *m, analyzer_t *an) {
+    packet_ctx_t pkt;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < m->count; i++) {
+        const Frame *f = &m->frames[i];
+        const u_char *data = m->slab + f->off;
+        switch (t) {
+        case TARGET_ANALYZE: {
+            struct pcap_pkthdr h;
+            h.ts.tv_sec = (long)(f->ts_us / 1000000u);
+            h.ts.tv_usec = (long)(f->ts_us % 1000000u);
+            h.caplen = h.len = f->len;
+            analyze_packet(an, &h, data);
+            break;
+        }
+        case TARGET_ETHERNET:
+            ctx_init(&pkt, an, f);
+            parse_ethernet(&pkt, data, f->len);
+            break;
+        case TARGET_IP:
+            if (!f->l3_type) continue;
+            ctx_init(&pkt, an, f);
+            if (f->l3_type == 0x0800) parse_ipv4(&pkt, data + 14, f->len - 14);
+            else parse_ipv6(&pkt, data + 14, f->len - 14);
+            break;
+        case TARGET_DNS:
+            if (!f->dns_off) continue;
+            ctx_init(&pkt, an, f);
+            pkt.sport = (uint16_t)((data[f->dns_off - 8] << 8) | data[f->dns_off - 7]);
+            pkt.dport = (uint16_t)((data[f->dns_off - 6] << 8) | data[f->dns_off - 5]);
+            parse_dns(&pkt, data + f->dns_off, f->dns_len);
+            break;
+        default:
+            for (int k = 0; k < STATS_OPS_PER_PACKET; k++) stats_increment((proto_id_t)((i + k) % PROTO_COUNT));
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+typedef struct {
+    target_t target;
+    const char *mix;
+    uint32_t packets;
+    double ns;                   // Per packet
+    double tsc;
+    int64_t ctr[CTR_COUNT];      // Totals for the pass, -1 = unavailable
+    uint64_t allocs;
+} Result;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int bench_one(target_t t, const Mix *m, int reps, Result *out) {
+    Result runs[MAX_REPS];
+    double order[MAX_REPS];
+    for (int r = -1; r < reps; r++) {            // r = -1 warms caches and lazy allocations
+        analyzer_t *an = analyzer_create(0, &bench_cfg);
+        if (!an) {
+            fprintf(stderr, "[!] Failed to create analyzer\n");
+            return -1;
+        }
+        Result *res = &runs[r < 0 ? 0 : r];
+        uint64_t allocs0 = alloc_calls;
+        counters_start();
+        uint64_t tsc0 = read_tsc();
+        uint64_t t0 = platform_now_ns();
+        uint32_t n = run_pass(t, m, an);
+        uint64_t t1 = platform_now_ns();
+        uint64_t tsc1 = read_tsc();
+        counters_stop(res->ctr);
+        res->allocs = alloc_calls - allocs0;
+        analyzer_destroy(an);
+
+        res->target = t;
+        res->mix = m->name;
+        res->packets = n;
+        res->ns = n ? (double)(t1 - t0) / n : 0.0;
+        res->tsc = n ? (double)(tsc1 - tsc0) / n : 0.0;
+        if (r >= 0) order[r] = res->ns;
+    }
+    // Median by time, with that repetition's counters
+    double sorted[MAX_REPS];
+    memcpy(sorted, order, sizeof(double) * (size_t)reps);
+    qsort(sorted, (size_t)reps, sizeof(double), cmp_double);
+    for (int r = 0; r < reps; r++) {
+        if (order[r] == sorted[reps / 2]) {
+            *out = runs[r];
+            break;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------
+// Output
+// ---------------------------
+static double per_packet(int64_t total, uint32_t packets) {
+    return total >= 0 && packets ? (double)total / packets : -1.0;
+}
+
+static void csv_field(FILE *fp, double v, const char *fmt) {
+    fputc(',', fp);
+    if (v >= 0) fprintf(fp, fmt, v);
+}
+
+static void write_csv(FILE *fp, const char *label, const Result *res, int n) {
+    fprintf(fp, "label,target,mix,packets,ns_per_pkt,cycles_per_pkt,cycle_source,instructions_per_pkt,"
+                "cache_misses_per_pkt,branch_misses_per_pkt,allocs_per_pkt\n");
+    for (int i = 0; i < n; i++) {
+        const Result *r = &res[i];
+        double cycles = per_packet(r->ctr[CTR_CYCLES], r->packets);
+        const char *source = cycles >= 0 ? "perf" : "tsc";
+        if (cycles < 0) cycles = r->tsc > 0 ? r->tsc : -1.0;
+        fprintf(fp, "%s,%s,%s,%u,%.2f", label, target_names[r->target], r->mix, r->packets, r->ns);
+        csv_field(fp, cycles, "%.1f");
+        fprintf(fp, ",%s", cycles >= 0 ? source : "");
+        csv_field(fp, per_packet(r->ctr[CTR_INSTRUCTIONS], r->packets), "%.1f");
+        csv_field(fp, per_packet(r->ctr[CTR_CACHE_MISSES], r->packets), "%.3f");
+        csv_field(fp, per_packet(r->ctr[CTR_BRANCH_MISSES], r->packets), "%.3f");
+        csv_field(fp, ALLOCS_COUNTED ? (double)r->allocs / (r->packets ? r->packets : 1) : -1.0, "%.4f");
+        fputc('\n', fp);
+    }
+}
+
+// ns/pkt of target/mix in a CSV written by an earlier run, or -1
+static double baseline_ns(const char *path, const char *target, const char *mix) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1.0;
+    char line[512], t[64], m[64];
+    double ns = -1.0, v;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%*[^,],%63[^,],%63[^,],%*u,%lf", t, m, &v) == 3 &&
+            strcmp(t, target) == 0 && strcmp(m, mix) == 0) {
+            ns = v;
+            break;
+        }
+    }
+    fclose(fp);
+    return ns;
+}
+
+static void print_results(const Result *res, int n, const char *baseline) {
+    printf("\n%-16s %-11s %9s %10s %10s %9s %9s %9s%s\n", "Target", "Mix", "Packets", "ns/pkt", "cyc/pkt",
+           "ins/pkt", "LLC/pkt", "alloc/pkt", baseline ? "   vs base" : "");
+    for (int i = 0; i < n; i++) {
+        const Result *r = &res[i];
+        double cycles = per_packet(r->ctr[CTR_CYCLES], r->packets);
+        if (cycles < 0) cycles = r->tsc;
+        double ins = per_packet(r->ctr[CTR_INSTRUCTIONS], r->packets);
+        double llc = per_packet(r->ctr[CTR_CACHE_MISSES], r->packets);
+        printf("%-16s %-11s %9u %10.1f ", target_names[r->target], r->mix, r->packets, r->ns);
+        if (cycles > 0) printf("%10.0f ", cycles); else printf("%10s ", "-");
+        if (ins >= 0) printf("%9.0f ", ins); else printf("%9s ", "-");
+        if (llc >= 0) printf("%9.3f ", llc); else printf("%9s ", "-");
+        if (ALLOCS_COUNTED) printf("%9.4f", (double)r->allocs / (r->packets ? r->packets : 1));
+        else printf("%9s", "-");
+        if (baseline) {
+            double base = baseline_ns(baseline, target_names[r->target], r->mix);
+            if (base > 0) printf("   %+7.1f%%", (r->ns - base) / base * 100.0);
+            else printf("   %8s", "new");
+        }
+        printf("\n");
+    }
+}
+
+// ---------------------------
+// Main
+// ---------------------------
+// Comma-separated names -> bitmask over names[0..count); -1 on an unknown name
+static int parse_list(const char *list, const char *const *names, int count) {
+    int mask = 0;
+    const char *p = list;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        int found = -1;
+        for (int i = 0; i < count; i++) {
+            if (strlen(names[i]) == len && strncmp(names[i], p, len) == 0) found = i;
+        }
+        if (found < 0) {
+            fprintf(stderr, "[!] Unknown name \"%.*s\"\n", (int)len, p);
+            return -1;
+        }
+        mask |= 1 << found;
+        p += len;
+        if (*p) p++;
+    }
+    return mask;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-n packets] [-r reps] [-m mix,...] [-t target,...] [-l label] [-o out.csv] [-b base.csv]\n", prog);
+    printf("Mixes:\n");
+    for (int i = 0; i < MIX_COUNT; i++) printf("  %-11s %s\n", mix_defs[i].name, mix_defs[i].desc);
+    printf("Targets: analyze_packet, parse_ethernet, parse_ip, parse_dns (mixes with DNS), stats_increment\n");
+}
+
+int main(int argc, char **argv) {
+    uint32_t packets = DEFAULT_PACKETS;
+    int reps = DEFAULT_REPS;
+    int mix_mask = (1 << MIX_COUNT) - 1, target_mask = (1 << TARGET_COUNT) - 1;
+    const char *label = "current", *out_path = NULL, *baseline = NULL;
+    const char *mix_names[MIX_COUNT];
+    for (int i = 0; i < MIX_COUNT; i++) mix_names[i] = mix_defs[i].name;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "-h") == 0 || i + 1 >= argc) {
+            usage(argv[0]);
+            return strcmp(arg, "-h") == 0 ? 0 : 1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(arg, "-n") == 0) packets = (uint32_t)strtoul(val, NULL, 10);
+        else if (strcmp(arg, "-r") == 0) reps = atoi(val);
+        else if (strcmp(arg, "-m") == 0) mix_mask = parse_list(val, mix_names, MIX_COUNT);
+        else if (strcmp(arg, "-t") == 0) target_mask = parse_list(val, target_names, TARGET_COUNT);
+        else if (strcmp(arg, "-l") == 0) label = val;
+        else if (strcmp(arg, "-o") == 0) out_path = val;
+        else if (strcmp(arg, "-b") == 0) baseline = val;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (mix_mask < 0 || target_mask < 0 || packets < 1000 || reps < 1 || reps > MAX_REPS) {
+        fprintf(stderr, "[!] Need at least 1000 packets and 1-%d repetitions\n", MAX_REPS);
+        return 1;
+    }
+
+    // Parsers as the sniffer runs them: no per-packet logging, default dissectors
+    current_log_level = LOG_ERROR;
+    if (dissect_init(NULL, NULL) != 0) return 1;
+    bench_cfg.flows.max_flows = BENCH_FLOWS;
+    bench_cfg.flows.idle_timeout_s = FLOW_DEFAULT_IDLE_TIMEOUT;
+    bench_cfg.flows.active_timeout_s = FLOW_DEFAULT_ACTIVE_TIMEOUT;
+    bench_cfg.tcp_sessions = ANALYZER_DEFAULT_TCP_SESSIONS;
+    bench_cfg.reasm_buffers = ANALYZER_DEFAULT_REASM_BUFFERS;
+    bench_cfg.tls_buffers = ANALYZER_DEFAULT_TLS_BUFFERS;
+    bench_cfg.frags.max_datagrams = IPFRAG_DEFAULT_MAX_DATAGRAMS;
+    bench_cfg.frags.max_buffers = IPFRAG_DEFAULT_MEMORY_KB / 2;
+    bench_cfg.frags.timeout_s = IPFRAG_DEFAULT_TIMEOUT;
+    bench_cfg.frags.ipv4_overlap = IPFRAG_OVERLAP_FIRST;
+    bench_cfg.dns.max_queries = DNSTRACK_DEFAULT_MAX_QUERIES;
+    bench_cfg.dns.timeout_s = DNSTRACK_DEFAULT_TIMEOUT;
+    stats_register_thread();
+
+    counters_open();
+    int have_perf = 0;
+    for (int c = 0; c < CTR_COUNT; c++) have_perf |= ctr_fd[c] >= 0;
+    printf("[+] %u packets per mix, %d repetitions (median reported)\n", packets, reps);
+    printf("[+] Hardware counters: ");
+    if (!have_perf) printf("unavailable (cycles from the TSC where present)");
+    for (int c = 0, first = 1; c < CTR_COUNT; c++) {
+        if (ctr_fd[c] < 0) continue;
+        printf("%s%s", first ? "" : ", ", ctr_names[c]);
+        first = 0;
+    }
+    printf("\n[+] Allocations: %s\n", ALLOCS_COUNTED ? "counted" : "not counted (build with -DBENCH_COUNT_ALLOCS)");
+
+    Result results[MIX_COUNT * TARGET_COUNT];
+    int nres = 0;
+    for (int i = 0; i < MIX_COUNT; i++) {
+        if (!(mix_mask & (1 << i))) continue;
+        Mix m;
+        memset(&m, 0, sizeof(m));
+        m.name = mix_defs[i].name;
+        m.desc = mix_defs[i].desc;
+        if (mix_init(&m, packets) != 0) {
+            fprintf(stderr, "[!] Out of memory for mix %s\n", m.name);
+            return 1;
+        }
+        rng_state = 0x9E3779B97F4A7C15ull + (uint64_t)i;
+        mix_defs[i].gen(&m);
+        for (int t = 0; t < TARGET_COUNT; t++) {
+            if (!(target_mask & (1 << t))) continue;
+            if (t == TARGET_STATS && i != 0 && (mix_mask & 1)) continue;   // Same for every mix
+            if (eligible((target_t)t, &m) == 0) continue;
+            if (bench_one((target_t)t, &m, reps, &results[nres]) == 0) nres++;
+            if (t == TARGET_STATS) results[nres - 1].mix = "-";
+        }
+        free(m.frames);
+        free(m.slab);
+    }
+
+    print_results(results, nres, baseline);
+    if (out_path) {
+        FILE *fp = fopen(out_path, "w");
+        if (!fp) {
+            fprintf(stderr, "[!] Cannot write %s\n", out_path);
+            return 1;
+        }
+        write_csv(fp, label, results, nres);
+        fclose(fp);
+        printf("[+] Results written to %s\n", out_path);
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+-- Database Migration: Add Distinct Counts Table
+-- Description: Adds distinct_stats, one row per flush with the number of
+-- distinct source IPs, destination IPs, destination ports (protocol and
+-- port) and TCP/UDP flows seen in the interval. The values are HyperLogLog
+-- estimates (about 1.6% standard error); a jump in dst_ports is the
+-- cheapest sign of a port scan
+
+CREATE TABLE IF NOT EXISTS distinct_stats (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    interval_ms INT NOT NULL DEFAULT 0,
+    src_ips BIGINT NOT NULL DEFAULT 0,
+    dst_ips BIGINT NOT NULL DEFAULT 0,
+    dst_ports BIGINT NOT NULL DEFAULT 0,
+    flows BIGINT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_distinct_stats_timestamp
+    ON distinct_stats(timestamp);
+
+-- Verify the change
+SELECT table_name, column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name = 'distinct_stats'
+ORDER BY ordinal_position;
@@ -0,0 +1,31 @@
+-- Database Migration: Add DNS Metrics Tables
+-- Description: Adds dns_qname_stats (most queried names) and
+-- dns_qname_latency_stats (names with the most total time waiting for an
+-- answer), written on every flush with the totals since the sniffer started
+
+CREATE TABLE IF NOT EXISTS dns_qname_stats (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    qname TEXT NOT NULL,
+    queries BIGINT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_dns_qname_stats_timestamp
+    ON dns_qname_stats(timestamp);
+
+CREATE TABLE IF NOT EXISTS dns_qname_latency_stats (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    qname TEXT NOT NULL,
+    responses BIGINT NOT NULL DEFAULT 0,
+    latency_us BIGINT NOT NULL DEFAULT 0   -- Sum over the responses; divide by responses for the mean
+);
+
+CREATE INDEX IF NOT EXISTS idx_dns_qname_latency_stats_timestamp
+    ON dns_qname_latency_stats(timestamp);
+
+-- Verify the change
+SELECT table_name, column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name IN ('dns_qname_stats', 'dns_qname_latency_stats')
+ORDER BY table_name, ordinal_position;
@@ -0,0 +1,26 @@
+-- Database Migration: Add Heavy Hitters Table
+-- Description: Adds heavy_hitters, the top talkers of each flush interval
+-- per dimension (src_ip, dst_ip, dst_port, ip_pair) from the streaming
+-- sketches. packets is an upper bound on the key's packets in the interval
+-- and max_error how far below it the true count may be; dimension_packets
+-- is every packet the dimension saw in that interval
+
+CREATE TABLE IF NOT EXISTS heavy_hitters (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    dimension TEXT NOT NULL,
+    key TEXT NOT NULL,
+    packets BIGINT NOT NULL DEFAULT 0,
+    max_error BIGINT NOT NULL DEFAULT 0,
+    dimension_packets BIGINT NOT NULL DEFAULT 0,
+    interval_ms INT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_heavy_hitters_timestamp
+    ON heavy_hitters(timestamp);
+
+-- Verify the change
+SELECT table_name, column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name = 'heavy_hitters'
+ORDER BY ordinal_position;
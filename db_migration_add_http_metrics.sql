@@ -0,0 +1,30 @@
+-- Database Migration: Add HTTP Metrics Tables
+-- Description: Adds http_status_stats (responses per status code) and
+-- http_host_stats (busiest Host headers), written on every flush with the
+-- totals since the sniffer started
+
+CREATE TABLE IF NOT EXISTS http_status_stats (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    status INTEGER NOT NULL,
+    responses BIGINT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_http_status_stats_timestamp
+    ON http_status_stats(timestamp);
+
+CREATE TABLE IF NOT EXISTS http_host_stats (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    host TEXT NOT NULL,
+    requests BIGINT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_http_host_stats_timestamp
+    ON http_host_stats(timestamp);
+
+-- Verify the change
+SELECT table_name, column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name IN ('http_status_stats', 'http_host_stats')
+ORDER BY table_name, ordinal_position;
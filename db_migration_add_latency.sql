@@ -0,0 +1,25 @@
+-- Database Migration: Add Capture Latency Table
+-- Description: Adds latency_stats, one row per stage per flush with the
+-- percentiles (microseconds) of how long live packets took from their
+-- capture timestamp to being dequeued by a worker and to being analyzed,
+-- over the packets seen since the previous flush
+
+CREATE TABLE IF NOT EXISTS latency_stats (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    stage TEXT NOT NULL,
+    samples BIGINT NOT NULL DEFAULT 0,
+    p50_us BIGINT NOT NULL DEFAULT 0,
+    p99_us BIGINT NOT NULL DEFAULT 0,
+    p999_us BIGINT NOT NULL DEFAULT 0,
+    max_us BIGINT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_latency_stats_timestamp
+    ON latency_stats(timestamp);
+
+-- Verify the change
+SELECT table_name, column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name = 'latency_stats'
+ORDER BY ordinal_position;
@@ -0,0 +1,28 @@
+-- Database Migration: Add Overload Transitions Table
+-- Description: Adds overload_transitions, one row each time a live
+-- capture worker changes load-shedding mode (full, counters, sampled),
+-- with how long the previous mode lasted and the queue fill that caused
+-- the change. While a worker is in sampled mode its packets count
+-- sample_rate times, so protocol_stats and the per-second deltas over that
+-- span are estimates, and application-level tables (HTTP, TLS, DNS) miss
+-- the traffic of both non-full modes
+
+CREATE TABLE IF NOT EXISTS overload_transitions (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    worker INT NOT NULL DEFAULT 0,
+    from_mode VARCHAR(16) NOT NULL,
+    to_mode VARCHAR(16) NOT NULL,
+    previous_ms BIGINT NOT NULL DEFAULT 0,
+    queue_fill_pct INT NOT NULL DEFAULT 0,
+    sample_rate INT NOT NULL DEFAULT 1
+);
+
+CREATE INDEX IF NOT EXISTS idx_overload_transitions_timestamp
+    ON overload_transitions(timestamp);
+
+-- Verify the change
+SELECT table_name, column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name = 'overload_transitions'
+ORDER BY ordinal_position;
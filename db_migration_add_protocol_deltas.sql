@@ -0,0 +1,23 @@
+-- Database Migration: Add Per-Second Protocol Deltas
+-- Description: Adds protocol_stats_delta, one row per protocol per
+-- 1-second bucket holding the packets counted in that bucket (not totals),
+-- so rates need no differencing. Rows arrive in batches via binary COPY.
+
+CREATE TABLE IF NOT EXISTS protocol_stats_delta (
+    bucket_start TIMESTAMPTZ NOT NULL,
+    interval_ms INTEGER NOT NULL,          -- Bucket width; the first and last of a run are partial
+    protocol TEXT NOT NULL,
+    packets BIGINT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_protocol_stats_delta_bucket
+    ON protocol_stats_delta(bucket_start);
+
+CREATE INDEX IF NOT EXISTS idx_protocol_stats_delta_protocol_bucket
+    ON protocol_stats_delta(protocol, bucket_start);
+
+-- Verify the change
+SELECT column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name = 'protocol_stats_delta'
+ORDER BY ordinal_position;
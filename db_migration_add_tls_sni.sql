@@ -0,0 +1,19 @@
+-- Database Migration: Add TLS Server Name Table
+-- Description: Adds tls_sni_stats, written on every flush with the busiest
+-- TLS server names (SNI) since the sniffer started
+
+CREATE TABLE IF NOT EXISTS tls_sni_stats (
+    id SERIAL PRIMARY KEY,
+    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    sni TEXT NOT NULL,
+    connections BIGINT NOT NULL DEFAULT 0
+);
+
+CREATE INDEX IF NOT EXISTS idx_tls_sni_stats_timestamp
+    ON tls_sni_stats(timestamp);
+
+-- Verify the change
+SELECT column_name, data_type, is_nullable, column_default
+FROM information_schema.columns
+WHERE table_name = 'tls_sni_stats'
+ORDER BY ordinal_position;
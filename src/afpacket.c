@@ -0,0 +1,222 @@
+// afpacket.c - Linux AF_PACKET TPACKET_V3 mmap ring capture backend
+//
+// The kernel fills whole blocks of frames in a shared ring; user space
+// processes a block in place and then flips its status back to the kernel.
+// No per-packet syscall and no per-packet copy.
+#include "afpacket.h"
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+struct afp_ring {
+    int fd;
+    uint8_t *map;
+    size_t map_len;
+    unsigned block_size;
+    unsigned block_count;
+    uint64_t stat_packets;
+    uint64_t stat_drops;
+    uint64_t stat_freeze_q;
+};
+
+static inline struct tpacket_block_desc *block_desc(afp_ring_t *ring, unsigned idx) {
+    return (struct tpacket_block_desc *)(ring->map + (size_t)idx * ring->block_size);
+}
+
+afp_ring_t *afp_open(const char *ifname, unsigned block_size, unsigned block_count,
+                     unsigned fanout_group, const struct bpf_program *filter) {
+    afp_ring_t *ring = (afp_ring_t *)calloc(1, sizeof(afp_ring_t));
+    if (!ring) {
+        fprintf(stderr, "[!] AF_PACKET: out of memory\n");
+        return NULL;
+    }
+    ring->fd = -1;
+    ring->block_size = block_size ? block_size : AFP_DEFAULT_BLOCK_SIZE;
+    ring->block_count = block_count ? block_count : AFP_DEFAULT_BLOCK_COUNT;
+
+    // Protocol 0: the socket receives nothing until bind, so packets from
+    // other interfaces, or ones the filter would drop, never reach the ring
+    ring->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (ring->fd < 0) {
+        fprintf(stderr, "[!] AF_PACKET: socket() failed: %s (need CAP_NET_RAW)\n", strerror(errno));
+        goto fail;
+    }
+
+    if (filter) {
+        // libpcap's bpf_insn has the same layout as the kernel's sock_filter
+        struct sock_fprog fprog;
+        fprog.len = (unsigned short)filter->bf_len;
+        fprog.filter = (struct sock_filter *)filter->bf_insns;
+        if (setsockopt(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+            fprintf(stderr, "[!] AF_PACKET: SO_ATTACH_FILTER failed: %s\n", strerror(errno));
+            goto fail;
+        }
+    }
+
+    unsigned ifindex = if_nametoindex(ifname);
+    if (ifindex == 0) {
+        fprintf(stderr, "[!] AF_PACKET: unknown interface %s\n", ifname);
+        goto fail;
+    }
+
+    // Start receiving once filtered, on this interface only, before the ring exists
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = (int)ifindex;
+    if (bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        fprintf(stderr, "[!] AF_PACKET: bind to %s failed: %s\n", ifname, strerror(errno));
+        goto fail;
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        fprintf(stderr, "[!] AF_PACKET: TPACKET_V3 not supported: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = ring->block_size;
+    req.tp_block_nr = ring->block_count;
+    req.tp_frame_size = AFP_DEFAULT_FRAME_SIZE;
+    req.tp_frame_nr = (ring->block_size / AFP_DEFAULT_FRAME_SIZE) * ring->block_count;
+    req.tp_retire_blk_tov = AFP_DEFAULT_RETIRE_MS;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        fprintf(stderr, "[!] AF_PACKET: PACKET_RX_RING (%u x %u bytes) failed: %s\n",
+                ring->block_count, ring->block_size, strerror(errno));
+        goto fail;
+    }
+
+    ring->map_len = (size_t)ring->block_size * ring->block_count;
+    ring->map = (uint8_t *)mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_LOCKED, ring->fd, 0);
+    if (ring->map == MAP_FAILED) {
+        // MAP_LOCKED can fail under a low RLIMIT_MEMLOCK; retry unlocked
+        ring->map = (uint8_t *)mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, ring->fd, 0);
+    }
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        fprintf(stderr, "[!] AF_PACKET: mmap of ring failed: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    struct packet_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = (int)ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        fprintf(stderr, "[!] AF_PACKET: promiscuous mode failed on %s: %s\n", ifname, strerror(errno));
+        // Non-fatal: keep capturing traffic addressed to this host
+    }
+
+    if (fanout_group) {
+        // Kernel flow hash is symmetric; DEFRAG keeps IP fragments together
+        int fanout = (int)(fanout_group & 0xFFFF) |
+                     ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+            fprintf(stderr, "[!] AF_PACKET: PACKET_FANOUT group %u failed: %s\n",
+                    fanout_group, strerror(errno));
+            goto fail;
+        }
+    }
+
+    return ring;
+
+fail:
+    afp_close(ring);
+    return NULL;
+}
+
+void afp_close(afp_ring_t *ring) {
+    if (!ring) return;
+    if (ring->map) munmap(ring->map, ring->map_len);
+    if (ring->fd >= 0) close(ring->fd);
+    free(ring);
+}
+
+unsigned afp_block_count(const afp_ring_t *ring) {
+    return ring->block_count;
+}
+
+int afp_wait_block(afp_ring_t *ring, unsigned idx, int timeout_ms) {
+    struct tpacket_block_desc *bd = block_desc(ring, idx);
+    if (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) {
+        return 1;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = ring->fd;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (pfd.revents & POLLERR) {
+        return -1;
+    }
+    return (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) ? 1 : 0;
+}
+
+unsigned afp_walk_block(afp_ring_t *ring, unsigned idx, afp_frame_fn fn, void *user) {
+    struct tpacket_block_desc *bd = block_desc(ring, idx);
+    unsigned num_pkts = bd->hdr.bh1.num_pkts;
+    const uint8_t *block_end = (const uint8_t *)bd + ring->block_size;
+    const struct tpacket3_hdr *ppd =
+        (const struct tpacket3_hdr *)((const uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+
+    for (unsigned i = 0; i < num_pkts; i++) {
+        const u_char *frame = (const u_char *)ppd + ppd->tp_mac;
+        if (frame + ppd->tp_snaplen > block_end) break;  // Corrupt descriptor; stop walking
+
+        struct pcap_pkthdr hdr;
+        hdr.ts.tv_sec = ppd->tp_sec;
+        hdr.ts.tv_usec = ppd->tp_nsec / 1000;
+        hdr.caplen = ppd->tp_snaplen;
+        hdr.len = ppd->tp_len;
+        fn(user, &hdr, frame);
+
+        if (ppd->tp_next_offset == 0) break;
+        ppd = (const struct tpacket3_hdr *)((const uint8_t *)ppd + ppd->tp_next_offset);
+    }
+    return num_pkts;
+}
+
+void afp_release_block(afp_ring_t *ring, unsigned idx) {
+    struct tpacket_block_desc *bd = block_desc(ring, idx);
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+}
+
+void afp_get_stats(afp_ring_t *ring, uint64_t *packets, uint64_t *drops, uint64_t *freeze_q) {
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+    memset(&st, 0, sizeof(st));
+    if (getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+        // tp_packets includes drops
+        ring->stat_packets += st.tp_packets;
+        ring->stat_drops += st.tp_drops;
+        ring->stat_freeze_q += st.tp_freeze_q_cnt;
+    }
+    if (packets) *packets = ring->stat_packets;
+    if (drops) *drops = ring->stat_drops;
+    if (freeze_q) *freeze_q = ring->stat_freeze_q;
+}
+
+#endif // __linux__
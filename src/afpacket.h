@@ -0,0 +1,46 @@
+// afpacket.h - Linux AF_PACKET TPACKET_V3 mmap ring capture backend
+#ifndef AFPACKET_H
+#define AFPACKET_H
+
+#include <pcap.h>
+#include <stdint.h>
+
+// Ring geometry defaults (block size must be a multiple of the page size)
+#define AFP_DEFAULT_BLOCK_SIZE  (1u << 22)   // 4 MiB per block
+#define AFP_DEFAULT_BLOCK_COUNT 64           // 256 MiB ring
+#define AFP_DEFAULT_FRAME_SIZE  2048         // Used only to size tp_frame_nr
+#define AFP_DEFAULT_RETIRE_MS   60           // Kernel retires partially filled blocks after this
+
+typedef struct afp_ring afp_ring_t;
+
+// Per-frame callback used while walking a block. The header is synthesized
+// from tpacket3_hdr so analyze_packet() sees the same view as with pcap.
+typedef void (*afp_frame_fn)(void *user, const struct pcap_pkthdr *header, const u_char *data);
+
+// Open a promiscuous TPACKET_V3 ring on ifname. A non-zero fanout_group joins
+// a PACKET_FANOUT_HASH group so the kernel spreads flows (both directions of
+// a connection to the same socket) across several rings. A non-NULL filter
+// (compiled for DLT_EN10MB) is attached with SO_ATTACH_FILTER before the
+// ring exists, so rejected frames are never copied into it.
+// Returns NULL (and prints why) on failure.
+afp_ring_t *afp_open(const char *ifname, unsigned block_size, unsigned block_count,
+                     unsigned fanout_group, const struct bpf_program *filter);
+void afp_close(afp_ring_t *ring);
+
+unsigned afp_block_count(const afp_ring_t *ring);
+
+// Wait up to timeout_ms for block idx to be handed to user space.
+// Returns 1 if ready, 0 on timeout/interrupt, -1 on socket error.
+int afp_wait_block(afp_ring_t *ring, unsigned idx, int timeout_ms);
+
+// Walk every frame in a ready block (in place, no copy); returns frames visited
+unsigned afp_walk_block(afp_ring_t *ring, unsigned idx, afp_frame_fn fn, void *user);
+
+// Return block idx to the kernel. Must only be called after all frames are parsed.
+void afp_release_block(afp_ring_t *ring, unsigned idx);
+
+// Kernel counters, accumulated across reads (PACKET_STATISTICS resets on read).
+// packets counts frames that passed the filter, including the dropped ones.
+void afp_get_stats(afp_ring_t *ring, uint64_t *packets, uint64_t *drops, uint64_t *freeze_q);
+
+#endif // AFPACKET_H
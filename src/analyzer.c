@@ -2,24 +2,178 @@
 #include "analyzer.h"
 #include "ethernet.h"
 #include "logger.h"
+#include "stats.h"
+#include "tracelog.h"
+#include "platform.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-// Packet counter for periodic summaries
-static unsigned long long packet_count = 0;
+// ---------------------------
+// Flow Expiry
+// ---------------------------
+static void on_flow_expired(void *user, const FlowRecord *f, flow_end_reason_t reason) {
+    analyzer_t *an = (analyzer_t *)user;
+    if (f->app) {
+        TcpSession *sess = (TcpSession *)f->app;
+        tcp_reasm_release(an->reasm, &sess->stream);
+        if (sess->app == TCP_APP_TLS) https_session_release(an, &sess->tls);
+        pool_free(&an->sessions, sess);
+    }
+
+    // Report in initiator -> responder order
+    uint16_t init_port = f->init_reversed ? f->key.port_hi : f->key.port_lo;
+    uint16_t resp_port = f->init_reversed ? f->key.port_lo : f->key.port_hi;
+    uint64_t duration_us = f->last_us - f->first_us;
+
+    TRACE(TRACE_FLOW_END, reason, f->key.proto, init_port, resp_port, duration_us, f->tcp_state);
+    TRACE(TRACE_FLOW_COUNTS, f->packets[FLOW_DIR_FORWARD], f->bytes[FLOW_DIR_FORWARD],
+          f->packets[FLOW_DIR_REVERSE], f->bytes[FLOW_DIR_REVERSE]);
+
+    if (LOG_ENABLED(LOG_DEBUG)) {
+        static const char *reasons[] = { "idle", "active", "closed", "shutdown" };
+        int af = f->key.family == 6 ? AF_INET6 : AF_INET;
+        char init_ip[INET6_ADDRSTRLEN], resp_ip[INET6_ADDRSTRLEN];
+        inet_ntop(af, f->init_reversed ? f->key.addr_hi : f->key.addr_lo, init_ip, sizeof(init_ip));
+        inet_ntop(af, f->init_reversed ? f->key.addr_lo : f->key.addr_hi, resp_ip, sizeof(resp_ip));
+        LOG_DEBUG_SIMPLE("Flow end (%s): proto=%u %s:%u <-> %s:%u, %llu/%llu pkts, %llu/%llu bytes, %.3f s\n",
+                         reasons[reason], f->key.proto, init_ip, init_port, resp_ip, resp_port,
+                         (unsigned long long)f->packets[FLOW_DIR_FORWARD],
+                         (unsigned long long)f->packets[FLOW_DIR_REVERSE],
+                         (unsigned long long)f->bytes[FLOW_DIR_FORWARD],
+                         (unsigned long long)f->bytes[FLOW_DIR_REVERSE],
+                         (double)duration_us / 1e6);
+    }
+}
+
+// ---------------------------
+// Lifecycle
+// ---------------------------
+analyzer_t *analyzer_create(unsigned worker_id, const AnalyzerConfig *cfg) {
+    analyzer_t *an = (analyzer_t *)calloc(1, sizeof(analyzer_t));
+    if (!an) return NULL;
+    an->worker_id = worker_id;
+    an->flows = flow_table_create(&cfg->flows, on_flow_expired, an);
+    an->reasm = tcp_reasm_create(cfg->reasm_buffers, 0);
+    an->frags = ipfrag_create(&cfg->frags);
+    an->dns = dnstrack_create(&cfg->dns);
+    if (!an->flows || !an->reasm || !an->frags || !an->dns ||
+        pool_init(&an->sessions, sizeof(TcpSession), cfg->tcp_sessions) != 0 ||
+        pool_init(&an->tls_buffers, TLS_HELLO_BUF, cfg->tls_buffers) != 0) {
+        analyzer_destroy(an);
+        return NULL;
+    }
+    return an;
+}
+
+// Flush first: the expire callback returns sessions and buffers to their pools
+void analyzer_destroy(analyzer_t *an) {
+    if (!an) return;
+    if (an->flows) flow_table_flush(an->flows);
+    flow_table_destroy(an->flows);
+    tcp_reasm_destroy(an->reasm);
+    ipfrag_destroy(an->frags);
+    dnstrack_destroy(an->dns);
+    pool_destroy(&an->sessions);
+    pool_destroy(&an->tls_buffers);
+    free(an);
+}
 
-void analyze_packet(const struct pcap_pkthdr *header, const u_char *pkt_data) {
-    packet_count++;
+void analyzer_idle(analyzer_t *an, uint64_t now_us) {
+    flow_table_advance(an->flows, now_us);
+    ipfrag_expire(an->frags, now_us);
+    dnstrack_expire(an->dns, now_us);
+}
+
+void analyzer_flush(analyzer_t *an) {
+    flow_table_flush(an->flows);
+}
+
+void analyzer_track_flow(packet_ctx_t *pkt, uint16_t sport, uint16_t dport, uint8_t tcp_flags) {
+    pkt->sport = sport;
+    pkt->dport = dport;
+    if (pkt->is_fragment || !pkt->an) return;
+
+    flow_key_t key;
+    int reversed;
+    flow_key_make(&key, pkt->family, pkt->ip_proto, pkt->src_addr, pkt->dst_addr,
+                  pkt->addr_len, sport, dport, &reversed);
+    pkt->flow = flow_table_track(pkt->an->flows, &key, reversed, pkt->ts_us, pkt->wire_len,
+                                 pkt->ip_proto == 6, tcp_flags, &pkt->flow_dir);
+}
+
+TcpSession *analyzer_tcp_session(packet_ctx_t *pkt, uint8_t app) {
+    FlowRecord *f = pkt->flow;
+    if (!f) return NULL;
+    if (f->app) return (TcpSession *)f->app;
+
+    analyzer_t *an = pkt->an;
+    TcpSession *sess = (TcpSession *)pool_alloc(&an->sessions);
+    if (!sess) {
+        an->sessions_exhausted++;
+        return NULL;
+    }
+    memset(sess, 0, sizeof(*sess));
+    sess->app = app;
+    f->app = sess;
+    an->sessions_created++;
+    return sess;
+}
+
+// ---------------------------
+// Entry Point
+// ---------------------------
+void analyze_packet(analyzer_t *an, const struct pcap_pkthdr *header, const u_char *pkt_data) {
+    // Overload: sampling leaves whole flows out, and each kept packet
+    // counts for the ones skipped (see overload.h)
+    OverloadState *ov = an->overload;
+    int fast = ov && ov->mode != OVERLOAD_FULL;
+    uint32_t weight = 1;
+    if (ov && ov->mode == OVERLOAD_SAMPLED) {
+        weight = overload_sample(ov, pkt_data, (int)header->caplen);
+        if (weight == 0) return;
+    }
+
+    // Numbered per worker: a shared counter would put every packet on one cache line
+    unsigned long long packet_num = (unsigned long long)++an->packets;
     
     // Only log every Nth packet in INFO mode to reduce console spam
     if (current_log_level < LOG_DEBUG) {
-        if (packet_count % 1000 == 0) {
-            LOG_INFO_MSG("Processed %llu packets...\n", packet_count);
+        if (packet_num % 1000 == 0) {
+            LOG_INFO_MSG("Worker %u: processed %llu packets...\n", an->worker_id, packet_num);
         }
-    } else {
+    } else if (!fast) {
         // Full per-packet logging in DEBUG mode
-        LOG_DEBUG_SIMPLE("\n[+] Packet #%llu: length %d bytes (captured: %d bytes)\n", 
-               packet_count, header->len, header->caplen);
+        LOG_DEBUG_SIMPLE("\n[+] Worker %u packet #%llu: length %d bytes (captured: %d bytes)\n", 
+               an->worker_id, packet_num, header->len, header->caplen);
     }
     
-    parse_ethernet(pkt_data, header->caplen);
+    TRACE(TRACE_PACKET, packet_num, header->len, header->caplen);
+
+    packet_ctx_t pkt;
+    pkt.an = an;
+    pkt.fast = fast;
+    pkt.ts_us = (uint64_t)header->ts.tv_sec * 1000000u + (uint64_t)header->ts.tv_usec;
+    pkt.wire_len = header->len;
+    pkt.cap_len = header->caplen;
+    pkt.family = 0;
+    pkt.ip_proto = 0;
+    pkt.is_fragment = 0;
+    pkt.addr_len = 0;
+    pkt.src_addr = pkt.dst_addr = NULL;
+    pkt.sport = pkt.dport = 0;
+    pkt.tcp_seq = 0;
+    pkt.tcp_flags = 0;
+    pkt.flow = NULL;
+    pkt.flow_dir = FLOW_DIR_FORWARD;
+    pkt.src_ip[0] = pkt.dst_ip[0] = '\0';
+
+    // Fragment and DNS timeouts run on packet time, like the flow table
+    ipfrag_expire(an->frags, pkt.ts_us);
+    dnstrack_expire(an->dns, pkt.ts_us);
+
+    // Snapshots see all of this packet's counters or none of them
+    stats_packet_begin(header->len, header->caplen, weight);
+    parse_ethernet(&pkt, pkt_data, header->caplen);
+    stats_packet_end();
 }
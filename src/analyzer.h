@@ -3,7 +3,82 @@
 #define ANALYZER_H
 
 #include <pcap.h>
+#include "packet.h"
+#include "flowtable.h"
+#include "tcp_reasm.h"
+#include "ipfrag.h"
+#include "dnstrack.h"
+#include "http.h"
+#include "https.h"
+#include "pool.h"
+#include "overload.h"
 
-void analyze_packet(const struct pcap_pkthdr *header, const u_char *pkt_data);
+#define ANALYZER_DEFAULT_TCP_SESSIONS  16384   // Reassembled connections, total across workers
+#define ANALYZER_DEFAULT_REASM_BUFFERS 8192    // 2 KiB out-of-order buffers, total across workers
+#define ANALYZER_DEFAULT_TLS_BUFFERS   1024    // TLS_HELLO_BUF buffers for split hellos, total across workers
+
+// Application protocol owning TcpSession's union
+enum {
+    TCP_APP_NONE = 0,
+    TCP_APP_HTTP,
+    TCP_APP_TLS
+};
+
+// Reassembly and application state of one TCP connection, attached to
+// FlowRecord.app while the flow lives
+typedef struct {
+    TcpStream stream;
+    uint8_t app;             // TCP_APP_*
+    union {
+        HttpStream http[2];  // Indexed by FLOW_DIR_*
+        TlsSession tls;
+    };
+} TcpSession;
+
+// Per-worker analysis state. Each worker owns one and is the only thread
+// that touches it, so nothing in here needs locking.
+struct analyzer {
+    unsigned worker_id;
+    uint64_t packets;            // Analyzed by this worker (progress log, trace numbering)
+    FlowTable *flows;
+    TcpReasm *reasm;
+    IpFragCache *frags;
+    DnsTracker *dns;
+    ObjPool sessions;            // TcpSession objects
+    uint64_t sessions_created;
+    uint64_t sessions_exhausted; // Connections parsed per segment because the pool was empty
+    ObjPool tls_buffers;         // TLS_HELLO_BUF buffers for hellos split across segments
+    TlsStats tls;
+    OverloadState *overload;     // Live capture load shedding (NULL = always parse in full)
+};
+
+typedef struct {
+    FlowTableConfig flows;   // Per-worker share of the flow table limits
+    uint32_t tcp_sessions;   // Per-worker share of the limits below
+    uint32_t reasm_buffers;
+    uint32_t tls_buffers;
+    IpFragConfig frags;
+    DnsTrackConfig dns;
+} AnalyzerConfig;
+
+analyzer_t *analyzer_create(unsigned worker_id, const AnalyzerConfig *cfg);
+void analyzer_destroy(analyzer_t *an);
+
+void analyze_packet(analyzer_t *an, const struct pcap_pkthdr *header, const u_char *pkt_data);
+
+// Expire flows, IP fragments and DNS queries against the wall clock while no packets arrive (live capture)
+void analyzer_idle(analyzer_t *an, uint64_t now_us);
+
+// End of capture: expire every tracked flow
+void analyzer_flush(analyzer_t *an);
+
+// Look up / create the flow for the packet's addresses and the given ports,
+// filling pkt->flow and pkt->flow_dir. Fragments are not tracked.
+void analyzer_track_flow(packet_ctx_t *pkt, uint16_t sport, uint16_t dport, uint8_t tcp_flags);
+
+// Reassembly session of the packet's TCP flow, created on first use for
+// the given TCP_APP_* parser. NULL when the flow is untracked or the
+// session pool is exhausted.
+TcpSession *analyzer_tcp_session(packet_ctx_t *pkt, uint8_t app);
 
 #endif // ANALYZER_H
@@ -1,8 +1,10 @@
 // ARP packet parsing
 #include "arp.h"
+#include "logger.h"
+#include "stats.h"
+#include "tracelog.h"
 #include <stdio.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "platform.h"
 
 // IP address formatting
 static void format_ip(u_int ip_addr, char *buffer, int size) {
@@ -21,7 +23,8 @@ static void format_mac(const u_char *mac, char *buffer) {
 
 void parse_arp(const u_char *data, int size) {
     if (size < (int)sizeof(arp_header_t)) {
-        printf("ARP: Truncated header (got %d, need %d)\n",
+        stats_count_truncated(PROTO_ARP);
+        LOG_DEBUG_SIMPLE("ARP: Truncated header (got %d, need %d)\n",
                size, (int)sizeof(arp_header_t));
         return;
     }
@@ -29,14 +32,19 @@ void parse_arp(const u_char *data, int size) {
 
     // Validate packet
     if (ntohs(arp->hardware_type) != 1) {
-        printf("ARP: Unsupported hardware type %u\n", ntohs(arp->hardware_type));
+        LOG_DEBUG_SIMPLE("ARP: Unsupported hardware type %u\n", ntohs(arp->hardware_type));
         return;
     }
     if (ntohs(arp->protocol_type) != 0x0800) {
-        printf("ARP: Unsupported protocol type 0x%04X\n", ntohs(arp->protocol_type));
+        LOG_DEBUG_SIMPLE("ARP: Unsupported protocol type 0x%04X\n", ntohs(arp->protocol_type));
         return;
     }
 
+    TRACE(TRACE_ARP, ntohs(arp->operation), arp->sender_ip, arp->target_ip);
+
+    // Everything below only produces debug output
+    if (!LOG_ENABLED(LOG_DEBUG)) return;
+
     // Format addresses
     char sender_mac[18], target_mac[18];
     char sender_ip[16], target_ip[16];
@@ -58,18 +66,18 @@ void parse_arp(const u_char *data, int size) {
     }
 
     // Display packet info
-    printf("ARP: %s\n", op_name);
-    printf("     Sender: %s (%s)\n", sender_ip, sender_mac);
+    LOG_DEBUG_SIMPLE("ARP: %s\n", op_name);
+    LOG_DEBUG_SIMPLE("     Sender: %s (%s)\n", sender_ip, sender_mac);
 
     if (op == 1) {
-        printf("     Target: %s (Broadcast)\n", target_ip);
+        LOG_DEBUG_SIMPLE("     Target: %s (Broadcast)\n", target_ip);
     } else {
-        printf("     Target: %s (%s)\n", target_ip, target_mac);
+        LOG_DEBUG_SIMPLE("     Target: %s (%s)\n", target_ip, target_mac);
     }
 
     // Packet details
-    printf("     Hardware Type: Ethernet (0x%04X)\n", ntohs(arp->hardware_type));
-    printf("     Protocol Type: IPv4 (0x%04X)\n", ntohs(arp->protocol_type));
-    printf("     Hardware Size: %u bytes\n", arp->hardware_size);
-    printf("     Protocol Size: %u bytes\n", arp->protocol_size);
+    LOG_DEBUG_SIMPLE("     Hardware Type: Ethernet (0x%04X)\n", ntohs(arp->hardware_type));
+    LOG_DEBUG_SIMPLE("     Protocol Type: IPv4 (0x%04X)\n", ntohs(arp->protocol_type));
+    LOG_DEBUG_SIMPLE("     Hardware Size: %u bytes\n", arp->hardware_size);
+    LOG_DEBUG_SIMPLE("     Protocol Size: %u bytes\n", arp->protocol_size);
 }
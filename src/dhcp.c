@@ -4,8 +4,7 @@
 #include "logger.h"
 #include <stdio.h>
 #include <string.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "platform.h"
 
 // DHCP magic cookie
 #define DHCP_MAGIC_COOKIE 0x63825363
@@ -77,7 +76,8 @@ static void parse_dhcp_options(const u_char *options, int options_len,
         
         // Check if we have enough space for length byte
         if (offset + 1 >= options_len) {
-            LOG_WARN_SIMPLE("DHCP: Truncated option at offset %d\n", offset);
+            stats_count_malformed(PROTO_DHCP);
+            LOG_DEBUG_SIMPLE("DHCP: Truncated option at offset %d\n", offset);
             break;
         }
         
@@ -85,7 +85,8 @@ static void parse_dhcp_options(const u_char *options, int options_len,
         
         // Validate option length
         if (offset + 2 + len > options_len) {
-            LOG_WARN_SIMPLE("DHCP: Invalid option length %d at offset %d\n", len, offset);
+            stats_count_malformed(PROTO_DHCP);
+            LOG_DEBUG_SIMPLE("DHCP: Invalid option length %d at offset %d\n", len, offset);
             break;
         }
         
@@ -161,11 +162,11 @@ static void parse_dhcp_options(const u_char *options, int options_len,
     }
 }
 
-void parse_dhcp(const u_char *data, int size, const char *src_ip, const char *dst_ip,
-                unsigned short src_port, unsigned short dst_port) {
+void parse_dhcp(packet_ctx_t *pkt, const u_char *data, int size) {
     // Validate minimum size
     if (size < (int)sizeof(dhcp_header_t)) {
-        LOG_WARN_SIMPLE("DHCP: Truncated header (size: %d, need: %zu)\n", 
+        stats_count_truncated(PROTO_DHCP);
+        LOG_DEBUG_SIMPLE("DHCP: Truncated header (size: %d, need: %zu)\n", 
                        size, sizeof(dhcp_header_t));
         return;
     }
@@ -181,7 +182,10 @@ void parse_dhcp(const u_char *data, int size, const char *src_ip, const char *ds
     }
     
     // Increment stats
-    stats_increment("DHCP");
+    stats_increment(PROTO_DHCP);
+
+    // Everything below only produces debug output
+    if (!LOG_ENABLED(LOG_DEBUG)) return;
     
     // Parse basic header info
     uint32_t xid = ntohl(dhcp->xid);
@@ -232,8 +236,8 @@ void parse_dhcp(const u_char *data, int size, const char *src_ip, const char *ds
     }
     
     // Print DHCP message info
-    LOG_INFO_SIMPLE("DHCP: %s:%u -> %s:%u, Op=%s, Type=%s, XID=0x%08X\n",
-           src_ip, src_port, dst_ip, dst_port,
+    LOG_DEBUG_SIMPLE("DHCP: %s:%u -> %s:%u, Op=%s, Type=%s, XID=0x%08X\n",
+           pkt->src_ip, pkt->sport, pkt->dst_ip, pkt->dport,
            get_dhcp_op_name(dhcp->op),
            msg_type ? get_dhcp_message_type(msg_type) : "UNKNOWN",
            xid);
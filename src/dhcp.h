@@ -2,7 +2,9 @@
 #ifndef DHCP_H
 #define DHCP_H
 
+#include <pcap.h>
 #include <stdint.h>
+#include "packet.h"
 
 // DHCP message types (option 53)
 #define DHCP_DISCOVER 1
@@ -45,7 +47,6 @@ typedef struct {
 } __attribute__((packed)) dhcp_option_t;
 
 // Function declarations
-void parse_dhcp(const u_char *data, int size, const char *src_ip, const char *dst_ip, 
-                unsigned short src_port, unsigned short dst_port);
+void parse_dhcp(packet_ctx_t *pkt, const u_char *data, int size);
 
 #endif // DHCP_H
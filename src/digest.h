@@ -0,0 +1,20 @@
+// digest.h - MD5 and SHA-256 for fingerprint hashing
+//
+// Small one-shot implementations used to hash JA3/JA4 strings; they are
+// not meant for anything security relevant.
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MD5_DIGEST_LEN    16
+#define SHA256_DIGEST_LEN 32
+
+void md5(const void *data, size_t len, uint8_t out[MD5_DIGEST_LEN]);
+void sha256(const void *data, size_t len, uint8_t out[SHA256_DIGEST_LEN]);
+
+// Lowercase hex of the first nbytes of digest into out (2 * nbytes + 1 bytes)
+void digest_hex(const uint8_t *digest, size_t nbytes, char *out);
+
+#endif // DIGEST_H
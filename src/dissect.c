@@ -0,0 +1,198 @@
+// dissect.c - Application dissector registry
+#include "dissect.h"
+#include "flowtable.h"
+#include "http.h"
+#include "https.h"
+#include "dns.h"
+#include "dhcp.h"
+#include "stats.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DISSECT_MAX_PORTS  8          // Default plus configured ports per dissector
+#define DISSECT_NONE       0xFF       // FlowRecord.dissector: no heuristic matched
+
+typedef struct {
+    const char *name;
+    dissect_transport_t transport;
+    dissector_fn parse;
+    heuristic_fn heuristic;           // Set for heuristic entries (no ports)
+    proto_id_t proto;                 // Counted by dissect_count
+    int enabled;
+    int nports;
+    uint16_t ports[DISSECT_MAX_PORTS];
+} Dissector;
+
+// Registration order is priority order. Index 0 is reserved so that a zero
+// table entry means "no dissector". To add a protocol, write its parser
+// (and optionally a heuristic) and add a line here; nothing else changes.
+static Dissector registry[] = {
+    { NULL, DISSECT_TCP, NULL, NULL, PROTO_COUNT, 0, 0, {0} },
+    { "http",           DISSECT_TCP, parse_http,  NULL,           PROTO_HTTP,  1, 1, { 80 } },
+    { "https",          DISSECT_TCP, parse_https, NULL,           PROTO_HTTPS, 1, 1, { 443 } },
+    { "dns",            DISSECT_UDP, parse_dns,   NULL,           PROTO_DNS,   1, 1, { 53 } },
+    { "dhcp",           DISSECT_UDP, parse_dhcp,  NULL,           PROTO_DHCP,  1, 2, { DHCP_SERVER_PORT, DHCP_CLIENT_PORT } },
+    { "http-heuristic", DISSECT_TCP, parse_http,  http_heuristic, PROTO_HTTP,  0, 0, {0} },
+    { "tls-heuristic",  DISSECT_TCP, parse_https, tls_heuristic,  PROTO_HTTPS, 0, 0, {0} },
+};
+
+#define DISSECT_COUNT ((int)(sizeof(registry) / sizeof(registry[0])))
+
+static uint8_t port_table[DISSECT_TRANSPORTS][65536];
+static uint8_t heuristics[DISSECT_TRANSPORTS][DISSECT_COUNT];   // Enabled heuristic indices, 0-terminated
+static int heuristics_enabled[DISSECT_TRANSPORTS];
+
+static const char *transport_name(dissect_transport_t t) {
+    return t == DISSECT_TCP ? "tcp" : "udp";
+}
+
+static int find_dissector(const char *name, size_t len) {
+    for (int i = 1; i < DISSECT_COUNT; i++) {
+        if (strlen(registry[i].name) == len && strncmp(registry[i].name, name, len) == 0) return i;
+    }
+    fprintf(stderr, "[!] Unknown dissector \"%.*s\"\n", (int)len, name);
+    return -1;
+}
+
+// ---------------------------
+// Configuration
+// ---------------------------
+// "-name" disables, "+name" or "name" enables
+static int apply_spec(const char *spec) {
+    const char *p = spec;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        int enable = 1;
+        if (len > 0 && (*p == '-' || *p == '+')) {
+            enable = (*p == '+');
+            p++;
+            len--;
+        }
+        if (len > 0) {
+            int idx = find_dissector(p, len);
+            if (idx < 0) return -1;
+            registry[idx].enabled = enable;
+        }
+        if (!end) break;
+        p = end + 1;
+    }
+    return 0;
+}
+
+// "name:port" pairs add ports to a port-based dissector
+static int apply_ports(const char *ports) {
+    const char *p = ports;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len > 0) {
+            const char *colon = memchr(p, ':', len);
+            if (!colon) {
+                fprintf(stderr, "[!] Bad dissector port \"%.*s\" (expected name:port)\n", (int)len, p);
+                return -1;
+            }
+            int idx = find_dissector(p, (size_t)(colon - p));
+            if (idx < 0) return -1;
+            char *stop;
+            unsigned long port = strtoul(colon + 1, &stop, 10);
+            if (stop == colon + 1 || stop != p + len || port == 0 || port > 65535) {
+                fprintf(stderr, "[!] Bad dissector port \"%.*s\"\n", (int)len, p);
+                return -1;
+            }
+            Dissector *d = &registry[idx];
+            if (d->heuristic) {
+                fprintf(stderr, "[!] Dissector \"%s\" is heuristic and takes no ports\n", d->name);
+                return -1;
+            }
+            if (d->nports == DISSECT_MAX_PORTS) {
+                fprintf(stderr, "[!] Dissector \"%s\": at most %d ports\n", d->name, DISSECT_MAX_PORTS);
+                return -1;
+            }
+            d->ports[d->nports++] = (uint16_t)port;
+        }
+        if (!end) break;
+        p = end + 1;
+    }
+    return 0;
+}
+
+int dissect_init(const char *spec, const char *ports) {
+    if (spec && apply_spec(spec) != 0) return -1;
+    if (ports && apply_ports(ports) != 0) return -1;
+
+    memset(port_table, 0, sizeof(port_table));
+    memset(heuristics, 0, sizeof(heuristics));
+    memset(heuristics_enabled, 0, sizeof(heuristics_enabled));
+
+    char summary[512];
+    size_t off = 0;
+    summary[0] = '\0';
+    for (int i = 1; i < DISSECT_COUNT; i++) {
+        Dissector *d = &registry[i];
+        if (!d->enabled) continue;
+        if (d->heuristic) {
+            heuristics[d->transport][heuristics_enabled[d->transport]++] = (uint8_t)i;
+        } else {
+            // Registered first keeps the port
+            for (int k = 0; k < d->nports; k++) {
+                uint8_t *slot = &port_table[d->transport][d->ports[k]];
+                if (*slot == 0) *slot = (uint8_t)i;
+            }
+        }
+        if (off < sizeof(summary)) {
+            int n = snprintf(summary + off, sizeof(summary) - off, "%s%s/%s",
+                             off ? ", " : "", d->name, transport_name(d->transport));
+            if (n > 0) off += (size_t)n;
+        }
+    }
+    printf("[+] Dissectors: %s\n", off ? summary : "none");
+    return 0;
+}
+
+// ---------------------------
+// Dispatch
+// ---------------------------
+// Unclaimed ports: the flow's cached choice, else try the heuristics on
+// the flow's first payload and remember the answer either way
+static void dispatch_heuristic(dissect_transport_t transport, packet_ctx_t *pkt, const u_char *data, int size) {
+    struct FlowRecord *flow = pkt->flow;
+    uint8_t idx = flow ? flow->dissector : 0;
+    if (idx == 0) {
+        if (size <= 0) return;
+        idx = DISSECT_NONE;
+        for (const uint8_t *h = heuristics[transport]; *h; h++) {
+            if (registry[*h].heuristic(data, size)) {
+                idx = *h;
+                break;
+            }
+        }
+        if (flow) flow->dissector = idx;
+    }
+    if (idx != DISSECT_NONE) registry[idx].parse(pkt, data, size);
+}
+
+void dissect_dispatch(dissect_transport_t transport, packet_ctx_t *pkt, const u_char *data, int size) {
+    uint8_t a = port_table[transport][pkt->sport];
+    uint8_t b = port_table[transport][pkt->dport];
+    uint8_t idx = (a && b) ? (a < b ? a : b) : (uint8_t)(a | b);
+    if (idx) {
+        registry[idx].parse(pkt, data, size);
+    } else if (heuristics_enabled[transport]) {
+        dispatch_heuristic(transport, pkt, data, size);
+    }
+}
+
+// Counters-only mode: the payload's protocol by port, or by the flow's
+// earlier heuristic match, without parsing it. New flows on unclaimed
+// ports are not offered to the heuristics.
+void dissect_count(dissect_transport_t transport, packet_ctx_t *pkt, int size) {
+    if (size <= 0) return;
+    uint8_t a = port_table[transport][pkt->sport];
+    uint8_t b = port_table[transport][pkt->dport];
+    uint8_t idx = (a && b) ? (a < b ? a : b) : (uint8_t)(a | b);
+    if (!idx && heuristics_enabled[transport] && pkt->flow) idx = pkt->flow->dissector;
+    if (idx && idx != DISSECT_NONE) stats_increment(registry[idx].proto);
+}
@@ -0,0 +1,43 @@
+// dissect.h - Application dissector registry
+//
+// Each transport has a 65536-entry table mapping a port to the dissector
+// that owns it, so choosing a parser is two loads whatever the number of
+// protocols. When both ports are claimed, the dissector registered first
+// wins. Payloads on unclaimed ports can be offered to heuristic
+// dissectors (off by default); the first one that recognizes a flow is
+// remembered on the flow record, so later segments skip the heuristics.
+// The tables are built once at startup and only read afterwards.
+#ifndef DISSECT_H
+#define DISSECT_H
+
+#include <pcap.h>
+#include "packet.h"
+
+typedef enum {
+    DISSECT_TCP = 0,
+    DISSECT_UDP,
+    DISSECT_TRANSPORTS
+} dissect_transport_t;
+
+// Application parser; TCP parsers also read pkt->tcp_seq / pkt->tcp_flags
+typedef void (*dissector_fn)(packet_ctx_t *pkt, const u_char *data, int size);
+
+// Does this first payload of a flow look like the protocol? (1 = yes)
+typedef int (*heuristic_fn)(const u_char *data, int size);
+
+// Build the port tables. spec is a comma-separated list of dissector names
+// to turn off ("-dhcp") or on ("+tls-heuristic", "http"); ports adds
+// "name:port" pairs ("http:8080,https:8443"). Either may be NULL.
+// Returns 0, or -1 (after printing why) on an unknown name or bad port.
+int dissect_init(const char *spec, const char *ports);
+
+// Hand a transport payload to its dissector, if any. TCP calls this for
+// every segment (the reassembler needs the SYN); UDP only with a payload.
+void dissect_dispatch(dissect_transport_t transport, packet_ctx_t *pkt, const u_char *data, int size);
+
+// Overload counters-only path (pkt->fast): count the protocol the payload
+// would be handed to, by port or the flow's cached heuristic match, and
+// parse nothing. Only payloads of at least one byte count.
+void dissect_count(dissect_transport_t transport, packet_ctx_t *pkt, int size);
+
+#endif // DISSECT_H
@@ -1,9 +1,12 @@
 // DNS packet parsing
 #include "dns.h"
+#include "analyzer.h"
+#include "stats.h"
+#include "logger.h"
+#include "tracelog.h"
 #include <stdio.h>
 #include <string.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "platform.h"
 
 // DNS name compression pointer flag
 #define DNS_COMPRESSION_MASK 0xC0
@@ -11,8 +14,10 @@
 // Forward declaration
 static int parse_dns_name(const u_char *data, int data_len, int *offset, char *name, int name_size);
 
-// Parse DNS record
-static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_question) {
+// Parse DNS record. For a question, name_out (DNS_NAME_MAX bytes) and
+// type_out receive the name and type when not NULL.
+static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_question,
+                        char *name_out, u_short *type_out) {
     char name[256] = {0};
     int name_len = parse_dns_name(data, data_len, offset, name, sizeof(name));
 
@@ -25,7 +30,9 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
     u_short class = ntohs(*(u_short*)(data + *offset)); *offset += 2;
 
     if (is_question) {
-        printf("     Question: %s (Type=%u, Class=%u)\n", name, type, class);
+        LOG_DEBUG_SIMPLE("     Question: %s (Type=%u, Class=%u)\n", name, type, class);
+        if (name_out) memcpy(name_out, name, (size_t)name_len + 1);
+        if (type_out) *type_out = type;
         return 0;
     }
 
@@ -37,8 +44,14 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
         return -1;
     }
 
+    // Record data is only decoded for the debug dump
+    if (!LOG_ENABLED(LOG_DEBUG)) {
+        *offset += rdlength;
+        return 0;
+    }
+
     // Parse record data
-    printf("     Answer: %s (Type=%u, Class=%u, TTL=%u)\n", name, type, class, ttl);
+    LOG_DEBUG_SIMPLE("     Answer: %s (Type=%u, Class=%u, TTL=%u)\n", name, type, class, ttl);
 
     switch (type) {
         case DNS_TYPE_A: {
@@ -47,9 +60,9 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
                 memcpy(&addr, data + *offset, 4);
                 char ip_str[INET_ADDRSTRLEN];
                 if (inet_ntop(AF_INET, &addr, ip_str, sizeof(ip_str)) != NULL) {
-                    printf("         A: %s\n", ip_str);
+                    LOG_DEBUG_SIMPLE("         A: %s\n", ip_str);
                 } else {
-                    printf("         A: Invalid address\n");
+                    LOG_DEBUG_SIMPLE("         A: Invalid address\n");
                 }
             }
             break;
@@ -60,9 +73,9 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
                 memcpy(&addr, data + *offset, 16);
                 char ip_str[INET6_ADDRSTRLEN];
                 if (inet_ntop(AF_INET6, &addr, ip_str, sizeof(ip_str)) != NULL) {
-                    printf("         AAAA: %s\n", ip_str);
+                    LOG_DEBUG_SIMPLE("         AAAA: %s\n", ip_str);
                 } else {
-                    printf("         AAAA: Invalid address\n");
+                    LOG_DEBUG_SIMPLE("         AAAA: Invalid address\n");
                 }
             }
             break;
@@ -71,7 +84,7 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
             char cname[256] = {0};
             int temp_offset = *offset;
             parse_dns_name(data, data_len, &temp_offset, cname, sizeof(cname));
-            printf("         CNAME: %s\n", cname);
+            LOG_DEBUG_SIMPLE("         CNAME: %s\n", cname);
             break;
         }
         case DNS_TYPE_MX: {
@@ -80,7 +93,7 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
                 int temp_offset = *offset + 2;
                 char mx_name[256] = {0};
                 parse_dns_name(data, data_len, &temp_offset, mx_name, sizeof(mx_name));
-                printf("         MX: %s (preference %u)\n", mx_name, preference);
+                LOG_DEBUG_SIMPLE("         MX: %s (preference %u)\n", mx_name, preference);
             }
             break;
         }
@@ -88,18 +101,18 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
             char ns_name[256] = {0};
             int temp_offset = *offset;
             parse_dns_name(data, data_len, &temp_offset, ns_name, sizeof(ns_name));
-            printf("         NS: %s\n", ns_name);
+            LOG_DEBUG_SIMPLE("         NS: %s\n", ns_name);
             break;
         }
         case DNS_TYPE_PTR: {
             char ptr_name[256] = {0};
             int temp_offset = *offset;
             parse_dns_name(data, data_len, &temp_offset, ptr_name, sizeof(ptr_name));
-            printf("         PTR: %s\n", ptr_name);
+            LOG_DEBUG_SIMPLE("         PTR: %s\n", ptr_name);
             break;
         }
         case DNS_TYPE_TXT: {
-            printf("         TXT: ");
+            LOG_DEBUG_SIMPLE("         TXT: ");
             const u_char *txt_data = data + *offset;
             int txt_len = rdlength;
             int original_txt_len = txt_len;
@@ -108,18 +121,18 @@ static int parse_dns_rr(const u_char *data, int data_len, int *offset, int is_qu
                 int str_len = *txt_data++;
                 txt_len--;
                 if (str_len > 0 && str_len <= txt_len && txt_data + str_len <= (data + data_len)) {
-                    printf("\"%.*s\" ", str_len, txt_data);
+                    LOG_DEBUG_SIMPLE("\"%.*s\" ", str_len, txt_data);
                     txt_data += str_len;
                     txt_len -= str_len;
                 } else {
                     break;  // Invalid string length or out of bounds
                 }
             }
-            printf("\n");
+            LOG_DEBUG_SIMPLE("\n");
             break;
         }
         default: {
-            printf("         Type %u: %u bytes of data\n", type, rdlength);
+            LOG_DEBUG_SIMPLE("         Type %u: %u bytes of data\n", type, rdlength);
             break;
         }
     }
@@ -215,9 +228,11 @@ static int parse_dns_name(const u_char *data, int data_len, int *offset, char *n
     return name_pos;
 }
 
-void parse_dns(const u_char *data, int size) {
+void parse_dns(packet_ctx_t *pkt, const u_char *data, int size) {
+    stats_increment(PROTO_DNS);
     if (size < (int)sizeof(dns_header_t)) {
-        printf("DNS: Truncated header\n");
+        stats_count_truncated(PROTO_DNS);
+        LOG_DEBUG_SIMPLE("DNS: Truncated header\n");
         return;
     }
 
@@ -230,19 +245,20 @@ void parse_dns(const u_char *data, int size) {
     int opcode = (flags >> 11) & 0xF;
     int rcode = flags & 0xF;
 
-    printf("DNS: %s (ID=0x%04X)\n",
+    TRACE(TRACE_DNS, ntohs(dns->transaction_id), flags, ntohs(dns->questions),
+          ntohs(dns->answer_rrs), size);
+    LOG_DEBUG_SIMPLE("DNS: %s (ID=0x%04X)\n",
            is_response ? "Response" : "Query",
            ntohs(dns->transaction_id));
 
     // Flags
-    printf("     Flags: ");
-    if (flags & DNS_FLAG_AA) printf("AA ");
-    if (flags & DNS_FLAG_TC) printf("TC ");
-    if (flags & DNS_FLAG_RD) printf("RD ");
-    if (flags & DNS_FLAG_RA) printf("RA ");
-    if (flags & DNS_FLAG_AD) printf("AD ");
-    if (flags & DNS_FLAG_CD) printf("CD ");
-    printf("\n");
+    LOG_DEBUG_SIMPLE("     Flags: %s%s%s%s%s%s\n",
+                     (flags & DNS_FLAG_AA) ? "AA " : "",
+                     (flags & DNS_FLAG_TC) ? "TC " : "",
+                     (flags & DNS_FLAG_RD) ? "RD " : "",
+                     (flags & DNS_FLAG_RA) ? "RA " : "",
+                     (flags & DNS_FLAG_AD) ? "AD " : "",
+                     (flags & DNS_FLAG_CD) ? "CD " : "");
 
     // Record counts
     u_short questions = ntohs(dns->questions);
@@ -250,21 +266,29 @@ void parse_dns(const u_char *data, int size) {
     u_short authorities = ntohs(dns->authority_rrs);
     u_short additionals = ntohs(dns->additional_rrs);
 
-    printf("     Questions: %u, Answers: %u, Authorities: %u, Additional: %u\n",
+    LOG_DEBUG_SIMPLE("     Questions: %u, Answers: %u, Authorities: %u, Additional: %u\n",
            questions, answers, authorities, additionals);
 
-    // Parse questions
+    // Parse questions; the first one identifies the transaction
+    char qname[DNS_NAME_MAX] = "";
+    u_short qtype = 0;
     for (int i = 0; i < questions && offset < size; i++) {
-        if (parse_dns_rr(data, size, &offset, 1) != 0) {
-            printf("     Error parsing question %d\n", i + 1);
+        if (parse_dns_rr(data, size, &offset, 1, i == 0 ? qname : NULL, i == 0 ? &qtype : NULL) != 0) {
+            stats_count_malformed(PROTO_DNS);
+            LOG_DEBUG_SIMPLE("     Error parsing question %d\n", i + 1);
+            if (i == 0) qname[0] = '\0';
             break;
         }
     }
 
-    // Parse answers
-    for (int i = 0; i < answers && offset < size; i++) {
-        if (parse_dns_rr(data, size, &offset, 0) != 0) {
-            printf("     Error parsing answer %d\n", i + 1);
+    if (pkt->an) {
+        dnstrack_message(pkt->an->dns, pkt, ntohs(dns->transaction_id), flags, qname, qtype);
+    }
+
+    // Parse answers: nothing but the debug dump reads them
+    for (int i = 0; LOG_ENABLED(LOG_DEBUG) && i < answers && offset < size; i++) {
+        if (parse_dns_rr(data, size, &offset, 0, NULL, NULL) != 0) {
+            LOG_DEBUG_SIMPLE("     Error parsing answer %d\n", i + 1);
             break;
         }
     }
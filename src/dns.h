@@ -3,6 +3,7 @@
 #define DNS_H
 
 #include <pcap.h>
+#include "packet.h"
 
 #pragma pack(push, 1)
 // DNS header
@@ -48,7 +49,9 @@ typedef struct {
 #define DNS_RCODE_NOT_IMPL    4
 #define DNS_RCODE_REFUSED     5
 
-// API
-void parse_dns(const u_char *data, int size);
+#define DNS_NAME_MAX 256   // Presentation form incl. NUL (names are at most 253 characters)
+
+// API: logs the message and hands it to the worker's DNS tracker
+void parse_dns(packet_ctx_t *pkt, const u_char *data, int size);
 
 #endif // DNS_H
@@ -0,0 +1,236 @@
+// dnstrack.c - DNS query/response matching
+#include "dnstrack.h"
+#include "dns.h"
+#include "pool.h"
+#include "stats.h"
+#include "logger.h"
+#include "tracelog.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct DnsQuery DnsQuery;
+struct DnsQuery {
+    uint8_t client[16];
+    uint8_t server[16];
+    uint32_t hash;
+    uint32_t question;           // Hash of qname and qtype (0 = no question)
+    uint16_t client_port;
+    uint16_t id;
+    uint8_t family;
+    uint64_t sent_us;
+    DnsQuery *hnext;             // Hash bucket chain
+    DnsQuery *older;             // Age list (creation order = expiry order)
+    DnsQuery *newer;
+};
+
+struct DnsTracker {
+    DnsTrackConfig cfg;
+    ObjPool entries;
+    DnsQuery **buckets;
+    uint32_t bucket_mask;
+    DnsQuery *oldest;
+    DnsQuery *newest;
+    DnsTrackStats stats;
+};
+
+static uint32_t round_up_pow2(uint32_t v) {
+    uint32_t p = 1;
+    while (p < v && p < 0x80000000u) p <<= 1;
+    return p;
+}
+
+DnsTracker *dnstrack_create(const DnsTrackConfig *cfg) {
+    DnsTracker *t = (DnsTracker *)calloc(1, sizeof(DnsTracker));
+    if (!t) return NULL;
+    t->cfg = *cfg;
+    if (t->cfg.max_queries == 0) t->cfg.max_queries = DNSTRACK_DEFAULT_MAX_QUERIES;
+    if (t->cfg.timeout_s == 0) t->cfg.timeout_s = DNSTRACK_DEFAULT_TIMEOUT;
+
+    uint32_t nbuckets = round_up_pow2(t->cfg.max_queries);
+    t->bucket_mask = nbuckets - 1;
+    t->buckets = (DnsQuery **)calloc(nbuckets, sizeof(DnsQuery *));
+    if (!t->buckets || pool_init(&t->entries, sizeof(DnsQuery), t->cfg.max_queries) != 0) {
+        fprintf(stderr, "[!] DNS tracker: failed to allocate table\n");
+        dnstrack_destroy(t);
+        return NULL;
+    }
+    t->stats.max_queries = t->cfg.max_queries;
+    t->stats.memory_bytes = (uint64_t)t->entries.obj_size * t->entries.capacity +
+                            (uint64_t)nbuckets * sizeof(DnsQuery *) + sizeof(DnsTracker);
+    return t;
+}
+
+void dnstrack_destroy(DnsTracker *t) {
+    if (!t) return;
+    pool_destroy(&t->entries);
+    free(t->buckets);
+    free(t);
+}
+
+// ---------------------------
+// Entries
+// ---------------------------
+// FNV-1a over the key fields
+#define DNSTRACK_MIX(h, b) do { (h) ^= (uint8_t)(b); (h) *= 16777619u; } while (0)
+
+static uint32_t key_hash(uint8_t family, const u_char *client, const u_char *server,
+                         unsigned addr_len, uint16_t client_port, uint16_t id) {
+    uint32_t h = 2166136261u;
+    DNSTRACK_MIX(h, family);
+    DNSTRACK_MIX(h, client_port);
+    DNSTRACK_MIX(h, client_port >> 8);
+    DNSTRACK_MIX(h, id);
+    DNSTRACK_MIX(h, id >> 8);
+    for (unsigned i = 0; i < addr_len; i++) DNSTRACK_MIX(h, client[i]);
+    for (unsigned i = 0; i < addr_len; i++) DNSTRACK_MIX(h, server[i]);
+    return h;
+}
+
+// Exact (case-sensitive) so 0x20-randomized names must be echoed as sent
+static uint32_t question_hash(const char *qname, uint16_t qtype) {
+    if (!qname[0]) return 0;
+    uint32_t h = 2166136261u;
+    DNSTRACK_MIX(h, qtype);
+    DNSTRACK_MIX(h, qtype >> 8);
+    for (const char *p = qname; *p; p++) DNSTRACK_MIX(h, *p);
+    return h ? h : 1;
+}
+#undef DNSTRACK_MIX
+
+static DnsQuery *entry_find(DnsTracker *t, const packet_ctx_t *pkt, const u_char *client,
+                            const u_char *server, uint16_t client_port, uint16_t id, uint32_t hash) {
+    for (DnsQuery *q = t->buckets[hash & t->bucket_mask]; q; q = q->hnext) {
+        if (q->hash == hash && q->id == id && q->client_port == client_port &&
+            q->family == pkt->family &&
+            memcmp(q->client, client, pkt->addr_len) == 0 &&
+            memcmp(q->server, server, pkt->addr_len) == 0) {
+            return q;
+        }
+    }
+    return NULL;
+}
+
+static void entry_free(DnsTracker *t, DnsQuery *q) {
+    DnsQuery **link = &t->buckets[q->hash & t->bucket_mask];
+    while (*link != q) link = &(*link)->hnext;
+    *link = q->hnext;
+
+    if (q->older) q->older->newer = q->newer;
+    else t->oldest = q->newer;
+    if (q->newer) q->newer->older = q->older;
+    else t->newest = q->older;
+
+    pool_free(&t->entries, q);
+}
+
+static DnsQuery *entry_create(DnsTracker *t, const packet_ctx_t *pkt, uint32_t hash) {
+    DnsQuery *q = (DnsQuery *)pool_alloc(&t->entries);
+    if (!q) {
+        if (!t->oldest) return NULL;
+        t->stats.evictions++;
+        entry_free(t, t->oldest);
+        q = (DnsQuery *)pool_alloc(&t->entries);
+    }
+    memset(q, 0, sizeof(*q));
+    memcpy(q->client, pkt->src_addr, pkt->addr_len);
+    memcpy(q->server, pkt->dst_addr, pkt->addr_len);
+    q->hash = hash;
+    q->family = pkt->family;
+    q->client_port = pkt->sport;
+
+    DnsQuery **bucket = &t->buckets[hash & t->bucket_mask];
+    q->hnext = *bucket;
+    *bucket = q;
+    q->older = t->newest;
+    if (t->newest) t->newest->newer = q;
+    else t->oldest = q;
+    t->newest = q;
+    if (t->entries.in_use > t->stats.peak) t->stats.peak = t->entries.in_use;
+    return q;
+}
+
+void dnstrack_expire(DnsTracker *t, uint64_t now_us) {
+    uint64_t timeout_us = (uint64_t)t->cfg.timeout_s * 1000000u;
+    while (t->oldest && t->oldest->sent_us + timeout_us <= now_us) {
+        t->stats.unanswered++;
+        entry_free(t, t->oldest);
+    }
+}
+
+// ---------------------------
+// Messages
+// ---------------------------
+// Names are case-insensitive: count them lowercased
+static void lower_name(const char *qname, char *out, size_t out_size) {
+    size_t n = 0;
+    for (; qname[n] && n < out_size - 1; n++) out[n] = (char)tolower((unsigned char)qname[n]);
+    out[n] = '\0';
+}
+
+static void on_query(DnsTracker *t, const packet_ctx_t *pkt, uint16_t id, const char *qname, uint16_t qtype) {
+    t->stats.queries++;
+    if (qname[0]) {
+        char name[STATS_NAME_LEN];
+        lower_name(qname, name, sizeof(name));
+        stats_count_name(STATS_NAMES_DNS_QNAME, name);
+    }
+
+    uint32_t hash = key_hash(pkt->family, pkt->src_addr, pkt->dst_addr, pkt->addr_len, pkt->sport, id);
+    if (entry_find(t, pkt, pkt->src_addr, pkt->dst_addr, pkt->sport, id, hash)) {
+        t->stats.retransmits++;
+        return;
+    }
+    DnsQuery *q = entry_create(t, pkt, hash);
+    if (!q) return;
+    q->id = id;
+    q->question = question_hash(qname, qtype);
+    q->sent_us = pkt->ts_us;
+}
+
+static void on_response(DnsTracker *t, const packet_ctx_t *pkt, uint16_t id, uint16_t flags,
+                        const char *qname, uint16_t qtype) {
+    t->stats.responses++;
+
+    // The client is the destination of a response
+    uint32_t hash = key_hash(pkt->family, pkt->dst_addr, pkt->src_addr, pkt->addr_len, pkt->dport, id);
+    DnsQuery *q = entry_find(t, pkt, pkt->dst_addr, pkt->src_addr, pkt->dport, id, hash);
+    if (!q) {
+        t->stats.unmatched++;
+        return;
+    }
+    uint32_t question = question_hash(qname, qtype);
+    if (q->question && question && q->question != question) {
+        t->stats.mismatched++;
+        return;
+    }
+
+    uint64_t latency_us = pkt->ts_us > q->sent_us ? pkt->ts_us - q->sent_us : 0;
+    unsigned rcode = flags & 0xF;
+    t->stats.matched++;
+    t->stats.rcodes[rcode]++;
+    hist_record(&t->stats.latency, latency_us);
+    if (qname[0]) {
+        char name[STATS_NAME_LEN];
+        lower_name(qname, name, sizeof(name));
+        stats_add_name(STATS_NAMES_DNS_LATENCY, name, latency_us);
+    }
+    entry_free(t, q);
+
+    TRACE(TRACE_DNS_LATENCY, id, rcode, latency_us);
+    LOG_DEBUG_SIMPLE("     Matched query 0x%04X: rcode=%u, latency=%.3f ms\n",
+                     id, rcode, (double)latency_us / 1000.0);
+}
+
+void dnstrack_message(DnsTracker *t, const packet_ctx_t *pkt, uint16_t id, uint16_t flags,
+                      const char *qname, uint16_t qtype) {
+    if (pkt->family == 0 || !pkt->src_addr) return;
+    if (flags & DNS_FLAG_QR) on_response(t, pkt, id, flags, qname, qtype);
+    else on_query(t, pkt, id, qname, qtype);
+}
+
+void dnstrack_get_stats(const DnsTracker *t, DnsTrackStats *out) {
+    *out = t->stats;
+    out->in_use = t->entries.in_use;
+}
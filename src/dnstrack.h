@@ -0,0 +1,59 @@
+// dnstrack.h - DNS query/response matching
+//
+// Each query is remembered by (family, client, server, client port,
+// transaction ID) until its response arrives or the timeout passes; a
+// matched response records the query-to-response time in a log-linear
+// histogram, its rcode, and the qname's latency total. Entries come from a
+// fixed per-worker pool and are kept on an age list (creation order =
+// expiry order), so memory is bounded however many queries a resolver
+// handles: when the pool is empty the oldest outstanding query is evicted.
+#ifndef DNSTRACK_H
+#define DNSTRACK_H
+
+#include <stdint.h>
+#include "packet.h"
+#include "histogram.h"
+
+#define DNSTRACK_DEFAULT_MAX_QUERIES 65536   // Outstanding, total across workers
+#define DNSTRACK_DEFAULT_TIMEOUT     5       // Seconds before a query counts as unanswered
+#define DNSTRACK_RCODES              16      // Header rcode is 4 bits
+
+typedef struct {
+    uint32_t max_queries;
+    uint32_t timeout_s;
+} DnsTrackConfig;
+
+typedef struct {
+    uint64_t queries;           // Queries seen (QR=0)
+    uint64_t responses;         // Responses seen (QR=1)
+    uint64_t matched;           // Responses paired with an outstanding query
+    uint64_t unmatched;         // No outstanding query: sent before the capture, timed out, evicted or spoofed
+    uint64_t mismatched;        // Key matched but the question differs (left outstanding)
+    uint64_t retransmits;       // Query repeated while the first is outstanding (timed from the first)
+    uint64_t unanswered;        // Timed out
+    uint64_t evictions;         // Oldest query dropped to make room
+    uint64_t rcodes[DNSTRACK_RCODES];   // Of matched responses
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t max_queries;
+    uint64_t memory_bytes;
+    LatencyHist latency;        // Matched responses, microseconds
+} DnsTrackStats;
+
+typedef struct DnsTracker DnsTracker;
+
+DnsTracker *dnstrack_create(const DnsTrackConfig *cfg);
+void dnstrack_destroy(DnsTracker *t);
+
+// One DNS message of the packet described by pkt (addresses, ports,
+// ts_us). qname is the first question ("" if there is none); responses
+// are matched on the key and, when both carry a question, qname and qtype.
+void dnstrack_message(DnsTracker *t, const packet_ctx_t *pkt, uint16_t id, uint16_t flags,
+                      const char *qname, uint16_t qtype);
+
+// Count queries older than the timeout as unanswered (called per packet and when idle)
+void dnstrack_expire(DnsTracker *t, uint64_t now_us);
+
+void dnstrack_get_stats(const DnsTracker *t, DnsTrackStats *out);
+
+#endif // DNSTRACK_H
@@ -8,8 +8,7 @@
 #include "stats.h"
 #include "logger.h"
 #include <stdio.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "platform.h"
 
 struct eth_header {
     unsigned char dest[6];
@@ -17,15 +16,16 @@ struct eth_header {
     unsigned short type;
 };
 
-void parse_ethernet(const u_char *data, int size) {
+void parse_ethernet(packet_ctx_t *pkt, const u_char *data, int size) {
     if (size < (int)sizeof(struct eth_header)) {
-        LOG_WARN_SIMPLE("Ethernet: Truncated frame\n");
+        stats_count_truncated(PROTO_ETHERNET);
+        LOG_DEBUG_SIMPLE("Ethernet: Truncated frame\n");
         return;
     }
 
     struct eth_header *eth = (struct eth_header *)data;
     
-    stats_increment("ETH");
+    stats_increment(PROTO_ETHERNET);
 
     LOG_DEBUG_SIMPLE("\n[Ethernet] Src MAC %02X:%02X:%02X:%02X:%02X:%02X, ",
            eth->src[0], eth->src[1], eth->src[2], eth->src[3], eth->src[4], eth->src[5]);
@@ -39,21 +39,21 @@ void parse_ethernet(const u_char *data, int size) {
     
     // Validate payload size is non-negative
     if (payload_size < 0) {
-        LOG_WARN_SIMPLE("Ethernet: Invalid payload size\n");
+        LOG_DEBUG_SIMPLE("Ethernet: Invalid payload size\n");
         return;
     }
 
     switch (eth_type) {
         case 0x0800:  // IPv4
-            stats_increment("IPv4");
-            parse_ipv4(payload, payload_size);
+            stats_increment(PROTO_IPV4);
+            parse_ipv4(pkt, payload, payload_size);
             break;
         case 0x86DD:  // IPv6
-            stats_increment("IPv6");
-            parse_ipv6(payload, payload_size);
+            stats_increment(PROTO_IPV6);
+            parse_ipv6(pkt, payload, payload_size);
             break;
         case 0x0806:  // ARP
-            stats_increment("ARP");
+            stats_increment(PROTO_ARP);
             parse_arp(payload, payload_size);
             break;
         default:
@@ -3,7 +3,8 @@
 #define ETHERNET_H
 
 #include <pcap.h>
+#include "packet.h"
 
-void parse_ethernet(const u_char *data, int size);
+void parse_ethernet(packet_ctx_t *pkt, const u_char *data, int size);
 
 #endif
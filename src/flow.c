@@ -0,0 +1,145 @@
+// flow.c - Bidirectional 5-tuple flow keys and symmetric hashing
+#include "flow.h"
+#include <string.h>
+
+#define ETH_HDR_LEN      14
+#define ETHERTYPE_IPV4   0x0800
+#define ETHERTYPE_IPV6   0x86DD
+#define MAX_V6_EXT_HDRS  8
+#define DNS_PORT         53
+
+void flow_key_make(flow_key_t *key, int family, uint8_t proto,
+                   const void *src, const void *dst, int addr_len,
+                   uint16_t sport, uint16_t dport, int *reversed) {
+    memset(key, 0, sizeof(*key));
+    key->family = (uint8_t)family;
+    key->proto = proto;
+
+    int cmp = memcmp(src, dst, addr_len);
+    int swap = cmp > 0 || (cmp == 0 && sport > dport);
+    if (swap) {
+        memcpy(key->addr_lo, dst, addr_len);
+        memcpy(key->addr_hi, src, addr_len);
+        key->port_lo = dport;
+        key->port_hi = sport;
+    } else {
+        memcpy(key->addr_lo, src, addr_len);
+        memcpy(key->addr_hi, dst, addr_len);
+        key->port_lo = sport;
+        key->port_hi = dport;
+    }
+    if (reversed) *reversed = swap;
+}
+
+static inline uint16_t read_be16(const u_char *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Ports for TCP and UDP (first 4 bytes of the header); 0/0 otherwise.
+// DNS is keyed without ports, like fragments: an EDNS answer is often
+// fragmented while its query was not, and only a ports-free key sends
+// both to the worker that tracks the query.
+static void l4_ports(uint8_t proto, const u_char *l4, int len, uint16_t *sport, uint16_t *dport) {
+    *sport = *dport = 0;
+    if ((proto == 6 || proto == 17) && len >= 4) {
+        *sport = read_be16(l4);
+        *dport = read_be16(l4 + 2);
+        if (proto == 17 && (*sport == DNS_PORT || *dport == DNS_PORT)) *sport = *dport = 0;
+    }
+}
+
+int flow_key_from_frame(const u_char *frame, int caplen, flow_key_t *key) {
+    memset(key, 0, sizeof(*key));
+    if (caplen < ETH_HDR_LEN) return -1;
+
+    uint16_t eth_type = read_be16(frame + 12);
+    const u_char *ip = frame + ETH_HDR_LEN;
+    int len = caplen - ETH_HDR_LEN;
+    uint16_t sport, dport;
+
+    if (eth_type == ETHERTYPE_IPV4) {
+        if (len < 20) return -1;
+        int ihl = (ip[0] & 0x0F) * 4;
+        if (ihl < 20 || ihl > len) return -1;
+        uint8_t proto = ip[9];
+        uint16_t ff = read_be16(ip + 6);
+        int fragment = (ff & 0x2000) || (ff & 0x1FFF);
+        if (fragment) {
+            sport = dport = 0;
+        } else {
+            l4_ports(proto, ip + ihl, len - ihl, &sport, &dport);
+        }
+        flow_key_make(key, 4, proto, ip + 12, ip + 16, 4, sport, dport, NULL);
+        return 0;
+    }
+
+    if (eth_type == ETHERTYPE_IPV6) {
+        if (len < 40) return -1;
+        uint8_t next = ip[6];
+        const u_char *p = ip + 40;
+        int remaining = len - 40;
+        int fragment = 0;
+
+        // Skip the common extension headers to reach the transport ports
+        for (int i = 0; i < MAX_V6_EXT_HDRS; i++) {
+            if (next == 0 || next == 43 || next == 60) {
+                if (remaining < 8) break;
+                int hdr_len = (p[1] + 1) * 8;
+                if (hdr_len > remaining) break;
+                next = p[0];
+                p += hdr_len;
+                remaining -= hdr_len;
+            } else if (next == 44) {
+                if (remaining < 8) break;
+                fragment = 1;
+                next = p[0];
+                p += 8;
+                remaining -= 8;
+                break;
+            } else {
+                break;
+            }
+        }
+        if (fragment) {
+            sport = dport = 0;
+        } else {
+            l4_ports(next, p, remaining, &sport, &dport);
+        }
+        flow_key_make(key, 6, next, ip + 8, ip + 24, 16, sport, dport, NULL);
+        return 0;
+    }
+
+    return -1;
+}
+
+// 32-bit finalizer from MurmurHash3
+static inline uint32_t fmix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline uint32_t mix_word(uint32_t h, uint32_t w) {
+    return fmix32(h ^ w) * 5 + 0xE6546B64u;
+}
+
+uint32_t flow_key_hash(const flow_key_t *key) {
+    uint32_t w[sizeof(flow_key_t) / 4];
+    memcpy(w, key, sizeof(w));
+
+    // Word layout: [0..3] addr_lo, [4..7] addr_hi, [8] ports, [9] proto/family
+    uint32_t h = 0x9747B28Cu;
+    if (key->family == 6) {
+        for (size_t i = 0; i < sizeof(w) / 4; i++) h = mix_word(h, w[i]);
+    } else {
+        // IPv4 keys only populate the first word of each address
+        h = mix_word(h, w[0]);
+        h = mix_word(h, w[4]);
+        h = mix_word(h, w[8]);
+        h = mix_word(h, w[9]);
+    }
+    return fmix32(h);
+}
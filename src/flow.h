@@ -0,0 +1,38 @@
+// flow.h - Bidirectional 5-tuple flow keys and symmetric hashing
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <pcap.h>
+#include <stdint.h>
+
+// Normalized key: the (addr, port) endpoint that sorts lower is stored
+// first, so both directions of a connection produce the same key.
+// IPv4 addresses occupy the first 4 bytes of the 16-byte fields.
+typedef struct {
+    uint8_t  addr_lo[16];
+    uint8_t  addr_hi[16];
+    uint16_t port_lo;
+    uint16_t port_hi;
+    uint8_t  proto;
+    uint8_t  family;     // 4 or 6 (0 = not IP)
+    uint8_t  pad[2];     // Always zero so keys can be compared with memcmp
+} flow_key_t;
+
+// Build a normalized key from raw endpoints. addr_len is 4 or 16.
+// *reversed is set to 1 when src/dst were swapped during normalization.
+void flow_key_make(flow_key_t *key, int family, uint8_t proto,
+                   const void *src, const void *dst, int addr_len,
+                   uint16_t sport, uint16_t dport, int *reversed);
+
+// Lightweight Ethernet/IP/L4 header walk used for steering before full
+// parsing. TCP and UDP are keyed on the 5-tuple. IP fragments carry no
+// ports and are keyed on addresses + protocol, so every fragment of a
+// datagram lands on the same worker; so is UDP to or from port 53, so a
+// DNS query and its fragmented answer do too. Returns 0 if the frame is
+// IPv4/IPv6, -1 otherwise (key zeroed).
+int flow_key_from_frame(const u_char *frame, int caplen, flow_key_t *key);
+
+// Symmetric by construction (hashes the normalized key)
+uint32_t flow_key_hash(const flow_key_t *key);
+
+#endif // FLOW_H
@@ -0,0 +1,317 @@
+// flowtable.c - Per-worker connection tracking table
+#include "flowtable.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WHEEL_SLOTS 4096          // One-second buckets (power of two); longer deadlines are re-checked
+#define WHEEL_MASK  (WHEEL_SLOTS - 1)
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+// Index entry: the full hash lets most probe mismatches skip the record
+typedef struct {
+    uint32_t hash;
+    uint32_t rec;                 // Pool index + 1 (0 = empty)
+} FlowSlot;
+
+struct FlowTable {
+    FlowSlot *slots;
+    uint32_t slot_mask;
+    FlowRecord *pool;
+    uint32_t capacity;
+    uint32_t free_head;           // Free list threaded through timer_next
+
+    uint32_t wheel[WHEEL_SLOTS];  // Bucket list heads
+    uint64_t wheel_tick;          // Last processed second
+    int wheel_started;
+
+    FlowTableConfig cfg;
+    flow_expire_fn on_expire;
+    void *user;
+    FlowTableStats stats;
+};
+
+static uint32_t round_up_pow2(uint32_t v) {
+    uint32_t p = 1;
+    while (p < v && p < 0x80000000u) p <<= 1;
+    return p;
+}
+
+FlowTable *flow_table_create(const FlowTableConfig *cfg, flow_expire_fn on_expire, void *user) {
+    FlowTable *t = (FlowTable *)calloc(1, sizeof(FlowTable));
+    if (!t) return NULL;
+    t->cfg = *cfg;
+    if (t->cfg.max_flows == 0) t->cfg.max_flows = FLOW_DEFAULT_MAX_FLOWS;
+    if (t->cfg.idle_timeout_s == 0) t->cfg.idle_timeout_s = FLOW_DEFAULT_IDLE_TIMEOUT;
+    if (t->cfg.active_timeout_s == 0) t->cfg.active_timeout_s = FLOW_DEFAULT_ACTIVE_TIMEOUT;
+    t->on_expire = on_expire;
+    t->user = user;
+
+    // Index at <= 50% load keeps probe sequences short
+    t->capacity = t->cfg.max_flows;
+    uint32_t nslots = round_up_pow2(t->capacity * 2u);
+    t->slot_mask = nslots - 1;
+    t->slots = (FlowSlot *)calloc(nslots, sizeof(FlowSlot));
+    t->pool = (FlowRecord *)malloc((size_t)t->capacity * sizeof(FlowRecord));
+    if (!t->slots || !t->pool) {
+        fprintf(stderr, "[!] Failed to allocate flow table (%u flows)\n", t->capacity);
+        flow_table_destroy(t);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < t->capacity; i++) {
+        t->pool[i].in_use = 0;
+        t->pool[i].timer_next = (i + 1 < t->capacity) ? i + 1 : FLOW_NIL;
+    }
+    t->free_head = 0;
+    for (uint32_t i = 0; i < WHEEL_SLOTS; i++) t->wheel[i] = FLOW_NIL;
+
+    t->stats.capacity = t->capacity;
+    t->stats.memory_bytes = (uint64_t)nslots * sizeof(FlowSlot) +
+                            (uint64_t)t->capacity * sizeof(FlowRecord);
+    return t;
+}
+
+void flow_table_destroy(FlowTable *t) {
+    if (!t) return;
+    free(t->slots);
+    free(t->pool);
+    free(t);
+}
+
+// ---------------------------
+// Open-Addressing Index
+// ---------------------------
+static uint32_t index_find(const FlowTable *t, const flow_key_t *key, uint32_t hash, uint32_t *pos) {
+    uint32_t i = hash & t->slot_mask;
+    for (;;) {
+        const FlowSlot *s = &t->slots[i];
+        if (s->rec == 0) {
+            *pos = i;            // First empty slot: insertion point
+            return FLOW_NIL;
+        }
+        if (s->hash == hash && memcmp(&t->pool[s->rec - 1].key, key, sizeof(*key)) == 0) {
+            *pos = i;
+            return s->rec - 1;
+        }
+        i = (i + 1) & t->slot_mask;
+    }
+}
+
+// Backward-shift deletion: pull later entries of the probe run into the
+// hole so lookups never need tombstones
+static void index_remove(FlowTable *t, uint32_t idx) {
+    uint32_t i = t->pool[idx].hash & t->slot_mask;
+    while (t->slots[i].rec != idx + 1) i = (i + 1) & t->slot_mask;
+
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & t->slot_mask;
+        if (t->slots[j].rec == 0) break;
+        uint32_t home = t->slots[j].hash & t->slot_mask;
+        // Entry j may move into hole i only if its home is not in (i, j]
+        int home_between = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (home_between) continue;
+        t->slots[i] = t->slots[j];
+        i = j;
+    }
+    t->slots[i].rec = 0;
+}
+
+// ---------------------------
+// Timer Wheel
+// ---------------------------
+static uint64_t flow_deadline_s(const FlowTable *t, const FlowRecord *f) {
+    uint32_t idle = (f->tcp_state == FLOW_TCP_CLOSED) ? FLOW_CLOSED_TIMEOUT : t->cfg.idle_timeout_s;
+    uint64_t idle_s = f->last_us / 1000000u + idle;
+    uint64_t active_s = f->first_us / 1000000u + t->cfg.active_timeout_s;
+    return idle_s < active_s ? idle_s : active_s;
+}
+
+static void timer_unlink(FlowTable *t, uint32_t idx) {
+    FlowRecord *f = &t->pool[idx];
+    if (f->timer_prev != FLOW_NIL) t->pool[f->timer_prev].timer_next = f->timer_next;
+    else t->wheel[f->timer_slot] = f->timer_next;
+    if (f->timer_next != FLOW_NIL) t->pool[f->timer_next].timer_prev = f->timer_prev;
+}
+
+static void timer_schedule(FlowTable *t, uint32_t idx) {
+    FlowRecord *f = &t->pool[idx];
+    uint64_t deadline = flow_deadline_s(t, f);
+    uint64_t delta = deadline > t->wheel_tick ? deadline - t->wheel_tick : 1;
+    if (delta >= WHEEL_SLOTS) delta = WHEEL_SLOTS - 1;   // Re-checked when the bucket fires
+    uint32_t slot = (uint32_t)((t->wheel_tick + delta) & WHEEL_MASK);
+
+    f->timer_slot = (uint16_t)slot;
+    f->timer_prev = FLOW_NIL;
+    f->timer_next = t->wheel[slot];
+    if (f->timer_next != FLOW_NIL) t->pool[f->timer_next].timer_prev = idx;
+    t->wheel[slot] = idx;
+}
+
+static void flow_release(FlowTable *t, uint32_t idx, flow_end_reason_t reason) {
+    FlowRecord *f = &t->pool[idx];
+    if (t->on_expire) t->on_expire(t->user, f, reason);
+    switch (reason) {
+        case FLOW_END_IDLE:     t->stats.expired_idle++; break;
+        case FLOW_END_ACTIVE:   t->stats.expired_active++; break;
+        case FLOW_END_CLOSED:   t->stats.closed++; break;
+        case FLOW_END_SHUTDOWN: t->stats.shutdown++; break;
+    }
+    index_remove(t, idx);
+    f->in_use = 0;
+    f->timer_next = t->free_head;
+    t->free_head = idx;
+    t->stats.active--;
+}
+
+// Check every flow in one bucket: expire the due ones, re-file the rest
+static void wheel_fire(FlowTable *t, uint32_t slot, uint64_t now_s) {
+    uint32_t idx = t->wheel[slot];
+    t->wheel[slot] = FLOW_NIL;
+    while (idx != FLOW_NIL) {
+        FlowRecord *f = &t->pool[idx];
+        uint32_t next = f->timer_next;
+        if (next != FLOW_NIL) t->pool[next].timer_prev = FLOW_NIL;
+
+        if (flow_deadline_s(t, f) <= now_s) {
+            flow_end_reason_t reason;
+            if (f->tcp_state == FLOW_TCP_CLOSED) reason = FLOW_END_CLOSED;
+            else if (f->first_us / 1000000u + t->cfg.active_timeout_s <= now_s) reason = FLOW_END_ACTIVE;
+            else reason = FLOW_END_IDLE;
+            flow_release(t, idx, reason);
+        } else {
+            timer_schedule(t, idx);
+        }
+        idx = next;
+    }
+}
+
+void flow_table_advance(FlowTable *t, uint64_t now_us) {
+    uint64_t now_s = now_us / 1000000u;
+    if (!t->wheel_started) {
+        t->wheel_tick = now_s;
+        t->wheel_started = 1;
+        return;
+    }
+    // One full revolution checks every bucket; skip the rest of a long gap
+    uint32_t steps = 0;
+    while (t->wheel_tick < now_s && steps < WHEEL_SLOTS) {
+        t->wheel_tick++;
+        steps++;
+        wheel_fire(t, (uint32_t)(t->wheel_tick & WHEEL_MASK), t->wheel_tick);
+    }
+    if (t->wheel_tick < now_s) t->wheel_tick = now_s;
+}
+
+// ---------------------------
+// Tracking
+// ---------------------------
+static void tcp_update(FlowRecord *f, int dir, uint8_t flags) {
+    f->tcp_flags[dir] |= flags;
+    if (flags & TCP_RST) {
+        f->tcp_state = FLOW_TCP_CLOSED;
+        return;
+    }
+    switch (f->tcp_state) {
+        case FLOW_TCP_NONE:
+            // First packet of a flow picked up mid-stream counts as established
+            if ((flags & (TCP_SYN | TCP_ACK)) == TCP_SYN) f->tcp_state = FLOW_TCP_SYN_SENT;
+            else if ((flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK)) f->tcp_state = FLOW_TCP_SYN_RECEIVED;
+            else f->tcp_state = FLOW_TCP_ESTABLISHED;
+            break;
+        case FLOW_TCP_SYN_SENT:
+            if (dir == FLOW_DIR_REVERSE && (flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK))
+                f->tcp_state = FLOW_TCP_SYN_RECEIVED;
+            break;
+        case FLOW_TCP_SYN_RECEIVED:
+            if (dir == FLOW_DIR_FORWARD && (flags & TCP_ACK)) f->tcp_state = FLOW_TCP_ESTABLISHED;
+            break;
+        default:
+            break;
+    }
+    if ((f->tcp_flags[0] & TCP_FIN) && (f->tcp_flags[1] & TCP_FIN)) {
+        f->tcp_state = FLOW_TCP_CLOSED;
+    } else if ((flags & TCP_FIN) && f->tcp_state != FLOW_TCP_CLOSED) {
+        f->tcp_state = FLOW_TCP_CLOSING;
+    }
+}
+
+FlowRecord *flow_table_track(FlowTable *t, const flow_key_t *key, int reversed,
+                             uint64_t ts_us, uint32_t bytes, int is_tcp, uint8_t tcp_flags,
+                             int *dir) {
+    flow_table_advance(t, ts_us);
+
+    uint32_t hash = flow_key_hash(key);
+    uint32_t pos;
+    uint32_t idx = index_find(t, key, hash, &pos);
+    FlowRecord *f;
+
+    if (idx == FLOW_NIL) {
+        if (t->free_head == FLOW_NIL) {
+            t->stats.table_full++;
+            return NULL;
+        }
+        idx = t->free_head;
+        f = &t->pool[idx];
+        t->free_head = f->timer_next;
+
+        memset(f, 0, sizeof(*f));
+        f->key = *key;
+        f->hash = hash;
+        f->first_us = ts_us;
+        f->last_us = ts_us;
+        f->in_use = 1;
+        // A SYN+ACK first means we missed the SYN: its sender is the responder
+        int syn_ack = is_tcp && (tcp_flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK);
+        f->init_reversed = (uint8_t)(syn_ack ? !reversed : reversed);
+        f->tcp_state = FLOW_TCP_NONE;
+
+        t->slots[pos].hash = hash;
+        t->slots[pos].rec = idx + 1;
+        t->stats.created++;
+        if (++t->stats.active > t->stats.peak_active) t->stats.peak_active = t->stats.active;
+        timer_schedule(t, idx);
+    } else {
+        f = &t->pool[idx];
+    }
+
+    int d = ((reversed != 0) != (f->init_reversed != 0)) ? FLOW_DIR_REVERSE : FLOW_DIR_FORWARD;
+    f->packets[d]++;
+    f->bytes[d] += bytes;
+    if (ts_us > f->last_us) f->last_us = ts_us;
+
+    if (is_tcp) {
+        int was_closed = f->tcp_state == FLOW_TCP_CLOSED;
+        tcp_update(f, d, tcp_flags);
+        // Pull a just-closed flow forward to the short closed timeout
+        if (!was_closed && f->tcp_state == FLOW_TCP_CLOSED) {
+            timer_unlink(t, idx);
+            timer_schedule(t, idx);
+        }
+    }
+
+    if (dir) *dir = d;
+    return f;
+}
+
+void flow_table_flush(FlowTable *t) {
+    for (uint32_t slot = 0; slot < WHEEL_SLOTS; slot++) {
+        uint32_t idx = t->wheel[slot];
+        t->wheel[slot] = FLOW_NIL;
+        while (idx != FLOW_NIL) {
+            uint32_t next = t->pool[idx].timer_next;
+            flow_release(t, idx, FLOW_END_SHUTDOWN);
+            idx = next;
+        }
+    }
+}
+
+void flow_table_get_stats(const FlowTable *t, FlowTableStats *out) {
+    *out = t->stats;
+}
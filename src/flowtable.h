@@ -0,0 +1,101 @@
+// flowtable.h - Per-worker connection tracking table
+//
+// Open addressing (linear probing, backward-shift deletion) over a
+// preallocated pool of flow records: capacity is fixed at creation, so
+// there is never a rehash. Expiry runs from a one-second timer wheel that
+// is advanced by packet timestamps; flows are re-checked lazily when
+// their bucket fires instead of being moved on every packet.
+#ifndef FLOWTABLE_H
+#define FLOWTABLE_H
+
+#include <stdint.h>
+#include "flow.h"
+
+#define FLOW_DEFAULT_MAX_FLOWS       (1u << 20)   // Total across workers
+#define FLOW_DEFAULT_IDLE_TIMEOUT    120          // Seconds without packets
+#define FLOW_DEFAULT_ACTIVE_TIMEOUT  1800         // Seconds since first packet (long flows are cut and restarted)
+#define FLOW_CLOSED_TIMEOUT          10           // Idle timeout once a TCP flow has seen RST or FIN both ways
+
+#define FLOW_NIL 0xFFFFFFFFu
+
+// Direction indices for the per-direction counters
+#define FLOW_DIR_FORWARD 0   // Initiator -> responder
+#define FLOW_DIR_REVERSE 1
+
+typedef enum {
+    FLOW_TCP_NONE = 0,       // Not TCP
+    FLOW_TCP_SYN_SENT,
+    FLOW_TCP_SYN_RECEIVED,
+    FLOW_TCP_ESTABLISHED,
+    FLOW_TCP_CLOSING,        // FIN seen in one direction
+    FLOW_TCP_CLOSED          // FIN both ways or RST
+} flow_tcp_state_t;
+
+typedef enum {
+    FLOW_END_IDLE = 0,
+    FLOW_END_ACTIVE,
+    FLOW_END_CLOSED,         // TCP teardown, then FLOW_CLOSED_TIMEOUT
+    FLOW_END_SHUTDOWN
+} flow_end_reason_t;
+
+typedef struct FlowRecord {
+    flow_key_t key;
+    uint64_t first_us;
+    uint64_t last_us;
+    uint64_t packets[2];     // Indexed by FLOW_DIR_*
+    uint64_t bytes[2];       // Wire bytes (header->len)
+    uint32_t hash;
+    uint32_t timer_next;     // Wheel bucket list (pool indices)
+    uint32_t timer_prev;
+    uint16_t timer_slot;
+    uint8_t  tcp_flags[2];   // OR of all flags seen per direction
+    uint8_t  tcp_state;      // flow_tcp_state_t
+    uint8_t  init_reversed;  // Key normalization swapped the initiator's addresses
+    uint8_t  in_use;
+    uint8_t  dissector;      // Heuristic dissector chosen for the flow (dissect.c), 0 = not tried yet
+    void *app;               // Analyzer-owned per-flow state (TCP session), freed by the expire callback
+} FlowRecord;
+
+typedef struct {
+    uint64_t created;
+    uint64_t expired_idle;
+    uint64_t expired_active;
+    uint64_t closed;
+    uint64_t shutdown;
+    uint64_t table_full;     // Packets not tracked because the pool was exhausted
+    uint32_t active;
+    uint32_t peak_active;
+    uint32_t capacity;
+    uint64_t memory_bytes;
+} FlowTableStats;
+
+typedef struct {
+    uint32_t max_flows;
+    uint32_t idle_timeout_s;
+    uint32_t active_timeout_s;
+} FlowTableConfig;
+
+typedef struct FlowTable FlowTable;
+
+// Called just before a record is released (flow_table_track never returns it again)
+typedef void (*flow_expire_fn)(void *user, const FlowRecord *flow, flow_end_reason_t reason);
+
+FlowTable *flow_table_create(const FlowTableConfig *cfg, flow_expire_fn on_expire, void *user);
+void flow_table_destroy(FlowTable *t);
+
+// Find or create the flow for a normalized key and account one packet.
+// reversed is the flag returned by flow_key_make for this packet; *dir
+// receives FLOW_DIR_*. Returns NULL when the table is full.
+FlowRecord *flow_table_track(FlowTable *t, const flow_key_t *key, int reversed,
+                             uint64_t ts_us, uint32_t bytes, int is_tcp, uint8_t tcp_flags,
+                             int *dir);
+
+// Run the timer wheel up to now_us without a packet (idle live capture)
+void flow_table_advance(FlowTable *t, uint64_t now_us);
+
+// Expire every remaining flow with FLOW_END_SHUTDOWN
+void flow_table_flush(FlowTable *t);
+
+void flow_table_get_stats(const FlowTable *t, FlowTableStats *out);
+
+#endif // FLOWTABLE_H
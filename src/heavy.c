@@ -0,0 +1,300 @@
+#include "heavy.h"
+#include "platform.h"   // inet_ntop
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef char heavy_key_is_words[sizeof(HeavyKey) == 40 ? 1 : -1];
+
+// Five independent multiplies folded together, then a full avalanche
+// (MurmurHash3 fmix64). The high half picks the index slot, both halves
+// drive the Count-Min rows (h1 + i * h2).
+uint64_t heavy_key_hash(const HeavyKey *key) {
+    uint64_t h = key->w[0] * 0x9E3779B97F4A7C15ull + key->w[1] * 0xC2B2AE3D27D4EB4Full +
+                 key->w[2] * 0x165667B19E3779F9ull + key->w[3] * 0xD6E8FEB86659FD93ull +
+                 key->w[4] * 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 33);
+}
+
+static int key_equal(const HeavyKey *a, const HeavyKey *b) {
+    return ((a->w[0] ^ b->w[0]) | (a->w[1] ^ b->w[1]) | (a->w[2] ^ b->w[2]) |
+            (a->w[3] ^ b->w[3]) | (a->w[4] ^ b->w[4])) == 0;
+}
+
+// ---------------------------
+// Count-Min (conservative update)
+// ---------------------------
+static void cm_positions(uint64_t h, uint32_t *pos) {
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1u;
+    for (int i = 0; i < HEAVY_CM_DEPTH; i++) pos[i] = (h1 + (uint32_t)i * h2) & (HEAVY_CM_WIDTH - 1);
+}
+
+// Raise only the cells below the new estimate: same upper bound, less
+// overshoot. Returns the key's estimate including this weight. Written
+// without data-dependent branches (cmov); random keys mispredict them.
+static uint32_t cm_update(HeavySketch *s, uint64_t h, uint32_t weight) {
+    uint32_t pos[HEAVY_CM_DEPTH];
+    cm_positions(h, pos);
+    uint32_t min = s->cm[0][pos[0]];
+    for (int i = 1; i < HEAVY_CM_DEPTH; i++) {
+        uint32_t c = s->cm[i][pos[i]];
+        min = c < min ? c : min;
+    }
+    uint32_t target = min > UINT32_MAX - weight ? UINT32_MAX : min + weight;
+    for (int i = 0; i < HEAVY_CM_DEPTH; i++) {
+        uint32_t c = s->cm[i][pos[i]];
+        s->cm[i][pos[i]] = c < target ? target : c;
+    }
+    return target;
+}
+
+static uint64_t cm_estimate(const HeavySketch *s, uint64_t h) {
+    uint32_t pos[HEAVY_CM_DEPTH];
+    cm_positions(h, pos);
+    uint32_t min = s->cm[0][pos[0]];
+    for (int i = 1; i < HEAVY_CM_DEPTH; i++) {
+        uint32_t c = s->cm[i][pos[i]];
+        min = c < min ? c : min;
+    }
+    return min;
+}
+
+// ---------------------------
+// Space-Saving Counters
+// ---------------------------
+static void heap_swap(HeavySketch *s, uint32_t a, uint32_t b) {
+    uint16_t t = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = t;
+    s->entries[s->heap[a]].heap_pos = (uint16_t)a;
+    s->entries[s->heap[b]].heap_pos = (uint16_t)b;
+}
+
+static void sift_down(HeavySketch *s, uint32_t pos) {
+    for (;;) {
+        uint32_t l = 2 * pos + 1, r = l + 1, min = pos;
+        if (l < s->used && s->entries[s->heap[l]].count < s->entries[s->heap[min]].count) min = l;
+        if (r < s->used && s->entries[s->heap[r]].count < s->entries[s->heap[min]].count) min = r;
+        if (min == pos) return;
+        heap_swap(s, pos, min);
+        pos = min;
+    }
+}
+
+static void sift_up(HeavySketch *s, uint32_t pos) {
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (s->entries[s->heap[parent]].count <= s->entries[s->heap[pos]].count) return;
+        heap_swap(s, pos, parent);
+        pos = parent;
+    }
+}
+
+// Index slots hold the entry index + 1 in the low 16 bits and the top 16
+// hash bits above them, so a probe rarely has to touch an entry
+#define SLOT_TAG(hash) ((hash) & 0xFFFF0000u)
+#define SLOT_ENTRY(v)  (((v) & 0xFFFFu) - 1)
+
+static void index_insert(HeavySketch *s, uint32_t hash, uint16_t idx) {
+    uint32_t slot = hash & (HEAVY_SLOTS - 1);
+    while (s->index[slot]) slot = (slot + 1) & (HEAVY_SLOTS - 1);
+    s->index[slot] = SLOT_TAG(hash) | (uint32_t)(idx + 1);
+}
+
+// Linear-probing delete: pull later entries of the run back into the hole
+static void index_remove(HeavySketch *s, uint16_t idx) {
+    uint32_t i = s->entries[idx].hash & (HEAVY_SLOTS - 1);
+    while (SLOT_ENTRY(s->index[i]) != idx) i = (i + 1) & (HEAVY_SLOTS - 1);
+    for (;;) {
+        s->index[i] = 0;
+        uint32_t j = i;
+        for (;;) {
+            j = (j + 1) & (HEAVY_SLOTS - 1);
+            if (!s->index[j]) return;
+            uint32_t home = s->entries[SLOT_ENTRY(s->index[j])].hash & (HEAVY_SLOTS - 1);
+            int movable = j > i ? (home <= i || home > j) : (home <= i && home > j);
+            if (movable) {
+                s->index[i] = s->index[j];
+                i = j;
+                break;
+            }
+        }
+    }
+}
+
+static const HeavyEntry *find(const HeavySketch *s, const HeavyKey *key, uint32_t hash) {
+    uint32_t tag = SLOT_TAG(hash);
+    for (uint32_t slot = hash & (HEAVY_SLOTS - 1); s->index[slot]; slot = (slot + 1) & (HEAVY_SLOTS - 1)) {
+        uint32_t v = s->index[slot];
+        if (SLOT_TAG(v) != tag) continue;
+        const HeavyEntry *e = &s->entries[SLOT_ENTRY(v)];
+        if (e->hash == hash && key_equal(&e->key, key)) return e;
+    }
+    return NULL;
+}
+
+void heavy_clear(HeavySketch *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void heavy_add(HeavySketch *s, const HeavyKey *key, uint32_t weight) {
+    heavy_add_hashed(s, key, heavy_key_hash(key), weight);
+}
+
+void heavy_add_hashed(HeavySketch *s, const HeavyKey *key, uint64_t h, uint32_t weight) {
+    uint32_t hash = (uint32_t)(h >> 32);
+    uint32_t estimate = cm_update(s, h, weight);
+    s->total += weight;
+
+    // A monitored key's count never exceeds its estimate (both grow by
+    // weight, and it entered at its estimate), so a key estimated below
+    // the smallest counter is neither monitored nor about to be: the
+    // common case during a scan costs no index probe
+    if (s->used == HEAVY_CAPACITY && estimate < s->entries[s->heap[0]].count) return;
+
+    HeavyEntry *e = (HeavyEntry *)find(s, key, hash);
+    if (e) {
+        e->count += weight;
+        sift_down(s, e->heap_pos);
+        return;
+    }
+
+    uint16_t idx;
+    int evicted = 0;
+    if (s->used < HEAVY_CAPACITY) {
+        idx = (uint16_t)s->used++;
+        e = &s->entries[idx];
+        e->heap_pos = idx;
+        s->heap[idx] = idx;
+    } else {
+        // Full: only a key whose Count-Min estimate beats the smallest
+        // counter takes its place. Rejected keys stay at or below that
+        // minimum, the same bound Space-Saving keeps, and a scan of one-off
+        // keys costs a sketch update instead of an eviction each.
+        idx = s->heap[0];
+        e = &s->entries[idx];
+        if (estimate <= e->count) return;
+        index_remove(s, idx);
+        evicted = 1;
+    }
+    e->key = *key;
+    e->hash = hash;
+    e->count = estimate;
+    e->error = estimate - weight;
+    index_insert(s, hash, idx);
+    if (evicted) sift_down(s, e->heap_pos);
+    else sift_up(s, e->heap_pos);
+}
+
+static int entry_by_count(const void *a, const void *b) {
+    uint64_t ca = ((const HeavyEntry *)a)->count, cb = ((const HeavyEntry *)b)->count;
+    if (ca != cb) return ca < cb ? 1 : -1;
+    return memcmp(&((const HeavyEntry *)a)->key, &((const HeavyEntry *)b)->key, sizeof(HeavyKey));
+}
+
+static uint64_t min_count(const HeavySketch *s) {
+    return s->used == HEAVY_CAPACITY ? s->entries[s->heap[0]].count : 0;
+}
+
+// A key missing from a full summary may have had up to its minimum count
+// there, so it is charged that much (upper bound and error alike); the
+// largest HEAVY_CAPACITY candidates survive.
+void heavy_merge(HeavySketch *into, const HeavySketch *from) {
+    static HeavyEntry cand[2 * HEAVY_CAPACITY];   // Merging thread only
+    uint64_t min_into = min_count(into), min_from = min_count(from);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < into->used; i++) {
+        const HeavyEntry *e = &into->entries[i];
+        const HeavyEntry *f = find(from, &e->key, e->hash);
+        cand[n] = *e;
+        cand[n].count += f ? f->count : min_from;
+        cand[n].error += f ? f->error : min_from;
+        n++;
+    }
+    for (uint32_t i = 0; i < from->used; i++) {
+        const HeavyEntry *f = &from->entries[i];
+        if (find(into, &f->key, f->hash)) continue;
+        cand[n] = *f;
+        cand[n].count += min_into;
+        cand[n].error += min_into;
+        n++;
+    }
+    for (int r = 0; r < HEAVY_CM_DEPTH; r++) {
+        for (int c = 0; c < HEAVY_CM_WIDTH; c++) {
+            uint32_t a = into->cm[r][c], b = from->cm[r][c];
+            into->cm[r][c] = a > UINT32_MAX - b ? UINT32_MAX : a + b;
+        }
+    }
+    into->total += from->total;
+
+    // Cap each count at the merged estimate, keeping its lower bound, so
+    // counts stay within estimates for later adds
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t cm = cm_estimate(into, heavy_key_hash(&cand[i].key));
+        if (cand[i].count <= cm) continue;
+        uint64_t lower = cand[i].count - cand[i].error;
+        cand[i].count = cm;
+        cand[i].error = cm > lower ? cm - lower : 0;
+    }
+    qsort(cand, n, sizeof(HeavyEntry), entry_by_count);
+    if (n > HEAVY_CAPACITY) n = HEAVY_CAPACITY;
+
+    memset(into->index, 0, sizeof(into->index));
+    into->used = n;
+    for (uint32_t i = 0; i < n; i++) {
+        into->entries[i] = cand[i];
+        into->entries[i].heap_pos = (uint16_t)i;
+        into->heap[i] = (uint16_t)i;
+        index_insert(into, cand[i].hash, (uint16_t)i);
+    }
+    for (uint32_t i = n / 2; i-- > 0;) sift_down(into, i);
+}
+
+static int item_by_count(const void *a, const void *b) {
+    uint64_t ca = ((const HeavyItem *)a)->count, cb = ((const HeavyItem *)b)->count;
+    if (ca != cb) return ca < cb ? 1 : -1;
+    return memcmp(&((const HeavyItem *)a)->key, &((const HeavyItem *)b)->key, sizeof(HeavyKey));
+}
+
+size_t heavy_top(const HeavySketch *s, HeavyItem *out, size_t max) {
+    static HeavyItem items[HEAVY_CAPACITY];       // Reporting thread only
+    for (uint32_t i = 0; i < s->used; i++) {
+        const HeavyEntry *e = &s->entries[i];
+        uint64_t cm = cm_estimate(s, heavy_key_hash(&e->key));
+        uint64_t upper = e->count < cm ? e->count : cm;
+        uint64_t lower = e->count - e->error;
+        if (lower > upper) lower = upper;
+        items[i].key = e->key;
+        items[i].count = upper;
+        items[i].error = upper - lower;
+    }
+    qsort(items, s->used, sizeof(HeavyItem), item_by_count);
+    size_t n = s->used < max ? s->used : max;
+    memcpy(out, items, n * sizeof(HeavyItem));
+    return n;
+}
+
+static void format_addr(uint8_t family, const uint8_t *addr, char *buf, size_t len) {
+    if (!inet_ntop(family == 6 ? AF_INET6 : AF_INET, addr, buf, (socklen_t)len)) snprintf(buf, len, "?");
+}
+
+void heavy_key_format(const HeavyKey *key, char *buf, size_t len) {
+    if (key->kind == HEAVY_KEY_PORT) {
+        const char *proto = key->proto == 6 ? "tcp" : key->proto == 17 ? "udp" : NULL;
+        if (proto) snprintf(buf, len, "%s/%u", proto, key->port);
+        else snprintf(buf, len, "%u/%u", key->proto, key->port);
+        return;
+    }
+    char a[INET6_ADDRSTRLEN], b[INET6_ADDRSTRLEN];
+    format_addr(key->family, key->addr, a, sizeof(a));
+    if (key->kind != HEAVY_KEY_PAIR) {
+        snprintf(buf, len, "%s", a);
+        return;
+    }
+    format_addr(key->family, key->addr2, b, sizeof(b));
+    snprintf(buf, len, "%s -> %s", a, b);
+}
@@ -0,0 +1,111 @@
+// heavy.h - Heavy-hitter sketch (Space-Saving top-K with a Count-Min bound)
+//
+// Constant memory whatever the key distribution: a conservative-update
+// Count-Min sketch bounds every key's count from above, and HEAVY_CAPACITY
+// Space-Saving counters hold the current candidates. Once they are full a
+// newcomer replaces the smallest only when its Count-Min estimate is
+// larger, entering with that estimate as its count and as its error. Any
+// key above total / HEAVY_CAPACITY is guaranteed a counter. Sketches of the same
+// shape merge (Space-Saving by the mergeable-summaries rule, Count-Min
+// cell by cell), so per-worker sketches combine into one per interval.
+// Not thread safe: each worker adds to its own.
+#ifndef HEAVY_H
+#define HEAVY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HEAVY_CAPACITY   256                   // Space-Saving counters
+#define HEAVY_SLOTS      (HEAVY_CAPACITY * 4)  // Key index (open addressing)
+#define HEAVY_CM_DEPTH   4
+#define HEAVY_CM_WIDTH   1024                  // Power of two
+
+typedef enum {
+    HEAVY_KEY_ADDR = 1,
+    HEAVY_KEY_PAIR,              // Source and destination address
+    HEAVY_KEY_PORT               // Transport protocol and port
+} heavy_key_t;
+
+// An address, an address pair or a transport port. Unused bytes are zero
+// so keys hash and compare as five words; build them with the helpers
+// below, which store whole words.
+typedef union {
+    struct {
+        uint8_t kind;            // heavy_key_t
+        uint8_t family;          // Addresses: 4 or 6
+        uint8_t proto;           // Ports: 6 (TCP) or 17 (UDP)
+        uint8_t pad;
+        uint16_t port;
+        uint16_t pad2;
+        uint8_t addr[16];        // Source (or the only) address
+        uint8_t addr2[16];       // Destination of a pair
+    };
+    uint64_t w[5];
+} HeavyKey;
+
+// One address (addr2 NULL) or a pair; 4 or 16 bytes each per family
+static inline void heavy_key_addr(HeavyKey *k, uint8_t family, const unsigned char *addr,
+                                  const unsigned char *addr2) {
+    k->w[0] = (uint64_t)(addr2 ? HEAVY_KEY_PAIR : HEAVY_KEY_ADDR) | (uint64_t)family << 8;
+    if (family == 6) {
+        memcpy(&k->w[1], addr, 16);
+        if (addr2) memcpy(&k->w[3], addr2, 16);
+        else k->w[3] = k->w[4] = 0;
+    } else {
+        uint32_t a = 0, b = 0;   // Whole-word stores: hashing reads the words straight back
+        memcpy(&a, addr, 4);
+        if (addr2) memcpy(&b, addr2, 4);
+        k->w[1] = a;
+        k->w[3] = b;
+        k->w[2] = k->w[4] = 0;
+    }
+}
+
+// Word 0 is composed directly (little-endian field order)
+static inline void heavy_key_port(HeavyKey *k, uint8_t proto, uint16_t port) {
+    k->w[0] = (uint64_t)HEAVY_KEY_PORT | (uint64_t)proto << 16 | (uint64_t)port << 32;
+    k->w[1] = k->w[2] = k->w[3] = k->w[4] = 0;
+}
+
+typedef struct {
+    HeavyKey key;
+    uint64_t count;              // Upper bound on the key's weight
+    uint64_t error;              // count - error is a lower bound
+    uint32_t hash;
+    uint16_t heap_pos;
+} HeavyEntry;
+
+typedef struct {
+    uint64_t total;              // Weight added (or merged) so far
+    uint32_t used;
+    uint16_t heap[HEAVY_CAPACITY];     // Entry indices, min-heap on count
+    uint32_t index[HEAVY_SLOTS];       // Hash tag | entry index + 1, 0 = empty
+    HeavyEntry entries[HEAVY_CAPACITY];
+    uint32_t cm[HEAVY_CM_DEPTH][HEAVY_CM_WIDTH];
+} HeavySketch;
+
+// One reported key: the tighter of the two upper bounds and how far below
+// it the true count may be
+typedef struct {
+    HeavyKey key;
+    uint64_t count;
+    uint64_t error;
+} HeavyItem;
+
+void heavy_clear(HeavySketch *s);
+void heavy_add(HeavySketch *s, const HeavyKey *key, uint32_t weight);
+
+// 64-bit avalanche hash of a key. Callers that feed the same key to other
+// sketches hash it once and pass the result to heavy_add_hashed.
+uint64_t heavy_key_hash(const HeavyKey *key);
+void heavy_add_hashed(HeavySketch *s, const HeavyKey *key, uint64_t hash, uint32_t weight);
+void heavy_merge(HeavySketch *into, const HeavySketch *from);
+
+// Up to max keys, highest count first. Returns how many were written.
+size_t heavy_top(const HeavySketch *s, HeavyItem *out, size_t max);
+
+// "10.0.0.1", "2001:db8::1", "10.0.0.1 -> 10.0.0.2", "tcp/443"
+void heavy_key_format(const HeavyKey *key, char *buf, size_t len);
+
+#endif // HEAVY_H
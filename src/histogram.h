@@ -0,0 +1,94 @@
+// histogram.h - Log-linear latency histogram
+//
+// Values (microseconds, or nanoseconds for stage timings) below HIST_SUB_BUCKETS get a bucket each; above
+// that every power of two is split into HIST_SUB_BUCKETS equal buckets, so
+// a bucket is never wider than 1/8 of its lower bound (12.5% worst-case
+// error) and the whole 32-bit range fits in a few hundred counters.
+// Recording is a bit scan and an increment. Not thread safe: each worker
+// keeps its own and readers merge them once the workers have stopped.
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS     3
+#define HIST_SUB_BUCKETS  (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS      ((32 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)   // 240: up to 2^32 - 1 us (71 min)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;                // For the mean
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} LatencyHist;
+
+static inline unsigned hist_bucket(uint64_t v) {
+    if (v > 0xFFFFFFFFu) v = 0xFFFFFFFFu;
+    if (v < HIST_SUB_BUCKETS) return (unsigned)v;
+    unsigned e = 31u - (unsigned)__builtin_clz((uint32_t)v);   // e >= HIST_SUB_BITS
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+           (unsigned)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+// Smallest value that lands in bucket b
+static inline uint64_t hist_bucket_low(unsigned b) {
+    if (b < HIST_SUB_BUCKETS) return b;
+    unsigned e = b / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+    return (uint64_t)(HIST_SUB_BUCKETS + b % HIST_SUB_BUCKETS) << (e - HIST_SUB_BITS);
+}
+
+// Largest value that lands in bucket b
+static inline uint64_t hist_bucket_high(unsigned b) {
+    if (b < HIST_SUB_BUCKETS) return b;
+    unsigned e = b / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+    return hist_bucket_low(b) + ((uint64_t)1 << (e - HIST_SUB_BITS)) - 1;
+}
+
+static inline void hist_record(LatencyHist *h, uint64_t v) {
+    h->count++;
+    h->sum += v;
+    if (v > h->max) h->max = v;
+    h->buckets[hist_bucket(v)]++;
+}
+
+static inline void hist_merge(LatencyHist *dst, const LatencyHist *src) {
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) dst->max = src->max;
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) dst->buckets[b] += src->buckets[b];
+}
+
+// What was recorded between prev and now (both copies of one histogram).
+// The exact maximum of the interval is unknown; the upper bound of its
+// highest non-empty bucket stands in for it.
+static inline void hist_delta(LatencyHist *out, const LatencyHist *now, const LatencyHist *prev) {
+    out->count = 0;
+    out->sum = now->sum - prev->sum;
+    out->max = 0;
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        out->buckets[b] = now->buckets[b] - prev->buckets[b];
+        out->count += out->buckets[b];
+        if (out->buckets[b]) out->max = hist_bucket_high(b);
+    }
+    if (out->max > now->max) out->max = now->max;
+}
+
+// Value at quantile q (0..1), reported as the upper bound of its bucket
+// (never above the recorded maximum). 0 when empty.
+static inline uint64_t hist_percentile(const LatencyHist *h, double q) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->count) rank = h->count;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint64_t high = hist_bucket_high(b);
+            return high < h->max ? high : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif // HISTOGRAM_H
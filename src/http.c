@@ -1,72 +1,438 @@
 #include "http.h"
+#include "analyzer.h"
 #include "stats.h"
+#include "logger.h"
+#include "tracelog.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-#ifdef _WIN32
-#include <windows.h>  // For _strnicmp on Windows
-#endif
+#include "simd.h"
+#include "platform.h"  // For _strnicmp (strncasecmp on POSIX)
 
 #ifndef u_char
 typedef unsigned char u_char;
 #endif
 
-// Helper: extract a line from payload (not null-terminated by default)
-static void extract_line(const char *payload, int size, char *line, int maxlen) {
-    if (size < 0 || maxlen < 1) {
-        line[0] = '\0';
-        return;
+// Parser states for HttpStream.state
+enum {
+    HTTP_START = 0,          // Expecting a request or status line
+    HTTP_HEADERS,
+    HTTP_BODY,               // Skipping Content-Length bytes
+    HTTP_CHUNK_SIZE,
+    HTTP_CHUNK_DATA,
+    HTTP_CHUNK_END,          // CRLF after chunk data
+    HTTP_TRAILERS,
+    HTTP_BODY_TO_CLOSE,      // Response delimited by connection close
+    HTTP_RESYNC              // Lost track (gap, mid-stream pickup): wait for a start line
+};
+
+// Header names the parsers act on
+typedef enum {
+    HTTP_HDR_OTHER = 0,
+    HTTP_HDR_HOST,
+    HTTP_HDR_CONTENT_LENGTH,
+    HTTP_HDR_TRANSFER_ENCODING,
+    HTTP_HDR_USER_AGENT
+} http_header_t;
+
+// Case-insensitive substring search bounded by size (payload is not NUL-terminated)
+static const char *strncasestr_bounded(const char *haystack, int size, const char *needle) {
+    int needle_len = (int)strlen(needle);
+    for (int i = 0; i + needle_len <= size; i++) {
+        if (_strnicmp(haystack + i, needle, needle_len) == 0)
+            return haystack + i;
     }
-    
-    int i = 0;
-    int max_copy = (size < maxlen - 1) ? size : (maxlen - 1);
-    
-    while (i < max_copy) {
-        if (payload[i] == '\r' || payload[i] == '\n') break;
-        line[i] = payload[i];
-        i++;
+    return NULL;
+}
+
+// ---------------------------
+// Line Parsers (shared by both paths)
+// ---------------------------
+// s[0..n) equals the lowercase literal, ignoring ASCII case
+static int name_equals(const u_char *s, const char *lower, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        u_char c = s[i];
+        if (c >= 'A' && c <= 'Z') c |= 0x20;
+        if (c != (u_char)lower[i]) return 0;
     }
-    line[i] = '\0';
+    return 1;
 }
 
-// MSVC-compatible case-insensitive substring search
-static const char *strcasestr_msvc(const char *haystack, const char *needle) {
-    int needle_len = (int)strlen(needle);
-    for (; *haystack; haystack++) {
-        if (_strnicmp(haystack, needle, needle_len) == 0)
-            return haystack;
+static http_header_t header_name(const u_char *name, size_t len) {
+    switch (len) {
+        case 4:  return name_equals(name, "host", 4) ? HTTP_HDR_HOST : HTTP_HDR_OTHER;
+        case 10: return name_equals(name, "user-agent", 10) ? HTTP_HDR_USER_AGENT : HTTP_HDR_OTHER;
+        case 14: return name_equals(name, "content-length", 14) ? HTTP_HDR_CONTENT_LENGTH : HTTP_HDR_OTHER;
+        case 17: return name_equals(name, "transfer-encoding", 17) ? HTTP_HDR_TRANSFER_ENCODING : HTTP_HDR_OTHER;
+        default: return HTTP_HDR_OTHER;
     }
-    return NULL;
 }
 
-void parse_http(const u_char *data, int size,
-                const char *src_ip, const char *dst_ip,
-                unsigned short src_port, unsigned short dst_port) {
+// "HTTP/1.x NNN ..." or "METHOD target HTTP/1.x" (line without CRLF)
+static int parse_start_line(const u_char *line, size_t len, HttpHead *h) {
+    if (len >= 12 && memcmp(line, "HTTP/1.", 7) == 0 && line[8] == ' ') {
+        uint16_t status = 0;
+        for (int i = 9; i < 12; i++) {
+            if (line[i] < '0' || line[i] > '9') return -1;
+            status = (uint16_t)(status * 10 + (line[i] - '0'));
+        }
+        h->is_response = 1;
+        h->status = status;
+        return 0;
+    }
+
+    size_t i = 0;
+    while (i < len && line[i] >= 'A' && line[i] <= 'Z') i++;
+    if (i < 3 || i > 10 || i == len || line[i] != ' ') return -1;
+    h->is_response = 0;
+    h->status = 0;
+    h->method.p = line;
+    h->method.len = (uint32_t)i;
+
+    size_t target = i + 1;
+    size_t sp = target + simd_find_byte(line + target, len - target, ' ');
+    if (sp + 6 > len || memcmp(line + sp, " HTTP/", 6) != 0) return -1;
+    size_t q = simd_find_byte(line + target, sp - target, '?');
+    h->path.p = line + target;
+    h->path.len = (uint32_t)q;
+    return 0;
+}
+
+// Header line with the colon at offset colon (line without CRLF)
+static http_header_t parse_header_line(const u_char *line, size_t len, size_t colon, HttpHead *h) {
+    http_header_t kind = header_name(line, colon);
+    if (kind == HTTP_HDR_OTHER) return kind;
+
+    size_t v = colon + 1, end = len;
+    while (v < end && (line[v] == ' ' || line[v] == '\t')) v++;
+    while (end > v && (line[end - 1] == ' ' || line[end - 1] == '\t')) end--;
+    http_span_t value = { line + v, (uint32_t)(end - v) };
+
+    switch (kind) {
+        case HTTP_HDR_HOST:
+            h->host = value;
+            break;
+        case HTTP_HDR_USER_AGENT:
+            h->user_agent = value;
+            break;
+        case HTTP_HDR_CONTENT_LENGTH: {
+            uint64_t n = 0;
+            uint32_t i = 0;
+            for (; i < value.len && value.p[i] >= '0' && value.p[i] <= '9' && n < (1ull << 59); i++) {
+                n = n * 10 + (uint64_t)(value.p[i] - '0');
+            }
+            if (i > 0) {
+                h->content_length = n;
+                h->has_length = 1;
+            }
+            break;
+        }
+        case HTTP_HDR_TRANSFER_ENCODING:
+            h->chunked = strncasestr_bounded((const char *)value.p, (int)value.len, "chunked") != NULL;
+            break;
+        default:
+            break;
+    }
+    return kind;
+}
+
+// Handle one line of a head; returns 1 when the head is finished or invalid
+static int head_line(const u_char *data, size_t start, size_t nl, size_t colon,
+                     unsigned line_no, HttpHead *h, int *rc) {
+    size_t end = nl;
+    if (end > start && data[end - 1] == '\r') end--;
+    const u_char *line = data + start;
+    size_t len = end - start;
+
+    if (line_no == 0) {
+        *rc = parse_start_line(line, len, h);
+        return *rc != 0;
+    }
+    if (len == 0) {
+        h->complete = 1;
+        h->head_len = (uint32_t)(nl + 1);
+        return 1;
+    }
+    if (colon < end) parse_header_line(line, len, colon - start, h);
+    return 0;
+}
+
+#define HTTP_NO_COLON ((size_t)-1)
+
+int http_parse_head(const u_char *data, size_t size, HttpHead *out) {
+    memset(out, 0, sizeof(*out));
+    size_t line_start = 0, colon = HTTP_NO_COLON;
+    unsigned line_no = 0;
+    int rc = -1;
+    size_t i = 0;
+
+#if SIMD_WIDTH
+    // One compare pass yields every line end and colon of the block; the
+    // set bits are then walked in order
+    for (; i + SIMD_WIDTH <= size; i += SIMD_WIDTH) {
+        uint32_t nl_mask, colon_mask;
+        simd_match2(data + i, '\n', ':', &nl_mask, &colon_mask);
+        uint32_t m = nl_mask | colon_mask;
+        while (m) {
+            unsigned bit = simd_ctz(m);
+            m &= m - 1;
+            size_t pos = i + bit;
+            if (nl_mask & (1u << bit)) {
+                if (head_line(data, line_start, pos, colon, line_no++, out, &rc)) return rc;
+                line_start = pos + 1;
+                colon = HTTP_NO_COLON;
+            } else if (colon == HTTP_NO_COLON) {
+                colon = pos;
+            }
+        }
+    }
+#endif
+    for (; i < size; i++) {
+        if (data[i] == '\n') {
+            if (head_line(data, line_start, i, colon, line_no++, out, &rc)) return rc;
+            line_start = i + 1;
+            colon = HTTP_NO_COLON;
+        } else if (data[i] == ':' && colon == HTTP_NO_COLON) {
+            colon = i;
+        }
+    }
+
+    // Cut off inside the start line: judge what is there
+    if (line_no == 0 && size > 0) rc = parse_start_line(data, size, out);
+    return rc;
+}
+
+// Per-host and per-status counters (stats.c flushes them with ProtocolStats)
+static void count_host(http_span_t host) {
+    if (host.len == 0) return;
+    char name[STATS_NAME_LEN];
+    size_t n = host.len < sizeof(name) - 1 ? host.len : sizeof(name) - 1;
+    for (size_t i = 0; i < n; i++) {
+        u_char c = host.p[i];
+        name[i] = (char)((c >= 'A' && c <= 'Z') ? (c | 0x20) : c);
+    }
+    name[n] = '\0';
+    stats_count_name(STATS_NAMES_HTTP_HOST, name);
+}
 
-    if (size <= 0) return;
+// ---------------------------
+// Stream Parser (reassembled)
+// ---------------------------
+typedef struct {
+    packet_ctx_t *pkt;
+    HttpStream *hs;
+    HttpStream *peer;        // Other direction: its requests are the ones this side answers
+} HttpDelivery;
 
-    // Increment HTTP stats
-    stats_increment("HTTP");
+// Requests are answered in order, so each direction queues whether its
+// pending requests are HEADs and the other side takes one per final
+// response. Past 32 pipelined requests the extras count as non-HEAD.
+static void queue_request(HttpStream *hs, int is_head) {
+    if (hs->pending >= 32) return;
+    if (is_head) hs->head_requests |= 1u << hs->pending;
+    hs->pending++;
+}
 
-    // Extract first line (request or response line)
-    char line[256];
-    extract_line((const char *)data, size, line, sizeof(line));
+static int answer_request(HttpStream *requests) {
+    if (requests->pending == 0) return 0;
+    int is_head = requests->head_requests & 1u;
+    requests->head_requests >>= 1;
+    requests->pending--;
+    return is_head;
+}
 
-    printf("[HTTP] %s:%u -> %s:%u | %s\n",
-           src_ip, src_port, dst_ip, dst_port, line);
+static void end_of_headers(HttpStream *hs) {
+    // Responses to HEAD, and 1xx, 204 and 304 responses, never carry a body
+    int no_body = hs->is_response &&
+                  (hs->head_response || hs->status < 200 || hs->status == 204 || hs->status == 304);
+    if (no_body) hs->state = HTTP_START;
+    else if (hs->chunked) hs->state = HTTP_CHUNK_SIZE;
+    else if (hs->has_length) hs->state = hs->body_left > 0 ? HTTP_BODY : HTTP_START;
+    else hs->state = hs->is_response ? HTTP_BODY_TO_CLOSE : HTTP_START;
+}
 
-    // Look for Host header (case-insensitive)
-    const char *host_ptr = strcasestr_msvc((const char *)data, "Host:");
-    if (host_ptr) {
-        // Validate host_ptr is within data bounds
-        int host_offset = host_ptr - (const char *)data;
-        if (host_offset >= 0 && host_offset < size) {
-            char host_line[256];
-            int remaining = size - host_offset;
-            if (remaining > 0) {
-                extract_line(host_ptr, remaining, host_line, sizeof(host_line));
-                printf("[HTTP]   %s\n", host_line);
+static void stream_line(HttpStream *hs, HttpStream *peer, packet_ctx_t *pkt) {
+    const u_char *line = (const u_char *)hs->line;
+    size_t len = hs->line_len;
+    HttpHead h;
+    switch (hs->state) {
+        case HTTP_START:
+        case HTTP_RESYNC: {
+            if (len == 0) return;  // Stray CRLF between messages
+            if (parse_start_line(line, len, &h) != 0) {
+                hs->state = HTTP_RESYNC;
+                return;
+            }
+            hs->state = HTTP_HEADERS;
+            hs->is_response = h.is_response;
+            hs->status = h.status;
+            hs->chunked = 0;
+            hs->has_length = 0;
+            hs->body_left = 0;
+            hs->head_response = 0;
+            if (h.is_response) {
+                // Interim (1xx) responses come before the final one to the same request
+                if (h.status >= 200) hs->head_response = (uint8_t)answer_request(peer);
+                stats_count_http_status(h.status);
+            } else {
+                queue_request(hs, h.method.len == 4 && memcmp(h.method.p, "HEAD", 4) == 0);
+            }
+            LOG_DEBUG_SIMPLE("[HTTP] %s:%u -> %s:%u | %s\n",
+                             pkt->src_ip, pkt->sport, pkt->dst_ip, pkt->dport, hs->line);
+            break;
+        }
+        case HTTP_HEADERS: {
+            if (len == 0) {
+                end_of_headers(hs);
+                return;
+            }
+            const u_char *colon = (const u_char *)memchr(line, ':', len);
+            if (!colon) return;
+            memset(&h, 0, sizeof(h));
+            switch (parse_header_line(line, len, (size_t)(colon - line), &h)) {
+                case HTTP_HDR_CONTENT_LENGTH:
+                    hs->body_left = h.content_length;
+                    hs->has_length = h.has_length;
+                    break;
+                case HTTP_HDR_TRANSFER_ENCODING:
+                    hs->chunked = h.chunked;
+                    break;
+                case HTTP_HDR_HOST:
+                    if (!hs->is_response) count_host(h.host);
+                    LOG_DEBUG_SIMPLE("[HTTP]   %s\n", hs->line);
+                    break;
+                case HTTP_HDR_USER_AGENT:
+                    LOG_DEBUG_SIMPLE("[HTTP]   %s\n", hs->line);
+                    break;
+                default:
+                    break;
             }
+            break;
         }
+        case HTTP_CHUNK_SIZE: {
+            char *end;
+            unsigned long long n = strtoull(hs->line, &end, 16);
+            if (end == hs->line) {
+                hs->state = HTTP_RESYNC;
+            } else if (n == 0) {
+                hs->state = HTTP_TRAILERS;
+            } else {
+                hs->body_left = n;
+                hs->state = HTTP_CHUNK_DATA;
+            }
+            break;
+        }
+        case HTTP_CHUNK_END:
+            hs->state = len == 0 ? HTTP_CHUNK_SIZE : HTTP_RESYNC;
+            break;
+        case HTTP_TRAILERS:
+            if (len == 0) hs->state = HTTP_START;
+            break;
+        default:
+            break;
+    }
+}
+
+static void stream_data(void *user, const u_char *data, uint32_t len) {
+    HttpDelivery *d = (HttpDelivery *)user;
+    HttpStream *hs = d->hs;
+
+    if (!data) {
+        // Bytes lost inside a body are harmless; anywhere else resync
+        if ((hs->state == HTTP_BODY || hs->state == HTTP_CHUNK_DATA) && len < hs->body_left) {
+            hs->body_left -= len;
+        } else if (hs->state != HTTP_BODY_TO_CLOSE) {
+            hs->state = HTTP_RESYNC;
+            hs->line_len = 0;
+        }
+        TRACE(TRACE_HTTP_GAP, d->pkt->sport, d->pkt->dport, len);
+        return;
     }
+
+    while (len > 0) {
+        if (hs->state == HTTP_BODY_TO_CLOSE) return;
+        if (hs->state == HTTP_BODY || hs->state == HTTP_CHUNK_DATA) {
+            uint32_t n = hs->body_left < len ? (uint32_t)hs->body_left : len;
+            hs->body_left -= n;
+            data += n;
+            len -= n;
+            if (hs->body_left == 0) hs->state = hs->state == HTTP_BODY ? HTTP_START : HTTP_CHUNK_END;
+            continue;
+        }
+
+        // Line-oriented states: collect up to the next LF
+        uint32_t nl_off = (uint32_t)simd_find_byte(data, len, '\n');
+        int has_nl = nl_off < len;
+        uint32_t take = has_nl ? nl_off + 1 : len;
+        uint32_t room = HTTP_LINE_MAX - 1u - hs->line_len;
+        uint32_t copy = take < room ? take : room;
+        memcpy(hs->line + hs->line_len, data, copy);
+        hs->line_len = (uint16_t)(hs->line_len + copy);
+        data += take;
+        len -= take;
+        if (!has_nl) return;  // Line continues in a later segment
+
+        while (hs->line_len > 0 && (hs->line[hs->line_len - 1] == '\n' || hs->line[hs->line_len - 1] == '\r')) {
+            hs->line_len--;
+        }
+        hs->line[hs->line_len] = '\0';
+        stream_line(hs, d->peer, d->pkt);
+        hs->line_len = 0;
+    }
+}
+
+// ---------------------------
+// Single-Segment Fallback
+// ---------------------------
+static void parse_segment(packet_ctx_t *pkt, const u_char *data, int size) {
+    HttpHead h;
+    if (http_parse_head(data, (size_t)size, &h) != 0) return;   // Body or continuation
+
+    if (h.is_response) stats_count_http_status(h.status);
+    else count_host(h.host);
+
+    if (!LOG_ENABLED(LOG_DEBUG)) return;
+    if (h.is_response) {
+        LOG_DEBUG_SIMPLE("[HTTP] %s:%u -> %s:%u | status %u%s\n",
+                         pkt->src_ip, pkt->sport, pkt->dst_ip, pkt->dport, h.status,
+                         h.complete ? "" : " (head continues in a later segment)");
+    } else {
+        LOG_DEBUG_SIMPLE("[HTTP] %s:%u -> %s:%u | %.*s %.*s\n",
+                         pkt->src_ip, pkt->sport, pkt->dst_ip, pkt->dport,
+                         (int)h.method.len, (const char *)h.method.p,
+                         (int)h.path.len, (const char *)h.path.p);
+    }
+    if (h.host.len) LOG_DEBUG_SIMPLE("[HTTP]   Host: %.*s\n", (int)h.host.len, (const char *)h.host.p);
+    if (h.user_agent.len) LOG_DEBUG_SIMPLE("[HTTP]   User-Agent: %.*s\n", (int)h.user_agent.len, (const char *)h.user_agent.p);
+    if (h.has_length) LOG_DEBUG_SIMPLE("[HTTP]   Content-Length: %llu\n", (unsigned long long)h.content_length);
+}
+
+void parse_http(packet_ctx_t *pkt, const u_char *data, int size) {
+    if (size < 0) return;
+
+    if (size > 0) {
+        // Increment HTTP stats
+        stats_increment(PROTO_HTTP);
+        TRACE(TRACE_HTTP, pkt->sport, pkt->dport, size);
+    }
+
+    TcpSession *sess = analyzer_tcp_session(pkt, TCP_APP_HTTP);
+    if (sess) {
+        HttpDelivery d = { pkt, &sess->http[pkt->flow_dir], &sess->http[pkt->flow_dir ^ 1] };
+        tcp_reasm_segment(pkt->an->reasm, &sess->stream, pkt->flow_dir, pkt->tcp_seq, pkt->tcp_flags,
+                          data, (uint32_t)size, stream_data, &d);
+        return;
+    }
+
+    // Untracked flow: only this segment is available
+    if (size > 0) parse_segment(pkt, data, size);
+}
+
+int http_heuristic(const u_char *data, int size) {
+    if (size < 12) return 0;
+    size_t len = simd_find_byte(data, (size_t)size, '\n');
+    if (len == (size_t)size) return 0;
+    if (len > 0 && data[len - 1] == '\r') len--;
+    HttpHead h;
+    return parse_start_line(data, len, &h) == 0;
 }
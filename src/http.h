@@ -2,11 +2,65 @@
 #define HTTP_H
 
 #include <pcap.h>
+#include <stdint.h>
+#include "packet.h"
 
-// Parse an HTTP payload carried inside TCP
-// src_ip/dst_ip are for logging context
-void parse_http(const u_char *data, int size,
-                const char *src_ip, const char *dst_ip,
-                unsigned short src_port, unsigned short dst_port);
+#define HTTP_LINE_MAX 256   // Longer header lines are truncated (the rest is still consumed)
+
+// Incremental parser state for one direction of a reassembled connection.
+// Only the current line is buffered, so memory per flow is fixed.
+typedef struct {
+    uint8_t  state;          // Parser state (http.c)
+    uint8_t  chunked;        // Message uses chunked transfer coding
+    uint8_t  is_response;
+    uint8_t  has_length;     // Content-Length seen
+    uint8_t  head_response;  // Current response answers a HEAD request
+    uint8_t  pending;        // Requests sent this way still awaiting a final response (at most 32)
+    uint16_t status;
+    uint16_t line_len;
+    uint32_t head_requests;  // Bit i set: the i-th pending request is a HEAD (oldest in bit 0)
+    uint64_t body_left;      // Content-Length or current chunk bytes still to skip
+    char line[HTTP_LINE_MAX];
+} HttpStream;
+
+// A byte range of the parsed buffer (not NUL-terminated)
+typedef struct {
+    const u_char *p;
+    uint32_t len;
+} http_span_t;
+
+// Fields of one request or response head. Spans point into the buffer
+// that was parsed and are empty (len 0) when absent.
+typedef struct {
+    uint8_t  is_response;
+    uint8_t  complete;       // Blank line reached: head_len is valid
+    uint8_t  chunked;        // Transfer-Encoding: chunked
+    uint8_t  has_length;     // Content-Length seen
+    uint16_t status;
+    uint32_t head_len;       // Bytes up to and including the blank line
+    uint64_t content_length;
+    http_span_t method;
+    http_span_t path;        // Request target without the query string
+    http_span_t host;
+    http_span_t user_agent;
+} HttpHead;
+
+// Parse the start line and headers at data in one vectorized pass over
+// line ends and colons (simd.h), never reading past size. A head cut off
+// by the end of the buffer still yields the fields of its complete lines,
+// with complete == 0. Returns 0 if data starts with a request or status line,
+// -1 otherwise.
+int http_parse_head(const u_char *data, size_t size, HttpHead *out);
+
+// Feed one TCP segment of an HTTP connection, including SYN/FIN segments
+// without payload (the stream needs the SYN to find the first byte).
+// Tracked flows go through reassembly so requests split across segments
+// parse as one message; otherwise the segment is parsed on its own.
+// Ports, sequence and flags come from pkt (set by the TCP parser);
+// addresses are for logging context.
+void parse_http(packet_ctx_t *pkt, const u_char *data, int size);
+
+// Heuristic dissector: data starts with a complete request or status line
+int http_heuristic(const u_char *data, int size);
 
 #endif // HTTP_H
@@ -1,5 +1,8 @@
 #include "https.h"
+#include "analyzer.h"
 #include "stats.h"
+#include "logger.h"
+#include "tracelog.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -11,6 +14,18 @@ typedef struct {
     uint16_t length;
 } tls_record_header_t;
 
+// Collector states for TlsHalf.state
+enum {
+    TLS_HALF_COLLECT = 0,    // Reading records until the first handshake message is complete
+    TLS_HALF_DONE            // Hello parsed or given up on: the rest of the direction is ignored
+};
+
+typedef struct {
+    packet_ctx_t *pkt;
+    TlsSession *tls;
+    TlsHalf *half;
+} TlsDelivery;
+
 static const char *tls_content_type(uint8_t type) {
     switch (type) {
         case 20: return "ChangeCipherSpec";
@@ -21,46 +36,258 @@ static const char *tls_content_type(uint8_t type) {
     }
 }
 
-static const char *tls_version(uint16_t v) {
-    switch (v) {
-        case 0x0300: return "SSL 3.0";
-        case 0x0301: return "TLS 1.0";
-        case 0x0302: return "TLS 1.1";
-        case 0x0303: return "TLS 1.2";
-        case 0x0304: return "TLS 1.3";
-        default: return "Unknown";
+static uint32_t read_u24(const u_char *p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+// ---------------------------
+// Hello Results
+// ---------------------------
+// Account and log one parsed hello. tls is the flow's cache, or NULL for
+// an untracked flow (fingerprints are then only computed for the log).
+static void report_hello(packet_ctx_t *pkt, const TlsHello *h, TlsSession *tls) {
+    analyzer_t *an = pkt->an;
+    char ja3[TLS_JA3_LEN] = "", ja4[TLS_JA4_LEN] = "";
+    int want_fp = tls || LOG_ENABLED(LOG_DEBUG);
+
+    if (h->type == TLS_HS_CLIENT_HELLO) {
+        an->tls.client_hellos++;
+        if (h->sni[0]) stats_count_name(STATS_NAMES_TLS_SNI, h->sni);
+        else an->tls.no_sni++;
+        TRACE(TRACE_TLS_CLIENT_HELLO, pkt->sport, pkt->dport, h->version,
+              h->n_ciphers, h->n_extensions, strlen(h->sni));
+
+        if (want_fp) {
+            tls_ja3(h, ja3);
+            tls_ja4(h, ja4);
+        }
+        if (tls) {
+            tls->client_done = 1;
+            if (!tls->server_done) tls->version = h->version;
+            memcpy(tls->sni, h->sni, sizeof(tls->sni));
+            if (!tls->server_done) memcpy(tls->alpn, h->alpn, sizeof(tls->alpn));
+            memcpy(tls->ja3, ja3, sizeof(ja3));
+            memcpy(tls->ja4, ja4, sizeof(ja4));
+        }
+        LOG_DEBUG_SIMPLE("TLS: ClientHello %s:%u -> %s:%u, SNI=%s, ALPN=%s, Version=%s, %u ciphers%s, JA3=%s, JA4=%s\n",
+                         pkt->src_ip, pkt->sport, pkt->dst_ip, pkt->dport,
+                         h->sni[0] ? h->sni : "-", h->alpn[0] ? h->alpn : "-",
+                         tls_version_name(h->version), h->n_ciphers,
+                         h->truncated ? " (lists truncated)" : "", ja3, ja4);
+    } else {
+        an->tls.server_hellos++;
+        TRACE(TRACE_TLS_SERVER_HELLO, pkt->sport, pkt->dport, h->version,
+              h->ciphers[0], h->n_extensions);
+
+        if (want_fp) tls_ja3(h, ja3);
+        if (tls) {
+            tls->server_done = 1;
+            tls->version = h->version;
+            tls->cipher = h->ciphers[0];
+            if (h->has_alpn) memcpy(tls->alpn, h->alpn, sizeof(tls->alpn));   // TLS 1.3 selects it in encrypted extensions
+            memcpy(tls->ja3s, ja3, sizeof(ja3));
+        }
+        LOG_DEBUG_SIMPLE("TLS: ServerHello %s:%u -> %s:%u, Version=%s, Cipher=0x%04x, ALPN=%s, JA3S=%s\n",
+                         pkt->src_ip, pkt->sport, pkt->dst_ip, pkt->dport,
+                         tls_version_name(h->version), h->ciphers[0],
+                         h->alpn[0] ? h->alpn : "-", ja3);
+    }
+}
+
+// ---------------------------
+// Handshake Collection
+// ---------------------------
+static void half_finish(analyzer_t *an, TlsHalf *half) {
+    if (half->buf) {
+        pool_free(&an->tls_buffers, half->buf);
+        half->buf = NULL;
     }
+    half->state = TLS_HALF_DONE;
 }
 
-void parse_https(const u_char *data, int size,
-                 const char *src_ip, const char *dst_ip,
-                 uint16_t sport, uint16_t dport) {
+static void hello_complete(TlsDelivery *d, const u_char *msg, uint32_t len) {
+    TlsHello h;
+    if (tls_parse_hello(msg, len, &h) == 0) {
+        report_hello(d->pkt, &h, d->tls);
+    } else {
+        d->pkt->an->tls.malformed++;
+    }
+    half_finish(d->pkt->an, d->half);
+}
+
+// n handshake-layer bytes (record headers already stripped)
+static void take_handshake(TlsDelivery *d, const u_char *p, uint32_t n) {
+    analyzer_t *an = d->pkt->an;
+    TlsHalf *half = d->half;
+
+    if (half->msg_have == 0) {
+        if (p[0] != TLS_HS_CLIENT_HELLO && p[0] != TLS_HS_SERVER_HELLO) {
+            an->tls.not_handshake++;
+            half_finish(an, half);
+            return;
+        }
+        // Common case: the whole hello is in this segment, parse it in place
+        if (n >= 4 && 4 + read_u24(p + 1) <= n) {
+            hello_complete(d, p, 4 + read_u24(p + 1));
+            return;
+        }
+    }
+
+    if (!half->buf) {
+        half->buf = (u_char *)pool_alloc(&an->tls_buffers);
+        if (!half->buf) {
+            an->tls.buffers_exhausted++;
+            half_finish(an, half);
+            return;
+        }
+    }
+    uint32_t want = half->msg_len ? half->msg_len - half->msg_have : TLS_HELLO_BUF - half->msg_have;
+    uint32_t copy = n < want ? n : want;
+    memcpy(half->buf + half->msg_have, p, copy);
+    half->msg_have += copy;
+
+    if (half->msg_len == 0 && half->msg_have >= 4) {
+        half->msg_len = 4 + read_u24(half->buf + 1);
+        if (half->msg_len > TLS_HELLO_BUF) {
+            an->tls.too_large++;
+            half_finish(an, half);
+            return;
+        }
+    }
+    if (half->msg_len && half->msg_have >= half->msg_len) hello_complete(d, half->buf, half->msg_len);
+}
+
+// Reassembled bytes of one direction: walk records until the hello is complete
+static void stream_data(void *user, const u_char *data, uint32_t len) {
+    TlsDelivery *d = (TlsDelivery *)user;
+    TlsHalf *half = d->half;
+
+    if (!data) {
+        if (half->state == TLS_HALF_COLLECT) {
+            d->pkt->an->tls.gaps++;
+            half_finish(d->pkt->an, half);
+        }
+        return;
+    }
+
+    while (len > 0 && half->state == TLS_HALF_COLLECT) {
+        if (half->hdr_have < 5) {
+            uint32_t take = 5u - half->hdr_have;
+            if (take > len) take = len;
+            memcpy(half->hdr + half->hdr_have, data, take);
+            half->hdr_have += (uint8_t)take;
+            data += take;
+            len -= take;
+            if (half->hdr_have < 5) return;
+            if (half->hdr[0] != TLS_CONTENT_HANDSHAKE) {
+                d->pkt->an->tls.not_handshake++;
+                half_finish(d->pkt->an, half);
+                return;
+            }
+            half->record_left = (uint16_t)((half->hdr[3] << 8) | half->hdr[4]);
+            if (half->record_left == 0) half->hdr_have = 0;
+            continue;
+        }
+
+        uint32_t take = half->record_left < len ? half->record_left : len;
+        take_handshake(d, data, take);
+        half->record_left -= (uint16_t)take;
+        if (half->record_left == 0) half->hdr_have = 0;
+        data += take;
+        len -= take;
+    }
+}
+
+// Untracked flow: only a hello that fits in this segment can be parsed
+static void parse_segment_hello(packet_ctx_t *pkt, const u_char *data, int size) {
+    if (size < 9 || data[0] != TLS_CONTENT_HANDSHAKE) return;
+    if (data[5] != TLS_HS_CLIENT_HELLO && data[5] != TLS_HS_SERVER_HELLO) return;
+    uint32_t record_len = (uint32_t)((data[3] << 8) | data[4]);
+    uint32_t avail = (uint32_t)size - 5;
+    if (record_len > avail) record_len = avail;
+
+    TlsHello h;
+    if (tls_parse_hello(data + 5, record_len, &h) != 0) return;   // Split or malformed
+    pkt->an->tls.segment_only++;
+    report_hello(pkt, &h, NULL);
+}
+
+// ---------------------------
+// Entry Points
+// ---------------------------
+static void log_record(packet_ctx_t *pkt, const u_char *data, int size) {
+    uint16_t sport = pkt->sport;
+    uint16_t dport = pkt->dport;
+
     if (size < 5) {
-        printf("HTTPS: Truncated TLS record\n");
+        LOG_DEBUG_SIMPLE("HTTPS: Truncated TLS record\n");
         return;
     }
 
     // Increment HTTPS stats
-    stats_increment("HTTPS");
+    stats_increment(PROTO_HTTPS);
 
     tls_record_header_t hdr;
     hdr.content_type = data[0];
     hdr.version = (data[1] << 8) | data[2];
     hdr.length  = (data[3] << 8) | data[4];
-    
+
     // Validate TLS record length against available data
     // TLS record header is 5 bytes, so payload starts at offset 5
     if (hdr.length > (size_t)(size - 5)) {
-        printf("HTTPS: Warning - TLS record length (%u) exceeds available data (%d)\n", 
+        LOG_DEBUG_SIMPLE("HTTPS: Warning - TLS record length (%u) exceeds available data (%d)\n",
                hdr.length, size - 5);
         hdr.length = (size > 5) ? (size - 5) : 0;
     }
 
-    printf("HTTPS: %s:%u -> %s:%u, TLS Record: %s, Version=%s, Length=%u\n",
-           src_ip, sport, dst_ip, dport,
+    TRACE(TRACE_TLS, sport, dport, hdr.content_type, hdr.version, hdr.length);
+    LOG_DEBUG_SIMPLE("HTTPS: %s:%u -> %s:%u, TLS Record: %s, Version=%s, Length=%u\n",
+           pkt->src_ip, sport, pkt->dst_ip, dport,
            tls_content_type(hdr.content_type),
-           tls_version(hdr.version),
+           tls_version_name(hdr.version),
            hdr.length);
+}
 
-    // Future extension: parse TLS handshake for Server Name Indication (SNI)
+void parse_https(packet_ctx_t *pkt, const u_char *data, int size) {
+    if (size < 0) return;
+    if (size > 0) log_record(pkt, data, size);
+
+    TcpSession *sess = analyzer_tcp_session(pkt, TCP_APP_TLS);
+    if (sess && sess->app == TCP_APP_TLS) {
+        TlsSession *tls = &sess->tls;
+        TlsHalf *half = &tls->half[pkt->flow_dir];
+        if (half->state != TLS_HALF_COLLECT) return;   // Hello already handled for this direction
+
+        TlsDelivery d = { pkt, tls, half };
+        tcp_reasm_segment(pkt->an->reasm, &sess->stream, pkt->flow_dir, pkt->tcp_seq, pkt->tcp_flags,
+                          data, (uint32_t)size, stream_data, &d);
+
+        // Both hellos handled: nothing left to reassemble on this connection
+        if (tls->half[0].state != TLS_HALF_COLLECT && tls->half[1].state != TLS_HALF_COLLECT) {
+            tcp_reasm_release(pkt->an->reasm, &sess->stream);
+        }
+        return;
+    }
+
+    if (size > 0) parse_segment_hello(pkt, data, size);
+}
+
+int tls_heuristic(const u_char *data, int size) {
+    return size >= 6 && data[0] == TLS_CONTENT_HANDSHAKE && data[1] == 3 && data[2] <= 4 &&
+           (data[5] == TLS_HS_CLIENT_HELLO || data[5] == TLS_HS_SERVER_HELLO);
+}
+
+void https_session_release(analyzer_t *an, TlsSession *tls) {
+    for (int i = 0; i < 2; i++) {
+        if (tls->half[i].buf) {
+            pool_free(&an->tls_buffers, tls->half[i].buf);
+            tls->half[i].buf = NULL;
+        }
+    }
+    if (tls->client_done) {
+        LOG_DEBUG_SIMPLE("TLS session: SNI=%s, ALPN=%s, Version=%s, Cipher=0x%04x, JA3=%s, JA3S=%s, JA4=%s\n",
+                         tls->sni[0] ? tls->sni : "-", tls->alpn[0] ? tls->alpn : "-",
+                         tls_version_name(tls->version), tls->cipher, tls->ja3,
+                         tls->server_done ? tls->ja3s : "-", tls->ja4);
+    }
 }
@@ -1,15 +1,66 @@
 #ifndef HTTPS_H
 #define HTTPS_H
 
-#include <winsock2.h>
+#include "platform.h"
 #include <stdint.h>  // for uint16_t
+#include "packet.h"
+#include "tls.h"
 
 #ifndef u_char
 typedef unsigned char u_char;
 #endif
 
-// Parse HTTPS/TLS traffic
-void parse_https(const u_char *data, int size,
-                 const char *src_ip, const char *dst_ip,
-                 uint16_t sport, uint16_t dport);
+#define TLS_HELLO_BUF 8192   // Largest hello reassembled across records or segments (pooled buffer)
+
+// Collects the first handshake message of one direction of a connection
+// from the reassembled stream, stripping TLS record headers on the way.
+typedef struct {
+    uint8_t  state;          // Collector state (https.c)
+    uint8_t  hdr_have;       // Bytes of the current record header seen
+    uint8_t  hdr[5];
+    uint16_t record_left;    // Handshake bytes still to come in the current record
+    uint32_t msg_len;        // Hello length including its 4-byte header (0 until known)
+    uint32_t msg_have;       // Bytes copied into buf
+    u_char  *buf;            // TLS_HELLO_BUF from the worker's pool, only while the hello is split
+} TlsHalf;
+
+// Per-connection TLS state, cached on the flow so each hello is parsed once
+typedef struct {
+    TlsHalf  half[2];        // Indexed by FLOW_DIR_*
+    uint8_t  client_done;    // ClientHello parsed
+    uint8_t  server_done;    // ServerHello parsed
+    uint16_t version;        // Negotiated (ServerHello), else offered
+    uint16_t cipher;         // Selected suite
+    char     alpn[TLS_ALPN_MAX + 1];
+    char     sni[TLS_SNI_MAX + 1];
+    char     ja3[TLS_JA3_LEN];
+    char     ja3s[TLS_JA3_LEN];
+    char     ja4[TLS_JA4_LEN];
+} TlsSession;
+
+// Per-worker handshake counters
+typedef struct {
+    uint64_t client_hellos;
+    uint64_t server_hellos;
+    uint64_t no_sni;             // ClientHellos without a server_name
+    uint64_t malformed;          // Hello failed to parse
+    uint64_t not_handshake;      // First record of a direction was not a handshake (mid-stream pickup, not TLS)
+    uint64_t too_large;          // Hello longer than TLS_HELLO_BUF
+    uint64_t gaps;               // Stream gap before the hello was complete
+    uint64_t buffers_exhausted;  // Split hello dropped because the buffer pool was empty
+    uint64_t segment_only;       // Hellos parsed from a single segment of an untracked flow
+} TlsStats;
+
+// Parse HTTPS/TLS traffic. Every segment of the connection comes here,
+// including the SYN (the stream needs it to find the first byte); the
+// hellos of tracked flows are reassembled and fingerprinted once.
+// Sequence and flags come from pkt.
+void parse_https(packet_ctx_t *pkt, const u_char *data, int size);
+
+// Heuristic dissector: data starts with a TLS handshake record carrying a hello
+int tls_heuristic(const u_char *data, int size);
+
+// Flow ended: return held buffers and log the connection's TLS summary
+void https_session_release(analyzer_t *an, TlsSession *tls);
+
 #endif // HTTPS_H
@@ -3,9 +3,12 @@
 #include "tcp.h"
 #include "udp.h"
 #include "stats.h"
+#include "analyzer.h"
+#include "ipfrag.h"
+#include "logger.h"
+#include "tracelog.h"
 #include <stdio.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "platform.h"
 
 static void print_ipv4_addresses(const ipv4_header_t *ip,
                                  char *src, int srcLen,
@@ -29,9 +32,18 @@ static void print_ipv6_addresses(const ipv6_header_t *ip6,
     }
 }
 
-// IPv6 extension parsing
+// Fragment header fields (IPv6)
+typedef struct {
+    int present;
+    uint32_t id;
+    uint32_t offset;     // Bytes
+    int more;
+} ipv6_frag_info_t;
+
+// IPv6 extension parsing. Stops after a Fragment header (filling *frag):
+// whatever follows it is only parseable once the datagram is reassembled.
 static int parse_ipv6_extensions(const u_char **payload_ptr, int *payload_size_ptr,
-                                u_char initial_next_header) {
+                                u_char initial_next_header, ipv6_frag_info_t *frag) {
     const u_char *current = *payload_ptr;
     const u_char *start = *payload_ptr;  // Track start position for loop detection
     int remaining = *payload_size_ptr;
@@ -39,7 +51,7 @@ static int parse_ipv6_extensions(const u_char **payload_ptr, int *payload_size_p
     int max_headers = 64;  // Maximum number of extension headers to prevent infinite loops
     int header_count = 0;
 
-    printf("IPv6: Extension Headers: ");
+    LOG_DEBUG_SIMPLE("IPv6: Extension Headers: ");
 
     while (remaining > 0 && header_count < max_headers) {
         header_count++;
@@ -49,14 +61,14 @@ static int parse_ipv6_extensions(const u_char **payload_ptr, int *payload_size_p
             case 6:   // TCP
             case 17:  // UDP
             case 58:  // ICMPv6
-                printf("-> Transport (0x%02X)\n", next_header);
+                LOG_DEBUG_SIMPLE("-> Transport (0x%02X)\n", next_header);
                 *payload_ptr = current;
                 *payload_size_ptr = remaining;
                 return next_header;
         }
 
         if (remaining < (int)sizeof(ipv6_ext_header_t)) {
-            printf("-> Truncated extension header\n");
+            LOG_DEBUG_SIMPLE("-> Truncated extension header\n");
             return -1;
         }
 
@@ -66,31 +78,31 @@ static int parse_ipv6_extensions(const u_char **payload_ptr, int *payload_size_p
         switch (next_header) {
             case 0: {
                 if (remaining < 8) {
-                    printf("-> Truncated Hop-by-Hop header\n");
+                    LOG_DEBUG_SIMPLE("-> Truncated Hop-by-Hop header\n");
                     return -1;
                 }
                 int hdr_len = (ext_hdr->hdr_ext_len + 1) * 8;
                 if (hdr_len < 8 || hdr_len > remaining || hdr_len > 2048) {
-                    printf("-> Invalid Hop-by-Hop header length (%d)\n", hdr_len);
+                    LOG_DEBUG_SIMPLE("-> Invalid Hop-by-Hop header length (%d)\n", hdr_len);
                     return -1;
                 }
-                printf("Hop-by-Hop (%d bytes) -> ", hdr_len);
+                LOG_DEBUG_SIMPLE("Hop-by-Hop (%d bytes) -> ", hdr_len);
                 current += hdr_len;
                 remaining -= hdr_len;
                 break;
             }
             case 43: {
                 if (remaining < 8) {
-                    printf("-> Truncated Routing header\n");
+                    LOG_DEBUG_SIMPLE("-> Truncated Routing header\n");
                     return -1;
                 }
                 const ipv6_routing_t *routing = (const ipv6_routing_t *)current;
                 int hdr_len = (ext_hdr->hdr_ext_len + 1) * 8;
                 if (hdr_len < 8 || hdr_len > remaining || hdr_len > 2048) {
-                    printf("-> Invalid Routing header length (%d)\n", hdr_len);
+                    LOG_DEBUG_SIMPLE("-> Invalid Routing header length (%d)\n", hdr_len);
                     return -1;
                 }
-                printf("Routing (type=%u, segments=%u, %d bytes) -> ",
+                LOG_DEBUG_SIMPLE("Routing (type=%u, segments=%u, %d bytes) -> ",
                        routing->routing_type, routing->segments_left, hdr_len);
                 current += hdr_len;
                 remaining -= hdr_len;
@@ -98,41 +110,43 @@ static int parse_ipv6_extensions(const u_char **payload_ptr, int *payload_size_p
             }
             case 44: {
                 if (remaining < (int)sizeof(ipv6_fragment_t)) {
-                    printf("-> Truncated Fragment header\n");
+                    LOG_DEBUG_SIMPLE("-> Truncated Fragment header\n");
                     return -1;
                 }
-                const ipv6_fragment_t *frag = (const ipv6_fragment_t *)current;
-                int frag_offset = (ntohs(frag->frag_offset_res_m) >> 3) * 8;
-                int more_fragments = ntohs(frag->frag_offset_res_m) & 0x0001;
-                printf("Fragment (offset=%u, MF=%u, id=0x%08X) -> ",
-                       frag_offset, more_fragments, ntohl(frag->id));
-                current += sizeof(ipv6_fragment_t);
-                remaining -= sizeof(ipv6_fragment_t);
-                break;
+                const ipv6_fragment_t *fh = (const ipv6_fragment_t *)current;
+                frag->present = 1;
+                frag->id = ntohl(fh->id);
+                frag->offset = (ntohs(fh->frag_offset_res_m) >> 3) * 8;
+                frag->more = ntohs(fh->frag_offset_res_m) & 0x0001;
+                LOG_DEBUG_SIMPLE("Fragment (offset=%u, MF=%u, id=0x%08X)\n",
+                       frag->offset, frag->more, frag->id);
+                *payload_ptr = current + sizeof(ipv6_fragment_t);
+                *payload_size_ptr = remaining - (int)sizeof(ipv6_fragment_t);
+                return fh->next_header;
             }
             case 60: {
                 if (remaining < 8) {
-                    printf("-> Truncated Destination Options header\n");
+                    LOG_DEBUG_SIMPLE("-> Truncated Destination Options header\n");
                     return -1;
                 }
                 int hdr_len = (ext_hdr->hdr_ext_len + 1) * 8;
                 if (hdr_len < 8 || hdr_len > remaining || hdr_len > 2048) {
-                    printf("-> Invalid Destination Options header length (%d)\n", hdr_len);
+                    LOG_DEBUG_SIMPLE("-> Invalid Destination Options header length (%d)\n", hdr_len);
                     return -1;
                 }
-                printf("Dest Options (%d bytes) -> ", hdr_len);
+                LOG_DEBUG_SIMPLE("Dest Options (%d bytes) -> ", hdr_len);
                 current += hdr_len;
                 remaining -= hdr_len;
                 break;
             }
             default: {
-                printf("-> Unknown extension header (0x%02X)\n", next_header);
+                LOG_DEBUG_SIMPLE("-> Unknown extension header (0x%02X)\n", next_header);
                 if (remaining < 8) {
                     return -1;
                 }
                 int hdr_len = (ext_hdr->hdr_ext_len + 1) * 8;
                 if (hdr_len < 8 || hdr_len > remaining || hdr_len > 2048) {
-                    printf("-> Invalid extension header length (%d)\n", hdr_len);
+                    LOG_DEBUG_SIMPLE("-> Invalid extension header length (%d)\n", hdr_len);
                     return -1;
                 }
                 current += hdr_len;
@@ -143,13 +157,13 @@ static int parse_ipv6_extensions(const u_char **payload_ptr, int *payload_size_p
 
         // Validate that we actually advanced
         if (current <= prev_current) {
-            printf("-> Loop detected: header did not advance\n");
+            LOG_DEBUG_SIMPLE("-> Loop detected: header did not advance\n");
             return -1;
         }
         
         // Check for backwards movement (should never happen)
         if (current < start) {
-            printf("-> Invalid: moved backwards in packet\n");
+            LOG_DEBUG_SIMPLE("-> Invalid: moved backwards in packet\n");
             return -1;
         }
 
@@ -160,17 +174,67 @@ static int parse_ipv6_extensions(const u_char **payload_ptr, int *payload_size_p
     }
 
     if (header_count >= max_headers) {
-        printf("-> Too many extension headers (max %d)\n", max_headers);
+        LOG_DEBUG_SIMPLE("-> Too many extension headers (max %d)\n", max_headers);
         return -1;
     }
 
-    printf("-> End of headers\n");
+    LOG_DEBUG_SIMPLE("-> End of headers\n");
+    *payload_size_ptr = remaining;
     return next_header;
 }
 
-void parse_ipv4(const u_char *data, int size) {
+// Hand a whole datagram's payload to the transport parser for pkt->ip_proto
+static void ip_dispatch_transport(packet_ctx_t *pkt, const u_char *payload, int payload_size) {
+    switch (pkt->ip_proto) {
+        case 1:    // ICMP
+        case 58:   // ICMPv6
+            stats_increment(PROTO_ICMP);
+            analyzer_track_flow(pkt, 0, 0, 0);
+            if (pkt->family == 4) parse_icmp(payload, payload_size);
+            else parse_icmpv6(payload, payload_size);
+            break;
+        case 6:
+            stats_increment(PROTO_TCP);
+            parse_tcp(pkt, payload, payload_size);
+            break;
+        case 17:
+            stats_increment(PROTO_UDP);
+            parse_udp(pkt, payload, payload_size);
+            break;
+        default:
+            analyzer_track_flow(pkt, 0, 0, 0);
+            LOG_DEBUG_SIMPLE("IPv%u: Unsupported transport protocol %u\n", pkt->family, pkt->ip_proto);
+            break;
+    }
+}
+
+// Feed a fragment to the worker's reassembly cache. Returns 1 with
+// *payload/*payload_size replaced by the whole datagram once complete.
+static int ip_reassemble(packet_ctx_t *pkt, uint32_t id, uint32_t offset, int more, int truncated,
+                         const u_char **payload, int *payload_size) {
+    if (!pkt->an) return 0;
+    if (truncated) {
+        // Snaplen cut the fragment short: its bytes cannot be trusted
+        LOG_DEBUG_SIMPLE("IPv%u: Truncated fragment not reassembled\n", pkt->family);
+        return 0;
+    }
+    IpFragDatagram dg;
+    if (ipfrag_add(pkt->an->frags, pkt, id, offset, more, *payload, (uint32_t)*payload_size, &dg) != 1) {
+        return 0;
+    }
+    TRACE(TRACE_IP_REASSEMBLED, pkt->family, pkt->ip_proto, dg.len, dg.fragments);
+    LOG_DEBUG_SIMPLE("IPv%u: Reassembled %u bytes from %u fragments\n", pkt->family, dg.len, dg.fragments);
+    pkt->is_fragment = 0;
+    pkt->wire_len = dg.wire_bytes;   // Flow byte counts cover every fragment
+    *payload = dg.data;
+    *payload_size = (int)dg.len;
+    return 1;
+}
+
+void parse_ipv4(packet_ctx_t *pkt, const u_char *data, int size) {
     if (size < (int)sizeof(ipv4_header_t)) {
-        printf("IPv4: Truncated header\n");
+        stats_count_truncated(PROTO_IPV4);
+        LOG_DEBUG_SIMPLE("IPv4: Truncated header\n");
         return;
     }
 
@@ -179,99 +243,132 @@ void parse_ipv4(const u_char *data, int size) {
     int total_len = ntohs(ip->total_length);
 
     if (ihl < 20 || ihl > size) {
-        printf("IPv4: Invalid IHL=%d (size=%d)\n", ihl, size);
+        if (ihl < 20) stats_count_malformed(PROTO_IPV4);
+        else stats_count_truncated(PROTO_IPV4);
+        LOG_DEBUG_SIMPLE("IPv4: Invalid IHL=%d (size=%d)\n", ihl, size);
         return;
     }
     if (total_len < ihl) {
-        printf("IPv4: Warning - Invalid total length %d < IHL %d\n", total_len, ihl);
+        stats_count_malformed(PROTO_IPV4);
+        LOG_DEBUG_SIMPLE("IPv4: Invalid total length %d < IHL %d\n", total_len, ihl);
         return;
     }
-    if (total_len > size) {
-        printf("IPv4: Warning - Packet truncated: declared length %d, available %d bytes\n", total_len, size);
+    int truncated = total_len > size;
+    if (truncated) {
+        stats_count_truncated(PROTO_IPV4);
+        LOG_DEBUG_SIMPLE("IPv4: Packet truncated: declared length %d, available %d bytes\n", total_len, size);
         total_len = size;  // Clamp to available bytes
     }
 
-    char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
-    print_ipv4_addresses(ip, src, sizeof(src), dst, sizeof(dst));
+    pkt->family = 4;
+    pkt->ip_proto = ip->protocol;
+    pkt->is_fragment = (ip->flags_fragment & htons(0x3FFF)) != 0;
+    pkt->addr_len = 4;
+    pkt->src_addr = (const u_char *)&ip->src_addr;
+    pkt->dst_addr = (const u_char *)&ip->dst_addr;
+    stats_heavy_addrs(4, pkt->src_addr, pkt->dst_addr);
 
-    unsigned short ff = ntohs(ip->flags_fragment);
-    int more_frags = (ff & 0x2000) != 0;
-    int frag_offset = (ff & 0x1FFF) * 8;
+    TRACE(TRACE_IPV4, ip->src_addr, ip->dst_addr, ip->ttl, ip->protocol, total_len);
+    if (pkt->is_fragment) {
+        TRACE(TRACE_IPV4_FRAG, (ntohs(ip->flags_fragment) & 0x2000) != 0,
+              (ntohs(ip->flags_fragment) & 0x1FFF) * 8);
+    }
 
-    printf("IPv4: %s -> %s, TTL=%u, Proto=%u, Len=%d",
-           src, dst, ip->ttl, ip->protocol, total_len);
-    if (more_frags || frag_offset)
-        printf("  [fragment %s offset=%d]", more_frags ? "MF" : "", frag_offset);
-    printf("\n");
+    // Address strings only feed debug output; skip inet_ntop otherwise
+    if (PKT_VERBOSE(pkt)) {
+        print_ipv4_addresses(ip, pkt->src_ip, sizeof(pkt->src_ip), pkt->dst_ip, sizeof(pkt->dst_ip));
+
+        unsigned short ff = ntohs(ip->flags_fragment);
+        int more_frags = (ff & 0x2000) != 0;
+        int frag_offset = (ff & 0x1FFF) * 8;
+
+        LOG_DEBUG_SIMPLE("IPv4: %s -> %s, TTL=%u, Proto=%u, Len=%d",
+                         pkt->src_ip, pkt->dst_ip, ip->ttl, ip->protocol, total_len);
+        if (more_frags || frag_offset)
+            LOG_DEBUG_SIMPLE("  [fragment %s offset=%d]", more_frags ? "MF" : "", frag_offset);
+        LOG_DEBUG_SIMPLE("\n");
+    }
 
     const u_char *payload = data + ihl;
     int payload_size = total_len - ihl;
     if (payload_size < 0) payload_size = 0;
 
-    switch (ip->protocol) {
-        case 1:
-            stats_increment("ICMP");
-            parse_icmp(payload, payload_size);
-            break;
-        case 6:
-            stats_increment("TCP");
-            parse_tcp(payload, payload_size, src, dst);
-            break;
-        case 17:
-            stats_increment("UDP");
-            parse_udp(payload, payload_size, src, dst);
-            break;
-        default:
-            printf("IPv4: Unsupported protocol %u\n", ip->protocol);
-            break;
+    // Transport parsers only ever see whole datagrams
+    if (pkt->is_fragment) {
+        unsigned short ff = ntohs(ip->flags_fragment);
+        if (!ip_reassemble(pkt, ntohs(ip->identification), (ff & 0x1FFF) * 8u, (ff & 0x2000) != 0,
+                           truncated, &payload, &payload_size)) {
+            return;
+        }
     }
+    ip_dispatch_transport(pkt, payload, payload_size);
 }
 
-void parse_ipv6(const u_char *data, int size) {
+void parse_ipv6(packet_ctx_t *pkt, const u_char *data, int size) {
     if (size < (int)sizeof(ipv6_header_t)) {
-        printf("IPv6: Truncated header\n");
+        stats_count_truncated(PROTO_IPV6);
+        LOG_DEBUG_SIMPLE("IPv6: Truncated header\n");
         return;
     }
 
     const ipv6_header_t *ip6 = (const ipv6_header_t *)data;
-    char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
-    print_ipv6_addresses(ip6, src, sizeof(src), dst, sizeof(dst));
+    if (PKT_VERBOSE(pkt)) {
+        print_ipv6_addresses(ip6, pkt->src_ip, sizeof(pkt->src_ip), pkt->dst_ip, sizeof(pkt->dst_ip));
+    }
 
     int payload_len = ntohs(ip6->payload_len);
-    if (payload_len + (int)sizeof(ipv6_header_t) > size) {
+    int truncated = payload_len + (int)sizeof(ipv6_header_t) > size;
+    if (truncated) {
+        stats_count_truncated(PROTO_IPV6);
         payload_len = size - (int)sizeof(ipv6_header_t); // clamp
     }
 
-    printf("IPv6: %s -> %s, HopLimit=%u, NextHdr=%u, PayloadLen=%d\n",
-           src, dst, ip6->hop_limit, ip6->next_header, payload_len);
+    TRACE(TRACE_IPV6, trace_ipv6_hi(&ip6->src), trace_ipv6_lo(&ip6->src),
+          trace_ipv6_hi(&ip6->dst), trace_ipv6_lo(&ip6->dst),
+          ip6->hop_limit, ip6->next_header, payload_len);
+    if (PKT_VERBOSE(pkt)) {
+        LOG_DEBUG_SIMPLE("IPv6: %s -> %s, HopLimit=%u, NextHdr=%u, PayloadLen=%d\n",
+               pkt->src_ip, pkt->dst_ip, ip6->hop_limit, ip6->next_header, payload_len);
+    }
 
     const u_char *payload = data + sizeof(ipv6_header_t);
     int payload_size = payload_len;
 
     // Parse extension headers
-    int final_protocol = parse_ipv6_extensions(&payload, &payload_size, ip6->next_header);
+    ipv6_frag_info_t frag = {0};
+    int final_protocol = parse_ipv6_extensions(&payload, &payload_size, ip6->next_header, &frag);
 
     if (final_protocol == -1) {
-        printf("IPv6: Error parsing extension headers\n");
+        stats_count_malformed(PROTO_IPV6);
+        LOG_DEBUG_SIMPLE("IPv6: Error parsing extension headers\n");
         return;
     }
 
-    // Route to transport parser
-    switch (final_protocol) {
-        case 58:
-            stats_increment("ICMP");
-            parse_icmpv6(payload, payload_size);
-            break;
-        case 6:
-            stats_increment("TCP");
-            parse_tcp(payload, payload_size, src, dst);
-            break;
-        case 17:
-            stats_increment("UDP");
-            parse_udp(payload, payload_size, src, dst);
-            break;
-        default:
-            printf("IPv6: Unsupported transport protocol %u\n", final_protocol);
-            break;
+    pkt->family = 6;
+    pkt->ip_proto = (uint8_t)final_protocol;   // Fragment header's next header until reassembled
+    pkt->is_fragment = frag.present && (frag.offset != 0 || frag.more);
+    pkt->addr_len = 16;
+    pkt->src_addr = (const u_char *)&ip6->src;
+    pkt->dst_addr = (const u_char *)&ip6->dst;
+    stats_heavy_addrs(6, pkt->src_addr, pkt->dst_addr);
+
+    if (frag.present) {
+        if (pkt->is_fragment &&
+            !ip_reassemble(pkt, frag.id, frag.offset, frag.more, truncated, &payload, &payload_size)) {
+            return;
+        }
+        // Headers after the Fragment header are part of the (reassembled) payload.
+        // An atomic fragment (offset 0, no MF) is just an unfragmented packet.
+        ipv6_frag_info_t nested = {0};
+        final_protocol = parse_ipv6_extensions(&payload, &payload_size, (u_char)final_protocol, &nested);
+        if (final_protocol == -1 || nested.present) {
+            stats_count_malformed(PROTO_IPV6);
+            LOG_DEBUG_SIMPLE("IPv6: Error parsing headers after Fragment header\n");
+            return;
+        }
+        pkt->ip_proto = (uint8_t)final_protocol;
     }
+
+    // Route to transport parser
+    ip_dispatch_transport(pkt, payload, payload_size);
 }
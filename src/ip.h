@@ -3,6 +3,8 @@
 #define IP_H
 
 #include <pcap.h>
+#include "platform.h"  // struct in6_addr
+#include "packet.h"
 
 // IPv4 header
 #pragma pack(push, 1)
@@ -68,7 +70,8 @@ typedef struct {
 #pragma pack(pop)
 
 // API
-void parse_ipv4(const u_char *data, int size);
-void parse_ipv6(const u_char *data, int size);
+// Both fill the network-layer fields of pkt before handing off to transport
+void parse_ipv4(packet_ctx_t *pkt, const u_char *data, int size);
+void parse_ipv6(packet_ctx_t *pkt, const u_char *data, int size);
 
 #endif // IP_H
@@ -0,0 +1,311 @@
+// ipfrag.c - IPv4/IPv6 fragment reassembly cache
+#include "ipfrag.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct FragChunk FragChunk;
+struct FragChunk {
+    FragChunk *next;
+    uint32_t offset;
+    uint32_t len;
+    u_char data[IPFRAG_CHUNK_DATA];
+};
+
+typedef struct FragEntry FragEntry;
+struct FragEntry {
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint32_t id;
+    uint32_t hash;
+    uint8_t family;
+    uint8_t proto;
+    uint8_t has_last;            // Fragment with MF=0 seen: total_len is known
+    uint32_t total_len;
+    uint32_t received;           // Distinct payload bytes held
+    uint32_t wire_bytes;
+    uint32_t fragments;
+    uint64_t first_us;
+    FragChunk *chunks;           // Ascending by offset, non-overlapping
+    FragEntry *hnext;            // Hash bucket chain
+    FragEntry *older;            // Age list (creation order = expiry order)
+    FragEntry *newer;
+};
+
+struct IpFragCache {
+    IpFragConfig cfg;
+    ObjPool entries;
+    ObjPool chunks;
+    FragEntry **buckets;
+    uint32_t bucket_mask;
+    FragEntry *oldest;
+    FragEntry *newest;
+    u_char *scratch;             // Reassembled payload handed to the caller
+    IpFragStats stats;
+};
+
+static uint32_t round_up_pow2(uint32_t v) {
+    uint32_t p = 1;
+    while (p < v && p < 0x80000000u) p <<= 1;
+    return p;
+}
+
+IpFragCache *ipfrag_create(const IpFragConfig *cfg) {
+    IpFragCache *c = (IpFragCache *)calloc(1, sizeof(IpFragCache));
+    if (!c) return NULL;
+    c->cfg = *cfg;
+    if (c->cfg.max_datagrams == 0) c->cfg.max_datagrams = IPFRAG_DEFAULT_MAX_DATAGRAMS;
+    if (c->cfg.max_buffers == 0) c->cfg.max_buffers = IPFRAG_DEFAULT_MEMORY_KB / 2;
+    if (c->cfg.timeout_s == 0) c->cfg.timeout_s = IPFRAG_DEFAULT_TIMEOUT;
+
+    uint32_t nbuckets = round_up_pow2(c->cfg.max_datagrams);
+    c->bucket_mask = nbuckets - 1;
+    c->buckets = (FragEntry **)calloc(nbuckets, sizeof(FragEntry *));
+    c->scratch = (u_char *)malloc(IPFRAG_MAX_PAYLOAD);
+    if (!c->buckets || !c->scratch ||
+        pool_init(&c->entries, sizeof(FragEntry), c->cfg.max_datagrams) != 0 ||
+        pool_init(&c->chunks, sizeof(FragChunk), c->cfg.max_buffers) != 0) {
+        fprintf(stderr, "[!] IP reassembly: failed to allocate cache\n");
+        ipfrag_destroy(c);
+        return NULL;
+    }
+    c->stats.max_datagrams = c->cfg.max_datagrams;
+    c->stats.max_buffers = c->cfg.max_buffers;
+    c->stats.memory_bytes = (uint64_t)c->entries.obj_size * c->entries.capacity +
+                            (uint64_t)c->chunks.obj_size * c->chunks.capacity +
+                            (uint64_t)nbuckets * sizeof(FragEntry *) + IPFRAG_MAX_PAYLOAD;
+    return c;
+}
+
+void ipfrag_destroy(IpFragCache *c) {
+    if (!c) return;
+    pool_destroy(&c->entries);
+    pool_destroy(&c->chunks);
+    free(c->buckets);
+    free(c->scratch);
+    free(c);
+}
+
+// ---------------------------
+// Entries
+// ---------------------------
+static uint32_t key_hash(uint8_t family, uint8_t proto, uint32_t id,
+                         const u_char *src, const u_char *dst, unsigned addr_len) {
+    // FNV-1a over the key fields
+    uint32_t h = 2166136261u;
+#define IPFRAG_MIX(b) do { h ^= (uint8_t)(b); h *= 16777619u; } while (0)
+    IPFRAG_MIX(family);
+    IPFRAG_MIX(proto);
+    for (int i = 0; i < 4; i++) IPFRAG_MIX(id >> (i * 8));
+    for (unsigned i = 0; i < addr_len; i++) IPFRAG_MIX(src[i]);
+    for (unsigned i = 0; i < addr_len; i++) IPFRAG_MIX(dst[i]);
+#undef IPFRAG_MIX
+    return h;
+}
+
+static FragEntry *entry_find(IpFragCache *c, const packet_ctx_t *pkt, uint32_t id, uint32_t hash) {
+    for (FragEntry *e = c->buckets[hash & c->bucket_mask]; e; e = e->hnext) {
+        if (e->hash == hash && e->id == id && e->family == pkt->family && e->proto == pkt->ip_proto &&
+            memcmp(e->src, pkt->src_addr, pkt->addr_len) == 0 &&
+            memcmp(e->dst, pkt->dst_addr, pkt->addr_len) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void entry_free(IpFragCache *c, FragEntry *e) {
+    FragEntry **link = &c->buckets[e->hash & c->bucket_mask];
+    while (*link != e) link = &(*link)->hnext;
+    *link = e->hnext;
+
+    if (e->older) e->older->newer = e->newer;
+    else c->oldest = e->newer;
+    if (e->newer) e->newer->older = e->older;
+    else c->newest = e->older;
+
+    while (e->chunks) {
+        FragChunk *ch = e->chunks;
+        e->chunks = ch->next;
+        pool_free(&c->chunks, ch);
+    }
+    pool_free(&c->entries, e);
+}
+
+// Make room by dropping the oldest datagram other than keep; 0 if there is none
+static int evict_oldest(IpFragCache *c, const FragEntry *keep) {
+    FragEntry *victim = c->oldest;
+    if (victim == keep) victim = victim->newer;
+    if (!victim) return 0;
+    c->stats.evictions++;
+    entry_free(c, victim);
+    return 1;
+}
+
+static FragEntry *entry_create(IpFragCache *c, const packet_ctx_t *pkt, uint32_t id, uint32_t hash) {
+    FragEntry *e;
+    while ((e = (FragEntry *)pool_alloc(&c->entries)) == NULL) {
+        if (!evict_oldest(c, NULL)) return NULL;
+    }
+    memset(e, 0, sizeof(*e));
+    memcpy(e->src, pkt->src_addr, pkt->addr_len);
+    memcpy(e->dst, pkt->dst_addr, pkt->addr_len);
+    e->id = id;
+    e->hash = hash;
+    e->family = pkt->family;
+    e->proto = pkt->ip_proto;
+    e->first_us = pkt->ts_us;
+
+    FragEntry **bucket = &c->buckets[hash & c->bucket_mask];
+    e->hnext = *bucket;
+    *bucket = e;
+    e->older = c->newest;
+    if (c->newest) c->newest->newer = e;
+    else c->oldest = e;
+    c->newest = e;
+    return e;
+}
+
+void ipfrag_expire(IpFragCache *c, uint64_t now_us) {
+    uint64_t timeout_us = (uint64_t)c->cfg.timeout_s * 1000000u;
+    while (c->oldest && c->oldest->first_us + timeout_us <= now_us) {
+        c->stats.timeouts++;
+        entry_free(c, c->oldest);
+    }
+}
+
+// ---------------------------
+// Fragment Insertion
+// ---------------------------
+// Bytes of [off, end) already held
+static uint32_t overlap_bytes(const FragEntry *e, uint32_t off, uint32_t end) {
+    uint32_t n = 0;
+    for (const FragChunk *ch = e->chunks; ch && ch->offset < end; ch = ch->next) {
+        uint32_t lo = ch->offset > off ? ch->offset : off;
+        uint32_t hi = ch->offset + ch->len < end ? ch->offset + ch->len : end;
+        if (hi > lo) n += hi - lo;
+    }
+    return n;
+}
+
+// Copy the parts of [off, off + len) not yet held (held bytes win).
+// Returns -1 if the buffers ran out even after evicting older datagrams.
+static int insert(IpFragCache *c, FragEntry *e, uint32_t off, const u_char *data, uint32_t len) {
+    FragChunk **link = &e->chunks;
+    uint32_t end = off + len;
+    while (off < end) {
+        FragChunk *cur = *link;
+        if (cur && cur->offset + cur->len <= off) {
+            link = &cur->next;
+            continue;
+        }
+        if (cur && cur->offset <= off) {
+            uint32_t skip = cur->offset + cur->len - off;
+            if (skip > end - off) skip = end - off;
+            off += skip;
+            data += skip;
+            link = &cur->next;
+            continue;
+        }
+
+        uint32_t take = end - off;
+        if (cur && cur->offset < end) take = cur->offset - off;
+        if (take > IPFRAG_CHUNK_DATA) take = IPFRAG_CHUNK_DATA;
+
+        FragChunk *ch;
+        while ((ch = (FragChunk *)pool_alloc(&c->chunks)) == NULL) {
+            if (!evict_oldest(c, e)) return -1;
+        }
+        ch->offset = off;
+        ch->len = take;
+        memcpy(ch->data, data, take);
+        ch->next = cur;
+        *link = ch;
+        link = &ch->next;
+        e->received += take;
+        off += take;
+        data += take;
+    }
+    return 0;
+}
+
+static void drop_datagram(IpFragCache *c, FragEntry *e, uint64_t *counter) {
+    (*counter)++;
+    entry_free(c, e);
+}
+
+int ipfrag_add(IpFragCache *c, const packet_ctx_t *pkt, uint32_t id, uint32_t offset, int more,
+               const u_char *data, uint32_t len, IpFragDatagram *out) {
+    c->stats.fragments++;
+    ipfrag_expire(c, pkt->ts_us);
+
+    uint32_t end = offset + len;
+    // Non-final fragments carry a multiple of 8 bytes; nothing may pass 64 KiB
+    if (end > IPFRAG_MAX_PAYLOAD || (more && (len == 0 || (len & 7) != 0))) {
+        c->stats.invalid++;
+        return -1;
+    }
+
+    uint32_t hash = key_hash(pkt->family, pkt->ip_proto, id, pkt->src_addr, pkt->dst_addr, pkt->addr_len);
+    FragEntry *e = entry_find(c, pkt, id, hash);
+    if (e) {
+        c->stats.hits++;
+    } else {
+        c->stats.misses++;
+        e = entry_create(c, pkt, id, hash);
+        if (!e) return -1;
+        if (c->entries.in_use > c->stats.peak) c->stats.peak = c->entries.in_use;
+    }
+
+    // The last fragment fixes the length; everything must stay inside it
+    if (!more) {
+        if ((e->has_last && e->total_len != end) ||
+            (!e->has_last && e->chunks && overlap_bytes(e, end, IPFRAG_MAX_PAYLOAD) > 0)) {
+            drop_datagram(c, e, &c->stats.invalid);
+            return -1;
+        }
+        e->has_last = 1;
+        e->total_len = end;
+    } else if (e->has_last && end > e->total_len) {
+        drop_datagram(c, e, &c->stats.invalid);
+        return -1;
+    }
+
+    uint32_t dup = overlap_bytes(e, offset, end);
+    if (dup == len && len > 0) {
+        c->stats.duplicates++;
+    } else if (dup > 0 && (pkt->family == 6 || c->cfg.ipv4_overlap == IPFRAG_OVERLAP_DROP)) {
+        drop_datagram(c, e, &c->stats.overlap_drops);
+        return -1;
+    } else {
+        c->stats.overlap_bytes += dup;
+        if (insert(c, e, offset, data, len) != 0) {
+            drop_datagram(c, e, &c->stats.evictions);
+            return -1;
+        }
+    }
+    e->wire_bytes += pkt->wire_len;
+    e->fragments++;
+
+    if (!e->has_last || e->received != e->total_len) return 0;
+
+    // Complete: chunks are contiguous from offset 0
+    uint32_t pos = 0;
+    for (const FragChunk *ch = e->chunks; ch; ch = ch->next) {
+        memcpy(c->scratch + pos, ch->data, ch->len);
+        pos += ch->len;
+    }
+    out->data = c->scratch;
+    out->len = pos;
+    out->wire_bytes = e->wire_bytes;
+    out->fragments = e->fragments;
+    c->stats.reassembled++;
+    entry_free(c, e);
+    return 1;
+}
+
+void ipfrag_get_stats(const IpFragCache *c, IpFragStats *out) {
+    *out = c->stats;
+    out->in_use = c->entries.in_use;
+    out->buffers_peak = c->chunks.peak;
+}
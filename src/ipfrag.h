@@ -0,0 +1,81 @@
+// ipfrag.h - IPv4/IPv6 fragment reassembly cache
+//
+// Fragments are keyed by (family, src, dst, id, proto) and copied into
+// fixed-size buffers from a per-worker pool until the datagram is whole;
+// the reassembled payload is then handed to the transport dispatch like an
+// unfragmented packet. Memory is capped by the number of datagrams and
+// buffers: when a pool is empty the oldest datagram is evicted. Datagrams
+// that do not complete within the timeout are dropped.
+#ifndef IPFRAG_H
+#define IPFRAG_H
+
+#include <pcap.h>
+#include <stdint.h>
+#include "packet.h"
+#include "pool.h"
+
+#define IPFRAG_DEFAULT_MAX_DATAGRAMS 4096    // In flight, total across workers
+#define IPFRAG_DEFAULT_MEMORY_KB     16384   // Fragment buffer memory, total across workers
+#define IPFRAG_DEFAULT_TIMEOUT       30      // Seconds from first fragment (Linux ipfrag_time)
+#define IPFRAG_CHUNK_DATA            2032    // Payload bytes per pooled buffer (2 KiB object)
+#define IPFRAG_MAX_PAYLOAD           65535   // Largest reassembled payload accepted
+
+// What to do when a fragment overlaps data already received. IPv6 always
+// uses IPFRAG_OVERLAP_DROP (RFC 5722); exact duplicates are ignored either way.
+typedef enum {
+    IPFRAG_OVERLAP_FIRST = 0,   // Keep the bytes received first, trim the newcomer
+    IPFRAG_OVERLAP_DROP         // Discard the whole datagram
+} ipfrag_overlap_t;
+
+typedef struct {
+    uint32_t max_datagrams;
+    uint32_t max_buffers;
+    uint32_t timeout_s;
+    ipfrag_overlap_t ipv4_overlap;
+} IpFragConfig;
+
+typedef struct {
+    uint64_t fragments;         // Fragments offered to the cache
+    uint64_t hits;              // Matched a datagram already in the cache
+    uint64_t misses;            // Started a new datagram
+    uint64_t reassembled;
+    uint64_t duplicates;        // Fragments that added no new bytes
+    uint64_t overlap_bytes;     // Trimmed under IPFRAG_OVERLAP_FIRST
+    uint64_t overlap_drops;     // Datagrams discarded for overlapping (IPFRAG_OVERLAP_DROP)
+    uint64_t invalid;           // Inconsistent length/offset, oversize, truncated capture
+    uint64_t timeouts;
+    uint64_t evictions;         // Oldest datagram dropped to make room
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t max_datagrams;
+    uint32_t buffers_peak;
+    uint32_t max_buffers;
+    uint64_t memory_bytes;
+} IpFragStats;
+
+// A complete datagram; data stays valid until the next ipfrag_add
+typedef struct {
+    const u_char *data;         // Transport payload (IPv6: starts at the Fragment header's next header)
+    uint32_t len;
+    uint32_t wire_bytes;        // Sum of the fragments' frame lengths
+    uint32_t fragments;
+} IpFragDatagram;
+
+typedef struct IpFragCache IpFragCache;
+
+IpFragCache *ipfrag_create(const IpFragConfig *cfg);
+void ipfrag_destroy(IpFragCache *c);
+
+// Add one fragment of the datagram described by pkt (family, ip_proto,
+// addresses, ts_us, wire_len). offset is in bytes. Returns 1 and fills out
+// when the datagram is complete, 0 while fragments are missing, -1 when
+// the fragment (or its whole datagram) was dropped.
+int ipfrag_add(IpFragCache *c, const packet_ctx_t *pkt, uint32_t id, uint32_t offset, int more,
+               const u_char *data, uint32_t len, IpFragDatagram *out);
+
+// Drop datagrams older than the timeout (called per fragment and when idle)
+void ipfrag_expire(IpFragCache *c, uint64_t now_us);
+
+void ipfrag_get_stats(const IpFragCache *c, IpFragStats *out);
+
+#endif // IPFRAG_H
@@ -12,33 +12,45 @@ typedef enum {
     LOG_DEBUG = 3    // Everything including per-packet details
 } LogLevel;
 
-// Global log level (can be set via command line or config)
+// Compile-time floor: anything more verbose than LOG_COMPILE_LEVEL is removed
+// by the compiler, arguments and all. Production builds keep the default
+// (2 = LOG_INFO); build with -DLOG_COMPILE_LEVEL=3 for per-packet output.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 2
+#endif
+
+// Global log level (can be set via command line or config); only applies
+// to levels that survived LOG_COMPILE_LEVEL
 extern LogLevel current_log_level;
 
+// Constant-false for compiled-out levels, so guarded blocks (address
+// stringification, flag formatting) are dead code in production builds
+#define LOG_ENABLED(level) ((level) <= LOG_COMPILE_LEVEL && (level) <= current_log_level)
+
 // Logging macros
 #define LOG_ERROR_MSG(...) \
-    do { if (LOG_ERROR <= current_log_level) fprintf(stderr, "[ERROR] " __VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_ERROR)) fprintf(stderr, "[ERROR] " __VA_ARGS__); } while(0)
 
 #define LOG_WARN_MSG(...) \
-    do { if (LOG_WARN <= current_log_level) printf("[WARN] " __VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_WARN)) printf("[WARN] " __VA_ARGS__); } while(0)
 
 #define LOG_INFO_MSG(...) \
-    do { if (LOG_INFO <= current_log_level) printf("[INFO] " __VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_INFO)) printf("[INFO] " __VA_ARGS__); } while(0)
 
 #define LOG_DEBUG_MSG(...) \
-    do { if (LOG_DEBUG <= current_log_level) printf("[DEBUG] " __VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_DEBUG)) printf("[DEBUG] " __VA_ARGS__); } while(0)
 
 // Simpler versions without level prefix (for backward compatibility)
 #define LOG_ERROR_SIMPLE(...) \
-    do { if (LOG_ERROR <= current_log_level) fprintf(stderr, __VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_ERROR)) fprintf(stderr, __VA_ARGS__); } while(0)
 
 #define LOG_WARN_SIMPLE(...) \
-    do { if (LOG_WARN <= current_log_level) printf(__VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_WARN)) printf(__VA_ARGS__); } while(0)
 
 #define LOG_INFO_SIMPLE(...) \
-    do { if (LOG_INFO <= current_log_level) printf(__VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_INFO)) printf(__VA_ARGS__); } while(0)
 
 #define LOG_DEBUG_SIMPLE(...) \
-    do { if (LOG_DEBUG <= current_log_level) printf(__VA_ARGS__); } while(0)
+    do { if (LOG_ENABLED(LOG_DEBUG)) printf(__VA_ARGS__); } while(0)
 
 #endif // LOGGER_H
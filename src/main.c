@@ -1,12 +1,18 @@
 // main.c - Packet Sniffer + Protocol Analyzer
 #include "sniffer.h"
 #include "stats.h"
+#include "platform.h"
+#include "tracelog.h"
+#include "flowtable.h"
+#include "ipfrag.h"
+#include "dnstrack.h"
+#include "metrics.h"
+#include "overload.h"
 #include <ctype.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
 
 // Configuration constants
 #define MAX_LINE_LENGTH 2048
@@ -62,16 +68,20 @@ static void load_env_file(const char *path) {
         trim(val);
         if (key[0] == '\0') continue;
 
-        // Build "KEY=VALUE" for _putenv with overflow protection
-        char env_entry[MAX_ENV_ENTRY];
-        int written = snprintf(env_entry, sizeof(env_entry), "%s=%s", key, val);
-        
-        if (written < 0 || written >= (int)sizeof(env_entry)) {
+        // Allow KEY="value with spaces" (filters, conninfo)
+        size_t vlen = strlen(val);
+        if (vlen >= 2 && (val[0] == '"' || val[0] == '\'') && val[vlen - 1] == val[0]) {
+            val[vlen - 1] = '\0';
+            val++;
+        }
+
+        // Reject entries that would not fit a "KEY=VALUE" environment block
+        if (strlen(key) + strlen(val) + 2 > MAX_ENV_ENTRY) {
             fprintf(stderr, "[!] Warning: Environment variable truncated: %s\n", key);
             continue;
         }
         
-        if (_putenv(env_entry) != 0) {
+        if (platform_setenv(key, val) != 0) {
             fprintf(stderr, "[!] Warning: Failed to set environment variable: %s\n", key);
         } else {
             loaded_count++;
@@ -97,27 +107,223 @@ static const char* get_postgres_conninfo(void) {
     return DEFAULT_POSTGRES_CONNINFO;
 }
 
+// Fill *out from a positive integer environment variable unless already set
+// (command-line options win over the environment)
+static void env_unsigned(const char *name, unsigned *out) {
+    const char *val = getenv(name);
+    if (*out != 0 || !val || val[0] == '\0') return;
+    char *end = NULL;
+    unsigned long v = strtoul(val, &end, 10);
+    if (!end || *end != '\0' || v == 0 || v > 0x10000000UL) {
+        fprintf(stderr, "[!] Warning: Ignoring invalid %s=%s\n", name, val);
+        return;
+    }
+    *out = (unsigned)v;
+}
+
+// String counterpart of env_unsigned (an empty -f "" still wins)
+static void env_string(const char *name, const char **out) {
+    const char *val = getenv(name);
+    if (*out || !val || val[0] == '\0') return;
+    *out = val;
+}
+
 // Ctrl+C handler (async-signal-safe - only sets flag)
 void handle_exit(int sig) {
     (void)sig; // Unused
     exit_requested = 1;  // Only async-signal-safe operations allowed here
 }
 
-int main() {
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  -r <file>   Replay a pcap/pcapng file through the analyzer at maximum speed\n");
+    printf("  -i <iface>  Capture live from <iface> (skips the interactive picker)\n");
+    printf("  -B <name>   Live capture backend: pcap or afpacket (default: afpacket on Linux)\n");
+    printf("  -s <bytes>  Snap length / packet ring slot size (default 9216)\n");
+    printf("  -q <slots>  Packet ring slots per worker, rounded down to a power of two\n");
+    printf("              (default 8192 split across workers, min 1024)\n");
+    printf("  -w <n>      Analysis worker threads, 1-%d (default 1); flows are hashed to workers\n",
+           SNIFFER_MAX_WORKERS);
+    printf("  -f <expr>   Capture filter in tcpdump syntax, applied in the kernel (env CAPTURE_FILTER)\n");
+    printf("  -F <flows>  Flow table capacity across all workers (default %u, env FLOW_TABLE_SIZE)\n",
+           FLOW_DEFAULT_MAX_FLOWS);
+    printf("  -t <file>   Trace per-packet detail as text to <file> (- for stdout), formatted off the hot path\n");
+    printf("  -T <file>   Trace per-packet detail as binary records (decode with tracedump)\n");
+    printf("  -m <port>   Serve Prometheus metrics on http://%s:<port>/metrics (env METRICS_PORT,\n"
+           "              bind address METRICS_ADDR)\n", METRICS_DEFAULT_ADDR);
+    printf("  -h          Show this help\n");
+    printf("Without -r or -i, an interactive device picker starts a live capture.\n");
+    printf("Flow timeouts (seconds): FLOW_IDLE_TIMEOUT (default %d), FLOW_ACTIVE_TIMEOUT (default %d).\n",
+           FLOW_DEFAULT_IDLE_TIMEOUT, FLOW_DEFAULT_ACTIVE_TIMEOUT);
+    printf("IP reassembly: IPFRAG_TIMEOUT seconds (default %d), IPFRAG_MEMORY_KB (default %d).\n",
+           IPFRAG_DEFAULT_TIMEOUT, IPFRAG_DEFAULT_MEMORY_KB);
+    printf("DNS transactions: DNS_TRACK_TIMEOUT seconds (default %d), DNS_TRACK_SIZE queries (default %d).\n",
+           DNSTRACK_DEFAULT_TIMEOUT, DNSTRACK_DEFAULT_MAX_QUERIES);
+    printf("Postgres outages: rows wait in STATS_SPOOL_FILE (default %s, none = off), capped at STATS_SPOOL_MAX_MB (default %d).\n",
+           STATS_SPOOL_DEFAULT_FILE, STATS_SPOOL_DEFAULT_MB);
+    printf("Dissectors: DISSECTORS (e.g. -dhcp,+tls-heuristic), DISSECTOR_PORTS (e.g. http:8080,https:8443).\n");
+    printf("Live load shedding (OVERLOAD=off disables): counters only at OVERLOAD_COUNTERS_PCT queue fill (default %d),\n"
+           "  1 flow in OVERLOAD_SAMPLE_RATE (default %d) at OVERLOAD_SAMPLE_PCT (default %d), back down one mode\n"
+           "  at OVERLOAD_RECOVER_PCT (default %d) after OVERLOAD_HOLD_MS (default %d).\n",
+           OVERLOAD_DEFAULT_COUNTERS_PCT, OVERLOAD_DEFAULT_SAMPLE_RATE, OVERLOAD_DEFAULT_SAMPLE_PCT,
+           OVERLOAD_DEFAULT_RECOVER_PCT, OVERLOAD_DEFAULT_HOLD_MS);
+}
+
+// Parse command line into cfg; returns 0 to continue, 1 to exit cleanly, -1 on error
+static int parse_args(int argc, char **argv, SnifferConfig *cfg) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[!] -r requires a file argument\n");
+                return -1;
+            }
+            cfg->read_file = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[!] -i requires an interface name\n");
+                return -1;
+            }
+            cfg->device = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[!] -f requires a filter expression (quote it)\n");
+                return -1;
+            }
+            cfg->capture_filter = argv[++i];
+        } else if (strcmp(argv[i], "-B") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[!] -B requires a backend name\n");
+                return -1;
+            }
+            const char *name = argv[++i];
+            if (strcmp(name, "pcap") == 0) {
+                cfg->backend = CAPTURE_BACKEND_PCAP;
+            } else if (strcmp(name, "afpacket") == 0) {
+                cfg->backend = CAPTURE_BACKEND_AFPACKET;
+            } else {
+                fprintf(stderr, "[!] Unknown capture backend: %s\n", name);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-q") == 0 ||
+                   strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "-F") == 0 ||
+                   strcmp(argv[i], "-m") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[!] %s requires a number\n", argv[i]);
+                return -1;
+            }
+            char *end = NULL;
+            unsigned long v = strtoul(argv[i + 1], &end, 10);
+            if (!end || *end != '\0' || v == 0 || v > 0x10000000UL) {
+                fprintf(stderr, "[!] Invalid value for %s: %s\n", argv[i], argv[i + 1]);
+                return -1;
+            }
+            if (argv[i][1] == 'w' && v > SNIFFER_MAX_WORKERS) {
+                fprintf(stderr, "[!] -w must be between 1 and %d\n", SNIFFER_MAX_WORKERS);
+                return -1;
+            }
+            if (argv[i][1] == 'm' && v > 65535) {
+                fprintf(stderr, "[!] -m must be a TCP port (1-65535)\n");
+                return -1;
+            }
+            if (argv[i][1] == 's') cfg->snaplen = (unsigned)v;
+            else if (argv[i][1] == 'q') {
+                cfg->queue_slots = (unsigned)v;
+                if (v & (v - 1)) {
+                    while (cfg->queue_slots & (cfg->queue_slots - 1)) cfg->queue_slots &= cfg->queue_slots - 1;
+                    printf("[!] -q %lu is not a power of two; using %u slots per worker\n", v, cfg->queue_slots);
+                }
+            }
+            else if (argv[i][1] == 'F') cfg->max_flows = (unsigned)v;
+            else if (argv[i][1] == 'm') cfg->metrics_port = (unsigned)v;
+            else cfg->workers = (unsigned)v;
+            i++;
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "-T") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[!] %s requires a file argument\n", argv[i]);
+                return -1;
+            }
+            cfg->trace_binary = argv[i][1] == 'T';
+            cfg->trace_path = argv[++i];
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            fprintf(stderr, "[!] Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
     printf("=== Packet Sniffer + Protocol Analyzer ===\n");
 
+    SnifferConfig cfg = {0};
+    int arg_result = parse_args(argc, argv, &cfg);
+    if (arg_result != 0) {
+        return arg_result < 0 ? 1 : 0;
+    }
+
     // Load environment overrides from .env if present
     load_env_file(".env");
+    env_string("CAPTURE_FILTER", &cfg.capture_filter);
+    env_unsigned("FLOW_TABLE_SIZE", &cfg.max_flows);
+    env_unsigned("FLOW_IDLE_TIMEOUT", &cfg.flow_idle_timeout);
+    env_unsigned("FLOW_ACTIVE_TIMEOUT", &cfg.flow_active_timeout);
+    env_unsigned("IPFRAG_TIMEOUT", &cfg.frag_timeout);
+    env_unsigned("IPFRAG_MEMORY_KB", &cfg.frag_memory_kb);
+    env_unsigned("DNS_TRACK_TIMEOUT", &cfg.dns_timeout);
+    env_unsigned("DNS_TRACK_SIZE", &cfg.dns_max_queries);
+    env_string("DISSECTORS", &cfg.dissectors);
+    env_string("DISSECTOR_PORTS", &cfg.dissector_ports);
+    env_string("OVERLOAD", &cfg.overload);
+    env_unsigned("OVERLOAD_COUNTERS_PCT", &cfg.overload_counters_pct);
+    env_unsigned("OVERLOAD_SAMPLE_PCT", &cfg.overload_sample_pct);
+    env_unsigned("OVERLOAD_RECOVER_PCT", &cfg.overload_recover_pct);
+    env_unsigned("OVERLOAD_HOLD_MS", &cfg.overload_hold_ms);
+    env_unsigned("OVERLOAD_SAMPLE_RATE", &cfg.overload_sample_rate);
+    env_unsigned("METRICS_PORT", &cfg.metrics_port);
+    env_string("METRICS_ADDR", &cfg.metrics_addr);
+    if (cfg.metrics_port > 65535) {
+        fprintf(stderr, "[!] Warning: Ignoring invalid METRICS_PORT=%u\n", cfg.metrics_port);
+        cfg.metrics_port = 0;
+    }
 
     // Initialize stats module with Postgres connection info
+    const char *spool_file = NULL;
+    unsigned spool_mb = 0;
+    env_string("STATS_SPOOL_FILE", &spool_file);
+    env_unsigned("STATS_SPOOL_MAX_MB", &spool_mb);
+    stats_configure_spool(spool_file, spool_mb);
     const char *conninfo = get_postgres_conninfo();
     stats_init(conninfo);
 
     // Set Ctrl+C handler
     signal(SIGINT, handle_exit);
 
-    // Start packet capture loop (blocking)
-    start_sniffer();
+    // Optional asynchronous per-packet trace (formatter thread owns the output)
+    if (cfg.trace_path && tracelog_open(cfg.trace_path, cfg.trace_binary) != 0) {
+        stats_cleanup();
+        return 1;
+    }
+
+    // Optional Prometheus endpoint; the sniffer adds its collector while it runs
+    if (cfg.metrics_port) {
+        if (metrics_start(cfg.metrics_addr, cfg.metrics_port) != 0) {
+            tracelog_close();
+            stats_cleanup();
+            return 1;
+        }
+        metrics_register(stats_collect_metrics, NULL);
+    }
+
+    // Start packet capture loop (blocking; returns at EOF in offline mode)
+    start_sniffer(&cfg);
+
+    // Workers have exited: drain and close the trace
+    tracelog_close();
+    metrics_stop();
 
     // Check if exit was requested via signal
     if (exit_requested) {
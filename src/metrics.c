@@ -0,0 +1,342 @@
+// metrics.c - Prometheus text-format endpoint
+#include "metrics.h"
+#include "platform.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+typedef SOCKET sock_t;
+#define SOCK_INVALID INVALID_SOCKET
+#define sock_close closesocket
+#define SEND_FLAGS 0
+#else
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+typedef int sock_t;
+#define SOCK_INVALID (-1)
+#define sock_close close
+#define SEND_FLAGS MSG_NOSIGNAL     // A scraper hanging up must not raise SIGPIPE
+#endif
+
+#define METRICS_MAX_COLLECTORS 8
+#define METRICS_POLL_MS 100         // Longest the thread waits before re-checking stop and refresh
+#define METRICS_IO_TIMEOUT_MS 1000  // Per-client receive/send timeout (one client at a time)
+#define METRICS_CLIENT_MS 2000      // Whole connection, however slowly the client trickles
+#define METRICS_REQUEST_MAX 2048    // Request line + headers kept; the rest is ignored
+
+typedef struct {
+    metrics_collect_fn fn;
+    void *arg;
+} Collector;
+
+static Collector collectors[METRICS_MAX_COLLECTORS];
+static mutex_t collectors_lock;
+static sock_t listen_sock = SOCK_INVALID;
+static thread_t metrics_thread;
+static volatile int running = 0;
+static volatile int stopping = 0;
+
+// Owned by the metrics thread: front is served, back is rendered into
+static MetricsBuf buffers[2];
+static MetricsBuf *front = &buffers[0];
+static MetricsBuf *back = &buffers[1];
+
+// ---------------------------
+// Rendering
+// ---------------------------
+static int buf_reserve(MetricsBuf *mb, size_t extra) {
+    if (mb->failed) return -1;
+    if (mb->len + extra + 1 <= mb->cap) return 0;
+    size_t cap = mb->cap ? mb->cap : 16384;
+    while (cap < mb->len + extra + 1) cap *= 2;
+    char *data = (char *)realloc(mb->data, cap);
+    if (!data) {
+        mb->failed = 1;
+        return -1;
+    }
+    mb->data = data;
+    mb->cap = cap;
+    return 0;
+}
+
+void metrics_printf(MetricsBuf *mb, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0 || buf_reserve(mb, (size_t)n) != 0) return;
+    va_start(ap, fmt);
+    vsnprintf(mb->data + mb->len, mb->cap - mb->len, fmt, ap);
+    va_end(ap);
+    mb->len += (size_t)n;
+}
+
+void metrics_family(MetricsBuf *mb, const char *name, const char *type, const char *help) {
+    metrics_printf(mb, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_sample(MetricsBuf *mb, const char *name, const char *labels, double value) {
+    if (labels) metrics_printf(mb, "%s{%s} %.15g\n", name, labels, value);
+    else metrics_printf(mb, "%s %.15g\n", name, value);
+}
+
+void metrics_sample_u64(MetricsBuf *mb, const char *name, const char *labels, uint64_t value) {
+    if (labels) metrics_printf(mb, "%s{%s} %llu\n", name, labels, (unsigned long long)value);
+    else metrics_printf(mb, "%s %llu\n", name, (unsigned long long)value);
+}
+
+void metrics_histogram(MetricsBuf *mb, const char *name, const char *labels,
+                       const LatencyHist *h, double unit_s) {
+    static const double bounds[] = {
+        1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3,
+        1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+    };
+    const char *sep = labels ? "," : "";
+    if (!labels) labels = "";
+
+    // The owner may be recording while this runs: +Inf and _count come
+    // from the same bucket walk so the series stays self-consistent
+    unsigned b = 0;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++) {
+        double limit = bounds[i] / unit_s;
+        while (b < HIST_BUCKETS && (double)hist_bucket_high(b) <= limit) cumulative += h->buckets[b++];
+        metrics_printf(mb, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep, bounds[i],
+                       (unsigned long long)cumulative);
+    }
+    while (b < HIST_BUCKETS) cumulative += h->buckets[b++];
+    metrics_printf(mb, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, (unsigned long long)cumulative);
+    if (labels[0]) {
+        metrics_printf(mb, "%s_sum{%s} %.15g\n", name, labels, (double)h->sum * unit_s);
+        metrics_printf(mb, "%s_count{%s} %llu\n", name, labels, (unsigned long long)cumulative);
+    } else {
+        metrics_printf(mb, "%s_sum %.15g\n", name, (double)h->sum * unit_s);
+        metrics_printf(mb, "%s_count %llu\n", name, (unsigned long long)cumulative);
+    }
+}
+
+// Render every collector into back and make it the served buffer
+static void refresh(void) {
+    back->len = 0;
+    back->failed = 0;
+    mutex_lock(&collectors_lock);
+    for (int i = 0; i < METRICS_MAX_COLLECTORS; i++) {
+        if (collectors[i].fn) collectors[i].fn(back, collectors[i].arg);
+    }
+    mutex_unlock(&collectors_lock);
+    metrics_family(back, "sniffer_metrics_rendered_timestamp_seconds", "gauge",
+                   "When this page was rendered (Unix time)");
+    metrics_sample(back, "sniffer_metrics_rendered_timestamp_seconds", NULL, (double)platform_wall_us() / 1e6);
+    if (back->failed) return;        // Keep serving the previous page
+
+    MetricsBuf *t = front;
+    front = back;
+    back = t;
+}
+
+int metrics_register(metrics_collect_fn fn, void *arg) {
+    if (!running) return 0;
+    int rc = -1;
+    mutex_lock(&collectors_lock);
+    for (int i = 0; i < METRICS_MAX_COLLECTORS; i++) {
+        if (!collectors[i].fn) {
+            collectors[i].fn = fn;
+            collectors[i].arg = arg;
+            rc = 0;
+            break;
+        }
+    }
+    mutex_unlock(&collectors_lock);
+    if (rc != 0) fprintf(stderr, "[!] Metrics: too many collectors\n");
+    return rc;
+}
+
+void metrics_unregister(metrics_collect_fn fn, void *arg) {
+    if (!running) return;
+    mutex_lock(&collectors_lock);
+    for (int i = 0; i < METRICS_MAX_COLLECTORS; i++) {
+        if (collectors[i].fn == fn && collectors[i].arg == arg) {
+            collectors[i].fn = NULL;
+            collectors[i].arg = NULL;
+        }
+    }
+    mutex_unlock(&collectors_lock);
+}
+
+// ---------------------------
+// HTTP
+// ---------------------------
+static void set_io_timeout(sock_t s) {
+#ifdef _WIN32
+    DWORD ms = METRICS_IO_TIMEOUT_MS;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&ms, sizeof(ms));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char *)&ms, sizeof(ms));
+#else
+    struct timeval tv = { METRICS_IO_TIMEOUT_MS / 1000, (METRICS_IO_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#endif
+}
+
+// Wait until s is readable (or writable) within what is left of the
+// connection's deadline. Returns 0 when ready, -1 once the time is up.
+static int wait_ready(sock_t s, int for_write, uint64_t deadline_ns) {
+    uint64_t now_ns = platform_now_ns();
+    if (now_ns >= deadline_ns) return -1;
+    uint64_t left_us = (deadline_ns - now_ns) / 1000;
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(s, &fds);
+    struct timeval tv = { (long)(left_us / 1000000), (long)(left_us % 1000000) };
+    int n = select((int)s + 1, for_write ? NULL : &fds, for_write ? &fds : NULL, NULL, &tv);
+    return n > 0 ? 0 : -1;
+}
+
+static int send_all(sock_t s, const char *data, size_t len, uint64_t deadline_ns) {
+    while (len > 0) {
+        if (wait_ready(s, 1, deadline_ns) != 0) return -1;
+        int chunk = len > 65536 ? 65536 : (int)len;
+        int n = send(s, data, chunk, SEND_FLAGS);
+        if (n <= 0) return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void send_response(sock_t s, const char *status, const char *type, const char *body, size_t len,
+                          uint64_t deadline_ns) {
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, type, len);
+    if (send_all(s, header, (size_t)n, deadline_ns) == 0 && len > 0) send_all(s, body, len, deadline_ns);
+}
+
+// One request per connection: GET /metrics gets the current page
+static void serve_client(sock_t s) {
+    char req[METRICS_REQUEST_MAX + 1];
+    size_t got = 0;
+    // The per-call timeouts alone let a client sending a byte a second hold
+    // the thread for the whole request; the deadline covers the connection
+    uint64_t deadline_ns = platform_now_ns() + (uint64_t)METRICS_CLIENT_MS * 1000000;
+    set_io_timeout(s);
+    while (got < METRICS_REQUEST_MAX) {
+        if (wait_ready(s, 0, deadline_ns) != 0) break;
+        int n = recv(s, req + got, (int)(METRICS_REQUEST_MAX - got), 0);
+        if (n <= 0) break;
+        got += (size_t)n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[got] = '\0';
+
+    static const char not_found[] = "Not found; try /metrics\n";
+    if (strncmp(req, "GET ", 4) != 0) {
+        if (got > 0) send_response(s, "405 Method Not Allowed", "text/plain", NULL, 0, deadline_ns);
+        return;
+    }
+    const char *path = req + 4;
+    size_t plen = strcspn(path, " ?\r\n");
+    if (plen == 8 && strncmp(path, "/metrics", 8) == 0) {
+        send_response(s, "200 OK", "text/plain; version=0.0.4; charset=utf-8", front->data, front->len, deadline_ns);
+    } else {
+        send_response(s, "404 Not Found", "text/plain", not_found, sizeof(not_found) - 1, deadline_ns);
+    }
+}
+
+static thread_ret_t THREAD_CALL metrics_thread_main(void *param) {
+    (void)param;
+    uint64_t next_refresh_ns = 0;
+    while (!stopping) {
+        uint64_t now_ns = platform_now_ns();
+        if (now_ns >= next_refresh_ns) {
+            refresh();
+            next_refresh_ns = now_ns + (uint64_t)METRICS_REFRESH_MS * 1000000;
+        }
+
+        fd_set rd;
+        FD_ZERO(&rd);
+        FD_SET(listen_sock, &rd);
+        struct timeval tv = { 0, METRICS_POLL_MS * 1000 };
+        if (select((int)listen_sock + 1, &rd, NULL, NULL, &tv) <= 0) continue;
+        sock_t c = accept(listen_sock, NULL, NULL);
+        if (c == SOCK_INVALID) continue;
+        serve_client(c);
+        sock_close(c);
+    }
+    return 0;
+}
+
+// ---------------------------
+// Start / Stop
+// ---------------------------
+int metrics_start(const char *addr, unsigned port) {
+    if (!addr || !addr[0]) addr = METRICS_DEFAULT_ADDR;
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        fprintf(stderr, "[!] Metrics: WSAStartup failed\n");
+        return -1;
+    }
+#endif
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+        fprintf(stderr, "[!] Metrics: invalid listen address %s (IPv4 expected)\n", addr);
+        return -1;
+    }
+    listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_sock == SOCK_INVALID) {
+        fprintf(stderr, "[!] Metrics: socket() failed\n");
+        return -1;
+    }
+#ifndef _WIN32
+    int one = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#endif
+    if (bind(listen_sock, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(listen_sock, 16) != 0) {
+        fprintf(stderr, "[!] Metrics: cannot listen on %s:%u\n", addr, port);
+        sock_close(listen_sock);
+        listen_sock = SOCK_INVALID;
+        return -1;
+    }
+
+    mutex_init(&collectors_lock);
+    memset(collectors, 0, sizeof(collectors));
+    stopping = 0;
+    running = 1;
+    if (thread_create(&metrics_thread, metrics_thread_main, NULL) != 0) {
+        fprintf(stderr, "[!] Metrics: failed to create thread\n");
+        running = 0;
+        mutex_destroy(&collectors_lock);
+        sock_close(listen_sock);
+        listen_sock = SOCK_INVALID;
+        return -1;
+    }
+    printf("[+] Metrics: http://%s:%u/metrics\n", addr, port);
+    return 0;
+}
+
+void metrics_stop(void) {
+    if (!running) return;
+    stopping = 1;
+    thread_join_timeout(metrics_thread, PLATFORM_WAIT_INFINITE);
+    thread_close(metrics_thread);
+    running = 0;
+    sock_close(listen_sock);
+    listen_sock = SOCK_INVALID;
+    mutex_destroy(&collectors_lock);
+    for (int i = 0; i < 2; i++) {
+        free(buffers[i].data);
+        memset(&buffers[i], 0, sizeof(buffers[i]));
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
@@ -0,0 +1,57 @@
+// metrics.h - Prometheus text-format endpoint
+//
+// One thread owns the listening socket. Once per METRICS_REFRESH_MS it
+// asks every registered collector to render its metrics into a back
+// buffer and swaps that buffer in; a scrape only copies the current front
+// buffer to the socket. Collectors therefore run once a second no matter
+// how often (or how many) scrapers poll, and a scrape never touches the
+// counters the analysis threads write.
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "histogram.h"
+
+#define METRICS_DEFAULT_ADDR "127.0.0.1"
+#define METRICS_REFRESH_MS 1000
+
+// Growable text buffer a collector renders into (metrics thread only)
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;                      // An allocation failed; the render is discarded
+} MetricsBuf;
+
+typedef void (*metrics_collect_fn)(MetricsBuf *mb, void *arg);
+
+// Listen on addr:port (addr NULL = METRICS_DEFAULT_ADDR). 0 on success.
+int  metrics_start(const char *addr, unsigned port);
+void metrics_stop(void);
+
+// Collectors are called from the metrics thread with the registry locked,
+// so metrics_unregister returns only once fn is no longer running and the
+// state it reads may be freed. Safe to call whether or not the endpoint runs.
+int  metrics_register(metrics_collect_fn fn, void *arg);
+void metrics_unregister(metrics_collect_fn fn, void *arg);
+
+// Rendering helpers. labels is the text between the braces ("worker=\"0\"")
+// or NULL; a family line (# HELP / # TYPE) comes before its samples.
+void metrics_printf(MetricsBuf *mb, const char *fmt, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+void metrics_family(MetricsBuf *mb, const char *name, const char *type, const char *help);
+void metrics_sample(MetricsBuf *mb, const char *name, const char *labels, double value);
+void metrics_sample_u64(MetricsBuf *mb, const char *name, const char *labels, uint64_t value);
+
+// A LatencyHist as a Prometheus histogram in seconds; unit_s is the size of
+// one recorded unit (1e-9 for nanoseconds). Bucket bounds run from 1 us to
+// 10 s; a log-linear bucket counts under a bound only if it lies wholly
+// below it, so counts may lag by up to one sub-bucket (12.5%).
+void metrics_histogram(MetricsBuf *mb, const char *name, const char *labels,
+                       const LatencyHist *h, double unit_s);
+
+#endif // METRICS_H
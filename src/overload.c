@@ -0,0 +1,203 @@
+// overload.c - Load shedding driven by analysis queue depth
+#include "overload.h"
+#include "flow.h"
+#include "sniffer.h"   // SNIFFER_MAX_WORKERS
+#include <stdio.h>
+#include <string.h>
+
+static OverloadConfig config = {
+    1,
+    OVERLOAD_DEFAULT_COUNTERS_PCT,
+    OVERLOAD_DEFAULT_SAMPLE_PCT,
+    OVERLOAD_DEFAULT_RECOVER_PCT,
+    OVERLOAD_DEFAULT_HOLD_MS,
+    OVERLOAD_DEFAULT_SAMPLE_RATE
+};
+
+static const char *const mode_names[OVERLOAD_MODES] = { "full", "counters", "sampled" };
+
+// One per worker, never freed: readers may still look after the capture stops
+static OverloadState states[SNIFFER_MAX_WORKERS];
+static volatile unsigned nstates = 0;
+
+// Transition log: a ring written under log_lock, read with a cursor
+static OverloadTransition log_ring[OVERLOAD_LOG_SIZE];
+static uint64_t log_next = 0;                // Sequence number of the next transition
+static mutex_t log_lock;
+static int log_lock_ready = 0;
+
+const char *overload_mode_name(overload_mode_t mode) {
+    return (unsigned)mode < OVERLOAD_MODES ? mode_names[mode] : "?";
+}
+
+// ---------------------------
+// Configuration
+// ---------------------------
+int overload_configure(const OverloadConfig *cfg) {
+    if (cfg->enabled) {
+        if (cfg->counters_pct == 0 || cfg->counters_pct > 100 ||
+            cfg->sample_pct < cfg->counters_pct || cfg->sample_pct > 100) {
+            fprintf(stderr, "[!] Overload watermarks must satisfy 0 < counters (%u%%) <= sample (%u%%) <= 100\n",
+                    cfg->counters_pct, cfg->sample_pct);
+            return -1;
+        }
+        if (cfg->recover_pct >= cfg->counters_pct) {
+            fprintf(stderr, "[!] Overload recovery level (%u%%) must be below the counters watermark (%u%%)\n",
+                    cfg->recover_pct, cfg->counters_pct);
+            return -1;
+        }
+        if (cfg->sample_rate < 2 || cfg->sample_rate > OVERLOAD_MAX_SAMPLE_RATE) {
+            fprintf(stderr, "[!] Overload sample rate must be between 2 and %d\n", OVERLOAD_MAX_SAMPLE_RATE);
+            return -1;
+        }
+    }
+    config = *cfg;
+    return 0;
+}
+
+const OverloadConfig *overload_config(void) {
+    return &config;
+}
+
+void overload_start(unsigned nworkers, uint64_t now_us) {
+    if (!log_lock_ready) {
+        mutex_init(&log_lock);
+        log_lock_ready = 1;
+    }
+    if (!config.enabled) return;
+    if (nworkers > SNIFFER_MAX_WORKERS) nworkers = SNIFFER_MAX_WORKERS;
+    memset(states, 0, sizeof(states));
+    for (unsigned i = 0; i < nworkers; i++) {
+        states[i].worker = i;
+        states[i].weight = 1;
+        states[i].countdown = OVERLOAD_CHECK_PACKETS;
+        states[i].since_us = now_us;
+    }
+    nstates = nworkers;
+    printf("[+] Overload control: counters only at %u%% queue fill, 1-in-%u flow sampling at %u%%, "
+           "back down at %u%% after %u ms\n",
+           config.counters_pct, config.sample_rate, config.sample_pct, config.recover_pct, config.hold_ms);
+}
+
+OverloadState *overload_worker(unsigned id) {
+    return id < nstates ? &states[id] : NULL;
+}
+
+// ---------------------------
+// Controller
+// ---------------------------
+static void overload_switch(OverloadState *st, overload_mode_t to, unsigned fill_pct, uint64_t now_us) {
+    overload_mode_t from = (overload_mode_t)st->mode;
+    uint64_t lasted_us = now_us > st->since_us ? now_us - st->since_us : 0;
+    st->mode_us[from] += lasted_us;
+    st->since_us = now_us;
+    st->low_since_us = 0;
+    st->weight = to == OVERLOAD_SAMPLED ? config.sample_rate : 1;
+    st->transitions++;
+    st->mode = to;
+
+    OverloadTransition t;
+    t.at_us = now_us;
+    t.lasted_us = lasted_us;
+    t.worker = st->worker;
+    t.from = (uint8_t)from;
+    t.to = (uint8_t)to;
+    t.fill_pct = (uint8_t)fill_pct;
+    t.sample_rate = st->weight;
+    mutex_lock(&log_lock);
+    log_ring[log_next % OVERLOAD_LOG_SIZE] = t;
+    log_next++;
+    mutex_unlock(&log_lock);
+
+    printf("%s Worker %u overload: %s -> %s (queue %u%% full) after %.3f s\n",
+           to > from ? "[!]" : "[+]", st->worker, mode_names[from], mode_names[to], fill_pct,
+           (double)lasted_us / 1e6);
+}
+
+overload_mode_t overload_update(OverloadState *st, uint32_t depth, uint32_t capacity, uint64_t now_us) {
+    overload_mode_t mode = (overload_mode_t)st->mode;
+    if (capacity == 0) return mode;
+    unsigned fill_pct = (unsigned)((uint64_t)depth * 100 / capacity);
+
+    overload_mode_t target = mode;
+    if (fill_pct >= config.sample_pct) {
+        target = OVERLOAD_SAMPLED;
+    } else if (fill_pct >= config.counters_pct && mode < OVERLOAD_COUNTERS) {
+        target = OVERLOAD_COUNTERS;
+    }
+    if (target > mode) {
+        overload_switch(st, target, fill_pct, now_us);
+        return target;
+    }
+
+    // Recovery: one mode per hold period at or below recover_pct
+    if (mode == OVERLOAD_FULL || fill_pct > config.recover_pct) {
+        st->low_since_us = 0;
+        return mode;
+    }
+    if (st->low_since_us == 0) {
+        st->low_since_us = now_us;
+    } else if (now_us - st->low_since_us >= (uint64_t)config.hold_ms * 1000) {
+        overload_switch(st, (overload_mode_t)(mode - 1), fill_pct, now_us);
+        st->low_since_us = now_us;
+        return (overload_mode_t)(mode - 1);
+    }
+    return mode;
+}
+
+// MurmurHash3 fmix32: workers are picked by flow_key_hash modulo the worker
+// count, so the raw hash modulo the sample rate would not be independent
+static uint32_t mix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t overload_sample(OverloadState *st, const u_char *frame, int caplen) {
+    flow_key_t key;
+    if (flow_key_from_frame(frame, caplen, &key) != 0) return 1;
+    if (mix32(flow_key_hash(&key)) % st->weight == 0) return st->weight;
+    st->skipped++;
+    return 0;
+}
+
+// ---------------------------
+// Reporting
+// ---------------------------
+void overload_summary(OverloadSummary *out, uint64_t now_us) {
+    memset(out, 0, sizeof(*out));
+    out->enabled = config.enabled && nstates > 0;
+    out->sample_rate = config.sample_rate;
+    for (unsigned i = 0; i < nstates; i++) {
+        const OverloadState *st = &states[i];
+        overload_mode_t mode = (overload_mode_t)st->mode;
+        uint64_t since_us = st->since_us;
+        out->workers[mode]++;
+        for (int m = 0; m < OVERLOAD_MODES; m++) out->mode_us[m] += st->mode_us[m];
+        if (now_us > since_us) out->mode_us[mode] += now_us - since_us;
+        out->transitions += st->transitions;
+        out->skipped += st->skipped;
+    }
+}
+
+size_t overload_transitions(uint64_t *cursor, OverloadTransition *out, size_t max, uint64_t *lost) {
+    if (lost) *lost = 0;
+    if (!log_lock_ready) return 0;
+    mutex_lock(&log_lock);
+    uint64_t first = *cursor;
+    if (log_next > OVERLOAD_LOG_SIZE && first < log_next - OVERLOAD_LOG_SIZE) {
+        if (lost) *lost = log_next - OVERLOAD_LOG_SIZE - first;
+        first = log_next - OVERLOAD_LOG_SIZE;
+    }
+    size_t n = 0;
+    while (first + n < log_next && n < max) {
+        out[n] = log_ring[(first + n) % OVERLOAD_LOG_SIZE];
+        n++;
+    }
+    *cursor = first + n;
+    mutex_unlock(&log_lock);
+    return n;
+}
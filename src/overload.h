@@ -0,0 +1,114 @@
+// overload.h - Load shedding driven by analysis queue depth
+//
+// Each live worker checks how full its queue is every
+// OVERLOAD_CHECK_PACKETS packets (every block on AF_PACKET, and while
+// idle) and picks one of three modes:
+//   full      every parser runs
+//   counters  Ethernet to TCP/UDP only: protocol counters, flows and the
+//             interval sketches. Application parsers and debug strings
+//             are skipped; HTTP/HTTPS/DNS/DHCP are counted by port.
+//   sampled   counters only, for 1 flow in sample_rate. Flows are chosen
+//             by the steering hash (flow_key_from_frame), so a flow is kept or
+//             skipped whole, and every kept packet counts sample_rate
+//             times so the totals stay unbiased estimates.
+// A watermark switches up at once; the worker steps back one mode at a
+// time after the queue has stayed at or below recover_pct for hold_ms, so
+// it does not flap around a watermark. Every transition is printed and
+// logged with how long the previous mode lasted.
+// Offline replay never sheds load: the reader waits for room instead.
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <pcap.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "platform.h"   // CACHE_ALIGNED
+
+#define OVERLOAD_DEFAULT_COUNTERS_PCT  50
+#define OVERLOAD_DEFAULT_SAMPLE_PCT    80
+#define OVERLOAD_DEFAULT_RECOVER_PCT   10
+#define OVERLOAD_DEFAULT_HOLD_MS       2000
+#define OVERLOAD_DEFAULT_SAMPLE_RATE   8
+#define OVERLOAD_MAX_SAMPLE_RATE       1024
+#define OVERLOAD_CHECK_PACKETS         64     // pcap backend: packets between queue checks
+#define OVERLOAD_LOG_SIZE              256    // Transitions kept for stats.c (oldest overwritten)
+
+typedef enum {
+    OVERLOAD_FULL = 0,
+    OVERLOAD_COUNTERS,
+    OVERLOAD_SAMPLED,
+    OVERLOAD_MODES
+} overload_mode_t;
+
+typedef struct {
+    int enabled;
+    unsigned counters_pct;   // Queue fill (%) that switches to counters only
+    unsigned sample_pct;     // Queue fill (%) that adds flow sampling (>= counters_pct)
+    unsigned recover_pct;    // Step back one mode once the fill has stayed at or below this...
+    unsigned hold_ms;        // ...for this long
+    unsigned sample_rate;    // Keep 1 flow in this many (2..OVERLOAD_MAX_SAMPLE_RATE)
+} OverloadConfig;
+
+// One worker's controller. Only the worker writes it; the metrics thread,
+// stats.json and the exit report read racy copies.
+typedef struct {
+    CACHE_ALIGNED volatile uint32_t mode;   // overload_mode_t
+    uint32_t weight;                 // Packets a kept packet stands for (sample_rate when sampled, else 1)
+    uint32_t countdown;              // Packets until the next queue check
+    unsigned worker;
+    uint64_t since_us;               // Wall clock when the mode was entered
+    uint64_t low_since_us;           // First check at or below recover_pct (0 = not there)
+    volatile uint64_t mode_us[OVERLOAD_MODES];   // Finished stretches in each mode
+    volatile uint64_t transitions;
+    volatile uint64_t skipped;       // Packets left out by sampling
+} OverloadState;
+
+// One mode change, as logged
+typedef struct {
+    uint64_t at_us;                  // Wall clock
+    uint64_t lasted_us;              // Time spent in the previous mode
+    uint32_t worker;
+    uint8_t from;                    // overload_mode_t
+    uint8_t to;
+    uint8_t fill_pct;                // Queue fill that triggered it
+    uint32_t sample_rate;            // In effect after the change (1 = every flow)
+} OverloadTransition;
+
+// All workers together
+typedef struct {
+    int enabled;
+    unsigned sample_rate;
+    unsigned workers[OVERLOAD_MODES];    // Workers in each mode now
+    uint64_t mode_us[OVERLOAD_MODES];    // Worker time in each mode, current stretches included
+    uint64_t transitions;
+    uint64_t skipped;
+} OverloadSummary;
+
+// Validate and store cfg (before overload_start). Returns 0, or -1 after
+// printing why (the previous configuration stays).
+int overload_configure(const OverloadConfig *cfg);
+const OverloadConfig *overload_config(void);
+
+// Live capture: reset and hand out one controller per worker. Without it
+// overload_worker returns NULL and every packet is parsed in full.
+void overload_start(unsigned nworkers, uint64_t now_us);
+OverloadState *overload_worker(unsigned id);
+
+// Pick the mode for the current queue fill; depth and capacity in the
+// same unit (packets or blocks)
+overload_mode_t overload_update(OverloadState *st, uint32_t depth, uint32_t capacity, uint64_t now_us);
+
+// Sampled mode: what the frame counts for. 0 = skip it (counted in
+// st->skipped), sample_rate = its flow is kept, 1 = not IP (always kept).
+uint32_t overload_sample(OverloadState *st, const u_char *frame, int caplen);
+
+void overload_summary(OverloadSummary *out, uint64_t now_us);
+
+// Transitions logged after *cursor, oldest first; *cursor moves past the
+// ones returned. *lost (may be NULL) receives how many were overwritten
+// before they could be read.
+size_t overload_transitions(uint64_t *cursor, OverloadTransition *out, size_t max, uint64_t *lost);
+
+const char *overload_mode_name(overload_mode_t mode);
+
+#endif // OVERLOAD_H
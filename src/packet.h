@@ -0,0 +1,45 @@
+// packet.h - Per-packet context passed down the parser chain
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <pcap.h>
+#include <stdint.h>
+#include "platform.h"   // INET6_ADDRSTRLEN
+
+typedef struct analyzer analyzer_t;
+struct FlowRecord;
+
+// Filled in layer by layer: Ethernet sets the capture fields, IP the
+// addresses, TCP/UDP the ports and flow (TCP also the sequence number
+// and flags). Addresses point into the frame; the string forms are only
+// rendered when debug output is compiled in and enabled (see PKT_VERBOSE),
+// so parsers must not rely on them.
+typedef struct {
+    analyzer_t *an;              // Worker-owned state (flow table, ...)
+    int fast;                    // Overload: counters only, no application parsing or debug strings
+    uint64_t ts_us;              // Capture timestamp
+    uint32_t wire_len;           // header->len
+    uint32_t cap_len;            // header->caplen
+
+    uint8_t  family;             // 4 or 6 (0 = not IP)
+    uint8_t  ip_proto;           // Transport protocol after IPv6 extension headers
+    uint8_t  is_fragment;        // Not a whole datagram (no reliable ports)
+    uint8_t  addr_len;           // 4 or 16
+    const u_char *src_addr;
+    const u_char *dst_addr;
+
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t tcp_seq;            // TCP only, for the stream reassembler
+    uint8_t  tcp_flags;
+    struct FlowRecord *flow;     // NULL if untracked (fragment, table full)
+    int flow_dir;                // FLOW_DIR_* of this packet
+
+    char src_ip[INET6_ADDRSTRLEN];
+    char dst_ip[INET6_ADDRSTRLEN];
+} packet_ctx_t;
+
+// Per-packet debug output: enabled, and not shedding load (logger.h)
+#define PKT_VERBOSE(pkt) (LOG_ENABLED(LOG_DEBUG) && !(pkt)->fast)
+
+#endif // PACKET_H
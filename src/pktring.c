@@ -0,0 +1,122 @@
+// pktring.c - Preallocated single-producer/single-consumer packet ring
+#include "pktring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPIN_ITERATIONS  2000   // Busy-wait polls before yielding
+#define YIELD_ITERATIONS 16     // Yields before parking on the condition variable
+
+// Rounding down keeps the ring within what was asked for
+static uint32_t round_down_pow2(uint32_t v) {
+    uint32_t p = 1;
+    while (p <= v / 2) p <<= 1;
+    return p;
+}
+
+int pktring_init(PktRing *r, uint32_t capacity, uint32_t slot_size) {
+    memset(r, 0, sizeof(*r));
+    r->capacity = round_down_pow2(capacity ? capacity : 1);
+    r->mask = r->capacity - 1;
+    r->slot_size = slot_size;
+
+    r->slots = (PktSlot *)calloc(r->capacity, sizeof(PktSlot));
+    r->slab = (u_char *)malloc((size_t)r->capacity * slot_size);
+    if (!r->slots || !r->slab) {
+        fprintf(stderr, "[!] Failed to allocate packet ring (%u slots x %u bytes)\n",
+                r->capacity, slot_size);
+        free(r->slots);
+        free(r->slab);
+        r->slots = NULL;
+        r->slab = NULL;
+        return -1;
+    }
+    for (uint32_t i = 0; i < r->capacity; i++) {
+        r->slots[i].data = r->slab + (size_t)i * slot_size;
+    }
+
+    mutex_init(&r->park_lock);
+    cond_init(&r->park_cond);
+    return 0;
+}
+
+void pktring_destroy(PktRing *r) {
+    if (!r->slots) return;
+    cond_destroy(&r->park_cond);
+    mutex_destroy(&r->park_lock);
+    free(r->slots);
+    free(r->slab);
+    r->slots = NULL;
+    r->slab = NULL;
+}
+
+PktSlot *pktring_reserve(PktRing *r) {
+    uint64_t tail = r->tail;  // Producer owns tail
+    if (tail - r->cached_head >= r->capacity) {
+        r->cached_head = atomic_load_acquire_u64(&r->head);
+        if (tail - r->cached_head >= r->capacity) return NULL;
+    }
+    return &r->slots[tail & r->mask];
+}
+
+void pktring_commit(PktRing *r) {
+    atomic_store_release_u64(&r->tail, r->tail + 1);
+
+    // Pairs with the barrier in the parking path: either the consumer sees
+    // the new tail before sleeping, or we see consumer_parked and wake it.
+    memory_barrier();
+    if (r->consumer_parked) {
+        mutex_lock(&r->park_lock);
+        cond_signal(&r->park_cond);
+        mutex_unlock(&r->park_lock);
+    }
+}
+
+static inline int ring_has_data(PktRing *r, uint64_t head) {
+    if (head != r->cached_tail) return 1;
+    r->cached_tail = atomic_load_acquire_u64(&r->tail);
+    return head != r->cached_tail;
+}
+
+PktSlot *pktring_peek(PktRing *r, unsigned timeout_ms) {
+    uint64_t head = r->head;  // Consumer owns head
+    if (ring_has_data(r, head)) return &r->slots[head & r->mask];
+
+    // Spin: cheapest wake-up latency while traffic is flowing
+    for (int i = 0; i < SPIN_ITERATIONS; i++) {
+        cpu_relax();
+        if (ring_has_data(r, head)) return &r->slots[head & r->mask];
+    }
+    for (int i = 0; i < YIELD_ITERATIONS; i++) {
+        thread_yield();
+        if (ring_has_data(r, head)) return &r->slots[head & r->mask];
+    }
+
+    // Park until the producer commits or the timeout expires
+    mutex_lock(&r->park_lock);
+    r->consumer_parked = 1;
+    memory_barrier();
+    if (!ring_has_data(r, head)) {
+        cond_timedwait(&r->park_cond, &r->park_lock, timeout_ms);
+    }
+    r->consumer_parked = 0;
+    mutex_unlock(&r->park_lock);
+
+    return ring_has_data(r, head) ? &r->slots[head & r->mask] : NULL;
+}
+
+void pktring_release(PktRing *r) {
+    atomic_store_release_u64(&r->head, r->head + 1);
+}
+
+void pktring_wake(PktRing *r) {
+    mutex_lock(&r->park_lock);
+    cond_broadcast(&r->park_cond);
+    mutex_unlock(&r->park_lock);
+}
+
+uint32_t pktring_count(const PktRing *r) {
+    uint64_t head = atomic_load_acquire_u64(&r->head);
+    uint64_t tail = atomic_load_acquire_u64(&r->tail);
+    return tail >= head ? (uint32_t)(tail - head) : 0;
+}
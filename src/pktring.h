@@ -0,0 +1,61 @@
+// pktring.h - Preallocated single-producer/single-consumer packet ring
+#ifndef PKTRING_H
+#define PKTRING_H
+
+#include <pcap.h>
+#include <stdint.h>
+#include "platform.h"
+
+// One preallocated slot; data points into the ring's slab (slot_size bytes)
+typedef struct {
+    struct pcap_pkthdr header;
+    uint64_t enqueue_ns;
+    u_char *data;
+} PktSlot;
+
+// Head and tail live on separate cache lines so the producer and consumer
+// never write to the same line. Each side also caches the other side's
+// index and only re-reads it when the cached value says full/empty.
+typedef struct {
+    // Producer-owned
+    CACHE_ALIGNED volatile uint64_t tail;
+    uint64_t cached_head;
+
+    // Consumer-owned
+    CACHE_ALIGNED volatile uint64_t head;
+    uint64_t cached_tail;
+
+    // Parking (slow path only)
+    CACHE_ALIGNED volatile int consumer_parked;
+    mutex_t park_lock;
+    cond_t park_cond;
+
+    // Read-only after init
+    CACHE_ALIGNED PktSlot *slots;
+    u_char *slab;
+    uint32_t capacity;   // Power of two
+    uint32_t mask;
+    uint32_t slot_size;  // Bytes of packet data per slot (snaplen)
+} PktRing;
+
+// capacity is rounded down to a power of two. Memory is exactly
+// capacity * (slot_size + sizeof(PktSlot)). Returns 0 on success.
+int  pktring_init(PktRing *r, uint32_t capacity, uint32_t slot_size);
+void pktring_destroy(PktRing *r);
+
+// Producer: claim the next free slot (NULL if full), fill it, then commit
+PktSlot *pktring_reserve(PktRing *r);
+void     pktring_commit(PktRing *r);
+
+// Consumer: wait adaptively (spin, yield, then park for up to timeout_ms)
+// for the oldest slot. Returns NULL on timeout. Release after processing.
+PktSlot *pktring_peek(PktRing *r, unsigned timeout_ms);
+void     pktring_release(PktRing *r);
+
+// Wake a parked consumer (e.g. on shutdown)
+void     pktring_wake(PktRing *r);
+
+// Approximate occupancy, safe from any thread
+uint32_t pktring_count(const PktRing *r);
+
+#endif // PKTRING_H
@@ -0,0 +1,298 @@
+// platform.c - Win32 / POSIX implementations of the platform.h primitives
+#ifndef _WIN32
+#define _GNU_SOURCE   // pthread_timedjoin_np
+#endif
+
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// ---------------------------
+// Threads
+// ---------------------------
+#ifdef _WIN32
+
+int thread_create(thread_t *t, thread_fn_t fn, void *arg) {
+    *t = CreateThread(NULL, 0, fn, arg, 0, NULL);
+    return *t ? 0 : -1;
+}
+
+int thread_join_timeout(thread_t t, unsigned timeout_ms) {
+    DWORD wait_ms = (timeout_ms == PLATFORM_WAIT_INFINITE) ? INFINITE : timeout_ms;
+    return WaitForSingleObject(t, wait_ms) == WAIT_TIMEOUT ? 1 : 0;
+}
+
+void thread_terminate(thread_t t) {
+    TerminateThread(t, 1);
+}
+
+void thread_close(thread_t t) {
+    CloseHandle(t);
+}
+
+void thread_yield(void) {
+    SwitchToThread();
+}
+
+#else
+
+int thread_create(thread_t *t, thread_fn_t fn, void *arg) {
+    return pthread_create(t, NULL, fn, arg) == 0 ? 0 : -1;
+}
+
+static void deadline_after_ms(struct timespec *ts, unsigned timeout_ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+int thread_join_timeout(thread_t t, unsigned timeout_ms) {
+    if (timeout_ms == PLATFORM_WAIT_INFINITE) {
+        return pthread_join(t, NULL) == 0 ? 0 : 1;
+    }
+    struct timespec ts;
+    deadline_after_ms(&ts, timeout_ms);
+    return pthread_timedjoin_np(t, NULL, &ts) == ETIMEDOUT ? 1 : 0;
+}
+
+void thread_terminate(thread_t t) {
+    pthread_cancel(t);
+}
+
+void thread_close(thread_t t) {
+    (void)t;  // Joined threads need no further cleanup
+}
+
+void thread_yield(void) {
+    sched_yield();
+}
+
+#endif
+
+// ---------------------------
+// Mutex / Condition Variable
+// ---------------------------
+#ifdef _WIN32
+
+void mutex_init(mutex_t *m)    { InitializeCriticalSection(m); }
+void mutex_lock(mutex_t *m)    { EnterCriticalSection(m); }
+void mutex_unlock(mutex_t *m)  { LeaveCriticalSection(m); }
+void mutex_destroy(mutex_t *m) { DeleteCriticalSection(m); }
+
+void cond_init(cond_t *c)                 { InitializeConditionVariable(c); }
+void cond_wait(cond_t *c, mutex_t *m)     { SleepConditionVariableCS(c, m, INFINITE); }
+void cond_timedwait(cond_t *c, mutex_t *m, unsigned timeout_ms) {
+    SleepConditionVariableCS(c, m, timeout_ms);
+}
+void cond_signal(cond_t *c)               { WakeConditionVariable(c); }
+void cond_broadcast(cond_t *c)            { WakeAllConditionVariable(c); }
+void cond_destroy(cond_t *c)              { (void)c; }
+
+#else
+
+void mutex_init(mutex_t *m)    { pthread_mutex_init(m, NULL); }
+void mutex_lock(mutex_t *m)    { pthread_mutex_lock(m); }
+void mutex_unlock(mutex_t *m)  { pthread_mutex_unlock(m); }
+void mutex_destroy(mutex_t *m) { pthread_mutex_destroy(m); }
+
+void cond_init(cond_t *c)                 { pthread_cond_init(c, NULL); }
+void cond_wait(cond_t *c, mutex_t *m)     { pthread_cond_wait(c, m); }
+void cond_timedwait(cond_t *c, mutex_t *m, unsigned timeout_ms) {
+    struct timespec ts;
+    deadline_after_ms(&ts, timeout_ms);
+    pthread_cond_timedwait(c, m, &ts);
+}
+void cond_signal(cond_t *c)               { pthread_cond_signal(c); }
+void cond_broadcast(cond_t *c)            { pthread_cond_broadcast(c); }
+void cond_destroy(cond_t *c)              { pthread_cond_destroy(c); }
+
+#endif
+
+// ---------------------------
+// Manual-reset event
+// ---------------------------
+#ifdef _WIN32
+
+int event_init(event_t *e) {
+    e->handle = CreateEvent(NULL, TRUE, FALSE, NULL);
+    return e->handle ? 0 : -1;
+}
+
+void event_set(event_t *e) {
+    SetEvent(e->handle);
+}
+
+int event_wait(event_t *e, unsigned timeout_ms) {
+    DWORD wait_ms = (timeout_ms == PLATFORM_WAIT_INFINITE) ? INFINITE : timeout_ms;
+    return WaitForSingleObject(e->handle, wait_ms) == WAIT_OBJECT_0;
+}
+
+void event_destroy(event_t *e) {
+    CloseHandle(e->handle);
+    e->handle = NULL;
+}
+
+#else
+
+int event_init(event_t *e) {
+    mutex_init(&e->lock);
+    cond_init(&e->cond);
+    e->signaled = 0;
+    return 0;
+}
+
+void event_set(event_t *e) {
+    mutex_lock(&e->lock);
+    e->signaled = 1;
+    cond_broadcast(&e->cond);
+    mutex_unlock(&e->lock);
+}
+
+int event_wait(event_t *e, unsigned timeout_ms) {
+    mutex_lock(&e->lock);
+    if (!e->signaled) {
+        if (timeout_ms == PLATFORM_WAIT_INFINITE) {
+            while (!e->signaled) cond_wait(&e->cond, &e->lock);
+        } else {
+            struct timespec ts;
+            deadline_after_ms(&ts, timeout_ms);
+            while (!e->signaled) {
+                if (pthread_cond_timedwait(&e->cond, &e->lock, &ts) == ETIMEDOUT) break;
+            }
+        }
+    }
+    int signaled = e->signaled;
+    mutex_unlock(&e->lock);
+    return signaled;
+}
+
+void event_destroy(event_t *e) {
+    cond_destroy(&e->cond);
+    mutex_destroy(&e->lock);
+}
+
+#endif
+
+// ---------------------------
+// Time / Misc
+// ---------------------------
+#ifdef _WIN32
+
+uint64_t platform_now_ns(void) {
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    // Split to avoid overflowing 64 bits on long uptimes
+    return (uint64_t)(t.QuadPart / freq.QuadPart) * 1000000000ULL +
+           (uint64_t)(t.QuadPart % freq.QuadPart) * 1000000000ULL / (uint64_t)freq.QuadPart;
+}
+
+uint64_t platform_wall_us(void) {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    // 100 ns ticks since 1601-01-01 -> microseconds since 1970-01-01
+    uint64_t ticks = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return ticks / 10u - 11644473600000000ULL;
+}
+
+void platform_sleep_ms(unsigned ms) {
+    Sleep(ms);
+}
+
+void *platform_aligned_alloc(size_t size, size_t alignment) {
+    void *p = _aligned_malloc(size, alignment);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+void platform_aligned_free(void *p) {
+    _aligned_free(p);
+}
+
+int platform_setenv(const char *key, const char *value) {
+    return _putenv_s(key, value) == 0 ? 0 : -1;
+}
+
+static void (*interrupt_callback)(void) = NULL;
+
+static BOOL WINAPI console_ctrl_handler(DWORD signal) {
+    if (signal == CTRL_C_EVENT || signal == CTRL_CLOSE_EVENT) {
+        if (interrupt_callback) interrupt_callback();
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void platform_set_interrupt_handler(void (*handler)(void)) {
+    interrupt_callback = handler;
+    SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
+}
+
+#else
+
+uint64_t platform_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t platform_wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+void platform_sleep_ms(unsigned ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+void *platform_aligned_alloc(size_t size, size_t alignment) {
+    void *p = NULL;
+    if (posix_memalign(&p, alignment, size) != 0) return NULL;
+    memset(p, 0, size);
+    return p;
+}
+
+void platform_aligned_free(void *p) {
+    free(p);
+}
+
+int platform_setenv(const char *key, const char *value) {
+    return setenv(key, value, 1);
+}
+
+static void (*interrupt_callback)(void) = NULL;
+
+static void signal_trampoline(int sig) {
+    (void)sig;
+    if (interrupt_callback) interrupt_callback();
+}
+
+void platform_set_interrupt_handler(void (*handler)(void)) {
+    interrupt_callback = handler;
+    struct sigaction sa;
+    sa.sa_handler = signal_trampoline;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;   // No SA_RESTART: let blocking reads return EINTR
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+#endif
@@ -0,0 +1,194 @@
+// platform.h - Thin OS abstraction (Win32 / POSIX) for threads, locks, atomics and time
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+// ---------------------------
+// Threads
+// ---------------------------
+#ifdef _WIN32
+typedef HANDLE thread_t;
+typedef DWORD thread_ret_t;
+#define THREAD_CALL WINAPI
+#else
+typedef pthread_t thread_t;
+typedef void *thread_ret_t;
+#define THREAD_CALL
+#endif
+
+typedef thread_ret_t (THREAD_CALL *thread_fn_t)(void *arg);
+
+#define PLATFORM_WAIT_INFINITE 0xFFFFFFFFu
+
+int  thread_create(thread_t *t, thread_fn_t fn, void *arg);   // 0 on success
+int  thread_join_timeout(thread_t t, unsigned timeout_ms);    // 0 joined, 1 timed out
+void thread_terminate(thread_t t);                            // Last resort after a join timeout
+void thread_close(thread_t t);                                // Release handle after join
+void thread_yield(void);                                      // Give up the rest of the time slice
+
+// ---------------------------
+// Mutex / Condition Variable
+// ---------------------------
+#ifdef _WIN32
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#endif
+
+void mutex_init(mutex_t *m);
+void mutex_lock(mutex_t *m);
+void mutex_unlock(mutex_t *m);
+void mutex_destroy(mutex_t *m);
+
+void cond_init(cond_t *c);
+void cond_wait(cond_t *c, mutex_t *m);
+void cond_timedwait(cond_t *c, mutex_t *m, unsigned timeout_ms);  // Spurious/timeout returns allowed
+void cond_signal(cond_t *c);
+void cond_broadcast(cond_t *c);
+void cond_destroy(cond_t *c);
+
+// ---------------------------
+// Manual-reset event (used for graceful thread shutdown)
+// ---------------------------
+typedef struct {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    mutex_t lock;
+    cond_t cond;
+    int signaled;
+#endif
+} event_t;
+
+int  event_init(event_t *e);                     // 0 on success
+void event_set(event_t *e);
+int  event_wait(event_t *e, unsigned timeout_ms); // 1 if signaled, 0 on timeout
+void event_destroy(event_t *e);
+
+// ---------------------------
+// Atomics (64-bit counters shared between threads)
+// ---------------------------
+#ifdef _WIN32
+#define atomic_inc64(p)      InterlockedIncrement64((volatile LONG64 *)(p))
+#define atomic_add64(p, v)   InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v))
+#define atomic_xchg64(p, v)  InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v))
+#else
+#define atomic_inc64(p)      __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define atomic_add64(p, v)   __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_xchg64(p, v)  __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#endif
+
+// Full compiler + CPU barrier
+#ifdef _WIN32
+#define memory_barrier()     MemoryBarrier()
+#else
+#define memory_barrier()     __sync_synchronize()
+#endif
+
+// Acquire/release publication for single-writer indices (lock-free rings)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#if defined(_M_X64)
+// x64 does not reorder loads with loads or stores with stores: only the
+// compiler has to be kept from moving the access
+static __forceinline uint64_t atomic_load_acquire_u64(const volatile uint64_t *p) {
+    uint64_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+static __forceinline void atomic_store_release_u64(volatile uint64_t *p, uint64_t v) {
+    _ReadWriteBarrier();
+    *p = v;
+}
+#elif defined(_M_ARM64)
+static __forceinline uint64_t atomic_load_acquire_u64(const volatile uint64_t *p) {
+    return __ldar64((volatile unsigned __int64 *)p);
+}
+static __forceinline void atomic_store_release_u64(volatile uint64_t *p, uint64_t v) {
+    __stlr64((volatile unsigned __int64 *)p, v);
+}
+#else
+// 32-bit targets: a plain 64-bit access may tear, so go through a full
+// barrier interlocked operation
+static __forceinline uint64_t atomic_load_acquire_u64(const volatile uint64_t *p) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0);
+}
+static __forceinline void atomic_store_release_u64(volatile uint64_t *p, uint64_t v) {
+    InterlockedExchange64((volatile LONG64 *)p, (LONG64)v);
+}
+#endif
+#if defined(_M_X64) || defined(_M_IX86)
+#define cpu_relax()          _mm_pause()
+#elif defined(_M_ARM64) || defined(_M_ARM)
+#define cpu_relax()          __yield()
+#else
+#define cpu_relax()          ((void)0)
+#endif
+#define CACHE_ALIGNED        __declspec(align(64))
+#define THREAD_LOCAL         __declspec(thread)
+#else
+#define atomic_load_acquire_u64(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomic_store_release_u64(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()          __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax()          __asm__ __volatile__("yield")
+#else
+#define cpu_relax()          ((void)0)
+#endif
+#define CACHE_ALIGNED        __attribute__((aligned(64)))
+#define THREAD_LOCAL         __thread
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+// Ordering-only fences for sequence locks: prior stores before later
+// stores (release), prior loads before later loads (acquire)
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define fence_release()      _ReadWriteBarrier()
+#define fence_acquire()      _ReadWriteBarrier()
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+#define fence_release()      __dmb(_ARM64_BARRIER_ISH)
+#define fence_acquire()      __dmb(_ARM64_BARRIER_ISHLD)
+#elif defined(_MSC_VER)
+#define fence_release()      MemoryBarrier()
+#define fence_acquire()      MemoryBarrier()
+#else
+#define fence_release()      __atomic_thread_fence(__ATOMIC_RELEASE)
+#define fence_acquire()      __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+// ---------------------------
+// Time / Misc
+// ---------------------------
+uint64_t platform_now_ns(void);          // Monotonic clock in nanoseconds
+uint64_t platform_wall_us(void);         // Wall clock (Unix epoch) in microseconds, same base as pcap timestamps
+void    *platform_aligned_alloc(size_t size, size_t alignment);  // Zeroed; NULL on failure
+void     platform_aligned_free(void *p);
+void     platform_sleep_ms(unsigned ms);
+int      platform_setenv(const char *key, const char *value);  // 0 on success
+
+// Console interrupt (Ctrl+C / SIGINT / SIGTERM). The callback must be
+// async-signal-safe on POSIX: set flags only.
+void platform_set_interrupt_handler(void (*handler)(void));
+
+#ifndef _WIN32
+#define _strnicmp strncasecmp
+#endif
+
+#endif // PLATFORM_H
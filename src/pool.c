@@ -0,0 +1,47 @@
+// pool.c - Fixed-size object pool
+#include "pool.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+
+int pool_init(ObjPool *p, size_t obj_size, uint32_t capacity) {
+    memset(p, 0, sizeof(*p));
+    p->obj_size = (obj_size + 15) & ~(size_t)15;
+    if (p->obj_size < sizeof(void *)) p->obj_size = sizeof(void *);
+    if (capacity == 0) return 0;
+
+    p->slab = (unsigned char *)platform_aligned_alloc(p->obj_size * capacity, CACHE_LINE_SIZE);
+    if (!p->slab) {
+        fprintf(stderr, "[!] Pool: failed to allocate %u x %zu bytes\n", capacity, p->obj_size);
+        return -1;
+    }
+    p->capacity = capacity;
+
+    // Thread the free list back to front so allocation walks the slab in order
+    for (uint32_t i = capacity; i-- > 0;) {
+        void **obj = (void **)(p->slab + (size_t)i * p->obj_size);
+        *obj = p->free_list;
+        p->free_list = obj;
+    }
+    return 0;
+}
+
+void pool_destroy(ObjPool *p) {
+    platform_aligned_free(p->slab);
+    memset(p, 0, sizeof(*p));
+}
+
+void *pool_alloc(ObjPool *p) {
+    void **obj = (void **)p->free_list;
+    if (!obj) return NULL;
+    p->free_list = *obj;
+    if (++p->in_use > p->peak) p->peak = p->in_use;
+    return obj;
+}
+
+void pool_free(ObjPool *p, void *obj) {
+    if (!obj) return;
+    *(void **)obj = p->free_list;
+    p->free_list = obj;
+    p->in_use--;
+}
@@ -0,0 +1,29 @@
+// pool.h - Fixed-size object pool
+//
+// One slab allocated up front and carved into equal objects threaded on an
+// intrusive free list: alloc and free are O(1) and never touch malloc once
+// the pool exists. Not thread safe; each worker owns its pools.
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    unsigned char *slab;
+    void *free_list;
+    size_t obj_size;         // Rounded up to 16 bytes
+    uint32_t capacity;
+    uint32_t in_use;
+    uint32_t peak;
+} ObjPool;
+
+// Returns 0 on success; capacity 0 leaves an empty pool that never allocates
+int   pool_init(ObjPool *p, size_t obj_size, uint32_t capacity);
+void  pool_destroy(ObjPool *p);
+
+// NULL when exhausted. Objects are not cleared.
+void *pool_alloc(ObjPool *p);
+void  pool_free(ObjPool *p, void *obj);
+
+#endif // POOL_H
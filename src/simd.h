@@ -0,0 +1,84 @@
+// simd.h - Bounded byte scanning with AVX2 / SSE2 and a scalar fallback
+//
+// Vector loads are only issued while a whole vector fits before the end of
+// the buffer; the tail is finished one byte at a time, so nothing here ever
+// reads past `n` (no page-boundary tricks). The instruction set is chosen
+// at compile time: -mavx2 (or -march=native on a capable host) selects the
+// 32-byte path, SSE2 is the x86-64 baseline, anything else is scalar.
+// -DSIMD_DISABLE forces the scalar path (for comparison and testing).
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(SIMD_DISABLE)
+#define SIMD_WIDTH 0
+#define SIMD_NAME "scalar"
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#define SIMD_NAME "AVX2"
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#define SIMD_NAME "SSE2"
+#else
+#define SIMD_WIDTH 0
+#define SIMD_NAME "scalar"
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static __forceinline unsigned simd_ctz(uint32_t m) {
+    unsigned long i;
+    _BitScanForward(&i, m);
+    return (unsigned)i;
+}
+#else
+#define simd_ctz(m) ((unsigned)__builtin_ctz(m))
+#endif
+
+// Bit i of *ma / *mb is set when p[i] == a / b, for the SIMD_WIDTH bytes at p.
+// The caller guarantees SIMD_WIDTH readable bytes.
+#if SIMD_WIDTH == 32
+static inline void simd_match2(const unsigned char *p, unsigned char a, unsigned char b,
+                               uint32_t *ma, uint32_t *mb) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    *ma = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)a)));
+    *mb = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)b)));
+}
+#elif SIMD_WIDTH == 16
+static inline void simd_match2(const unsigned char *p, unsigned char a, unsigned char b,
+                               uint32_t *ma, uint32_t *mb) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    *ma = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)a)));
+    *mb = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)b)));
+}
+#endif
+
+// Offset of the first c in p[0..n), or n
+static inline size_t simd_find_byte(const unsigned char *p, size_t n, unsigned char c) {
+    size_t i = 0;
+#if SIMD_WIDTH == 32
+    __m256i needle = _mm256_set1_epi8((char)c);
+    for (; i + 32 <= n; i += 32) {
+        uint32_t m = (uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), needle));
+        if (m) return i + simd_ctz(m);
+    }
+#elif SIMD_WIDTH == 16
+    __m128i needle = _mm_set1_epi8((char)c);
+    for (; i + 16 <= n; i += 16) {
+        uint32_t m = (uint32_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), needle));
+        if (m) return i + simd_ctz(m);
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == c) return i;
+    }
+    return n;
+}
+
+#endif // SIMD_H
@@ -1,170 +1,336 @@
 #include "sniffer.h"
 #include "analyzer.h"
+#include "afpacket.h"
+#include "dissect.h"
+#include "flow.h"
+#include "histogram.h"
+#include "metrics.h"
+#include "overload.h"
+#include "platform.h"
+#include "pktring.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
-#include <winsock2.h>
-#include <iphlpapi.h>
 #include <pcap.h>
+#ifdef _WIN32
+#include <iphlpapi.h>
 #pragma comment(lib, "iphlpapi.lib")
+#else
+#include <unistd.h>
+#endif
 
 // Configuration constants
-#define MAX_QUEUE_SIZE 10000          // Maximum packets in queue
+#define MAX_QUEUE_SIZE 8192           // Total packet ring slots, split across workers (memory = slots x snaplen)
+#define MIN_WORKER_QUEUE 1024         // Per-worker floor when splitting the default (power of two)
+#define DEFAULT_SNAPLEN 9216          // Bytes captured per packet / ring slot size (jumbo frame)
 #define MAX_ADAPTERS 64               // Maximum network adapters
+#define OFFLINE_DISPATCH_BATCH 256    // Packets per pcap_dispatch() call when replaying a file
+#define QUEUE_POLL_MS 100             // Max sleep before re-checking stop_sniffer
+#define MAX_DEVICE_NAME 256
+#define MIN_WORKER_BLOCKS 8           // AF_PACKET: per-worker floor when splitting the block budget
+#define MIN_WORKER_FLOWS 1024         // Per-worker floor when splitting the flow table
+#define MIN_WORKER_SESSIONS 256       // Per-worker floors when splitting the TCP reassembly pools
+#define MIN_WORKER_REASM_BUFFERS 256
+#define MIN_WORKER_TLS_BUFFERS 16     // Per-worker floor for split TLS hello buffers
+#define MIN_WORKER_FRAG_DATAGRAMS 64  // Per-worker floors when splitting the IP reassembly cache
+#define MIN_WORKER_FRAG_BUFFERS 64
+#define MIN_WORKER_DNS_QUERIES 1024   // Per-worker floor when splitting the DNS transaction table
+#define FILTER_SNAPLEN 262144         // Snap length compiled into AF_PACKET filters (the accept return value truncates)
+#define KERNEL_STATS_INTERVAL_NS 1000000000ull   // Live kernel drop counters are sampled this often for /metrics
 
 // ---------------------------
 // Global Stop Flag and Statistics
 // ---------------------------
-volatile BOOL stop_sniffer = FALSE;
+volatile int stop_sniffer = 0;
+static volatile int interrupted = 0;
+
+// Offline mode: capture thread waits for room instead of dropping
+static int queue_blocking = 0;
+
+// Per-worker analyzer limits (flow table share), set by start_sniffer
+static AnalyzerConfig analyzer_cfg;
+
+// BPF expression installed at open (CAPTURE_FILTER / -f), NULL = every frame
+static const char *capture_filter = NULL;
 
-// Capture statistics (thread-safe atomic counters)
-static volatile LONG64 packets_received = 0;
-static volatile LONG64 packets_dropped_queue_full = 0;
-static volatile LONG64 packets_dropped_alloc_fail = 0;
-static volatile LONG64 queue_high_water_mark = 0;
+// Kernel-side counters of a capture, -1 where the backend cannot tell
+typedef struct {
+    int64_t accepted;        // Frames that passed the capture filter (including kernel drops)
+    int64_t drops;           // Passed the filter but dropped for lack of buffer space
+    int64_t iface_packets;   // Frames received and sent by the interface during the capture
+} KernelCounters;
 
 // ---------------------------
-// Thread-Safe Queue
+// Per-Stage Timing
 // ---------------------------
-typedef struct PacketNode {
-    struct pcap_pkthdr *header;
-    u_char *data;
-    struct PacketNode *next;
-} PacketNode;
+// Accumulated in nanoseconds from platform_now_ns(). Only the owning
+// thread records; the metrics collector reads a racy copy.
+typedef struct {
+    volatile int64_t total_ns;
+    volatile int64_t max_ns;
+    volatile int64_t count;
+    LatencyHist hist;                  // Nanoseconds
+} StageTimer;
+
+static StageTimer stage_read;      // pcap_dispatch() excluding handler time (capture thread)
+static StageTimer stage_enqueue;   // steering + queue_push() copy (+ backpressure wait offline)
 
+// Kernel drops of the live pcap handle, sampled by the capture loop (-1 = unknown)
+static volatile int64_t live_kernel_drops = -1;
+
+static void stage_record(StageTimer *st, int64_t ns) {
+    if (ns < 0) ns = 0;
+    hist_record(&st->hist, (uint64_t)ns);
+    st->total_ns += ns;
+    st->count++;
+    if (ns > st->max_ns) st->max_ns = ns;
+}
+
+// Live packets: age by capture timestamp when the worker picked the packet
+// up (dequeue_us, wall clock) and once analysis was done
+static void record_capture_age(const struct pcap_pkthdr *header, uint64_t dequeue_us, uint64_t analyze_ns) {
+    uint64_t captured_us = (uint64_t)header->ts.tv_sec * 1000000u + (uint64_t)header->ts.tv_usec;
+    uint64_t age_us = dequeue_us > captured_us ? dequeue_us - captured_us : 0;
+    stats_record_latency(STATS_LATENCY_CAPTURE_TO_DEQUEUE, age_us);
+    stats_record_latency(STATS_LATENCY_CAPTURE_TO_ANALYZED, age_us + analyze_ns / 1000);
+}
+
+static void stage_merge(StageTimer *dst, const StageTimer *src) {
+    dst->total_ns += src->total_ns;
+    dst->count += src->count;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+    hist_merge(&dst->hist, &src->hist);
+}
+
+// ---------------------------
+// Block Handoff Queue (AF_PACKET)
+// ---------------------------
+// Carries ring block indices from the capture thread to the analysis thread.
+// A block stays "in flight" until analysis releases it back to the kernel,
+// so the capture thread never hands out the same block twice.
 typedef struct {
-    PacketNode *head;
-    PacketNode *tail;
-    CRITICAL_SECTION cs;
-    CONDITION_VARIABLE cv;
-    int count;
-} PacketQueue;
-
-static PacketQueue queue;
-
-// Initialize queue
-void queue_init(PacketQueue *q) {
-    q->head = q->tail = NULL;
-    q->count = 0;
-    InitializeCriticalSection(&q->cs);
-    InitializeConditionVariable(&q->cv);
-}
-
-// Push packet to queue with size limit and error tracking
-void queue_push(PacketQueue *q, const struct pcap_pkthdr *header, const u_char *data) {
-    InterlockedIncrement64(&packets_received);
-    
-    // Check queue size limit first (before allocating memory)
-    EnterCriticalSection(&q->cs);
-    if (q->count >= MAX_QUEUE_SIZE) {
-        LeaveCriticalSection(&q->cs);
-        InterlockedIncrement64(&packets_dropped_queue_full);
-        
-        // Log periodically (every 1000 drops)
-        LONG64 drops = packets_dropped_queue_full;
-        if (drops % 1000 == 1) {
-            fprintf(stderr, "[!] Queue full: dropped %lld packets (queue size: %d)\n", 
-                    drops, MAX_QUEUE_SIZE);
+    unsigned *slots;
+    uint64_t *enqueue_ns;
+    unsigned capacity;
+    unsigned head;
+    unsigned count;      // Ready, not yet popped
+    unsigned inflight;   // Pushed, not yet released
+    mutex_t cs;
+    cond_t ready;
+    cond_t released;
+} BlockQueue;
+
+// ---------------------------
+// Workers
+// ---------------------------
+// Each worker owns one queue and parses only the flows steered to it, so
+// both directions of a connection are always seen by the same thread.
+// Counters are grouped by writer onto separate cache lines and merged
+// only for reporting.
+typedef struct {
+    // Capture side: the thread feeding this worker's queue
+    // (AF_PACKET frames are counted by the worker itself while walking)
+    CACHE_ALIGNED int64_t packets_received;
+    int64_t bytes_received;       // Sum of header->len (wire bytes)
+    int64_t bytes_captured;       // Sum of header->caplen
+    int64_t dropped_queue_full;
+    int64_t truncated;            // caplen larger than a ring slot (offline files)
+    int64_t high_water;
+    volatile int64_t kernel_drops;     // AF_PACKET: sampled by the capture thread (-1 = not yet)
+
+    // Analysis side: written only by the worker thread
+    CACHE_ALIGNED StageTimer queued;   // time spent waiting in the queue (or block handoff)
+    StageTimer analyze;                // analyze_packet()
+
+    // Set up before the threads start
+    CACHE_ALIGNED unsigned id;
+    analyzer_t *an;               // Flow table etc.; touched only by the worker thread
+    PktRing ring;                 // pcap backend
+    afp_ring_t *afp;              // AF_PACKET backend: one fanout member per worker
+    BlockQueue blocks;
+    uint64_t block_enqueue_ns;    // Handoff time of the block being walked
+    thread_t thread;
+    thread_t capture_thread;
+    int thread_started;
+    int capture_started;
+} Worker;
+
+static Worker *workers = NULL;
+static unsigned num_workers = 0;
+
+static void workers_free(void) {
+    for (unsigned i = 0; i < num_workers; i++) analyzer_destroy(workers[i].an);
+    platform_aligned_free(workers);
+    workers = NULL;
+    num_workers = 0;
+}
+
+static int workers_alloc(unsigned count) {
+    workers = (Worker *)platform_aligned_alloc(sizeof(Worker) * count, CACHE_LINE_SIZE);
+    if (!workers) {
+        fprintf(stderr, "[!] Failed to allocate %u workers\n", count);
+        return -1;
+    }
+    num_workers = count;
+    for (unsigned i = 0; i < count; i++) {
+        workers[i].id = i;
+        workers[i].kernel_drops = -1;
+        workers[i].an = analyzer_create(i, &analyzer_cfg);
+        if (!workers[i].an) {
+            fprintf(stderr, "[!] Failed to allocate analyzer state for worker %u\n", i);
+            workers_free();
+            return -1;
         }
-        return;
     }
-    LeaveCriticalSection(&q->cs);
-    
-    // Allocate memory for node
-    PacketNode *node = (PacketNode *)malloc(sizeof(PacketNode));
-    if (!node) {
-        InterlockedIncrement64(&packets_dropped_alloc_fail);
-        if (packets_dropped_alloc_fail % 1000 == 1) {
-            fprintf(stderr, "[!] Memory allocation failed: dropped %lld packets\n", 
-                    packets_dropped_alloc_fail);
+    return 0;
+}
+
+// Live captures shed load under pressure (see overload.h); replay never
+// does, its reader waits for room instead
+static void workers_overload_start(void) {
+    overload_start(num_workers, platform_wall_us());
+    for (unsigned i = 0; i < num_workers; i++) workers[i].an->overload = overload_worker(i);
+}
+
+// Symmetric 5-tuple hash -> worker. Non-IP frames all go to worker 0.
+static Worker *steer(const struct pcap_pkthdr *header, const u_char *data) {
+    if (num_workers == 1) return &workers[0];
+    flow_key_t key;
+    if (flow_key_from_frame(data, (int)header->caplen, &key) != 0) return &workers[0];
+    return &workers[flow_key_hash(&key) % num_workers];
+}
+
+// ---------------------------
+// Capture -> Analysis Ring
+// ---------------------------
+// Copy one packet into the worker's next free slot; drops (or waits, offline) when full
+static void queue_push(Worker *w, const struct pcap_pkthdr *header, const u_char *data) {
+    PktRing *q = &w->ring;
+    w->packets_received++;
+    w->bytes_received += header->len;
+    w->bytes_captured += header->caplen;
+
+    PktSlot *slot = pktring_reserve(q);
+    if (!slot && queue_blocking) {
+        // Offline replay: apply backpressure instead of dropping
+        while (!slot && !stop_sniffer) {
+            thread_yield();
+            slot = pktring_reserve(q);
         }
-        return;
     }
-    
-    node->header = (struct pcap_pkthdr *)malloc(sizeof(struct pcap_pkthdr));
-    if (!node->header) {
-        free(node);
-        InterlockedIncrement64(&packets_dropped_alloc_fail);
+    if (!slot) {
+        int64_t drops = ++w->dropped_queue_full;
+
+        // Log periodically (every 1000 drops)
+        if (drops % 1000 == 1) {
+            fprintf(stderr, "[!] Worker %u queue full: dropped %lld packets (queue size: %u)\n",
+                    w->id, (long long)drops, q->capacity);
+        }
         return;
     }
-    
-    node->data = (u_char *)malloc(header->caplen);
-    if (!node->data) {
-        free(node->header);
-        free(node);
-        InterlockedIncrement64(&packets_dropped_alloc_fail);
-        return;
+
+    slot->header = *header;
+    if (slot->header.caplen > q->slot_size) {
+        slot->header.caplen = q->slot_size;
+        w->truncated++;
     }
+    memcpy(slot->data, data, slot->header.caplen);
+    slot->enqueue_ns = platform_now_ns();
+    pktring_commit(q);
 
-    memcpy(node->header, header, sizeof(struct pcap_pkthdr));
-    memcpy(node->data, data, header->caplen);
-    node->next = NULL;
+    // Track high water mark (single producer, plain store is enough)
+    int64_t depth = (int64_t)pktring_count(q);
+    if (depth > w->high_water) w->high_water = depth;
+}
 
-    EnterCriticalSection(&q->cs);
-    if (q->tail) q->tail->next = node;
-    else q->head = node;
-    q->tail = node;
-    q->count++;
-    
-    // Track high water mark
-    if (q->count > queue_high_water_mark) {
-        InterlockedExchange64(&queue_high_water_mark, q->count);
+// ---------------------------
+// Block Handoff Queue operations
+// ---------------------------
+static int block_queue_init(BlockQueue *bq, unsigned capacity) {
+    memset(bq, 0, sizeof(*bq));
+    bq->slots = (unsigned *)calloc(capacity, sizeof(unsigned));
+    bq->enqueue_ns = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    if (!bq->slots || !bq->enqueue_ns) {
+        free(bq->slots);
+        free(bq->enqueue_ns);
+        return -1;
     }
-    
-    LeaveCriticalSection(&q->cs);
-    WakeConditionVariable(&q->cv);
+    bq->capacity = capacity;
+    mutex_init(&bq->cs);
+    cond_init(&bq->ready);
+    cond_init(&bq->released);
+    return 0;
 }
 
-// Pop packet from queue
-PacketNode* queue_pop(PacketQueue *q) {
-    EnterCriticalSection(&q->cs);
-    while (!q->head && !stop_sniffer) {
-        SleepConditionVariableCS(&q->cv, &q->cs, INFINITE);
-    }
+static void block_queue_destroy(BlockQueue *bq) {
+    cond_destroy(&bq->ready);
+    cond_destroy(&bq->released);
+    mutex_destroy(&bq->cs);
+    free(bq->slots);
+    free(bq->enqueue_ns);
+}
 
-    PacketNode *node = q->head;
-    if (node) {
-        q->head = node->next;
-        if (!q->head) q->tail = NULL;
-        q->count--;
+// Returns 1 when another block may be handed out, 0 on timeout
+static int block_queue_wait_room(BlockQueue *bq) {
+    mutex_lock(&bq->cs);
+    if (bq->inflight >= bq->capacity && !stop_sniffer) {
+        cond_timedwait(&bq->released, &bq->cs, QUEUE_POLL_MS);
     }
-    LeaveCriticalSection(&q->cs);
-    return node;
+    int room = bq->inflight < bq->capacity;
+    mutex_unlock(&bq->cs);
+    return room;
 }
 
-// Get queue count (thread-safe, for checking if queue is empty)
-int queue_get_count(PacketQueue *q) {
-    EnterCriticalSection(&q->cs);
-    int count = q->count;
-    LeaveCriticalSection(&q->cs);
+// Returns the number of blocks waiting after the push (for high-water tracking)
+static unsigned block_queue_push(BlockQueue *bq, unsigned idx) {
+    mutex_lock(&bq->cs);
+    unsigned tail = (bq->head + bq->count) % bq->capacity;
+    bq->slots[tail] = idx;
+    bq->enqueue_ns[tail] = platform_now_ns();
+    bq->count++;
+    bq->inflight++;
+    unsigned count = bq->count;
+    mutex_unlock(&bq->cs);
+    cond_signal(&bq->ready);
     return count;
 }
 
-// Cleanup queue (must be called after stop_sniffer is set and analysis thread has finished)
-void queue_cleanup(PacketQueue *q) {
-    EnterCriticalSection(&q->cs);
-    
-    // Drain remaining packets in queue
-    PacketNode *node = q->head;
-    while (node) {
-        PacketNode *next = node->next;
-        free(node->header);
-        free(node->data);
-        free(node);
-        node = next;
+// Returns 1 and fills idx/enqueue_ns when a block is ready, 0 on timeout
+static int block_queue_pop(BlockQueue *bq, unsigned *idx, uint64_t *enqueue_ns) {
+    mutex_lock(&bq->cs);
+    if (bq->count == 0 && !stop_sniffer) {
+        cond_timedwait(&bq->ready, &bq->cs, QUEUE_POLL_MS);
     }
-    
-    q->head = q->tail = NULL;
-    q->count = 0;
-    
-    LeaveCriticalSection(&q->cs);
-    DeleteCriticalSection(&q->cs);
+    int got = bq->count > 0;
+    if (got) {
+        *idx = bq->slots[bq->head];
+        *enqueue_ns = bq->enqueue_ns[bq->head];
+        bq->head = (bq->head + 1) % bq->capacity;
+        bq->count--;
+    }
+    mutex_unlock(&bq->cs);
+    return got;
+}
+
+static void block_queue_done(BlockQueue *bq) {
+    mutex_lock(&bq->cs);
+    bq->inflight--;
+    mutex_unlock(&bq->cs);
+    cond_signal(&bq->released);
+}
+
+static unsigned block_queue_pending(BlockQueue *bq) {
+    mutex_lock(&bq->cs);
+    unsigned count = bq->count;
+    mutex_unlock(&bq->cs);
+    return count;
 }
 
 // ---------------------------
 // MAC Address Helper
 // ---------------------------
+#ifdef _WIN32
 static void print_mac(const char *guid) {
     IP_ADAPTER_INFO AdapterInfo[MAX_ADAPTERS];
     DWORD buflen = sizeof(AdapterInfo);
@@ -185,64 +351,167 @@ static void print_mac(const char *guid) {
     }
     printf(" (MAC: Unknown)");
 }
+#else
+static void print_mac(const char *ifname) {
+    char path[MAX_DEVICE_NAME + 32];
+    char mac[32];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/address", ifname);
+    FILE *fp = fopen(path, "r");
+    if (!fp || !fgets(mac, sizeof(mac), fp)) {
+        if (fp) fclose(fp);
+        printf(" (MAC: Unknown)");
+        return;
+    }
+    fclose(fp);
+    mac[strcspn(mac, "\r\n")] = '\0';
+    printf(" (MAC: %s)", mac);
+}
+#endif
 
 // ---------------------------
 // Ctrl+C Handler
 // ---------------------------
-BOOL WINAPI console_handler(DWORD signal) {
-    if (signal == CTRL_C_EVENT || signal == CTRL_CLOSE_EVENT) {
-        printf("\n[Sniffer] Ctrl+C detected. Stopping...\n");
-        stop_sniffer = TRUE;
-        WakeConditionVariable(&queue.cv); // wake analysis thread
-        return TRUE;
-    }
-    return FALSE;
+// Runs on the console-control thread (Windows) or in signal context (POSIX):
+// only set flags. Waiters use timed waits and notice within QUEUE_POLL_MS.
+static void on_interrupt(void) {
+    interrupted = 1;
+    stop_sniffer = 1;
 }
 
 // ---------------------------
 // Packet Handler (Capture Thread)
 // ---------------------------
 static void packet_handler(u_char *param, const struct pcap_pkthdr *header, const u_char *pkt_data) {
+    (void)param;
     if (!stop_sniffer) {
-        queue_push(&queue, header, pkt_data);
+        uint64_t t0 = platform_now_ns();
+        queue_push(steer(header, pkt_data), header, pkt_data);
+        stage_record(&stage_enqueue, (int64_t)(platform_now_ns() - t0));
     }
 }
 
 // ---------------------------
-// Analysis Thread
+// Worker Thread (pcap backend)
 // ---------------------------
-DWORD WINAPI analysis_thread(LPVOID param) {
-    (void)param;  // Unused parameter
-    while (!stop_sniffer || queue_get_count(&queue) > 0) {
-        PacketNode *node = queue_pop(&queue);
-        if (!node) {
-            // If stop_sniffer is set and queue is empty, we're done
-            if (stop_sniffer && queue_get_count(&queue) == 0) break;
+static thread_ret_t THREAD_CALL worker_thread(void *param) {
+    Worker *w = (Worker *)param;
+    PktRing *q = &w->ring;
+    while (!stop_sniffer || pktring_count(q) > 0) {
+        PktSlot *slot = pktring_peek(q, QUEUE_POLL_MS);
+        OverloadState *ov = w->an->overload;
+        if (!slot) {
+            // Timeout: expire idle flows (live only, replay runs on packet time), re-check stop_sniffer
+            stats_thread_idle();
+            if (!queue_blocking) {
+                uint64_t now_us = platform_wall_us();
+                analyzer_idle(w->an, now_us);
+                if (ov) overload_update(ov, 0, q->capacity, now_us);
+            }
             continue;
         }
-        analyze_packet(node->header, node->data);
-        free(node->header);
-        free(node->data);
-        free(node);
+
+        // Parse in place, then hand the slot back to the producer
+        uint64_t t0 = platform_now_ns();
+        uint64_t dequeue_us = queue_blocking ? 0 : platform_wall_us();
+        if (ov && --ov->countdown == 0) {
+            ov->countdown = OVERLOAD_CHECK_PACKETS;
+            overload_update(ov, pktring_count(q), q->capacity, dequeue_us);
+        }
+        stage_record(&w->queued, (int64_t)(t0 - slot->enqueue_ns));
+        analyze_packet(w->an, &slot->header, slot->data);
+        uint64_t analyze_ns = platform_now_ns() - t0;
+        stage_record(&w->analyze, (int64_t)analyze_ns);
+        if (dequeue_us) record_capture_age(&slot->header, dequeue_us, analyze_ns);
+        pktring_release(q);
     }
-    printf("[Sniffer] Analysis thread exiting\n");
+    printf("[Sniffer] Worker %u exiting\n", w->id);
     return 0;
 }
 
 // ---------------------------
-// Start Sniffer
+// AF_PACKET Pipeline (Linux)
 // ---------------------------
-void start_sniffer() {
-    SetConsoleCtrlHandler(console_handler, TRUE);
+// With several workers each one has its own ring in a PACKET_FANOUT group;
+// the kernel's flow hash does the steering, so no user-space copy is needed.
+static void afp_frame_handler(void *user, const struct pcap_pkthdr *header, const u_char *data) {
+    Worker *w = (Worker *)user;
+    w->packets_received++;
+    w->bytes_received += header->len;
+    w->bytes_captured += header->caplen;
+
+    uint64_t t0 = platform_now_ns();
+    uint64_t dequeue_us = platform_wall_us();
+    stage_record(&w->queued, (int64_t)(t0 - w->block_enqueue_ns));
+    analyze_packet(w->an, header, data);
+    uint64_t analyze_ns = platform_now_ns() - t0;
+    stage_record(&w->analyze, (int64_t)analyze_ns);
+    record_capture_age(header, dequeue_us, analyze_ns);
+}
 
+// Walks each handed-off block in place, then returns it to the kernel
+static thread_ret_t THREAD_CALL afp_worker_thread(void *param) {
+    Worker *w = (Worker *)param;
+    while (!stop_sniffer || block_queue_pending(&w->blocks) > 0) {
+        unsigned idx;
+        OverloadState *ov = w->an->overload;
+        if (!block_queue_pop(&w->blocks, &idx, &w->block_enqueue_ns)) {
+            uint64_t now_us = platform_wall_us();
+            stats_thread_idle();
+            analyzer_idle(w->an, now_us);
+            if (ov) overload_update(ov, 0, w->blocks.capacity, now_us);
+            continue;
+        }
+        // Blocks the kernel has retired and this worker has not reached yet
+        if (ov) overload_update(ov, block_queue_pending(&w->blocks), w->blocks.capacity, platform_wall_us());
+        afp_walk_block(w->afp, idx, afp_frame_handler, w);
+        afp_release_block(w->afp, idx);
+        block_queue_done(&w->blocks);
+    }
+    printf("[Sniffer] Worker %u exiting\n", w->id);
+    return 0;
+}
+
+// Capture side: wait for the kernel to retire blocks in ring order and hand them off
+static thread_ret_t THREAD_CALL afp_capture_thread(void *param) {
+    Worker *w = (Worker *)param;
+    unsigned idx = 0;
+    unsigned nblocks = afp_block_count(w->afp);
+    uint64_t next_stats_ns = 0;
+    while (!stop_sniffer) {
+        uint64_t now_ns = platform_now_ns();
+        if (now_ns >= next_stats_ns) {
+            uint64_t drops = 0;
+            afp_get_stats(w->afp, NULL, &drops, NULL);
+            w->kernel_drops = (int64_t)drops;
+            next_stats_ns = now_ns + KERNEL_STATS_INTERVAL_NS;
+        }
+        if (!block_queue_wait_room(&w->blocks)) continue;
+        int rc = afp_wait_block(w->afp, idx, QUEUE_POLL_MS);
+        if (rc < 0) {
+            fprintf(stderr, "[!] AF_PACKET: socket error on worker %u, stopping capture\n", w->id);
+            stop_sniffer = 1;
+            break;
+        }
+        if (rc == 0) continue;
+        int64_t depth = (int64_t)block_queue_push(&w->blocks, idx);
+        if (depth > w->high_water) w->high_water = depth;
+        idx = (idx + 1) % nblocks;
+    }
+    return 0;
+}
+
+// ---------------------------
+// Device Selection (Live Mode)
+// ---------------------------
+// Interactive picker; copies the chosen device name into name. Returns 0 on success.
+static int select_device_interactive(char *name, size_t name_len) {
     pcap_if_t *alldevs, *d;
-    pcap_t *adhandle;
     char errbuf[PCAP_ERRBUF_SIZE];
     int i = 0;
 
     if (pcap_findalldevs(&alldevs, errbuf) == -1) {
         fprintf(stderr, "Error finding devices: %s\n", errbuf);
-        return;
+        return -1;
     }
 
     printf("\n=== Available Devices ===\n");
@@ -256,25 +525,25 @@ void start_sniffer() {
     if (i == 0) {
         printf("No interfaces found.\n");
         pcap_freealldevs(alldevs);
-        return;
+        return -1;
     }
 
     int dev_num;
     char input[32];
-    
+
     printf("\nEnter device number to capture: ");
     fflush(stdout);
-    
+
     if (fgets(input, sizeof(input), stdin) == NULL) {
         printf("Failed to read input.\n");
         pcap_freealldevs(alldevs);
-        return;
+        return -1;
     }
-    
+
     if (sscanf(input, "%d", &dev_num) != 1 || dev_num <= 0 || dev_num > i) {
         printf("Invalid device number. Please enter a number between 1 and %d.\n", i);
         pcap_freealldevs(alldevs);
-        return;
+        return -1;
     }
 
     d = alldevs;
@@ -282,68 +551,943 @@ void start_sniffer() {
     if (!d) {
         printf("Invalid device.\n");
         pcap_freealldevs(alldevs);
-        return;
+        return -1;
     }
 
-    adhandle = pcap_open_live(d->name, 65536, 1, 1000, errbuf);
-    if (!adhandle) {
-        fprintf(stderr, "Unable to open adapter: %s\n", errbuf);
-        pcap_freealldevs(alldevs);
+    snprintf(name, name_len, "%s", d->name);
+    pcap_freealldevs(alldevs);
+    return 0;
+}
+
+// ---------------------------
+// Reporting
+// ---------------------------
+// Sum of all workers' counters; only read once the workers have stopped
+typedef struct {
+    int64_t packets_received;
+    int64_t bytes_received;
+    int64_t bytes_captured;
+    int64_t dropped_queue_full;
+    int64_t truncated;
+    int64_t high_water;
+    StageTimer queued;
+    StageTimer analyze;
+} WorkerTotals;
+
+static void merge_workers(WorkerTotals *t) {
+    memset(t, 0, sizeof(*t));
+    for (unsigned i = 0; i < num_workers; i++) {
+        const Worker *w = &workers[i];
+        t->packets_received += w->packets_received;
+        t->bytes_received += w->bytes_received;
+        t->bytes_captured += w->bytes_captured;
+        t->dropped_queue_full += w->dropped_queue_full;
+        t->truncated += w->truncated;
+        if (w->high_water > t->high_water) t->high_water = w->high_water;
+        stage_merge(&t->queued, &w->queued);
+        stage_merge(&t->analyze, &w->analyze);
+    }
+}
+
+// Mean and percentiles in microseconds; ns_per_unit scales the recorded values
+static void print_latency(const char *name, const LatencyHist *h, double ns_per_unit) {
+    double scale = ns_per_unit / 1000.0;
+    printf("  %-22s avg %9.3f  p50 %9.3f  p99 %9.3f  p99.9 %9.3f  max %10.3f us",
+           name,
+           (double)h->sum * scale / (double)h->count,
+           (double)hist_percentile(h, 0.50) * scale,
+           (double)hist_percentile(h, 0.99) * scale,
+           (double)hist_percentile(h, 0.999) * scale,
+           (double)h->max * scale);
+}
+
+static void print_stage(const char *name, const StageTimer *st) {
+    if (st->count == 0) {
+        printf("  %-22s n/a\n", name);
         return;
     }
+    print_latency(name, &st->hist, 1.0);
+    printf("  total %10.3f ms\n", (double)st->total_ns / 1e6);
+}
 
-    printf("[Sniffer] Listening on %s...\n", d->name);
+static void print_stage_timings(const WorkerTotals *t) {
+    static StatsSnapshot snap;
+    printf("\n=== Stage Timings ===\n");
+    print_stage("Read (pcap)", &stage_read);
+    print_stage("Enqueue", &stage_enqueue);
+    print_stage("Queue wait", &t->queued);
+    print_stage("Analyze", &t->analyze);
 
-    // Initialize queue and start analysis thread
-    queue_init(&queue);
-    HANDLE hThread = CreateThread(NULL, 0, analysis_thread, NULL, 0, NULL);
-    if (!hThread) {
-        fprintf(stderr, "Failed to create analysis thread\n");
-        pcap_freealldevs(alldevs);
+    // Live captures only: how stale a packet was by its capture timestamp
+    stats_take_snapshot(&snap);
+    const LatencyHist *dequeue = &snap.latency[STATS_LATENCY_CAPTURE_TO_DEQUEUE];
+    const LatencyHist *analyzed = &snap.latency[STATS_LATENCY_CAPTURE_TO_ANALYZED];
+    if (dequeue->count == 0) return;
+    print_latency("Capture -> dequeue", dequeue, 1000.0);
+    printf("\n");
+    print_latency("Capture -> analyzed", analyzed, 1000.0);
+    printf("\n");
+}
+
+static void print_throughput(const WorkerTotals *t, uint64_t elapsed_ns) {
+    double secs = (double)elapsed_ns / 1e9;
+    printf("\n=== Replay Throughput ===\n");
+    printf("Elapsed:                  %.3f s\n", secs);
+    if (secs <= 0.0) return;
+    printf("Packets/sec:              %.0f\n", (double)t->analyze.count / secs);
+    printf("Bytes/sec (wire):         %.0f (%.2f Mbit/s)\n",
+           (double)t->bytes_received / secs, (double)t->bytes_received * 8.0 / secs / 1e6);
+    printf("Bytes/sec (captured):     %.0f\n", (double)t->bytes_captured / secs);
+}
+
+static void print_capture_statistics(const WorkerTotals *t, const KernelCounters *k) {
+    int64_t kernel_drops = k->drops;
+    printf("\n=== Capture Statistics ===\n");
+    if (capture_filter) {
+        printf("Capture filter:           %s\n", capture_filter);
+    }
+    if (k->accepted >= 0) {
+        printf("%s%lld\n", capture_filter ? "Passed filter (kernel):   " : "Accepted (kernel):        ",
+               (long long)k->accepted);
+    }
+    if (capture_filter && k->accepted >= 0 && k->iface_packets >= 0) {
+        // Interface counters include frames the socket never saw, so this is an estimate
+        int64_t rejected = k->iface_packets > k->accepted ? k->iface_packets - k->accepted : 0;
+        printf("Filtered out (kernel):    ~%lld of %lld interface frames (%.1f%%)\n",
+               (long long)rejected, (long long)k->iface_packets,
+               k->iface_packets > 0 ? (double)rejected / (double)k->iface_packets * 100.0 : 0.0);
+    }
+    printf("Packets received:         %lld\n", (long long)t->packets_received);
+    printf("Packets queued:           %lld\n",
+           (long long)(t->packets_received - t->dropped_queue_full));
+    printf("Dropped (queue full):     %lld\n", (long long)t->dropped_queue_full);
+    if (t->truncated > 0) {
+        printf("Truncated to slot size:   %lld\n", (long long)t->truncated);
+    }
+    if (kernel_drops >= 0) {
+        printf("Dropped (kernel):         %lld\n", (long long)kernel_drops);
+    }
+    printf("Queue high water mark:    %lld\n", (long long)t->high_water);
+    if (t->packets_received > 0) {
+        int64_t drops = t->dropped_queue_full + (kernel_drops > 0 ? kernel_drops : 0);
+        double drop_rate = (double)drops / (t->packets_received + (kernel_drops > 0 ? kernel_drops : 0)) * 100.0;
+        printf("Drop rate:                %.2f%%\n", drop_rate);
+    }
+}
+
+// Packets and bytes per protocol layer, and the busiest second of the
+// rate window (none for runs shorter than a second)
+static void print_protocol_traffic(void) {
+    static StatsSnapshot snap;
+    StatsRates rates;
+    stats_take_snapshot(&snap);
+    stats_rates(&rates);
+    printf("\n=== Protocol Traffic ===\n");
+    printf("  %-9s %12s %14s %14s %12s %12s\n",
+           "Protocol", "Packets", "Wire bytes", "Captured", "Peak pkt/s", "Peak Mbit/s");
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        if (!snap.since_start.counters[p]) continue;
+        printf("  %-9s %12llu %14llu %14llu", stats_proto_name((proto_id_t)p),
+               (unsigned long long)snap.since_start.counters[p],
+               (unsigned long long)snap.since_start.wire_bytes[p],
+               (unsigned long long)snap.since_start.cap_bytes[p]);
+        if (rates.proto[p].peak_pps_us) {
+            printf(" %12.0f %12.2f\n", rates.proto[p].peak_pps, rates.proto[p].peak_bps / 1e6);
+        } else {
+            printf(" %12s %12s\n", "-", "-");
+        }
+    }
+    if (rates.buckets) printf("Peaks over the last %u s (one-second buckets)\n", rates.buckets);
+
+    // Counted, not printed, as they happen (see stats_count_truncated)
+    int header = 0;
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        uint64_t truncated = snap.since_start.truncated[p], malformed = snap.since_start.malformed[p];
+        if (!truncated && !malformed) continue;
+        if (!header) {
+            printf("  %-9s %12s %12s   (truncated: cut short by the capture length)\n",
+                   "Protocol", "Truncated", "Malformed");
+            header = 1;
+        }
+        printf("  %-9s %12llu %12llu\n", stats_proto_name((proto_id_t)p),
+               (unsigned long long)truncated, (unsigned long long)malformed);
+    }
+}
+
+// Live captures: time spent shedding load (see overload.h)
+static void print_overload(void) {
+    OverloadSummary ov;
+    overload_summary(&ov, platform_wall_us());
+    if (!ov.enabled) return;
+    uint64_t total_us = 0;
+    for (int m = 0; m < OVERLOAD_MODES; m++) total_us += ov.mode_us[m];
+    printf("\n=== Overload ===\n");
+    printf("Mode transitions:         %llu\n", (unsigned long long)ov.transitions);
+    for (int m = 0; m < OVERLOAD_MODES; m++) {
+        printf("  %-9s %12.3f s worker time (%5.1f%%)\n", overload_mode_name((overload_mode_t)m),
+               (double)ov.mode_us[m] / 1e6,
+               total_us ? (double)ov.mode_us[m] * 100.0 / (double)total_us : 0.0);
+    }
+    if (ov.skipped) {
+        printf("Sampled out:              %llu packets (1 flow in %u kept, counts scaled up)\n",
+               (unsigned long long)ov.skipped, ov.sample_rate);
+    }
+}
+
+// Per-worker share of the traffic; imbalance is the busiest worker over the mean
+static void print_worker_balance(const WorkerTotals *t) {
+    if (num_workers < 2) return;
+    printf("\n=== Worker Load Balance ===\n");
+    printf("  %-6s %12s %7s %10s %9s %14s\n",
+           "Worker", "Packets", "Share", "Dropped", "Queue HWM", "Avg analyze");
+    int64_t busiest = 0;
+    for (unsigned i = 0; i < num_workers; i++) {
+        const Worker *w = &workers[i];
+        double share = t->packets_received > 0
+            ? (double)w->packets_received * 100.0 / (double)t->packets_received : 0.0;
+        double avg_us = w->analyze.count > 0
+            ? (double)w->analyze.total_ns / 1000.0 / (double)w->analyze.count : 0.0;
+        printf("  %-6u %12lld %6.1f%% %10lld %9lld %11.3f us\n",
+               w->id, (long long)w->packets_received, share,
+               (long long)w->dropped_queue_full, (long long)w->high_water, avg_us);
+        if (w->packets_received > busiest) busiest = w->packets_received;
+    }
+    if (t->packets_received > 0) {
+        double mean = (double)t->packets_received / (double)num_workers;
+        printf("Imbalance (max/mean):     %.2f\n", (double)busiest / mean);
+    }
+}
+
+static void print_flow_table(void) {
+    FlowTableStats sum, s;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned i = 0; i < num_workers; i++) {
+        flow_table_get_stats(workers[i].an->flows, &s);
+        sum.created += s.created;
+        sum.expired_idle += s.expired_idle;
+        sum.expired_active += s.expired_active;
+        sum.closed += s.closed;
+        sum.shutdown += s.shutdown;
+        sum.table_full += s.table_full;
+        sum.peak_active += s.peak_active;   // Upper bound: workers peak at different times
+        sum.capacity += s.capacity;
+        sum.memory_bytes += s.memory_bytes;
+    }
+    printf("\n=== Flow Table ===\n");
+    printf("Flows created:            %llu\n", (unsigned long long)sum.created);
+    printf("Peak active (sum):        %u of %u\n", sum.peak_active, sum.capacity);
+    printf("Expired (idle):           %llu\n", (unsigned long long)sum.expired_idle);
+    printf("Expired (active):         %llu\n", (unsigned long long)sum.expired_active);
+    printf("Closed (TCP FIN/RST):     %llu\n", (unsigned long long)sum.closed);
+    printf("Open at shutdown:         %llu\n", (unsigned long long)sum.shutdown);
+    if (sum.table_full > 0) {
+        printf("Untracked (table full):   %llu packets\n", (unsigned long long)sum.table_full);
+    }
+    printf("Table memory:             %.1f MiB\n", (double)sum.memory_bytes / (1024.0 * 1024.0));
+}
+
+static void print_tcp_reassembly(void) {
+    TcpReasmStats sum, s;
+    uint64_t sessions = 0, exhausted = 0;
+    uint32_t sessions_peak = 0, sessions_capacity = 0;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned i = 0; i < num_workers; i++) {
+        const analyzer_t *an = workers[i].an;
+        tcp_reasm_get_stats(an->reasm, &s);
+        sum.segments += s.segments;
+        sum.in_order += s.in_order;
+        sum.out_of_order += s.out_of_order;
+        sum.retransmits += s.retransmits;
+        sum.overlap_bytes += s.overlap_bytes;
+        sum.gaps += s.gaps;
+        sum.gap_bytes += s.gap_bytes;
+        sum.delivered_bytes += s.delivered_bytes;
+        sum.buffers_peak += s.buffers_peak;
+        sum.buffers_capacity += s.buffers_capacity;
+        sum.memory_bytes += s.memory_bytes + (uint64_t)an->sessions.obj_size * an->sessions.capacity;
+        sessions += an->sessions_created;
+        exhausted += an->sessions_exhausted;
+        sessions_peak += an->sessions.peak;
+        sessions_capacity += an->sessions.capacity;
+    }
+    if (sessions == 0 && exhausted == 0) return;
+    printf("\n=== TCP Reassembly ===\n");
+    printf("Sessions:                 %llu (peak %u of %u)\n",
+           (unsigned long long)sessions, sessions_peak, sessions_capacity);
+    if (exhausted > 0) {
+        printf("Session pool exhausted:   %llu packets parsed per segment\n", (unsigned long long)exhausted);
+    }
+    printf("Segments:                 %llu (in order %llu, out of order %llu, retransmitted %llu)\n",
+           (unsigned long long)sum.segments, (unsigned long long)sum.in_order,
+           (unsigned long long)sum.out_of_order, (unsigned long long)sum.retransmits);
+    printf("Overlapping bytes:        %llu\n", (unsigned long long)sum.overlap_bytes);
+    printf("Gaps skipped:             %llu (%llu bytes)\n",
+           (unsigned long long)sum.gaps, (unsigned long long)sum.gap_bytes);
+    printf("Bytes delivered:          %llu\n", (unsigned long long)sum.delivered_bytes);
+    printf("Buffers peak:             %u of %u\n", sum.buffers_peak, sum.buffers_capacity);
+    printf("Reassembly memory:        %.1f MiB\n", (double)sum.memory_bytes / (1024.0 * 1024.0));
+}
+
+static void print_ip_reassembly(void) {
+    IpFragStats sum, s;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned i = 0; i < num_workers; i++) {
+        ipfrag_get_stats(workers[i].an->frags, &s);
+        sum.fragments += s.fragments;
+        sum.hits += s.hits;
+        sum.misses += s.misses;
+        sum.reassembled += s.reassembled;
+        sum.duplicates += s.duplicates;
+        sum.overlap_bytes += s.overlap_bytes;
+        sum.overlap_drops += s.overlap_drops;
+        sum.invalid += s.invalid;
+        sum.timeouts += s.timeouts;
+        sum.evictions += s.evictions;
+        sum.in_use += s.in_use;
+        sum.peak += s.peak;
+        sum.max_datagrams += s.max_datagrams;
+        sum.buffers_peak += s.buffers_peak;
+        sum.max_buffers += s.max_buffers;
+        sum.memory_bytes += s.memory_bytes;
+    }
+    if (sum.fragments == 0) return;
+    printf("\n=== IP Reassembly ===\n");
+    printf("Fragments:                %llu (hit %llu, new datagram %llu)\n",
+           (unsigned long long)sum.fragments, (unsigned long long)sum.hits, (unsigned long long)sum.misses);
+    printf("Datagrams reassembled:    %llu\n", (unsigned long long)sum.reassembled);
+    printf("Timed out:                %llu\n", (unsigned long long)sum.timeouts);
+    printf("Evicted (cache full):     %llu\n", (unsigned long long)sum.evictions);
+    printf("Incomplete at shutdown:   %u\n", sum.in_use);
+    printf("Duplicates:               %llu\n", (unsigned long long)sum.duplicates);
+    printf("Overlaps:                 %llu bytes trimmed, %llu datagrams dropped\n",
+           (unsigned long long)sum.overlap_bytes, (unsigned long long)sum.overlap_drops);
+    printf("Invalid:                  %llu\n", (unsigned long long)sum.invalid);
+    printf("Peak in flight:           %u of %u datagrams, %u of %u buffers\n",
+           sum.peak, sum.max_datagrams, sum.buffers_peak, sum.max_buffers);
+    printf("Reassembly memory:        %.1f MiB\n", (double)sum.memory_bytes / (1024.0 * 1024.0));
+}
+
+static void print_top_names(stats_names_t set, const char *title) {
+    NameCount top[10];
+    uint64_t other = 0;
+    size_t ntop = stats_top_names(set, top, 10, &other);
+    if (ntop == 0) return;
+    printf("%s\n", title);
+    for (size_t i = 0; i < ntop; i++) {
+        printf("  %10llu  %s\n", (unsigned long long)top[i].count, top[i].name);
+    }
+    if (other > 0) printf("  %10llu  (other)\n", (unsigned long long)other);
+}
+
+static void print_dns_summary(void) {
+    static const char *rcode_names[DNSTRACK_RCODES] = {
+        "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED", "YXDOMAIN", "YXRRSET",
+        "NXRRSET", "NOTAUTH", "NOTZONE", "DSOTYPENI", "rcode 12", "rcode 13", "rcode 14", "rcode 15"
+    };
+    DnsTrackStats sum, s;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned i = 0; i < num_workers; i++) {
+        dnstrack_get_stats(workers[i].an->dns, &s);
+        sum.queries += s.queries;
+        sum.responses += s.responses;
+        sum.matched += s.matched;
+        sum.unmatched += s.unmatched;
+        sum.mismatched += s.mismatched;
+        sum.retransmits += s.retransmits;
+        sum.unanswered += s.unanswered;
+        sum.evictions += s.evictions;
+        for (int r = 0; r < DNSTRACK_RCODES; r++) sum.rcodes[r] += s.rcodes[r];
+        sum.in_use += s.in_use;
+        sum.peak += s.peak;   // Upper bound: workers peak at different times
+        sum.max_queries += s.max_queries;
+        sum.memory_bytes += s.memory_bytes;
+        hist_merge(&sum.latency, &s.latency);
+    }
+    if (sum.queries == 0 && sum.responses == 0) return;
+
+    printf("\n=== DNS Transactions ===\n");
+    printf("Queries / responses:      %llu / %llu (%llu retransmitted queries)\n",
+           (unsigned long long)sum.queries, (unsigned long long)sum.responses,
+           (unsigned long long)sum.retransmits);
+    printf("Answered:                 %llu\n", (unsigned long long)sum.matched);
+    printf("Unanswered:               %llu timed out, %llu evicted, %u pending at exit\n",
+           (unsigned long long)sum.unanswered, (unsigned long long)sum.evictions, sum.in_use);
+    printf("Unmatched responses:      %llu (%llu with a different question)\n",
+           (unsigned long long)(sum.unmatched + sum.mismatched), (unsigned long long)sum.mismatched);
+    if (sum.latency.count > 0) {
+        printf("Latency (ms):             mean %.3f, p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+               (double)sum.latency.sum / (double)sum.latency.count / 1000.0,
+               (double)hist_percentile(&sum.latency, 0.50) / 1000.0,
+               (double)hist_percentile(&sum.latency, 0.90) / 1000.0,
+               (double)hist_percentile(&sum.latency, 0.99) / 1000.0,
+               (double)hist_percentile(&sum.latency, 0.999) / 1000.0,
+               (double)sum.latency.max / 1000.0);
+        printf("Response codes:\n");
+        for (int r = 0; r < DNSTRACK_RCODES; r++) {
+            if (sum.rcodes[r]) printf("  %10llu  %s\n", (unsigned long long)sum.rcodes[r], rcode_names[r]);
+        }
+    }
+    printf("Peak outstanding:         %u of %u (%.1f MiB)\n",
+           sum.peak, sum.max_queries, (double)sum.memory_bytes / (1024.0 * 1024.0));
+
+    print_top_names(STATS_NAMES_DNS_QNAME, "Top qnames (queries):");
+
+    NameCount slow[10];
+    uint64_t other = 0;
+    size_t nslow = stats_top_names(STATS_NAMES_DNS_LATENCY, slow, 10, &other);
+    if (nslow > 0) {
+        printf("Top qnames (total wait, responses, mean):\n");
+        for (size_t i = 0; i < nslow; i++) {
+            printf("  %10.3f s  %8llu  %9.3f ms  %s\n", (double)slow[i].total / 1e6,
+                   (unsigned long long)slow[i].count,
+                   (double)slow[i].total / (double)slow[i].count / 1000.0, slow[i].name);
+        }
+    }
+}
+
+static void print_tls_summary(void) {
+    TlsStats sum;
+    uint32_t buffers_peak = 0, buffers_capacity = 0;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned i = 0; i < num_workers; i++) {
+        const analyzer_t *an = workers[i].an;
+        sum.client_hellos += an->tls.client_hellos;
+        sum.server_hellos += an->tls.server_hellos;
+        sum.no_sni += an->tls.no_sni;
+        sum.malformed += an->tls.malformed;
+        sum.not_handshake += an->tls.not_handshake;
+        sum.too_large += an->tls.too_large;
+        sum.gaps += an->tls.gaps;
+        sum.buffers_exhausted += an->tls.buffers_exhausted;
+        sum.segment_only += an->tls.segment_only;
+        buffers_peak += an->tls_buffers.peak;
+        buffers_capacity += an->tls_buffers.capacity;
+    }
+    if (sum.client_hellos == 0 && sum.server_hellos == 0 && sum.malformed == 0) return;
+    printf("\n=== TLS Handshakes ===\n");
+    printf("ClientHello / ServerHello: %llu / %llu (%llu without SNI, %llu from untracked flows)\n",
+           (unsigned long long)sum.client_hellos, (unsigned long long)sum.server_hellos,
+           (unsigned long long)sum.no_sni, (unsigned long long)sum.segment_only);
+    printf("Not parsed:               %llu malformed, %llu mid-stream, %llu over %u bytes, %llu gaps, %llu no buffer\n",
+           (unsigned long long)sum.malformed, (unsigned long long)sum.not_handshake,
+           (unsigned long long)sum.too_large, TLS_HELLO_BUF, (unsigned long long)sum.gaps,
+           (unsigned long long)sum.buffers_exhausted);
+    printf("Split hello buffers peak: %u of %u\n", buffers_peak, buffers_capacity);
+
+    print_top_names(STATS_NAMES_TLS_SNI, "Top server names (SNI):");
+}
+
+static void print_http_summary(void) {
+    static StatsSnapshot snap;
+    stats_take_snapshot(&snap);
+    const uint64_t *status = snap.since_start.http_status;
+    uint64_t responses = 0;
+    for (int c = 0; c < STATS_HTTP_STATUS_MAX; c++) responses += status[c];
+    NameCount probe;
+    uint64_t other = 0;
+    if (responses == 0 && stats_top_names(STATS_NAMES_HTTP_HOST, &probe, 1, &other) == 0) return;
+
+    printf("\n=== HTTP ===\n");
+    printf("Responses:                %llu\n", (unsigned long long)responses);
+    for (int c = 0; c < STATS_HTTP_STATUS_MAX; c++) {
+        if (!status[c]) continue;
+        if (c == 0) printf("  %10llu  (invalid status)\n", (unsigned long long)status[c]);
+        else printf("  %10llu  %d\n", (unsigned long long)status[c], c);
+    }
+    print_top_names(STATS_NAMES_HTTP_HOST, "Top hosts (requests):");
+}
+
+static void print_report(const KernelCounters *kernel, int offline, uint64_t elapsed_ns) {
+    WorkerTotals totals;
+    merge_workers(&totals);
+    print_capture_statistics(&totals, kernel);
+    print_worker_balance(&totals);
+    print_protocol_traffic();
+    print_overload();
+
+    // Workers have stopped: expire what is still tracked (FLOW_END_SHUTDOWN)
+    for (unsigned i = 0; i < num_workers; i++) analyzer_flush(workers[i].an);
+    print_flow_table();
+    print_ip_reassembly();
+    print_tcp_reassembly();
+    print_dns_summary();
+    print_http_summary();
+    print_tls_summary();
+    print_stage_timings(&totals);
+    if (offline) print_throughput(&totals, elapsed_ns);
+}
+
+// ---------------------------
+// Metrics
+// ---------------------------
+// Registered while the workers exist; runs once per METRICS_REFRESH_MS on
+// the metrics thread and reads the workers' counters without locking them
+static void sniffer_collect_metrics(MetricsBuf *mb, void *arg) {
+    (void)arg;
+    static StageTimer queued, analyze;   // Metrics thread only
+    char labels[32];
+    memset(&queued, 0, sizeof(queued));
+    memset(&analyze, 0, sizeof(analyze));
+
+    static const struct { const char *name, *type, *help; } families[] = {
+        { "sniffer_worker_packets_total", "counter", "Packets handed to each worker" },
+        { "sniffer_worker_bytes_total", "counter", "Wire bytes handed to each worker" },
+        { "sniffer_worker_dropped_packets_total", "counter", "Packets dropped because the worker's queue was full" },
+        { "sniffer_worker_truncated_packets_total", "counter", "Packets cut to the ring slot size" },
+        { "sniffer_queue_depth", "gauge", "Packets (AF_PACKET: blocks) waiting in each worker's queue" },
+        { "sniffer_queue_high_water", "gauge", "Deepest each worker's queue has been" },
+        { "sniffer_queue_capacity", "gauge", "Slots (AF_PACKET: blocks) in each worker's queue" },
+    };
+    for (size_t f = 0; f < sizeof(families) / sizeof(families[0]); f++) {
+        metrics_family(mb, families[f].name, families[f].type, families[f].help);
+        for (unsigned i = 0; i < num_workers; i++) {
+            Worker *w = &workers[i];
+            snprintf(labels, sizeof(labels), "worker=\"%u\"", w->id);
+            uint64_t v;
+            switch (f) {
+            case 0: v = (uint64_t)w->packets_received; break;
+            case 1: v = (uint64_t)w->bytes_received; break;
+            case 2: v = (uint64_t)w->dropped_queue_full; break;
+            case 3: v = (uint64_t)w->truncated; break;
+            case 4: v = w->afp ? block_queue_pending(&w->blocks) : pktring_count(&w->ring); break;
+            case 5: v = (uint64_t)w->high_water; break;
+            default: v = w->afp ? w->blocks.capacity : w->ring.capacity; break;
+            }
+            metrics_sample_u64(mb, families[f].name, labels, v);
+        }
+    }
+
+    // Kernel drops: the pcap handle, or every AF_PACKET fanout member
+    int64_t kernel_drops = live_kernel_drops;
+    for (unsigned i = 0; i < num_workers; i++) {
+        if (workers[i].kernel_drops >= 0) kernel_drops = (kernel_drops > 0 ? kernel_drops : 0) + workers[i].kernel_drops;
+    }
+    if (kernel_drops >= 0) {
+        metrics_family(mb, "sniffer_kernel_dropped_packets_total", "counter",
+                       "Packets the kernel dropped for lack of buffer space");
+        metrics_sample_u64(mb, "sniffer_kernel_dropped_packets_total", NULL, (uint64_t)kernel_drops);
+    }
+
+    for (unsigned i = 0; i < num_workers; i++) {
+        stage_merge(&queued, &workers[i].queued);
+        stage_merge(&analyze, &workers[i].analyze);
+    }
+    // Load shedding, live captures only
+    OverloadSummary ov;
+    overload_summary(&ov, platform_wall_us());
+    if (ov.enabled) {
+        metrics_family(mb, "sniffer_overload_mode", "gauge",
+                       "Each worker's overload mode (0 = full parsing, 1 = counters only, 2 = sampled)");
+        for (unsigned i = 0; i < num_workers; i++) {
+            const OverloadState *st = overload_worker(i);
+            if (!st) continue;
+            snprintf(labels, sizeof(labels), "worker=\"%u\"", i);
+            metrics_sample_u64(mb, "sniffer_overload_mode", labels, st->mode);
+        }
+        metrics_family(mb, "sniffer_overload_seconds_total", "counter", "Worker time spent in each overload mode");
+        for (int m = 0; m < OVERLOAD_MODES; m++) {
+            snprintf(labels, sizeof(labels), "mode=\"%s\"", overload_mode_name((overload_mode_t)m));
+            metrics_sample(mb, "sniffer_overload_seconds_total", labels, (double)ov.mode_us[m] / 1e6);
+        }
+        metrics_family(mb, "sniffer_overload_transitions_total", "counter", "Overload mode changes across workers");
+        metrics_sample_u64(mb, "sniffer_overload_transitions_total", NULL, ov.transitions);
+        metrics_family(mb, "sniffer_overload_sampled_out_packets_total", "counter",
+                       "Packets left out by flow sampling (the kept ones count for them)");
+        metrics_sample_u64(mb, "sniffer_overload_sampled_out_packets_total", NULL, ov.skipped);
+        metrics_family(mb, "sniffer_overload_sample_rate", "gauge", "Sampled mode keeps 1 flow in this many");
+        metrics_sample_u64(mb, "sniffer_overload_sample_rate", NULL, ov.sample_rate);
+    }
+
+    metrics_family(mb, "sniffer_stage_latency_seconds", "histogram",
+                   "Time per pipeline stage (read and enqueue per pcap_dispatch call and packet, queue wait and analyze per packet)");
+    metrics_histogram(mb, "sniffer_stage_latency_seconds", "stage=\"read\"", &stage_read.hist, 1e-9);
+    metrics_histogram(mb, "sniffer_stage_latency_seconds", "stage=\"enqueue\"", &stage_enqueue.hist, 1e-9);
+    metrics_histogram(mb, "sniffer_stage_latency_seconds", "stage=\"queue_wait\"", &queued.hist, 1e-9);
+    metrics_histogram(mb, "sniffer_stage_latency_seconds", "stage=\"analyze\"", &analyze.hist, 1e-9);
+}
+
+// Wait for a worker to drain; force-terminate after a bounded wait (live mode)
+static void join_worker(Worker *w, int pending, int drain_fully) {
+    unsigned timeout_ms = 10000 + (pending * 10);  // 10ms per packet + 10s base
+    if (timeout_ms > 300000) timeout_ms = 300000;  // Cap at 5 minutes
+    if (drain_fully) timeout_ms = PLATFORM_WAIT_INFINITE;  // Replay must drain fully
+
+    printf("[Sniffer] Waiting for worker %u (%d pending, timeout: %u ms)...\n",
+           w->id, pending, timeout_ms);
+
+    if (thread_join_timeout(w->thread, timeout_ms) != 0) {
+        fprintf(stderr, "[!] Worker %u did not finish in %u ms\n", w->id, timeout_ms);
+        fprintf(stderr, "[!] Force terminating - may lose data!\n");
+        thread_terminate(w->thread);
+    }
+}
+
+// ---------------------------
+// Capture Filter
+// ---------------------------
+// Compile capture_filter for p (an open handle, or a dead DLT_EN10MB one
+// for AF_PACKET). Prints the expression and libpcap's reason on failure.
+static int compile_capture_filter(pcap_t *p, struct bpf_program *prog) {
+    if (pcap_compile(p, prog, capture_filter, 1, PCAP_NETMASK_UNKNOWN) != 0) {
+        fprintf(stderr, "[!] Invalid capture filter \"%s\": %s\n", capture_filter, pcap_geterr(p));
+        return -1;
+    }
+    printf("[Sniffer] Capture filter: %s (%u BPF instructions)\n", capture_filter, prog->bf_len);
+    return 0;
+}
+
+// Frames received plus sent by the interface so far, to estimate how many
+// the filter rejected. -1 where the counters are not available.
+static int64_t iface_packet_count(const char *device) {
+#ifdef __linux__
+    static const char *names[] = { "rx_packets", "tx_packets" };
+    int64_t total = 0;
+    for (int i = 0; i < 2; i++) {
+        char path[MAX_DEVICE_NAME + 64];
+        snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", device, names[i]);
+        FILE *fp = fopen(path, "r");
+        if (!fp) return -1;
+        unsigned long long v = 0;
+        int n = fscanf(fp, "%llu", &v);
+        fclose(fp);
+        if (n != 1) return -1;
+        total += (int64_t)v;
+    }
+    return total;
+#else
+    (void)device;
+    return -1;
+#endif
+}
+
+// ---------------------------
+// Start Sniffer (AF_PACKET backend)
+// ---------------------------
+static void run_afpacket(const char *device, unsigned nworkers) {
+#ifdef __linux__
+    if (workers_alloc(nworkers) != 0) return;
+
+    // Split the default block budget so total ring memory does not grow with -w
+    unsigned block_count = AFP_DEFAULT_BLOCK_COUNT / nworkers;
+    if (block_count < MIN_WORKER_BLOCKS) block_count = MIN_WORKER_BLOCKS;
+    unsigned fanout_group = nworkers > 1 ? ((unsigned)getpid() & 0xFFFF) : 0;
+    if (nworkers > 1 && fanout_group == 0) fanout_group = 1;
+
+    // The kernel runs the same classic BPF that libpcap compiles for Ethernet
+    struct bpf_program prog;
+    int have_prog = 0;
+    if (capture_filter) {
+        pcap_t *dead = pcap_open_dead(DLT_EN10MB, FILTER_SNAPLEN);
+        if (!dead || compile_capture_filter(dead, &prog) != 0) {
+            if (dead) pcap_close(dead);
+            workers_free();
+            return;
+        }
+        pcap_close(dead);
+        have_prog = 1;
+    }
+
+    int64_t iface_before = iface_packet_count(device);
+    int ok = 1;
+    for (unsigned i = 0; i < nworkers && ok; i++) {
+        Worker *w = &workers[i];
+        w->afp = afp_open(device, AFP_DEFAULT_BLOCK_SIZE, block_count, fanout_group,
+                          have_prog ? &prog : NULL);
+        if (!w->afp || block_queue_init(&w->blocks, afp_block_count(w->afp)) != 0) {
+            if (w->afp) fprintf(stderr, "Failed to allocate block queue\n");
+            afp_close(w->afp);
+            w->afp = NULL;
+            ok = 0;
+        }
+    }
+    if (have_prog) pcap_freecode(&prog);   // The sockets hold their own copies
+    if (ok) {
+        printf("[Sniffer] Listening on %s (AF_PACKET TPACKET_V3, %u worker%s x %u x %u KiB blocks)...\n",
+               device, nworkers, nworkers > 1 ? "s" : "", block_count, AFP_DEFAULT_BLOCK_SIZE / 1024);
+        workers_overload_start();
+        metrics_register(sniffer_collect_metrics, NULL);
+        for (unsigned i = 0; i < nworkers; i++) {
+            Worker *w = &workers[i];
+            if (thread_create(&w->thread, afp_worker_thread, w) != 0) {
+                fprintf(stderr, "Failed to create worker thread %u\n", i);
+                stop_sniffer = 1;
+                break;
+            }
+            w->thread_started = 1;
+            if (thread_create(&w->capture_thread, afp_capture_thread, w) != 0) {
+                fprintf(stderr, "Failed to create capture thread %u\n", i);
+                stop_sniffer = 1;
+                break;
+            }
+            w->capture_started = 1;
+        }
+
+        // Capture threads exit on Ctrl+C or a socket error
+        for (unsigned i = 0; i < nworkers; i++) {
+            if (workers[i].capture_started) {
+                thread_join_timeout(workers[i].capture_thread, PLATFORM_WAIT_INFINITE);
+                thread_close(workers[i].capture_thread);
+            }
+        }
+
+        if (interrupted) printf("\n[Sniffer] Ctrl+C detected. Stopping...\n");
+        printf("[Sniffer] Exiting...\n");
+        for (unsigned i = 0; i < nworkers; i++) {
+            Worker *w = &workers[i];
+            if (!w->thread_started) continue;
+            join_worker(w, (int)block_queue_pending(&w->blocks), 0);
+            thread_close(w->thread);
+        }
+
+        KernelCounters kernel = { 0, 0, -1 };
+        for (unsigned i = 0; i < nworkers; i++) {
+            uint64_t packets = 0, drops = 0;
+            afp_get_stats(workers[i].afp, &packets, &drops, NULL);
+            kernel.accepted += (int64_t)packets;
+            kernel.drops += (int64_t)drops;
+        }
+        int64_t iface_after = iface_packet_count(device);
+        if (iface_before >= 0 && iface_after >= iface_before) kernel.iface_packets = iface_after - iface_before;
+        print_report(&kernel, 0, 0);
+    }
+
+    metrics_unregister(sniffer_collect_metrics, NULL);
+    for (unsigned i = 0; i < nworkers; i++) {
+        if (!workers[i].afp) continue;
+        block_queue_destroy(&workers[i].blocks);
+        afp_close(workers[i].afp);
+    }
+    workers_free();
+#else
+    (void)device;
+    (void)nworkers;
+    fprintf(stderr, "[!] AF_PACKET backend is only available on Linux\n");
+#endif
+}
+
+// ---------------------------
+// Start Sniffer (pcap backend: live or offline)
+// ---------------------------
+static void run_pcap(const char *device, const char *read_file, unsigned snaplen,
+                     unsigned queue_slots, unsigned nworkers) {
+    const int offline = read_file != NULL;
+    pcap_t *adhandle;
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    if (offline) {
+        // pcap_open_offline handles both pcap and pcapng (libpcap >= 1.1 / Npcap)
+        adhandle = pcap_open_offline(read_file, errbuf);
+        if (!adhandle) {
+            fprintf(stderr, "Unable to open capture file %s: %s\n", read_file, errbuf);
+            return;
+        }
+        printf("[Sniffer] Replaying %s at maximum speed...\n", read_file);
+        queue_blocking = 1;
+    } else {
+        adhandle = pcap_open_live(device, (int)snaplen, 1, 1000, errbuf);
+        if (!adhandle) {
+            fprintf(stderr, "Unable to open adapter: %s\n", errbuf);
+            return;
+        }
+        printf("[Sniffer] Listening on %s...\n", device);
+    }
+
+    // Live: the kernel (or the capture driver) drops rejected frames before
+    // they are copied; offline: libpcap skips them while reading
+    if (capture_filter) {
+        struct bpf_program prog;
+        if (compile_capture_filter(adhandle, &prog) != 0) {
+            pcap_close(adhandle);
+            return;
+        }
+        int rc = pcap_setfilter(adhandle, &prog);
+        pcap_freecode(&prog);
+        if (rc != 0) {
+            fprintf(stderr, "[!] Failed to install capture filter: %s\n", pcap_geterr(adhandle));
+            pcap_close(adhandle);
+            return;
+        }
+    }
+    int64_t iface_before = offline ? -1 : iface_packet_count(device);
+
+    // Preallocate one ring per worker and start the workers
+    if (workers_alloc(nworkers) != 0) {
+        pcap_close(adhandle);
         return;
     }
+    unsigned inited = 0;
+    for (; inited < nworkers; inited++) {
+        if (pktring_init(&workers[inited].ring, queue_slots, snaplen) != 0) break;
+    }
+    if (inited < nworkers) {
+        for (unsigned i = 0; i < inited; i++) pktring_destroy(&workers[i].ring);
+        workers_free();
+        pcap_close(adhandle);
+        return;
+    }
+    const PktRing *r0 = &workers[0].ring;
+    printf("[Sniffer] Packet rings: %u worker%s x %u slots x %u bytes (%.1f MiB total)\n",
+           nworkers, nworkers > 1 ? "s" : "", r0->capacity, r0->slot_size,
+           (double)nworkers * r0->capacity * (r0->slot_size + sizeof(PktSlot)) / (1024.0 * 1024.0));
+
+    if (!offline) workers_overload_start();
+    metrics_register(sniffer_collect_metrics, NULL);
+
+    uint64_t start_ns = platform_now_ns();
+    for (unsigned i = 0; i < nworkers; i++) {
+        if (thread_create(&workers[i].thread, worker_thread, &workers[i]) != 0) {
+            fprintf(stderr, "Failed to create worker thread %u\n", i);
+            stop_sniffer = 1;
+            break;
+        }
+        workers[i].thread_started = 1;
+    }
 
     // Capture loop with graceful exit
+    uint64_t next_stats_ns = 0;
     while (!stop_sniffer) {
-        pcap_dispatch(adhandle, 1, packet_handler, NULL);
+        uint64_t t0 = platform_now_ns();
+        if (!offline && t0 >= next_stats_ns) {
+            struct pcap_stat ps;
+            if (pcap_stats(adhandle, &ps) == 0) live_kernel_drops = ps.ps_drop;
+            next_stats_ns = t0 + KERNEL_STATS_INTERVAL_NS;
+        }
+        int64_t handler_before = stage_enqueue.total_ns;
+        int n = pcap_dispatch(adhandle, offline ? OFFLINE_DISPATCH_BATCH : 1, packet_handler, NULL);
+        // Attribute only the time pcap itself spent reading to the read stage
+        stage_record(&stage_read, (int64_t)(platform_now_ns() - t0) - (stage_enqueue.total_ns - handler_before));
+
+        if (offline && n <= 0) {
+            if (n == -1) fprintf(stderr, "[!] Error reading capture file: %s\n", pcap_geterr(adhandle));
+            // End of file: let the workers drain their queues and exit
+            stop_sniffer = 1;
+        }
     }
+    for (unsigned i = 0; i < nworkers; i++) pktring_wake(&workers[i].ring);
 
     // Cleanup
+    if (interrupted) printf("\n[Sniffer] Ctrl+C detected. Stopping...\n");
     printf("[Sniffer] Exiting...\n");
     pcap_breakloop(adhandle);
+
+    // Kernel counters only exist for live captures. On Linux ps_recv counts
+    // frames that passed the filter; other platforms may count before it.
+    KernelCounters kernel = { -1, -1, -1 };
+    struct pcap_stat ps;
+    if (!offline && pcap_stats(adhandle, &ps) == 0) {
+        kernel.accepted = ps.ps_recv;
+        kernel.drops = ps.ps_drop;
+        int64_t iface_after = iface_packet_count(device);
+        if (iface_before >= 0 && iface_after >= iface_before) kernel.iface_packets = iface_after - iface_before;
+    }
     pcap_close(adhandle);
-    
-    // Wait for analysis thread to finish processing remaining packets
-    int queue_size = queue_get_count(&queue);
-    DWORD timeout_ms = 10000 + (queue_size * 10);  // 10ms per packet + 10s base
-    if (timeout_ms > 300000) timeout_ms = 300000;  // Cap at 5 minutes
-    
-    printf("[Sniffer] Waiting for analysis thread (%d packets in queue, timeout: %u ms)...\n", 
-           queue_size, timeout_ms);
-    
-    DWORD wait_result = WaitForSingleObject(hThread, timeout_ms);
-    if (wait_result == WAIT_TIMEOUT) {
-        fprintf(stderr, "[!] Analysis thread did not finish in %u ms\n", timeout_ms);
-        fprintf(stderr, "[!] Force terminating - may lose data!\n");
-        TerminateThread(hThread, 1);
+
+    // Wait for workers to finish processing remaining packets
+    for (unsigned i = 0; i < nworkers; i++) {
+        if (!workers[i].thread_started) continue;
+        join_worker(&workers[i], (int)pktring_count(&workers[i].ring), offline);
+        thread_close(workers[i].thread);
     }
-    
-    // Print capture statistics
-    printf("\n=== Capture Statistics ===\n");
-    printf("Packets received:         %lld\n", packets_received);
-    printf("Packets queued:           %lld\n", 
-           packets_received - packets_dropped_queue_full - packets_dropped_alloc_fail);
-    printf("Dropped (queue full):     %lld\n", packets_dropped_queue_full);
-    printf("Dropped (alloc failed):   %lld\n", packets_dropped_alloc_fail);
-    printf("Queue high water mark:    %lld\n", queue_high_water_mark);
-    if (packets_received > 0) {
-        double drop_rate = (double)(packets_dropped_queue_full + packets_dropped_alloc_fail) / 
-                          packets_received * 100.0;
-        printf("Drop rate:                %.2f%%\n", drop_rate);
+    uint64_t elapsed_ns = platform_now_ns() - start_ns;
+
+    print_report(&kernel, offline, elapsed_ns);
+
+    // Now safe to release the rings (workers are done)
+    metrics_unregister(sniffer_collect_metrics, NULL);
+    for (unsigned i = 0; i < nworkers; i++) pktring_destroy(&workers[i].ring);
+    workers_free();
+}
+
+// ---------------------------
+// Start Sniffer
+// ---------------------------
+void start_sniffer(const SnifferConfig *cfg) {
+    platform_set_interrupt_handler(on_interrupt);
+
+    const char *read_file = cfg ? cfg->read_file : NULL;
+    unsigned snaplen = (cfg && cfg->snaplen) ? cfg->snaplen : DEFAULT_SNAPLEN;
+    unsigned nworkers = (cfg && cfg->workers) ? cfg->workers : 1;
+    if (nworkers > SNIFFER_MAX_WORKERS) nworkers = SNIFFER_MAX_WORKERS;
+
+    // -q is per worker; the default total is split so memory does not grow
+    // with -w. Each share is rounded down to the ring's power of two so the
+    // shares add up to no more than MAX_QUEUE_SIZE (until the floor applies).
+    unsigned queue_slots = (cfg && cfg->queue_slots) ? cfg->queue_slots : MAX_QUEUE_SIZE / nworkers;
+    if (!(cfg && cfg->queue_slots)) {
+        while (queue_slots & (queue_slots - 1)) queue_slots &= queue_slots - 1;
+        if (queue_slots < MIN_WORKER_QUEUE) queue_slots = MIN_WORKER_QUEUE;
     }
-    
-    // Now safe to cleanup queue (analysis thread is done)
-    queue_cleanup(&queue);
-    CloseHandle(hThread);
-    pcap_freealldevs(alldevs);
-}
\ No newline at end of file
+
+    // Flow table limit is a total; each worker only sees its own flows
+    unsigned max_flows = (cfg && cfg->max_flows) ? cfg->max_flows : FLOW_DEFAULT_MAX_FLOWS;
+    analyzer_cfg.flows.max_flows = max_flows / nworkers;
+    if (analyzer_cfg.flows.max_flows < MIN_WORKER_FLOWS) analyzer_cfg.flows.max_flows = MIN_WORKER_FLOWS;
+    analyzer_cfg.flows.idle_timeout_s = (cfg && cfg->flow_idle_timeout) ? cfg->flow_idle_timeout : FLOW_DEFAULT_IDLE_TIMEOUT;
+    analyzer_cfg.flows.active_timeout_s = (cfg && cfg->flow_active_timeout) ? cfg->flow_active_timeout : FLOW_DEFAULT_ACTIVE_TIMEOUT;
+    analyzer_cfg.tcp_sessions = ANALYZER_DEFAULT_TCP_SESSIONS / nworkers;
+    if (analyzer_cfg.tcp_sessions < MIN_WORKER_SESSIONS) analyzer_cfg.tcp_sessions = MIN_WORKER_SESSIONS;
+    analyzer_cfg.reasm_buffers = ANALYZER_DEFAULT_REASM_BUFFERS / nworkers;
+    if (analyzer_cfg.reasm_buffers < MIN_WORKER_REASM_BUFFERS) analyzer_cfg.reasm_buffers = MIN_WORKER_REASM_BUFFERS;
+    analyzer_cfg.tls_buffers = ANALYZER_DEFAULT_TLS_BUFFERS / nworkers;
+    if (analyzer_cfg.tls_buffers < MIN_WORKER_TLS_BUFFERS) analyzer_cfg.tls_buffers = MIN_WORKER_TLS_BUFFERS;
+
+    unsigned frag_kb = (cfg && cfg->frag_memory_kb) ? cfg->frag_memory_kb : IPFRAG_DEFAULT_MEMORY_KB;
+    analyzer_cfg.frags.max_datagrams = IPFRAG_DEFAULT_MAX_DATAGRAMS / nworkers;
+    if (analyzer_cfg.frags.max_datagrams < MIN_WORKER_FRAG_DATAGRAMS) analyzer_cfg.frags.max_datagrams = MIN_WORKER_FRAG_DATAGRAMS;
+    analyzer_cfg.frags.max_buffers = frag_kb / 2 / nworkers;   // 2 KiB buffers
+    if (analyzer_cfg.frags.max_buffers < MIN_WORKER_FRAG_BUFFERS) analyzer_cfg.frags.max_buffers = MIN_WORKER_FRAG_BUFFERS;
+    analyzer_cfg.frags.timeout_s = (cfg && cfg->frag_timeout) ? cfg->frag_timeout : IPFRAG_DEFAULT_TIMEOUT;
+    analyzer_cfg.frags.ipv4_overlap = IPFRAG_OVERLAP_FIRST;
+
+    unsigned dns_queries = (cfg && cfg->dns_max_queries) ? cfg->dns_max_queries : DNSTRACK_DEFAULT_MAX_QUERIES;
+    analyzer_cfg.dns.max_queries = dns_queries / nworkers;
+    if (analyzer_cfg.dns.max_queries < MIN_WORKER_DNS_QUERIES) analyzer_cfg.dns.max_queries = MIN_WORKER_DNS_QUERIES;
+    analyzer_cfg.dns.timeout_s = (cfg && cfg->dns_timeout) ? cfg->dns_timeout : DNSTRACK_DEFAULT_TIMEOUT;
+
+    capture_filter = (cfg && cfg->capture_filter && cfg->capture_filter[0]) ? cfg->capture_filter : NULL;
+
+    OverloadConfig overload = *overload_config();
+    if (cfg) {
+        overload.enabled = !(cfg->overload && strcmp(cfg->overload, "off") == 0);
+        if (cfg->overload_counters_pct) overload.counters_pct = cfg->overload_counters_pct;
+        if (cfg->overload_sample_pct) overload.sample_pct = cfg->overload_sample_pct;
+        if (cfg->overload_recover_pct) overload.recover_pct = cfg->overload_recover_pct;
+        if (cfg->overload_hold_ms) overload.hold_ms = cfg->overload_hold_ms;
+        if (cfg->overload_sample_rate) overload.sample_rate = cfg->overload_sample_rate;
+    }
+    if (overload_configure(&overload) != 0) {
+        return;
+    }
+
+    // Port tables are read-only once the workers start
+    if (dissect_init(cfg ? cfg->dissectors : NULL, cfg ? cfg->dissector_ports : NULL) != 0) {
+        return;
+    }
+
+    if (read_file) {
+        run_pcap(NULL, read_file, snaplen, queue_slots, nworkers);
+        return;
+    }
+
+    char device[MAX_DEVICE_NAME];
+    if (cfg && cfg->device) {
+        snprintf(device, sizeof(device), "%s", cfg->device);
+    } else if (select_device_interactive(device, sizeof(device)) != 0) {
+        return;
+    }
+
+    CaptureBackend backend = cfg ? cfg->backend : CAPTURE_BACKEND_AUTO;
+    if (backend == CAPTURE_BACKEND_AUTO) {
+#ifdef __linux__
+        backend = CAPTURE_BACKEND_AFPACKET;
+#else
+        backend = CAPTURE_BACKEND_PCAP;
+#endif
+    }
+
+    if (backend == CAPTURE_BACKEND_AFPACKET) {
+        run_afpacket(device, nworkers);
+    } else {
+        run_pcap(device, NULL, snaplen, queue_slots, nworkers);
+    }
+}
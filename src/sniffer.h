@@ -2,6 +2,44 @@
 #ifndef SNIFFER_H
 #define SNIFFER_H
 
-void start_sniffer();
+#define SNIFFER_MAX_WORKERS 64   // Upper bound for -w
+
+typedef enum {
+    CAPTURE_BACKEND_AUTO = 0,   // AF_PACKET on Linux, pcap elsewhere
+    CAPTURE_BACKEND_PCAP,       // libpcap / WinPcap / Npcap
+    CAPTURE_BACKEND_AFPACKET    // Linux TPACKET_V3 mmap ring
+} CaptureBackend;
+
+// Runtime configuration (filled from the command line in main.c)
+typedef struct {
+    const char *read_file;   // Offline mode: pcap/pcapng file to replay (NULL = live capture)
+    const char *device;      // Live interface name (NULL = interactive picker)
+    CaptureBackend backend;  // Live capture backend
+    const char *capture_filter;  // BPF expression (tcpdump syntax) installed at open, NULL/"" = everything
+    unsigned snaplen;        // Bytes per packet / ring slot (0 = default)
+    unsigned queue_slots;    // Capture->analysis ring slots per worker, rounded down to a power of two (0 = default)
+    unsigned workers;        // Analysis worker threads, flows steered by symmetric hash (0 = 1)
+    const char *trace_path;  // Per-packet trace sink ("-" = stdout), NULL = tracing off
+    int trace_binary;        // Write raw trace records for tools/tracedump instead of text
+    unsigned metrics_port;   // Prometheus /metrics listener port (0 = off)
+    const char *metrics_addr;      // Address it binds (NULL = 127.0.0.1)
+    unsigned max_flows;            // Flow table capacity across all workers (0 = default)
+    unsigned flow_idle_timeout;    // Seconds without packets before a flow expires (0 = default)
+    unsigned flow_active_timeout;  // Seconds before a long-lived flow is cut (0 = default)
+    unsigned frag_timeout;         // Seconds to wait for the rest of a fragmented datagram (0 = default)
+    unsigned frag_memory_kb;       // Fragment reassembly buffer memory across all workers (0 = default)
+    unsigned dns_timeout;          // Seconds before an outstanding DNS query counts as unanswered (0 = default)
+    unsigned dns_max_queries;      // Outstanding DNS queries tracked across all workers (0 = default)
+    const char *dissectors;        // Dissectors to turn on/off ("-dhcp,+tls-heuristic"), NULL = defaults
+    const char *dissector_ports;   // Extra ports ("http:8080,https:8443"), NULL = none
+    const char *overload;          // "off" turns live load shedding off, NULL = on
+    unsigned overload_counters_pct;  // Queue fill (%) that switches to counters only (0 = default)
+    unsigned overload_sample_pct;    // Queue fill (%) that adds 1-in-N flow sampling (0 = default)
+    unsigned overload_recover_pct;   // Step back a mode at or below this fill... (0 = default)
+    unsigned overload_hold_ms;       // ...once it has lasted this long (0 = default)
+    unsigned overload_sample_rate;   // N (0 = default)
+} SnifferConfig;
+
+void start_sniffer(const SnifferConfig *cfg);
 
 #endif // SNIFFER_H
@@ -0,0 +1,187 @@
+// spool.c - Append-only checksummed record file
+#include "spool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define SPOOL_MAGIC 0x4C505331u      // "1SPL" little-endian
+#define SPOOL_MAX_FILE (1u << 30)    // Offsets stay within a long
+
+typedef struct {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t len;
+    uint32_t crc;                    // CRC-32 of the payload
+} SpoolHeader;
+
+struct Spool {
+    FILE *fp;
+    uint64_t size;                   // Bytes of whole records
+    uint64_t read_off;               // Next record for spool_next
+    uint64_t commit_off;             // Records before this were delivered
+    uint64_t read_records;           // Read since the last commit
+    SpoolStats stats;
+};
+
+// ---------------------------
+// CRC-32 (IEEE, reflected)
+// ---------------------------
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+    if (crc_table[1]) return;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_of(const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t c = 0xFFFFFFFFu;
+    for (uint32_t i = 0; i < len; i++) c = crc_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// ---------------------------
+// File access
+// ---------------------------
+static int file_truncate(FILE *fp, uint64_t size) {
+    fflush(fp);
+#ifdef _WIN32
+    return _chsize_s(_fileno(fp), (__int64)size) == 0 ? 0 : -1;
+#else
+    return ftruncate(fileno(fp), (off_t)size);
+#endif
+}
+
+// Record at off: 1 and its payload, 0 at a clean end, -1 if damaged
+static int read_record(Spool *s, uint64_t off, uint16_t *type, void *data, uint32_t *len) {
+    SpoolHeader h;
+    if (fseek(s->fp, (long)off, SEEK_SET) != 0) return -1;
+    size_t got = fread(&h, 1, sizeof(h), s->fp);
+    if (got == 0) return 0;
+    if (got != sizeof(h) || h.magic != SPOOL_MAGIC || h.len > SPOOL_MAX_RECORD) return -1;
+    if (fread(data, 1, h.len, s->fp) != h.len || crc32_of(data, h.len) != h.crc) return -1;
+    *type = h.type;
+    *len = h.len;
+    return 1;
+}
+
+// Cut the file at off (a damaged record and whatever follows it)
+static void cut_tail(Spool *s, uint64_t off) {
+    s->stats.corrupt++;
+    fprintf(stderr, "[!] Spool: damaged record at offset %llu; discarding %llu trailing bytes\n",
+            (unsigned long long)off, (unsigned long long)(s->size > off ? s->size - off : 0));
+    file_truncate(s->fp, off);
+    s->size = off;
+}
+
+Spool *spool_open(const char *path, uint64_t max_bytes) {
+    crc_init();
+    Spool *s = (Spool *)calloc(1, sizeof(Spool));
+    if (!s) return NULL;
+    s->fp = fopen(path, "r+b");
+    if (!s->fp) s->fp = fopen(path, "w+b");
+    if (!s->fp) {
+        fprintf(stderr, "[!] Spool: cannot open %s\n", path);
+        free(s);
+        return NULL;
+    }
+    s->stats.max_bytes = max_bytes < SPOOL_MAX_FILE ? max_bytes : SPOOL_MAX_FILE;
+
+    // Count the whole records left by a previous run
+    fseek(s->fp, 0, SEEK_END);
+    s->size = (uint64_t)ftell(s->fp);
+    uint64_t off = 0;
+    uint16_t type;
+    uint32_t len;
+    unsigned char buf[SPOOL_MAX_RECORD];
+    int rc;
+    while ((rc = read_record(s, off, &type, buf, &len)) == 1) {
+        off += sizeof(SpoolHeader) + len;
+        s->stats.records++;
+    }
+    if (rc < 0 || off != s->size) cut_tail(s, off);
+    return s;
+}
+
+void spool_close(Spool *s) {
+    if (!s) return;
+    fclose(s->fp);
+    free(s);
+}
+
+int spool_append(Spool *s, uint16_t type, const void *data, uint32_t len) {
+    if (len > SPOOL_MAX_RECORD || s->size + sizeof(SpoolHeader) + len > s->stats.max_bytes) {
+        s->stats.dropped++;
+        return -1;
+    }
+    SpoolHeader h = { SPOOL_MAGIC, type, 0, len, crc32_of(data, len) };
+    if (fseek(s->fp, (long)s->size, SEEK_SET) != 0 ||
+        fwrite(&h, 1, sizeof(h), s->fp) != sizeof(h) ||
+        fwrite(data, 1, len, s->fp) != len) {
+        // Leave the file ending at the last whole record
+        file_truncate(s->fp, s->size);
+        s->stats.dropped++;
+        return -1;
+    }
+    s->size += sizeof(h) + len;
+    s->stats.records++;
+    s->stats.appended++;
+    return 0;
+}
+
+void spool_sync(Spool *s) {
+    fflush(s->fp);
+#ifdef _WIN32
+    _commit(_fileno(s->fp));
+#else
+    fsync(fileno(s->fp));
+#endif
+}
+
+// ---------------------------
+// Replay
+// ---------------------------
+int spool_next(Spool *s, uint16_t *type, void *data, uint32_t *len) {
+    if (s->read_off >= s->size) return 0;
+    int rc = read_record(s, s->read_off, type, data, len);
+    if (rc <= 0) {
+        cut_tail(s, s->read_off);
+        return 0;
+    }
+    s->read_off += sizeof(SpoolHeader) + *len;
+    s->read_records++;
+    return 1;
+}
+
+void spool_commit(Spool *s) {
+    s->stats.records -= s->read_records;
+    s->read_records = 0;
+    if (s->read_off >= s->size) {
+        // All delivered: start over with an empty file
+        file_truncate(s->fp, 0);
+        s->size = s->read_off = s->commit_off = 0;
+        s->stats.records = 0;
+    } else {
+        s->commit_off = s->read_off;
+    }
+}
+
+void spool_rewind(Spool *s) {
+    s->read_off = s->commit_off;
+    s->read_records = 0;
+}
+
+void spool_get_stats(const Spool *s, SpoolStats *out) {
+    *out = s->stats;
+    out->bytes = s->size - s->commit_off;
+}
@@ -0,0 +1,48 @@
+// spool.h - Append-only checksummed record file
+//
+// Rows that could not be written to Postgres are appended here and read
+// back once the database returns. Each record carries a length and a
+// CRC-32 of its payload, so a write torn by a crash is detected on open
+// (the tail is cut at the last whole record) and on read. The file never
+// grows past max_bytes: records that do not fit are refused and counted.
+// Records are in host byte order; the file is meant for the same machine.
+// Not thread safe: one thread appends and replays.
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdint.h>
+
+#define SPOOL_MAX_RECORD 512         // Payload bytes
+
+typedef struct {
+    uint64_t bytes;                  // File size (spool depth)
+    uint64_t records;                // Records in the file
+    uint64_t max_bytes;
+    uint64_t appended;               // Records written since open
+    uint64_t dropped;                // Refused: file at max_bytes or write error
+    uint64_t corrupt;                // Bad records cut from the file
+} SpoolStats;
+
+typedef struct Spool Spool;
+
+// Open (creating if needed) and validate path. NULL on error (printed).
+Spool *spool_open(const char *path, uint64_t max_bytes);
+void spool_close(Spool *s);
+
+// Append one record. 0, or -1 when it was dropped.
+int spool_append(Spool *s, uint16_t type, const void *data, uint32_t len);
+
+// Flush appended records to disk (called once per batch)
+void spool_sync(Spool *s);
+
+// Replay: spool_next returns the record after the read cursor (1), or 0 at
+// the end. spool_commit marks everything read so far as delivered (the file
+// is emptied once all of it is); spool_rewind goes back to the last commit
+// after a failed delivery, so records are delivered at least once.
+int spool_next(Spool *s, uint16_t *type, void *data, uint32_t *len);
+void spool_commit(Spool *s);
+void spool_rewind(Spool *s);
+
+void spool_get_stats(const Spool *s, SpoolStats *out);
+
+#endif // SPOOL_H
@@ -1,28 +1,242 @@
 // stats.c - Performance-optimized version
 #include "stats.h"
+#include "platform.h"
+#include "spool.h"
+#include "overload.h"
 #include <stdio.h>
-#include <windows.h>
 #include <libpq-fe.h>
+#include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
 
 #define BATCH_INTERVAL_MS 15000  // Flush every 15 seconds
+#define DELTA_INTERVAL_MS 1000   // Width of a per-protocol delta bucket (aligned to the wall clock)
+#define DELTA_MAX_BUCKETS 3600   // Unflushed buckets kept in memory (1 hour) when they cannot be spooled
+#define RECONNECT_MIN_DELAY_MS 1000     // Background reconnect backoff, doubled per failure
+#define RECONNECT_MAX_DELAY_MS 60000
+#define RECONNECT_TIMEOUT_MS 10000      // Give up on a connection attempt after this long
+#define RECONNECT_POLL_MS 100           // Longest the batch thread waits on a connecting socket per tick
+#define SPOOL_REPLAY_BATCH 1024         // Spooled records per replay statement
 #define MAX_RETRY_ATTEMPTS 3
 #define INITIAL_RETRY_DELAY_MS 1000
 #define JSON_FILE "stats.json"
+#define STATS_MAX_SHARDS 128     // Counting threads (workers + anything else that parses)
+#define STATS_NAME_SLOTS 1024    // Distinct names per set per counting thread (power of two)
+#define STATS_NAME_FILL (STATS_NAME_SLOTS * 3 / 4)   // Names kept before new ones go to "other"
+#define STATS_TOP_NAMES 20       // Names written to stats.json and Postgres per flush
+#define STATS_TOP_HEAVY 20       // Heavy hitters written per dimension per flush
+#define HEAVY_ROTATE_WAIT_MS 500 // Longest a flush waits for busy or idle owners to switch sketches
 
-ProtocolStats stats;
-static HANDLE batch_thread_handle = NULL;
-static HANDLE shutdown_event = NULL;  // Event for graceful thread termination
+// Name counters of one set in one shard. Only the owning thread inserts
+// and increments; a slot's name is written before `ready` is published,
+// and slots are never reused, so readers can walk the table without a lock.
+typedef struct {
+    volatile uint64_t count;
+    volatile uint64_t total;
+    volatile uint32_t ready;
+    uint32_t hash;
+    char name[STATS_NAME_LEN];
+} NameSlot;
+
+struct NameTable {
+    NameSlot slots[STATS_NAME_SLOTS];
+    uint32_t used;               // Owner only
+    volatile uint64_t overflow;  // Counts for names that did not fit
+};
+
+// How each named set is persisted
+typedef struct {
+    const char *json_key;        // Array in stats.json ("<key>_other" holds the rest)
+    const char *count_key;       // Per-entry count field in stats.json
+    const char *total_key;       // Per-entry total field, NULL when the set has no totals
+    const char *table;
+    const char *insert;          // $1 text[] of names, $2 bigint[] of counts (, $3 bigint[] of totals)
+    const char *migration;
+    int db_enabled;              // Cleared when the table does not exist (migration not applied)
+} NameSink;
+
+static NameSink name_sinks[STATS_NAMES_COUNT] = {
+    { "tls_sni", "connections", NULL, "tls_sni_stats",
+      "INSERT INTO tls_sni_stats(sni, connections) SELECT * FROM unnest($1::text[], $2::bigint[]);",
+      "db_migration_add_tls_sni.sql", 1 },
+    { "http_hosts", "requests", NULL, "http_host_stats",
+      "INSERT INTO http_host_stats(host, requests) SELECT * FROM unnest($1::text[], $2::bigint[]);",
+      "db_migration_add_http_metrics.sql", 1 },
+    { "dns_qnames", "queries", NULL, "dns_qname_stats",
+      "INSERT INTO dns_qname_stats(qname, queries) SELECT * FROM unnest($1::text[], $2::bigint[]);",
+      "db_migration_add_dns_metrics.sql", 1 },
+    { "dns_slow_qnames", "responses", "latency_us", "dns_qname_latency_stats",
+      "INSERT INTO dns_qname_latency_stats(qname, responses, latency_us) "
+      "SELECT * FROM unnest($1::text[], $2::bigint[], $3::bigint[]);",
+      "db_migration_add_dns_metrics.sql", 1 }
+};
+static int http_status_db_enabled = 1;
+static int latency_db_enabled = 1;
+static int heavy_db_enabled = 1;
+
+#define HEAVY_BATCH 64           // Packets buffered before the sketches are updated
+
+// One packet's keys, waiting for the next batch update
+typedef struct {
+    uint8_t family;
+    uint8_t proto;               // 0 until the transport layer adds the ports
+    uint16_t port;               // Destination
+    uint16_t src_port;
+    uint16_t weight;             // stats_packet_begin's (at most OVERLOAD_MAX_SAMPLE_RATE)
+    unsigned char src[16];
+    unsigned char dst[16];
+} HeavyPending;
+
+// Two sketch sets per counting thread (heavy hitters and distinct
+// counts): the owner adds to set [active] while the batch thread merges
+// and clears the other one. The owner flips
+// active only when asked (heavy_req), between packets, so neither side
+// ever waits on the other inside a packet. Packets are applied in batches,
+// one dimension at a time, so a single sketch is cache-hot while it is
+// updated instead of all four competing with the parsers for every packet.
+struct HeavyShard {
+    HeavySketch sketch[2][STATS_HEAVY_COUNT];
+    HllSketch distinct[2][STATS_DISTINCT_COUNT];
+    volatile uint32_t active;    // Owner only
+    uint32_t npending;
+    HeavyPending pending[HEAVY_BATCH];
+};
+
+static const char *const heavy_names[STATS_HEAVY_COUNT] = {
+    "src_ip", "dst_ip", "dst_port", "ip_pair"
+};
+
+// The last complete interval, merged across shards (batch thread, and
+// stats_cleanup once it has stopped)
+static HeavySketch heavy_interval[STATS_HEAVY_COUNT];
+static uint64_t heavy_interval_start_us = 0;
+static uint64_t heavy_interval_end_us = 0;
+static uint64_t heavy_collected[STATS_MAX_SHARDS];   // Last heavy_req merged, per shard
+
+static const char *const distinct_names[STATS_DISTINCT_COUNT] = {
+    "src_ips", "dst_ips", "dst_ports", "flows"
+};
+
+// Same interval as heavy_interval. The estimates are also read by the
+// metrics thread, one word each.
+static HllSketch distinct_interval[STATS_DISTINCT_COUNT];
+static volatile uint64_t distinct_estimate[STATS_DISTINCT_COUNT];
+static int distinct_db_enabled = 1;
+
+// Overload transitions up to here are in Postgres (batch thread only)
+static uint64_t overload_flushed = 0;
+static int overload_db_enabled = 1;
+
+static const char *const latency_names[STATS_LATENCY_COUNT] = {
+    "capture_to_dequeue", "capture_to_analyzed"
+};
+
+// Latency histograms as of the last flush that reached latency_stats
+// (batch thread); each flush writes the percentiles of what came since
+static LatencyHist latency_flushed[STATS_LATENCY_COUNT];
+
+// Packets counted per protocol during one DELTA_INTERVAL_MS bucket
+typedef struct {
+    uint64_t start_us;           // Wall clock at the start of the bucket
+    uint32_t interval_ms;        // Actual width (the first and last buckets are partial)
+    uint64_t packets[PROTO_COUNT];
+} DeltaBucket;
+
+static const char *const proto_names[PROTO_COUNT] = {
+    "ethernet", "ipv4", "ipv6", "tcp", "udp", "icmp", "arp", "dns", "http", "https", "dhcp"
+};
+
+// Owned by the batch thread (and stats_cleanup once it has exited)
+static DeltaBucket delta_ring[DELTA_MAX_BUCKETS];
+static uint32_t delta_head = 0;             // Oldest unflushed bucket
+static uint32_t delta_len = 0;
+static uint64_t delta_dropped = 0;          // Buckets lost to a full ring
+static uint64_t delta_last[PROTO_COUNT];    // Shard sums at the end of the previous bucket
+static uint64_t delta_last_us = 0;
+static int delta_db_enabled = 1;            // Cleared when protocol_stats_delta does not exist
+static int delta_copy_enabled = 1;          // Cleared when COPY is refused; prepared inserts instead
+static int delta_prepared = 0;              // Fallback statement prepared on the current connection
+
+// Buckets to write: n of them from base[head] on, wrapping at cap (the
+// in-memory ring, or a batch read back from the spool)
+typedef struct {
+    const DeltaBucket *base;
+    uint32_t cap;
+    uint32_t head;
+    uint32_t n;
+} DeltaSpan;
+
+#define DELTA_AT(span, i) (&(span)->base[((span)->head + (i)) % (span)->cap])
+
+#define RATE_MIN_BUCKET_MS 500   // Shorter buckets (the first after startup) never set a peak
+
+// Packets and bytes per protocol during one second, kept for the rate
+// window whether or not Postgres is configured
+typedef struct {
+    uint64_t start_us;
+    uint32_t interval_ms;
+    uint64_t packets[PROTO_COUNT];
+    uint64_t wire_bytes[PROTO_COUNT];
+    uint64_t cap_bytes[PROTO_COUNT];
+} RateBucket;
+
+// Owned by the batch thread; readers get rates_current under rate_lock
+static RateBucket rate_ring[STATS_RATE_WINDOW_S];
+static uint32_t rate_next = 0;              // Slot the next bucket goes to
+static uint32_t rate_len = 0;
+static uint64_t rate_last[3][PROTO_COUNT];  // Packets, wire and captured bytes at the end of the previous bucket
+static uint64_t rate_last_us = 0;
+static mutex_t rate_lock;
+static StatsRates rates_current;
+
+// Spool record types
+#define SPOOL_PROTOCOL_ROW 1     // SpoolProtocolRow: a protocol_stats row
+#define SPOOL_DELTA_BUCKET 2     // DeltaBucket: one second of protocol_stats_delta
+
+typedef struct {
+    uint64_t ts_us;              // When the row was taken (becomes its timestamp)
+    ProtocolStats stats;
+} SpoolProtocolRow;
+
+// Rows that Postgres could not take wait in the spool until a background
+// reconnect succeeds. All owned by the batch thread (and stats_cleanup).
+static char spool_path[512] = STATS_SPOOL_DEFAULT_FILE;
+static uint64_t spool_max_bytes = (uint64_t)STATS_SPOOL_DEFAULT_MB << 20;
+static Spool *spool = NULL;
+static PGconn *pg_pending = NULL;           // Connection being established (non-blocking)
+static uint64_t pg_pending_since_us = 0;
+static uint64_t reconnect_at_us = 0;
+static uint32_t reconnect_delay_ms = RECONNECT_MIN_DELAY_MS;
+static int reconnect_failing = 0;           // Failure already reported for this outage
+static StatsDbStatus db_status;
+
+static ProtocolStats stats_base;        // Loaded from stats.json at startup; read-only afterwards
+static StatsShard shards[STATS_MAX_SHARDS];
+static mutex_t snapshot_lock;           // One snapshot reader at a time (batch thread, exit report)
+static volatile int64_t shard_count = 0;
+THREAD_LOCAL StatsShard *stats_tls_shard = NULL;
+static thread_t batch_thread_handle;
+static int batch_thread_running = 0;
+static event_t shutdown_event;        // Event for graceful thread termination
+static int shutdown_event_ready = 0;
 static char postgres_conninfo[512] = {0};
-static PGconn *pg_conn = NULL;  // Persistent DB connection
-static int db_enabled = 1;  // Track if database is available
+static PGconn *pg_conn = NULL;  // Persistent DB connection (NULL while down)
+static int db_enabled = 1;  // Postgres configured; rows go to the spool while it is down
 // Return codes for stats_save_postgres
 #define STATS_DB_OK 0
 #define STATS_DB_CONN_FAIL -2
 #define STATS_DB_QUERY_FAIL -3
 
-// Forward declaration
-static DWORD WINAPI stats_batch_thread(LPVOID lpParam);
+// Forward declarations
+static thread_ret_t THREAD_CALL stats_batch_thread(void *param);
+static void stats_sample_deltas(const StatsSnapshot *snap);
+static void stats_sample_rates(const StatsSnapshot *snap);
+static void spool_report(void);
+static void heavy_rotate(int owners_stopped);
+static void heavy_drain(struct HeavyShard *hs);
+static void heavy_wait(int64_t used);
 
 // Try to (re)establish a Postgres connection with simple retries
 static PGconn* connect_with_retry(const char *conninfo) {
@@ -54,7 +268,7 @@ static PGconn* connect_with_retry(const char *conninfo) {
         if (retry_count < MAX_RETRY_ATTEMPTS) {
             printf("[!] Postgres connection attempt %d failed, retrying in %d ms\n",
                    retry_count, delay_ms);
-            Sleep(delay_ms);
+            platform_sleep_ms(delay_ms);
             delay_ms *= 2;  // exponential backoff
         }
     }
@@ -63,35 +277,97 @@ static PGconn* connect_with_retry(const char *conninfo) {
     return NULL;
 }
 
-// Ensure we have a healthy connection before issuing commands
-static int ensure_pg_connection(void) {
-    if (postgres_conninfo[0] == '\0') {
-        printf("[!] Postgres connection string is empty; skipping DB writes\n");
-        return -1;  // connection disabled
+// A usable connection; a broken one is closed so the reconnect starts
+static int pg_connected(void) {
+    if (pg_conn && PQstatus(pg_conn) == CONNECTION_OK) return 1;
+    if (pg_conn) {
+        PQfinish(pg_conn);
+        pg_conn = NULL;
     }
+    return 0;
+}
+
+static void on_connected(PGconn *conn) {
+    pg_conn = conn;
+    delta_prepared = 0;   // Prepared statements belong to the old session
+    reconnect_delay_ms = RECONNECT_MIN_DELAY_MS;
+    reconnect_failing = 0;
+}
 
-    if (pg_conn && PQstatus(pg_conn) == CONNECTION_OK) {
-        return 0;
+static void reconnect_failed(const char *why, uint64_t now_us) {
+    if (!reconnect_failing) {
+        printf("[!] Postgres reconnect failed: %s; retrying in the background (backoff up to %d s)\n",
+               why, RECONNECT_MAX_DELAY_MS / 1000);
+        reconnect_failing = 1;
     }
+    if (pg_pending) {
+        PQfinish(pg_pending);
+        pg_pending = NULL;
+    }
+    reconnect_at_us = now_us + (uint64_t)reconnect_delay_ms * 1000;
+    reconnect_delay_ms = reconnect_delay_ms * 2 < RECONNECT_MAX_DELAY_MS ? reconnect_delay_ms * 2 : RECONNECT_MAX_DELAY_MS;
+}
 
-    if (pg_conn) {
-        PQfinish(pg_conn);
-        pg_conn = NULL;
+// Advance a non-blocking connection attempt, waiting at most
+// RECONNECT_POLL_MS on its socket. Called by the batch thread every tick
+// while Postgres is down; returns 1 when the connection is back.
+static int poll_reconnect(uint64_t now_us) {
+    if (pg_conn) return 0;
+    if (!pg_pending) {
+        if (now_us < reconnect_at_us) return 0;
+        db_status.reconnect_attempts++;
+        pg_pending = PQconnectStart(postgres_conninfo);   // Host name lookup may still block
+        pg_pending_since_us = now_us;
+        if (!pg_pending || PQstatus(pg_pending) == CONNECTION_BAD) {
+            reconnect_failed(pg_pending ? PQerrorMessage(pg_pending) : "out of memory", now_us);
+            return 0;
+        }
     }
 
-    pg_conn = connect_with_retry(postgres_conninfo);
-    if (!pg_conn) {
-        printf("[!] Failed to establish Postgres connection\n");
-        return -1;
+    uint64_t budget_us = (uint64_t)RECONNECT_POLL_MS * 1000;
+    uint64_t start_us = platform_wall_us();
+    PostgresPollingStatusType st = PQconnectPoll(pg_pending);
+    while (st == PGRES_POLLING_READING || st == PGRES_POLLING_WRITING) {
+        uint64_t spent_us = platform_wall_us() - start_us;
+        if (spent_us >= budget_us) break;
+        int fd = PQsocket(pg_pending);
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        struct timeval tv = { 0, (long)(budget_us - spent_us) };
+        int ready = select(fd + 1, st == PGRES_POLLING_READING ? &fds : NULL,
+                           st == PGRES_POLLING_WRITING ? &fds : NULL, NULL, &tv);
+        if (ready <= 0) break;
+        st = PQconnectPoll(pg_pending);
     }
 
-    printf("[+] Postgres connection established\n");
+    if (st == PGRES_POLLING_OK) {
+        on_connected(pg_pending);
+        pg_pending = NULL;
+        printf("[+] Postgres connection re-established\n");
+        return 1;
+    }
+    if (st == PGRES_POLLING_FAILED) {
+        reconnect_failed(PQerrorMessage(pg_pending), now_us);
+    } else if (now_us - pg_pending_since_us >= (uint64_t)RECONNECT_TIMEOUT_MS * 1000) {
+        reconnect_failed("timed out", now_us);
+    }
     return 0;
 }
 
+void stats_configure_spool(const char *path, unsigned max_mb) {
+    if (path) {
+        strncpy(spool_path, path, sizeof(spool_path) - 1);
+        spool_path[sizeof(spool_path) - 1] = '\0';
+    }
+    if (max_mb) spool_max_bytes = (uint64_t)max_mb << 20;
+}
+
 // Initialize stats and start batch thread
 void stats_init(const char *conninfo) {
-    memset(&stats, 0, sizeof(stats));
+    memset(&stats_base, 0, sizeof(stats_base));
+    mutex_init(&snapshot_lock);
+    mutex_init(&rate_lock);
     if (conninfo) {
         strncpy(postgres_conninfo, conninfo, sizeof(postgres_conninfo) - 1);
         postgres_conninfo[sizeof(postgres_conninfo) - 1] = '\0';  // Ensure null termination
@@ -99,61 +375,83 @@ void stats_init(const char *conninfo) {
 
     // Load previous stats from JSON if exists
     stats_load_json(JSON_FILE);
+    delta_last_us = platform_wall_us();
+    rate_last_us = delta_last_us;
+    heavy_interval_start_us = heavy_interval_end_us = delta_last_us;
 
-    // Connect to Postgres once
+    // Connect to Postgres once; after that the batch thread reconnects in the background
     if (postgres_conninfo[0] != '\0') {
-        if (ensure_pg_connection() != 0) {
-            printf("[!] Postgres connection failed during init - using file-only mode\n");
-            db_enabled = 0;
+        db_enabled = 1;
+        if (strcmp(spool_path, "none") != 0) spool = spool_open(spool_path, spool_max_bytes);
+        PGconn *conn = connect_with_retry(postgres_conninfo);
+        if (conn) {
+            on_connected(conn);
+            printf("[+] Postgres connection established\n");
         } else {
-            db_enabled = 1;
+            printf("[!] Postgres connection failed during init - %s%s, reconnecting in the background\n",
+                   spool ? "spooling rows to " : "rows are not kept (no spool)", spool ? spool_path : "");
+            reconnect_failing = 1;
+            reconnect_at_us = platform_wall_us() + (uint64_t)reconnect_delay_ms * 1000;
+        }
+        if (spool) {
+            SpoolStats ss;
+            spool_get_stats(spool, &ss);
+            if (ss.records) {
+                printf("[+] Spool %s holds %llu records from an earlier run; replaying once connected\n",
+                       spool_path, (unsigned long long)ss.records);
+            }
         }
     } else {
+        printf("[!] Postgres connection string is empty; skipping DB writes\n");
         db_enabled = 0;
     }
 
     // Create shutdown event for graceful thread termination
-    shutdown_event = CreateEvent(NULL, TRUE, FALSE, NULL);  // Manual-reset event
-    if (!shutdown_event) {
+    if (event_init(&shutdown_event) != 0) {  // Manual-reset event
         fprintf(stderr, "[!] Failed to create shutdown event\n");
         return;
     }
+    shutdown_event_ready = 1;
 
     // Start batch thread
-    batch_thread_handle = CreateThread(NULL, 0, stats_batch_thread, NULL, 0, NULL);
-    if (!batch_thread_handle) {
+    if (thread_create(&batch_thread_handle, stats_batch_thread, NULL) != 0) {
         fprintf(stderr, "[!] Failed to create stats batch thread\n");
-        CloseHandle(shutdown_event);
-        shutdown_event = NULL;
+        event_destroy(&shutdown_event);
+        shutdown_event_ready = 0;
+    } else {
+        batch_thread_running = 1;
     }
 }
 
 // Cleanup
 void stats_cleanup(void) {
     // Signal batch thread to stop
-    if (shutdown_event) {
-        SetEvent(shutdown_event);  // Signal shutdown
+    if (shutdown_event_ready) {
+        event_set(&shutdown_event);  // Signal shutdown
         
         // Wait for thread to finish (with timeout)
-        if (batch_thread_handle) {
-            DWORD wait_result = WaitForSingleObject(batch_thread_handle, 10000);  // 10 second timeout
-            if (wait_result == WAIT_TIMEOUT) {
+        if (batch_thread_running) {
+            if (thread_join_timeout(batch_thread_handle, 10000) != 0) {  // 10 second timeout
                 fprintf(stderr, "[!] Stats batch thread did not terminate in time\n");
                 fprintf(stderr, "[!] Skipping final database save to avoid corruption\n");
                 // Don't call TerminateThread - too dangerous with locks
             } else {
                 // Thread exited cleanly - safe to do final save
+                StatsSnapshot snap;
+                stats_take_snapshot(&snap);
+                heavy_rotate(1);
                 if (db_enabled) {
-                    stats_save_postgres(postgres_conninfo);
+                    stats_sample_deltas(&snap);   // Partial last bucket
+                    stats_save_postgres(postgres_conninfo, &snap);
                 }
-                stats_save_json(JSON_FILE);
+                stats_save_json(JSON_FILE, &snap);
             }
-            CloseHandle(batch_thread_handle);
-            batch_thread_handle = NULL;
+            thread_close(batch_thread_handle);
+            batch_thread_running = 0;
         }
         
-        CloseHandle(shutdown_event);
-        shutdown_event = NULL;
+        event_destroy(&shutdown_event);
+        shutdown_event_ready = 0;
     }
     
     // Close PostgreSQL connection
@@ -161,32 +459,454 @@ void stats_cleanup(void) {
         PQfinish(pg_conn);
         pg_conn = NULL;
     }
+    if (pg_pending) {
+        PQfinish(pg_pending);
+        pg_pending = NULL;
+    }
+    if (spool) {
+        spool_report();
+        spool_close(spool);
+        spool = NULL;
+    }
+}
+
+// ---------------------------
+// Per-Thread Shards
+// ---------------------------
+StatsShard *stats_register_thread(void) {
+    int64_t idx = atomic_inc64(&shard_count) - 1;
+    if (idx >= STATS_MAX_SHARDS) {
+        // Out of shards: share the last one (increments may then race)
+        if (idx == STATS_MAX_SHARDS) {
+            fprintf(stderr, "[!] More than %d counting threads; sharing a stats shard\n",
+                    STATS_MAX_SHARDS);
+        }
+        idx = STATS_MAX_SHARDS - 1;
+    }
+    shards[idx].pkt_weight = 1;      // Counting outside stats_packet_begin counts once
+    stats_tls_shard = &shards[idx];
+    return stats_tls_shard;
+}
+
+#define SNAPSHOT_SPINS 64         // Seqlock attempts on a shard before asking its owner for a copy
+
+// Owner side of a reader's request, between two packets: copy the
+// counters for a snapshot, or switch to the other heavy-hitter sketches
+void stats_shard_publish(StatsShard *shard) {
+    uint64_t req = shard->snap_req;
+    if (req != shard->snap_ack) {
+        for (int p = 0; p < PROTO_COUNT; p++) {
+            shard->snap.counters[p] = shard->counters[p];
+            shard->snap.wire_bytes[p] = shard->wire_bytes[p];
+            shard->snap.cap_bytes[p] = shard->cap_bytes[p];
+            shard->snap.truncated[p] = shard->truncated[p];
+            shard->snap.malformed[p] = shard->malformed[p];
+        }
+        for (int c = 0; c < STATS_HTTP_STATUS_MAX; c++) shard->snap.http_status[c] = shard->http_status[c];
+        atomic_store_release_u64(&shard->snap_ack, req);
+    }
+    req = shard->heavy_req;
+    if (req != shard->heavy_ack) {
+        if (shard->heavy) {
+            heavy_drain(shard->heavy);
+            shard->heavy->active ^= 1;
+        }
+        atomic_store_release_u64(&shard->heavy_ack, req);
+    }
+}
+
+void stats_thread_idle(void) {
+    StatsShard *shard = stats_tls_shard;
+    if (shard && (shard->snap_req != shard->snap_ack || shard->heavy_req != shard->heavy_ack)) {
+        stats_shard_publish(shard);
+    }
+}
+
+// Copy one shard as of a packet boundary. The seqlock read succeeds at
+// once on a quiet shard; on a busy one the owner answers the request at
+// the end of its current packet. Callers hold snapshot_lock.
+static void read_shard(StatsShard *shard, StatsCounters *out) {
+    uint64_t req = 0;
+    for (unsigned spins = 0;; spins++) {
+        uint64_t seq = atomic_load_acquire_u64(&shard->seq);
+        if (!(seq & 1)) {
+            for (int p = 0; p < PROTO_COUNT; p++) {
+                out->counters[p] = shard->counters[p];
+                out->wire_bytes[p] = shard->wire_bytes[p];
+                out->cap_bytes[p] = shard->cap_bytes[p];
+                out->truncated[p] = shard->truncated[p];
+                out->malformed[p] = shard->malformed[p];
+            }
+            for (int c = 0; c < STATS_HTTP_STATUS_MAX; c++) out->http_status[c] = shard->http_status[c];
+            fence_acquire();
+            if (shard->seq == seq) return;
+        }
+        if (req == 0 && spins >= SNAPSHOT_SPINS) {
+            req = shard->snap_ack + 1;
+            atomic_store_release_u64(&shard->snap_req, req);
+        }
+        if (req && atomic_load_acquire_u64(&shard->snap_ack) == req) {
+            *out = shard->snap;
+            return;
+        }
+        if (spins >= 2 * SNAPSHOT_SPINS) thread_yield();
+        else cpu_relax();
+    }
+}
+
+void stats_take_snapshot(StatsSnapshot *out) {
+    static StatsCounters shard_copy;
+    memset(&out->since_start, 0, sizeof(out->since_start));
+    memset(out->latency, 0, sizeof(out->latency));
+
+    mutex_lock(&snapshot_lock);
+    int64_t used = shard_count;
+    if (used > STATS_MAX_SHARDS) used = STATS_MAX_SHARDS;
+    for (int64_t i = 0; i < used; i++) {
+        read_shard(&shards[i], &shard_copy);
+        for (int p = 0; p < PROTO_COUNT; p++) {
+            out->since_start.counters[p] += shard_copy.counters[p];
+            out->since_start.wire_bytes[p] += shard_copy.wire_bytes[p];
+            out->since_start.cap_bytes[p] += shard_copy.cap_bytes[p];
+            out->since_start.truncated[p] += shard_copy.truncated[p];
+            out->since_start.malformed[p] += shard_copy.malformed[p];
+        }
+        for (int c = 0; c < STATS_HTTP_STATUS_MAX; c++) out->since_start.http_status[c] += shard_copy.http_status[c];
+        for (int l = 0; l < STATS_LATENCY_COUNT; l++) hist_merge(&out->latency[l], &shards[i].latency[l]);
+    }
+    mutex_unlock(&snapshot_lock);
+    out->taken_us = platform_wall_us();
+
+    const uint64_t *sum = out->since_start.counters;
+    uint64_t layers = 0;
+    for (int p = 0; p < PROTO_COUNT; p++) layers += sum[p];
+
+    ProtocolStats *t = &out->totals;
+    t->total_packets = stats_base.total_packets + layers;
+    t->ethernet = stats_base.ethernet + sum[PROTO_ETHERNET];
+    t->ipv4 = stats_base.ipv4 + sum[PROTO_IPV4];
+    t->ipv6 = stats_base.ipv6 + sum[PROTO_IPV6];
+    t->tcp = stats_base.tcp + sum[PROTO_TCP];
+    t->udp = stats_base.udp + sum[PROTO_UDP];
+    t->icmp = stats_base.icmp + sum[PROTO_ICMP];
+    t->arp = stats_base.arp + sum[PROTO_ARP];
+    t->dns = stats_base.dns + sum[PROTO_DNS];
+    t->http = stats_base.http + sum[PROTO_HTTP];
+    t->https = stats_base.https + sum[PROTO_HTTPS];
+    t->dhcp = stats_base.dhcp + sum[PROTO_DHCP];
+}
+
+const char *stats_latency_name(stats_latency_t stage) {
+    return latency_names[stage];
 }
 
-// Increment protocol stats using 64-bit atomic operations
-void stats_increment(const char *proto) {
-    InterlockedIncrement64((volatile LONG64*)&stats.total_packets);
-    if (strcmp(proto, "ETH") == 0) InterlockedIncrement64((volatile LONG64*)&stats.ethernet);
-    else if (strcmp(proto, "IPv4") == 0) InterlockedIncrement64((volatile LONG64*)&stats.ipv4);
-    else if (strcmp(proto, "IPv6") == 0) InterlockedIncrement64((volatile LONG64*)&stats.ipv6);
-    else if (strcmp(proto, "TCP") == 0) InterlockedIncrement64((volatile LONG64*)&stats.tcp);
-    else if (strcmp(proto, "UDP") == 0) InterlockedIncrement64((volatile LONG64*)&stats.udp);
-    else if (strcmp(proto, "ICMP") == 0) InterlockedIncrement64((volatile LONG64*)&stats.icmp);
-    else if (strcmp(proto, "ARP") == 0) InterlockedIncrement64((volatile LONG64*)&stats.arp);
-    else if (strcmp(proto, "DNS") == 0) InterlockedIncrement64((volatile LONG64*)&stats.dns);
-    else if (strcmp(proto, "HTTP") == 0) InterlockedIncrement64((volatile LONG64*)&stats.http);
-    else if (strcmp(proto, "HTTPS") == 0) InterlockedIncrement64((volatile LONG64*)&stats.https);
-    else if (strcmp(proto, "DHCP") == 0) InterlockedIncrement64((volatile LONG64*)&stats.dhcp);
+const char *stats_proto_name(proto_id_t proto) {
+    return proto_names[proto];
+}
+
+// ---------------------------
+// Heavy Hitters
+// ---------------------------
+static struct HeavyShard *heavy_shard(void) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    struct HeavyShard *hs = shard->heavy;
+    if (!hs) {
+        hs = (struct HeavyShard *)calloc(1, sizeof(*hs));
+        if (!hs) return NULL;
+        memory_barrier();
+        shard->heavy = hs;
+    }
+    return hs;
+}
+
+// MurmurHash3 fmix64
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 33);
+}
+
+// A 5-tuple from the two address hashes already computed: each endpoint
+// folds in its port, and ordering them makes both directions agree
+static uint64_t flow_hash(uint64_t src, uint16_t src_port, uint64_t dst, uint16_t dst_port, uint8_t proto) {
+    uint64_t a = src ^ (uint64_t)src_port * 0x9E3779B97F4A7C15ull;
+    uint64_t b = dst ^ (uint64_t)dst_port * 0x9E3779B97F4A7C15ull;
+    uint64_t lo = a < b ? a : b, hi = a < b ? b : a;
+    return mix64(lo * 0xC2B2AE3D27D4EB4Full + hi + proto);
+}
+
+// Apply the buffered packets to the active sketch set (owner only). Every
+// key is hashed once, for its heavy-hitter sketch and its HyperLogLog.
+static void heavy_drain(struct HeavyShard *hs) {
+    HeavySketch *sk = hs->sketch[hs->active];
+    HllSketch *hll = hs->distinct[hs->active];
+    const HeavyPending *p = hs->pending;
+    uint32_t n = hs->npending;
+    uint64_t src_hash[HEAVY_BATCH], dst_hash[HEAVY_BATCH];
+    HeavyKey key;
+    for (uint32_t i = 0; i < n; i++) {
+        heavy_key_addr(&key, p[i].family, p[i].src, NULL);
+        src_hash[i] = heavy_key_hash(&key);
+        heavy_add_hashed(&sk[STATS_HEAVY_SRC_IP], &key, src_hash[i], p[i].weight);
+        hll_add(&hll[STATS_DISTINCT_SRC_IPS], src_hash[i]);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        heavy_key_addr(&key, p[i].family, p[i].dst, NULL);
+        dst_hash[i] = heavy_key_hash(&key);
+        heavy_add_hashed(&sk[STATS_HEAVY_DST_IP], &key, dst_hash[i], p[i].weight);
+        hll_add(&hll[STATS_DISTINCT_DST_IPS], dst_hash[i]);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        heavy_key_addr(&key, p[i].family, p[i].src, p[i].dst);
+        heavy_add(&sk[STATS_HEAVY_IP_PAIR], &key, p[i].weight);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (!p[i].proto) continue;
+        heavy_key_port(&key, p[i].proto, p[i].port);
+        uint64_t h = heavy_key_hash(&key);
+        heavy_add_hashed(&sk[STATS_HEAVY_DST_PORT], &key, h, p[i].weight);
+        hll_add(&hll[STATS_DISTINCT_DST_PORTS], h);
+        hll_add(&hll[STATS_DISTINCT_FLOWS],
+                flow_hash(src_hash[i], p[i].src_port, dst_hash[i], p[i].port, p[i].proto));
+    }
+    hs->npending = 0;
+}
+
+void stats_heavy_addrs(uint8_t family, const unsigned char *src, const unsigned char *dst) {
+    struct HeavyShard *hs = heavy_shard();
+    if (!hs) return;
+    if (hs->npending == HEAVY_BATCH) heavy_drain(hs);
+    HeavyPending *p = &hs->pending[hs->npending++];
+    size_t len = family == 6 ? 16 : 4;
+    p->family = family;
+    p->proto = 0;
+    p->weight = (uint16_t)stats_tls_shard->pkt_weight;
+    memcpy(p->src, src, len);
+    memcpy(p->dst, dst, len);
+}
+
+// Belongs to the packet whose addresses were added last
+void stats_heavy_ports(uint8_t proto, uint16_t src_port, uint16_t dst_port) {
+    struct HeavyShard *hs = stats_tls_shard ? stats_tls_shard->heavy : NULL;
+    if (!hs || hs->npending == 0) return;
+    HeavyPending *p = &hs->pending[hs->npending - 1];
+    p->proto = proto;
+    p->port = dst_port;
+    p->src_port = src_port;
+}
+
+static void heavy_collect(struct HeavyShard *hs, int set) {
+    for (int d = 0; d < STATS_HEAVY_COUNT; d++) {
+        heavy_merge(&heavy_interval[d], &hs->sketch[set][d]);
+        heavy_clear(&hs->sketch[set][d]);
+    }
+    for (int d = 0; d < STATS_DISTINCT_COUNT; d++) {
+        hll_merge(&distinct_interval[d], &hs->distinct[set][d]);
+        memset(&hs->distinct[set][d], 0, sizeof(HllSketch));
+    }
+}
+
+// Close the interval: have every owner switch sketch sets, then merge and
+// clear the sets they left. An owner that does not answer within
+// HEAVY_ROTATE_WAIT_MS keeps its counts for a later interval. Once the
+// owners have stopped (stats_cleanup) both sets are taken directly.
+static void heavy_rotate(int owners_stopped) {
+    int64_t used = shard_count;
+    if (used > STATS_MAX_SHARDS) used = STATS_MAX_SHARDS;
+    for (int d = 0; d < STATS_HEAVY_COUNT; d++) heavy_clear(&heavy_interval[d]);
+    memset(distinct_interval, 0, sizeof(distinct_interval));
+    heavy_interval_start_us = heavy_interval_end_us;
+    heavy_interval_end_us = platform_wall_us();
+
+    for (int64_t i = 0; i < used; i++) {
+        StatsShard *shard = &shards[i];
+        struct HeavyShard *hs = shard->heavy;
+        if (!hs) continue;
+        memory_barrier();
+        if (owners_stopped) {
+            heavy_drain(hs);
+            heavy_collect(hs, 0);
+            heavy_collect(hs, 1);
+            continue;
+        }
+        uint64_t ack = atomic_load_acquire_u64(&shard->heavy_ack);
+        if (ack != shard->heavy_req) continue;          // Still owed from a timed-out request
+        if (heavy_collected[i] != ack) {
+            heavy_collect(hs, hs->active ^ 1);          // That request was answered late
+            heavy_collected[i] = ack;
+        }
+        atomic_store_release_u64(&shard->heavy_req, ack + 1);
+    }
+    if (!owners_stopped) heavy_wait(used);
+    for (int d = 0; d < STATS_DISTINCT_COUNT; d++) distinct_estimate[d] = hll_estimate(&distinct_interval[d]);
+}
+
+// Second half of heavy_rotate: collect the sets switched since, waiting
+// up to HEAVY_ROTATE_WAIT_MS in all
+static void heavy_wait(int64_t used) {
+    uint64_t deadline = platform_now_ns() + (uint64_t)HEAVY_ROTATE_WAIT_MS * 1000000u;
+    for (int64_t i = 0; i < used; i++) {
+        StatsShard *shard = &shards[i];
+        struct HeavyShard *hs = shard->heavy;
+        if (!hs || heavy_collected[i] == shard->heavy_req) continue;
+        while (atomic_load_acquire_u64(&shard->heavy_ack) != shard->heavy_req &&
+               platform_now_ns() < deadline) {
+            platform_sleep_ms(1);
+        }
+        uint64_t ack = atomic_load_acquire_u64(&shard->heavy_ack);
+        if (ack != shard->heavy_req) continue;
+        heavy_collect(hs, hs->active ^ 1);
+        heavy_collected[i] = ack;
+    }
+}
+
+// ---------------------------
+// Named Counters and HTTP Status
+// ---------------------------
+// Copy name as stored (see stats_count_name) and hash it (FNV-1a)
+static uint32_t name_prepare(const char *name, char *out) {
+    uint32_t h = 2166136261u;
+    size_t n = 0;
+    for (; name[n] && n < STATS_NAME_LEN - 1; n++) {
+        unsigned char c = (unsigned char)name[n];
+        if (c <= 0x20 || c >= 0x7f || c == '"' || c == '\\') c = '?';
+        out[n] = (char)c;
+        h ^= c;
+        h *= 16777619u;
+    }
+    out[n] = '\0';
+    return h;
+}
+
+void stats_count_name(stats_names_t set, const char *name) {
+    stats_add_name(set, name, 0);
+}
+
+void stats_add_name(stats_names_t set, const char *name, uint64_t value) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    struct NameTable *t = shard->names[set];
+    if (!t) {
+        t = (struct NameTable *)calloc(1, sizeof(*t));
+        if (!t) return;
+        memory_barrier();
+        shard->names[set] = t;
+    }
+
+    char clean[STATS_NAME_LEN];
+    uint32_t h = name_prepare(name, clean);
+    for (uint32_t i = h & (STATS_NAME_SLOTS - 1);; i = (i + 1) & (STATS_NAME_SLOTS - 1)) {
+        NameSlot *slot = &t->slots[i];
+        if (!slot->ready) {
+            if (t->used >= STATS_NAME_FILL) break;
+            memcpy(slot->name, clean, sizeof(clean));
+            slot->hash = h;
+            slot->count = 1;
+            slot->total = value;
+            memory_barrier();
+            slot->ready = 1;
+            t->used++;
+            return;
+        }
+        if (slot->hash == h && strcmp(slot->name, clean) == 0) {
+            slot->count++;
+            slot->total += value;
+            return;
+        }
+    }
+    t->overflow++;
+}
+
+typedef struct {
+    const char *name;
+    uint64_t count;
+    uint64_t total;
+} NameRef;
+
+static int name_ref_by_name(const void *a, const void *b) {
+    return strcmp(((const NameRef *)a)->name, ((const NameRef *)b)->name);
+}
+
+static int name_ref_by_count(const void *a, const void *b) {
+    uint64_t ca = ((const NameRef *)a)->count, cb = ((const NameRef *)b)->count;
+    if (ca != cb) return ca < cb ? 1 : -1;
+    return strcmp(((const NameRef *)a)->name, ((const NameRef *)b)->name);
+}
+
+static int name_ref_by_total(const void *a, const void *b) {
+    uint64_t ta = ((const NameRef *)a)->total, tb = ((const NameRef *)b)->total;
+    if (ta != tb) return ta < tb ? 1 : -1;
+    return name_ref_by_count(a, b);
+}
+
+size_t stats_top_names(stats_names_t set, NameCount *out, size_t max, uint64_t *other) {
+    int64_t used = shard_count;
+    if (used > STATS_MAX_SHARDS) used = STATS_MAX_SHARDS;
+    *other = 0;
+
+    // References into the shards (names never change once ready)
+    size_t total = 0;
+    for (int64_t i = 0; i < used; i++) {
+        if (shards[i].names[set]) total += STATS_NAME_FILL;
+    }
+    if (total == 0) return 0;
+    NameRef *refs = (NameRef *)malloc(total * sizeof(NameRef));
+    if (!refs) return 0;
+
+    size_t n = 0;
+    for (int64_t i = 0; i < used; i++) {
+        const struct NameTable *t = shards[i].names[set];
+        if (!t) continue;
+        memory_barrier();
+        *other += t->overflow;
+        for (uint32_t j = 0; j < STATS_NAME_SLOTS && n < total; j++) {
+            const NameSlot *slot = &t->slots[j];
+            if (!slot->ready) continue;
+            memory_barrier();
+            refs[n].name = slot->name;
+            refs[n].count = slot->count;
+            refs[n].total = slot->total;
+            n++;
+        }
+    }
+
+    // Combine the same name seen by several workers, then rank
+    qsort(refs, n, sizeof(NameRef), name_ref_by_name);
+    size_t merged = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (merged > 0 && strcmp(refs[merged - 1].name, refs[i].name) == 0) {
+            refs[merged - 1].count += refs[i].count;
+            refs[merged - 1].total += refs[i].total;
+        } else {
+            refs[merged++] = refs[i];
+        }
+    }
+    qsort(refs, merged, sizeof(NameRef), name_sinks[set].total_key ? name_ref_by_total : name_ref_by_count);
+
+    size_t count = merged < max ? merged : max;
+    for (size_t i = 0; i < count; i++) {
+        strncpy(out[i].name, refs[i].name, STATS_NAME_LEN - 1);
+        out[i].name[STATS_NAME_LEN - 1] = '\0';
+        out[i].count = refs[i].count;
+        out[i].total = refs[i].total;
+    }
+    for (size_t i = count; i < merged; i++) *other += refs[i].count;
+    free(refs);
+    return count;
 }
 
 // Save stats to JSON with error checking
-int stats_save_json(const char *filename) {
+int stats_save_json(const char *filename, const StatsSnapshot *snap) {
     FILE *fp = fopen(filename, "w");
     if (!fp) {
         fprintf(stderr, "[!] Failed to open %s for writing\n", filename);
         return -1;
     }
 
+    const ProtocolStats stats = snap->totals;
     int result = fprintf(fp,
         "{\n"
         "  \"total_packets\": %llu,\n"
@@ -200,8 +920,7 @@ int stats_save_json(const char *filename) {
         "  \"dns\": %llu,\n"
         "  \"http\": %llu,\n"
         "  \"https\": %llu,\n"
-        "  \"dhcp\": %llu\n"
-        "}\n",
+        "  \"dhcp\": %llu,\n",
         (unsigned long long)stats.total_packets,
         (unsigned long long)stats.ethernet,
         (unsigned long long)stats.ipv4,
@@ -216,6 +935,131 @@ int stats_save_json(const char *filename) {
         (unsigned long long)stats.dhcp
     );
 
+    // Since-startup breakdowns, each on lines the line-based loader below
+    // skips (no "key": number pairs). Names are stored sanitized, so they
+    // need no escaping.
+    const uint64_t *status = snap->since_start.http_status;
+    if (result >= 0) result = fprintf(fp, "  \"http_status\": {");
+    for (int c = 0, first = 1; c < STATS_HTTP_STATUS_MAX && result >= 0; c++) {
+        if (!status[c]) continue;
+        result = fprintf(fp, "%s\"%d\": %llu", first ? "" : ", ", c, (unsigned long long)status[c]);
+        first = 0;
+    }
+    if (result >= 0) result = fprintf(fp, "}");
+
+    // Capture-to-analysis latency since startup (live captures), one line
+    if (result >= 0) result = fprintf(fp, ",\n  \"latency\": {");
+    for (int l = 0; l < STATS_LATENCY_COUNT && result >= 0; l++) {
+        const LatencyHist *h = &snap->latency[l];
+        result = fprintf(fp, "%s\"%s\": {\"samples\": %llu, \"mean_us\": %.1f, \"p50_us\": %llu, "
+                         "\"p99_us\": %llu, \"p999_us\": %llu, \"max_us\": %llu}",
+                         l ? ", " : "", latency_names[l], (unsigned long long)h->count,
+                         h->count ? (double)h->sum / (double)h->count : 0.0,
+                         (unsigned long long)hist_percentile(h, 0.50),
+                         (unsigned long long)hist_percentile(h, 0.99),
+                         (unsigned long long)hist_percentile(h, 0.999),
+                         (unsigned long long)h->max);
+    }
+    if (result >= 0) result = fprintf(fp, "}");
+
+    // Bytes per protocol since startup (this run), one line
+    if (result >= 0) result = fprintf(fp, ",\n  \"bytes\": {");
+    for (int p = 0; p < PROTO_COUNT && result >= 0; p++) {
+        result = fprintf(fp, "%s\"%s\": {\"wire\": %llu, \"captured\": %llu}", p ? ", " : "", proto_names[p],
+                         (unsigned long long)snap->since_start.wire_bytes[p],
+                         (unsigned long long)snap->since_start.cap_bytes[p]);
+    }
+    if (result >= 0) result = fprintf(fp, "}");
+
+    // Last second and peak second of the rate window, one line
+    StatsRates rates;
+    stats_rates(&rates);
+    if (result >= 0) result = fprintf(fp, ",\n  \"rates\": {\"window_s\": %u", rates.buckets);
+    for (int p = 0; p < PROTO_COUNT && result >= 0; p++) {
+        const ProtoRate *r = &rates.proto[p];
+        result = fprintf(fp, ", \"%s\": {\"pps\": %.0f, \"bps\": %.0f, \"cap_bps\": %.0f, "
+                         "\"peak_pps\": %.0f, \"peak_bps\": %.0f}",
+                         proto_names[p], r->pps, r->bps, r->cap_bps, r->peak_pps, r->peak_bps);
+    }
+    if (result >= 0) result = fprintf(fp, "}");
+
+    for (int set = 0; set < STATS_NAMES_COUNT && result >= 0; set++) {
+        const NameSink *sink = &name_sinks[set];
+        NameCount top[STATS_TOP_NAMES];
+        uint64_t other = 0;
+        size_t ntop = stats_top_names((stats_names_t)set, top, STATS_TOP_NAMES, &other);
+        result = fprintf(fp, ",\n  \"%s_other\": %llu,\n  \"%s\": [",
+                         sink->json_key, (unsigned long long)other, sink->json_key);
+        for (size_t i = 0; i < ntop && result >= 0; i++) {
+            result = fprintf(fp, "%s\n    {\"name\": \"%s\", \"%s\": %llu",
+                             i ? "," : "", top[i].name, sink->count_key, (unsigned long long)top[i].count);
+            if (result >= 0 && sink->total_key) {
+                result = fprintf(fp, ", \"%s\": %llu", sink->total_key, (unsigned long long)top[i].total);
+            }
+            if (result >= 0) result = fprintf(fp, "}");
+        }
+        if (result >= 0) result = fprintf(fp, "%s]", ntop ? "\n  " : "");
+    }
+
+    // Top talkers of the last flush interval (none before the first flush)
+    if (result >= 0) {
+        result = fprintf(fp, ",\n  \"heavy_interval_ms\": %llu",
+                         (unsigned long long)((heavy_interval_end_us - heavy_interval_start_us) / 1000));
+    }
+    for (int d = 0; d < STATS_HEAVY_COUNT && result >= 0; d++) {
+        HeavyItem top[STATS_TOP_HEAVY];
+        char key[2 * INET6_ADDRSTRLEN + 8];
+        size_t ntop = heavy_top(&heavy_interval[d], top, STATS_TOP_HEAVY);
+        result = fprintf(fp, ",\n  \"heavy_%s_packets\": %llu,\n  \"heavy_%s\": [",
+                         heavy_names[d], (unsigned long long)heavy_interval[d].total, heavy_names[d]);
+        for (size_t i = 0; i < ntop && result >= 0; i++) {
+            heavy_key_format(&top[i].key, key, sizeof(key));
+            result = fprintf(fp, "%s\n    {\"key\": \"%s\", \"packets\": %llu, \"max_error\": %llu}",
+                             i ? "," : "", key, (unsigned long long)top[i].count,
+                             (unsigned long long)top[i].error);
+        }
+        if (result >= 0) result = fprintf(fp, "%s]", ntop ? "\n  " : "");
+    }
+
+    // Distinct keys in the same interval, one line
+    if (result >= 0) result = fprintf(fp, ",\n  \"distinct\": {");
+    for (int d = 0; d < STATS_DISTINCT_COUNT && result >= 0; d++) {
+        result = fprintf(fp, "%s\"%s\": %llu", d ? ", " : "", distinct_names[d],
+                         (unsigned long long)distinct_estimate[d]);
+    }
+    if (result >= 0) result = fprintf(fp, "}");
+
+    // Live load shedding since startup (counts above are scaled while sampling)
+    OverloadSummary ov;
+    overload_summary(&ov, platform_wall_us());
+    if (result >= 0 && ov.enabled) {
+        result = fprintf(fp, ",\n  \"overload\": {\"sample_rate\": %u, \"transitions\": %llu, "
+                         "\"sampled_out\": %llu",
+                         ov.sample_rate, (unsigned long long)ov.transitions, (unsigned long long)ov.skipped);
+        for (int m = 0; m < OVERLOAD_MODES && result >= 0; m++) {
+            result = fprintf(fp, ", \"%s\": {\"workers\": %u, \"ms\": %llu}",
+                             overload_mode_name((overload_mode_t)m), ov.workers[m],
+                             (unsigned long long)(ov.mode_us[m] / 1000));
+        }
+        if (result >= 0) result = fprintf(fp, "}");
+    }
+
+    // Postgres writer health, on one line so the loader skips it
+    StatsDbStatus db;
+    stats_db_status(&db);
+    if (result >= 0) {
+        result = fprintf(fp, ",\n  \"db\": {\"enabled\": %d, \"connected\": %d, \"reconnect_attempts\": %llu, "
+                         "\"spool_bytes\": %llu, \"spool_records\": %llu, \"spool_max_bytes\": %llu, "
+                         "\"spooled\": %llu, \"spool_dropped\": %llu, \"spool_corrupt\": %llu, "
+                         "\"replayed\": %llu, \"replay_records_per_s\": %.0f}",
+                         db.enabled, db.connected, (unsigned long long)db.reconnect_attempts,
+                         (unsigned long long)db.spool_bytes, (unsigned long long)db.spool_records,
+                         (unsigned long long)db.spool_max_bytes, (unsigned long long)db.spooled,
+                         (unsigned long long)db.spool_dropped, (unsigned long long)db.spool_corrupt,
+                         (unsigned long long)db.replayed, db.replay_records_per_s);
+    }
+    if (result >= 0) result = fprintf(fp, "\n}\n");
+
     if (result < 0) {
         fprintf(stderr, "[!] Failed to write to %s\n", filename);
         fclose(fp);
@@ -259,40 +1103,40 @@ int stats_load_json(const char *filename) {
             }
             
             if (strcmp(key, "total_packets") == 0) {
-                stats.total_packets = value;
+                stats_base.total_packets = value;
                 found_count++;
             } else if (strcmp(key, "ethernet") == 0) {
-                stats.ethernet = value;
+                stats_base.ethernet = value;
                 found_count++;
             } else if (strcmp(key, "ipv4") == 0) {
-                stats.ipv4 = value;
+                stats_base.ipv4 = value;
                 found_count++;
             } else if (strcmp(key, "ipv6") == 0) {
-                stats.ipv6 = value;
+                stats_base.ipv6 = value;
                 found_count++;
             } else if (strcmp(key, "tcp") == 0) {
-                stats.tcp = value;
+                stats_base.tcp = value;
                 found_count++;
             } else if (strcmp(key, "udp") == 0) {
-                stats.udp = value;
+                stats_base.udp = value;
                 found_count++;
             } else if (strcmp(key, "icmp") == 0) {
-                stats.icmp = value;
+                stats_base.icmp = value;
                 found_count++;
             } else if (strcmp(key, "arp") == 0) {
-                stats.arp = value;
+                stats_base.arp = value;
                 found_count++;
             } else if (strcmp(key, "dns") == 0) {
-                stats.dns = value;
+                stats_base.dns = value;
                 found_count++;
             } else if (strcmp(key, "http") == 0) {
-                stats.http = value;
+                stats_base.http = value;
                 found_count++;
             } else if (strcmp(key, "https") == 0) {
-                stats.https = value;
+                stats_base.https = value;
                 found_count++;
             } else if (strcmp(key, "dhcp") == 0) {
-                stats.dhcp = value;
+                stats_base.dhcp = value;
                 found_count++;
             }
         }
@@ -307,19 +1151,759 @@ int stats_load_json(const char *filename) {
     return 0;
 }
 
-// Save stats to Postgres using persistent connection
-int stats_save_postgres(const char *conninfo) {
-    (void)conninfo; // ignored, using persistent pg_conn
-    
-    // Skip if database is disabled
-    if (!db_enabled) {
+// One insert over nparams text parameters, usually a multi-row
+// unnest($1::..[], $2::bigint[], ...) of array literals built by the
+// caller. A missing table disables that insert for the rest of the run
+// instead of failing every flush.
+static int insert_arrays(const char *query, const char *const *arrays, int nparams,
+                         const char *table, const char *migration, int *enabled) {
+    PGresult *res = PQexecParams(pg_conn, query, nparams, NULL, arrays, NULL, NULL, 0);
+    if (res == NULL) {
+        fprintf(stderr, "[!] PQexecParams returned NULL: %s\n", PQerrorMessage(pg_conn));
+        PQfinish(pg_conn);
+        pg_conn = NULL;
+        return STATS_DB_QUERY_FAIL;
+    }
+
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+        const char *state = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+        if (state && strcmp(state, "42P01") == 0) {
+            // undefined_table: keep protocol_stats flowing, stop trying this table
+            printf("[!] Table %s not found (apply %s); its counters go to %s only\n",
+                   table, migration, JSON_FILE);
+            *enabled = 0;
+            PQclear(res);
+            return STATS_DB_OK;
+        }
+        fprintf(stderr, "[!] Postgres %s insert failed: %s\n", table, PQerrorMessage(pg_conn));
+        PQclear(res);
+        PQfinish(pg_conn);
+        pg_conn = NULL;
+        return STATS_DB_QUERY_FAIL;
+    }
+
+    PQclear(res);
+    return STATS_DB_OK;
+}
+
+// Top names of one set, one row each
+static int save_names_postgres(stats_names_t set) {
+    NameSink *sink = &name_sinks[set];
+    if (!sink->db_enabled) return STATS_DB_OK;
+
+    NameCount top[STATS_TOP_NAMES];
+    uint64_t other = 0;
+    size_t ntop = stats_top_names(set, top, STATS_TOP_NAMES, &other);
+    if (ntop == 0) return STATS_DB_OK;
+
+    // Names carry no quotes or backslashes, so quoting each element is enough
+    char names[STATS_TOP_NAMES * (STATS_NAME_LEN + 3) + 3];
+    char counts[STATS_TOP_NAMES * 21 + 3];
+    char totals[STATS_TOP_NAMES * 21 + 3];
+    size_t np = 0, cp = 0, tp = 0;
+    names[np++] = '{';
+    counts[cp++] = '{';
+    totals[tp++] = '{';
+    for (size_t i = 0; i < ntop; i++) {
+        np += (size_t)snprintf(names + np, sizeof(names) - np, "%s\"%s\"", i ? "," : "", top[i].name);
+        cp += (size_t)snprintf(counts + cp, sizeof(counts) - cp, "%s%llu", i ? "," : "",
+                               (unsigned long long)top[i].count);
+        tp += (size_t)snprintf(totals + tp, sizeof(totals) - tp, "%s%llu", i ? "," : "",
+                               (unsigned long long)top[i].total);
+    }
+    snprintf(names + np, sizeof(names) - np, "}");
+    snprintf(counts + cp, sizeof(counts) - cp, "}");
+    snprintf(totals + tp, sizeof(totals) - tp, "}");
+    const char *arrays[3] = { names, counts, totals };
+    return insert_arrays(sink->insert, arrays, sink->total_key ? 3 : 2,
+                         sink->table, sink->migration, &sink->db_enabled);
+}
+
+// Responses per status code seen so far, one row per code
+static int save_http_status_postgres(const StatsSnapshot *snap) {
+    if (!http_status_db_enabled) return STATS_DB_OK;
+
+    const uint64_t *status = snap->since_start.http_status;
+    char codes[STATS_HTTP_STATUS_MAX * 4 + 3];
+    char counts[STATS_HTTP_STATUS_MAX * 21 + 3];
+    size_t np = 0, cp = 0;
+    codes[np++] = '{';
+    counts[cp++] = '{';
+    for (int c = 0; c < STATS_HTTP_STATUS_MAX; c++) {
+        if (!status[c]) continue;
+        np += (size_t)snprintf(codes + np, sizeof(codes) - np, "%s%d", np > 1 ? "," : "", c);
+        cp += (size_t)snprintf(counts + cp, sizeof(counts) - cp, "%s%llu", cp > 1 ? "," : "",
+                               (unsigned long long)status[c]);
+    }
+    if (np == 1) return STATS_DB_OK;
+    snprintf(codes + np, sizeof(codes) - np, "}");
+    snprintf(counts + cp, sizeof(counts) - cp, "}");
+    const char *arrays[2] = { codes, counts };
+    return insert_arrays("INSERT INTO http_status_stats(status, responses) "
+                         "SELECT * FROM unnest($1::int[], $2::bigint[]);",
+                         arrays, 2, "http_status_stats", "db_migration_add_http_metrics.sql",
+                         &http_status_db_enabled);
+}
+
+// Capture-to-analysis percentiles of the packets seen since the last
+// flush that got here, one row per stage. Not spooled: after an outage
+// the next flush covers the whole gap.
+static int save_latency_postgres(const StatsSnapshot *snap) {
+    static LatencyHist interval;
+    if (!latency_db_enabled) return STATS_DB_OK;
+
+    char stages[STATS_LATENCY_COUNT * 32 + 3];
+    char cols[5][STATS_LATENCY_COUNT * 21 + 3];
+    size_t sp = 0, cp[5] = { 0 };
+    stages[sp++] = '{';
+    for (int k = 0; k < 5; k++) cols[k][cp[k]++] = '{';
+    int rows = 0;
+    for (int l = 0; l < STATS_LATENCY_COUNT; l++) {
+        hist_delta(&interval, &snap->latency[l], &latency_flushed[l]);
+        if (interval.count == 0) continue;
+        uint64_t v[5] = { interval.count, hist_percentile(&interval, 0.50), hist_percentile(&interval, 0.99),
+                          hist_percentile(&interval, 0.999), interval.max };
+        sp += (size_t)snprintf(stages + sp, sizeof(stages) - sp, "%s%s", rows ? "," : "", latency_names[l]);
+        for (int k = 0; k < 5; k++) {
+            cp[k] += (size_t)snprintf(cols[k] + cp[k], sizeof(cols[k]) - cp[k], "%s%llu", rows ? "," : "",
+                                      (unsigned long long)v[k]);
+        }
+        rows++;
+    }
+    if (rows == 0) return STATS_DB_OK;
+    snprintf(stages + sp, sizeof(stages) - sp, "}");
+    for (int k = 0; k < 5; k++) snprintf(cols[k] + cp[k], sizeof(cols[k]) - cp[k], "}");
+    const char *arrays[6] = { stages, cols[0], cols[1], cols[2], cols[3], cols[4] };
+    int rc = insert_arrays("INSERT INTO latency_stats(stage, samples, p50_us, p99_us, p999_us, max_us) "
+                           "SELECT * FROM unnest($1::text[], $2::bigint[], $3::bigint[], $4::bigint[], "
+                           "$5::bigint[], $6::bigint[]);",
+                           arrays, 6, "latency_stats", "db_migration_add_latency.sql", &latency_db_enabled);
+    if (rc == STATS_DB_OK) memcpy(latency_flushed, snap->latency, sizeof(latency_flushed));
+    return rc;
+}
+
+// Top talkers of the interval that just closed, one row per key. Not
+// spooled: an interval Postgres missed is only in that flush's stats.json.
+static int save_heavy_postgres(void) {
+    if (!heavy_db_enabled) return STATS_DB_OK;
+
+    static char keys[STATS_HEAVY_COUNT * STATS_TOP_HEAVY * (2 * INET6_ADDRSTRLEN + 11) + 3];
+    char dims[STATS_HEAVY_COUNT * STATS_TOP_HEAVY * 12 + 3];
+    char cols[3][STATS_HEAVY_COUNT * STATS_TOP_HEAVY * 21 + 3];
+    char interval[24];
+    size_t kp = 0, dp = 0, cp[3] = { 0 };
+    keys[kp++] = '{';
+    dims[dp++] = '{';
+    for (int k = 0; k < 3; k++) cols[k][cp[k]++] = '{';
+    int rows = 0;
+    for (int d = 0; d < STATS_HEAVY_COUNT; d++) {
+        HeavyItem top[STATS_TOP_HEAVY];
+        char key[2 * INET6_ADDRSTRLEN + 8];
+        size_t ntop = heavy_top(&heavy_interval[d], top, STATS_TOP_HEAVY);
+        for (size_t i = 0; i < ntop; i++) {
+            uint64_t v[3] = { top[i].count, top[i].error, heavy_interval[d].total };
+            heavy_key_format(&top[i].key, key, sizeof(key));
+            kp += (size_t)snprintf(keys + kp, sizeof(keys) - kp, "%s\"%s\"", rows ? "," : "", key);
+            dp += (size_t)snprintf(dims + dp, sizeof(dims) - dp, "%s%s", rows ? "," : "", heavy_names[d]);
+            for (int k = 0; k < 3; k++) {
+                cp[k] += (size_t)snprintf(cols[k] + cp[k], sizeof(cols[k]) - cp[k], "%s%llu", rows ? "," : "",
+                                          (unsigned long long)v[k]);
+            }
+            rows++;
+        }
+    }
+    if (rows == 0) return STATS_DB_OK;
+    snprintf(keys + kp, sizeof(keys) - kp, "}");
+    snprintf(dims + dp, sizeof(dims) - dp, "}");
+    for (int k = 0; k < 3; k++) snprintf(cols[k] + cp[k], sizeof(cols[k]) - cp[k], "}");
+    snprintf(interval, sizeof(interval), "%llu",
+             (unsigned long long)((heavy_interval_end_us - heavy_interval_start_us) / 1000));
+    const char *arrays[6] = { dims, keys, cols[0], cols[1], cols[2], interval };
+    return insert_arrays("INSERT INTO heavy_hitters(dimension, key, packets, max_error, dimension_packets, interval_ms) "
+                         "SELECT d, k, p, e, t, $6::int FROM unnest($1::text[], $2::text[], $3::bigint[], "
+                         "$4::bigint[], $5::bigint[]) AS u(d, k, p, e, t);",
+                         arrays, 6, "heavy_hitters", "db_migration_add_heavy_hitters.sql", &heavy_db_enabled);
+}
+
+// Distinct-count estimates of the interval that just closed, one row.
+// Not spooled, like the heavy hitters.
+static int save_distinct_postgres(void) {
+    if (!distinct_db_enabled) return STATS_DB_OK;
+
+    char values[1 + STATS_DISTINCT_COUNT][24];
+    snprintf(values[0], sizeof(values[0]), "%llu",
+             (unsigned long long)((heavy_interval_end_us - heavy_interval_start_us) / 1000));
+    for (int d = 0; d < STATS_DISTINCT_COUNT; d++) {
+        snprintf(values[1 + d], sizeof(values[1 + d]), "%llu", (unsigned long long)distinct_estimate[d]);
+    }
+    const char *params[1 + STATS_DISTINCT_COUNT];
+    for (int k = 0; k < 1 + STATS_DISTINCT_COUNT; k++) params[k] = values[k];
+    return insert_arrays("INSERT INTO distinct_stats(interval_ms, src_ips, dst_ips, dst_ports, flows) "
+                         "VALUES ($1::int, $2::bigint, $3::bigint, $4::bigint, $5::bigint);",
+                         params, 1 + STATS_DISTINCT_COUNT, "distinct_stats", "db_migration_add_distinct_stats.sql",
+                         &distinct_db_enabled);
+}
+
+// Overload mode changes since the last flush that got here, one row each.
+// The cursor only moves on success, so an outage is caught up from the
+// log (OVERLOAD_LOG_SIZE transitions) rather than spooled.
+static int save_overload_postgres(void) {
+    if (!overload_db_enabled) return STATS_DB_OK;
+
+    OverloadTransition t[OVERLOAD_LOG_SIZE];
+    uint64_t cursor = overload_flushed, lost = 0;
+    size_t n = overload_transitions(&cursor, t, OVERLOAD_LOG_SIZE, &lost);
+    if (lost) printf("[!] %llu overload transitions were overwritten before reaching Postgres\n",
+                     (unsigned long long)lost);
+    if (n == 0) {
+        overload_flushed = cursor;
         return STATS_DB_OK;
     }
-    
-    if (ensure_pg_connection() != 0) {
-        db_enabled = 0;  // Disable for future attempts
-        return STATS_DB_CONN_FAIL;
+
+    static char cols[7][OVERLOAD_LOG_SIZE * 21 + 3];
+    size_t cp[7] = { 0 };
+    for (int k = 0; k < 7; k++) cols[k][cp[k]++] = '{';
+    for (size_t i = 0; i < n; i++) {
+        char v[7][24];
+        snprintf(v[0], sizeof(v[0]), "%llu", (unsigned long long)t[i].at_us);
+        snprintf(v[1], sizeof(v[1]), "%u", t[i].worker);
+        snprintf(v[2], sizeof(v[2]), "%s", overload_mode_name((overload_mode_t)t[i].from));
+        snprintf(v[3], sizeof(v[3]), "%s", overload_mode_name((overload_mode_t)t[i].to));
+        snprintf(v[4], sizeof(v[4]), "%llu", (unsigned long long)(t[i].lasted_us / 1000));
+        snprintf(v[5], sizeof(v[5]), "%u", t[i].fill_pct);
+        snprintf(v[6], sizeof(v[6]), "%u", t[i].sample_rate);
+        for (int k = 0; k < 7; k++) {
+            cp[k] += (size_t)snprintf(cols[k] + cp[k], sizeof(cols[k]) - cp[k], "%s%s", i ? "," : "", v[k]);
+        }
+    }
+    for (int k = 0; k < 7; k++) snprintf(cols[k] + cp[k], sizeof(cols[k]) - cp[k], "}");
+    const char *arrays[7] = { cols[0], cols[1], cols[2], cols[3], cols[4], cols[5], cols[6] };
+    int rc = insert_arrays("INSERT INTO overload_transitions(timestamp, worker, from_mode, to_mode, "
+                           "previous_ms, queue_fill_pct, sample_rate) "
+                           "SELECT to_timestamp(a / 1e6), w, f, m, p, q, r "
+                           "FROM unnest($1::bigint[], $2::int[], $3::text[], $4::text[], $5::bigint[], "
+                           "$6::int[], $7::int[]) AS u(a, w, f, m, p, q, r);",
+                           arrays, 7, "overload_transitions", "db_migration_add_overload_transitions.sql",
+                           &overload_db_enabled);
+    if (rc == STATS_DB_OK) overload_flushed = cursor;
+    return rc;
+}
+
+// ---------------------------
+// Per-Interval Deltas
+// ---------------------------
+// Close the current bucket: what was counted between the previous snapshot and this one
+static void stats_sample_deltas(const StatsSnapshot *snap) {
+    const uint64_t *sum = snap->since_start.counters;
+    uint64_t now_us = snap->taken_us;
+
+    if (delta_len == DELTA_MAX_BUCKETS) {
+        if (delta_dropped == 0) {
+            fprintf(stderr, "[!] %d delta buckets unflushed; dropping the oldest until Postgres catches up\n",
+                    DELTA_MAX_BUCKETS);
+        }
+        delta_head = (delta_head + 1) % DELTA_MAX_BUCKETS;
+        delta_len--;
+        delta_dropped++;
+    }
+    DeltaBucket *b = &delta_ring[(delta_head + delta_len) % DELTA_MAX_BUCKETS];
+    b->start_us = delta_last_us;
+    b->interval_ms = now_us > delta_last_us ? (uint32_t)((now_us - delta_last_us + 500) / 1000) : 0;
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        b->packets[p] = sum[p] - delta_last[p];
+        delta_last[p] = sum[p];
+    }
+    delta_last_us = now_us;
+    delta_len++;
+}
+
+// Big-endian field writers for the binary COPY stream
+static unsigned char *put_be16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+    return p + 2;
+}
+
+static unsigned char *put_be32(unsigned char *p, uint32_t v) {
+    p = put_be16(p, (uint16_t)(v >> 16));
+    return put_be16(p, (uint16_t)v);
+}
+
+static unsigned char *put_be64(unsigned char *p, uint64_t v) {
+    p = put_be32(p, (uint32_t)(v >> 32));
+    return put_be32(p, (uint32_t)v);
+}
+
+#define PG_EPOCH_OFFSET_US 946684800000000ULL   // 1970-01-01 to 2000-01-01 (timestamptz origin)
+#define DELTA_ROW_MAX_BYTES (2 + 12 + 8 + 4 + 8 + 12)   // Field count, 4 fields with lengths, name up to 8 bytes
+
+// The span's buckets as one binary COPY stream: one row per protocol
+static unsigned char *build_delta_copy(const DeltaSpan *span, size_t *len_out) {
+    size_t cap = 19 + (size_t)span->n * PROTO_COUNT * DELTA_ROW_MAX_BYTES + 2;
+    unsigned char *buf = (unsigned char *)malloc(cap);
+    if (!buf) return NULL;
+    unsigned char *p = buf;
+    memcpy(p, "PGCOPY\n\377\r\n\0", 11);
+    p += 11;
+    p = put_be32(p, 0);          // Flags
+    p = put_be32(p, 0);          // Header extension length
+    for (uint32_t i = 0; i < span->n; i++) {
+        const DeltaBucket *b = DELTA_AT(span, i);
+        for (int proto = 0; proto < PROTO_COUNT; proto++) {
+            size_t nlen = strlen(proto_names[proto]);
+            p = put_be16(p, 4);
+            p = put_be32(p, 8);
+            p = put_be64(p, b->start_us - PG_EPOCH_OFFSET_US);
+            p = put_be32(p, 4);
+            p = put_be32(p, b->interval_ms);
+            p = put_be32(p, (uint32_t)nlen);
+            memcpy(p, proto_names[proto], nlen);
+            p += nlen;
+            p = put_be32(p, 8);
+            p = put_be64(p, b->packets[proto]);
+        }
+    }
+    p = put_be16(p, 0xFFFF);     // Trailer
+    *len_out = (size_t)(p - buf);
+    return buf;
+}
+
+#define STATS_DB_FALLBACK 1      // COPY refused; use the prepared insert
+
+// COPY ... FROM STDIN (FORMAT binary): the rows go out as one data stream
+static int copy_deltas_postgres(const DeltaSpan *span) {
+    size_t len = 0;
+    unsigned char *buf = build_delta_copy(span, &len);
+    if (!buf) {
+        fprintf(stderr, "[!] Out of memory building delta rows\n");
+        return STATS_DB_QUERY_FAIL;
+    }
+
+    PGresult *res = PQexec(pg_conn, "COPY protocol_stats_delta(bucket_start, interval_ms, protocol, packets) "
+                                    "FROM STDIN (FORMAT binary);");
+    if (res == NULL) {
+        fprintf(stderr, "[!] PQexec returned NULL: %s\n", PQerrorMessage(pg_conn));
+        free(buf);
+        PQfinish(pg_conn);
+        pg_conn = NULL;
+        return STATS_DB_QUERY_FAIL;
+    }
+    if (PQresultStatus(res) != PGRES_COPY_IN) {
+        const char *state = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+        int rc = STATS_DB_FALLBACK;
+        if (state && strcmp(state, "42P01") == 0) {
+            printf("[!] Table protocol_stats_delta not found (apply db_migration_add_protocol_deltas.sql); "
+                   "per-second deltas are not stored\n");
+            delta_db_enabled = 0;
+            rc = STATS_DB_OK;
+        } else {
+            // Poolers and some managed services reject COPY; the session is still usable
+            const char *why = PQresultErrorField(res, PG_DIAG_MESSAGE_PRIMARY);
+            printf("[!] COPY into protocol_stats_delta refused (%s); using prepared inserts\n",
+                   why ? why : "no message");
+            delta_copy_enabled = 0;
+        }
+        PQclear(res);
+        free(buf);
+        return rc;
+    }
+    PQclear(res);
+
+    int ok = PQputCopyData(pg_conn, (const char *)buf, (int)len) == 1 &&
+             PQputCopyEnd(pg_conn, NULL) == 1;
+    free(buf);
+    while ((res = PQgetResult(pg_conn)) != NULL) {
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) ok = 0;
+        PQclear(res);
+    }
+    if (!ok) {
+        fprintf(stderr, "[!] Postgres protocol_stats_delta copy failed: %s\n", PQerrorMessage(pg_conn));
+        PQfinish(pg_conn);
+        pg_conn = NULL;
+        return STATS_DB_QUERY_FAIL;
+    }
+    return STATS_DB_OK;
+}
+
+// Fallback: the same rows as unnest() arrays through a prepared statement
+static int insert_deltas_postgres(const DeltaSpan *span) {
+    if (!delta_prepared) {
+        PGresult *res = PQprepare(pg_conn, "insert_protocol_deltas",
+            "INSERT INTO protocol_stats_delta(bucket_start, interval_ms, protocol, packets) "
+            "SELECT to_timestamp(t / 1e6), i, p, n FROM unnest($1::bigint[], $2::int[], $3::text[], $4::bigint[]) "
+            "AS u(t, i, p, n);", 4, NULL);
+        int ok = res && PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        if (!ok) {
+            fprintf(stderr, "[!] Postgres prepare failed: %s\n", PQerrorMessage(pg_conn));
+            PQfinish(pg_conn);
+            pg_conn = NULL;
+            return STATS_DB_QUERY_FAIL;
+        }
+        delta_prepared = 1;
+    }
+
+    size_t rows = (size_t)span->n * PROTO_COUNT;
+    char *starts = (char *)malloc(rows * 21 + 3);
+    char *widths = (char *)malloc(rows * 11 + 3);
+    char *protos = (char *)malloc(rows * 9 + 3);
+    char *counts = (char *)malloc(rows * 21 + 3);
+    if (!starts || !widths || !protos || !counts) {
+        free(starts); free(widths); free(protos); free(counts);
+        fprintf(stderr, "[!] Out of memory building delta rows\n");
+        return STATS_DB_QUERY_FAIL;
+    }
+    size_t sp = 0, wp = 0, pp = 0, cp = 0;
+    starts[sp++] = widths[wp++] = protos[pp++] = counts[cp++] = '{';
+    for (uint32_t i = 0; i < span->n; i++) {
+        const DeltaBucket *b = DELTA_AT(span, i);
+        for (int proto = 0; proto < PROTO_COUNT; proto++) {
+            const char *sep = (i || proto) ? "," : "";
+            sp += (size_t)sprintf(starts + sp, "%s%llu", sep, (unsigned long long)b->start_us);
+            wp += (size_t)sprintf(widths + wp, "%s%u", sep, b->interval_ms);
+            pp += (size_t)sprintf(protos + pp, "%s%s", sep, proto_names[proto]);
+            cp += (size_t)sprintf(counts + cp, "%s%llu", sep, (unsigned long long)b->packets[proto]);
+        }
+    }
+    strcpy(starts + sp, "}");
+    strcpy(widths + wp, "}");
+    strcpy(protos + pp, "}");
+    strcpy(counts + cp, "}");
+
+    const char *params[4] = { starts, widths, protos, counts };
+    PGresult *res = PQexecPrepared(pg_conn, "insert_protocol_deltas", 4, params, NULL, NULL, 0);
+    free(starts); free(widths); free(protos); free(counts);
+    if (res == NULL || PQresultStatus(res) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "[!] Postgres protocol_stats_delta insert failed: %s\n", PQerrorMessage(pg_conn));
+        PQclear(res);
+        PQfinish(pg_conn);
+        pg_conn = NULL;
+        return STATS_DB_QUERY_FAIL;
+    }
+    PQclear(res);
+    return STATS_DB_OK;
+}
+
+static int write_deltas_postgres(const DeltaSpan *span) {
+    if (!delta_db_enabled || span->n == 0) return STATS_DB_OK;
+    int rc = delta_copy_enabled ? copy_deltas_postgres(span) : STATS_DB_FALLBACK;
+    if (rc == STATS_DB_FALLBACK) rc = insert_deltas_postgres(span);
+    return rc;
+}
+
+// ---------------------------
+// Rate Windows
+// ---------------------------
+// Close the current one-second bucket (overwriting the oldest once the
+// window is full) and work out the rates readers see until the next one
+static void stats_sample_rates(const StatsSnapshot *snap) {
+    const uint64_t *sum[3] = { snap->since_start.counters, snap->since_start.wire_bytes,
+                               snap->since_start.cap_bytes };
+    uint64_t now_us = snap->taken_us;
+    if (now_us <= rate_last_us) return;
+
+    RateBucket *b = &rate_ring[rate_next];
+    b->start_us = rate_last_us;
+    b->interval_ms = (uint32_t)((now_us - rate_last_us + 500) / 1000);
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        b->packets[p] = sum[0][p] - rate_last[0][p];
+        b->wire_bytes[p] = sum[1][p] - rate_last[1][p];
+        b->cap_bytes[p] = sum[2][p] - rate_last[2][p];
+        for (int k = 0; k < 3; k++) rate_last[k][p] = sum[k][p];
+    }
+    rate_last_us = now_us;
+    rate_next = (rate_next + 1) % STATS_RATE_WINDOW_S;
+    if (rate_len < STATS_RATE_WINDOW_S) rate_len++;
+
+    static StatsRates r;
+    memset(&r, 0, sizeof(r));
+    r.updated_us = now_us;
+    r.buckets = rate_len;
+    double per_s = b->interval_ms ? 1000.0 / (double)b->interval_ms : 0.0;
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        r.proto[p].pps = (double)b->packets[p] * per_s;
+        r.proto[p].bps = (double)b->wire_bytes[p] * 8.0 * per_s;
+        r.proto[p].cap_bps = (double)b->cap_bytes[p] * 8.0 * per_s;
+    }
+    for (uint32_t i = 0; i < rate_len; i++) {
+        const RateBucket *w = &rate_ring[i];
+        if (w->interval_ms < RATE_MIN_BUCKET_MS) continue;
+        double scale = 1000.0 / (double)w->interval_ms;
+        for (int p = 0; p < PROTO_COUNT; p++) {
+            ProtoRate *pr = &r.proto[p];
+            double pps = (double)w->packets[p] * scale;
+            double bps = (double)w->wire_bytes[p] * 8.0 * scale;
+            if (pps > pr->peak_pps) {
+                pr->peak_pps = pps;
+                pr->peak_pps_us = w->start_us;
+            }
+            if (bps > pr->peak_bps) {
+                pr->peak_bps = bps;
+                pr->peak_bps_us = w->start_us;
+            }
+        }
+    }
+
+    mutex_lock(&rate_lock);
+    rates_current = r;
+    mutex_unlock(&rate_lock);
+}
+
+void stats_rates(StatsRates *out) {
+    mutex_lock(&rate_lock);
+    *out = rates_current;
+    mutex_unlock(&rate_lock);
+}
+
+// ---------------------------
+// Spool and Replay
+// ---------------------------
+// Move the rows of a failed flush to the spool: the protocol_stats row (if
+// any) and every buffered bucket. Without a spool the buckets stay in memory.
+static void spool_rows(const SpoolProtocolRow *row) {
+    if (!spool) return;
+    if (row) spool_append(spool, SPOOL_PROTOCOL_ROW, row, sizeof(*row));
+    if (delta_db_enabled) {
+        for (uint32_t i = 0; i < delta_len; i++) {
+            spool_append(spool, SPOOL_DELTA_BUCKET, &delta_ring[(delta_head + i) % DELTA_MAX_BUCKETS],
+                         sizeof(DeltaBucket));
+        }
+    }
+    delta_head = 0;
+    delta_len = 0;
+    spool_sync(spool);
+}
+
+// Spooled protocol_stats rows with their original timestamps, one statement
+static int insert_protocol_rows(const SpoolProtocolRow *rows, size_t n) {
+    if (n == 0) return STATS_DB_OK;
+    enum { NCOLS = 13 };         // Timestamp and the 12 ProtocolStats counters
+    char *arrays[NCOLS];
+    size_t pos[NCOLS];
+    int ok = 1;
+    for (int c = 0; c < NCOLS; c++) {
+        arrays[c] = (char *)malloc(n * 21 + 3);
+        if (!arrays[c]) ok = 0;
+        pos[c] = 0;
+    }
+    for (size_t i = 0; i < n && ok; i++) {
+        uint64_t vals[NCOLS];
+        vals[0] = rows[i].ts_us;
+        memcpy(&vals[1], &rows[i].stats, sizeof(rows[i].stats));
+        for (int c = 0; c < NCOLS; c++) {
+            pos[c] += (size_t)sprintf(arrays[c] + pos[c], "%s%llu", i ? "," : "{", (unsigned long long)vals[c]);
+        }
+    }
+    int rc = STATS_DB_OK;
+    if (ok) {
+        for (int c = 0; c < NCOLS; c++) strcpy(arrays[c] + pos[c], "}");
+        PGresult *res = PQexecParams(pg_conn,
+            "INSERT INTO protocol_stats(timestamp, total_packets, ethernet, ipv4, ipv6, tcp, udp, icmp, arp, dns, http, https, dhcp) "
+            "SELECT to_timestamp(t / 1e6), c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12 "
+            "FROM unnest($1::bigint[], $2::bigint[], $3::bigint[], $4::bigint[], $5::bigint[], $6::bigint[], $7::bigint[], "
+            "$8::bigint[], $9::bigint[], $10::bigint[], $11::bigint[], $12::bigint[], $13::bigint[]) "
+            "AS u(t, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12);",
+            NCOLS, NULL, (const char *const *)arrays, NULL, NULL, 0);
+        if (res == NULL || PQresultStatus(res) != PGRES_COMMAND_OK) {
+            fprintf(stderr, "[!] Postgres spool replay insert failed: %s\n", PQerrorMessage(pg_conn));
+            PQfinish(pg_conn);
+            pg_conn = NULL;
+            rc = STATS_DB_QUERY_FAIL;
+        }
+        PQclear(res);
+    } else {
+        fprintf(stderr, "[!] Out of memory building spooled rows\n");
+        rc = STATS_DB_QUERY_FAIL;
+    }
+    for (int c = 0; c < NCOLS; c++) free(arrays[c]);
+    return rc;
+}
+
+// Send everything in the spool, SPOOL_REPLAY_BATCH records per statement.
+// A batch is committed (removed from the spool) once written, so a failure
+// resumes at the batch that failed; rows are written at least once.
+static int replay_spool(void) {
+    SpoolStats ss;
+    if (!spool) return STATS_DB_OK;
+    spool_get_stats(spool, &ss);
+    if (ss.records == 0) return STATS_DB_OK;
+
+    static SpoolProtocolRow rows[SPOOL_REPLAY_BATCH];
+    static DeltaBucket buckets[SPOOL_REPLAY_BATCH];
+    unsigned char rec[SPOOL_MAX_RECORD];
+    uint64_t start_ns = platform_now_ns();
+    uint64_t replayed = 0;
+    int rc = STATS_DB_OK;
+    for (;;) {
+        size_t nrows = 0;
+        uint32_t nbuckets = 0;
+        uint16_t type;
+        uint32_t len;
+        while (nrows < SPOOL_REPLAY_BATCH && nbuckets < SPOOL_REPLAY_BATCH &&
+               spool_next(spool, &type, rec, &len)) {
+            if (type == SPOOL_PROTOCOL_ROW && len == sizeof(SpoolProtocolRow)) {
+                memcpy(&rows[nrows++], rec, len);
+            } else if (type == SPOOL_DELTA_BUCKET && len == sizeof(DeltaBucket)) {
+                memcpy(&buckets[nbuckets++], rec, len);
+            }
+            replayed++;
+        }
+        if (nrows == 0 && nbuckets == 0) {
+            spool_commit(spool);     // Only unknown records (or none) were left
+            break;
+        }
+        DeltaSpan span = { buckets, SPOOL_REPLAY_BATCH, 0, nbuckets };
+        rc = insert_protocol_rows(rows, nrows);
+        if (rc == STATS_DB_OK) rc = write_deltas_postgres(&span);
+        if (rc != STATS_DB_OK) {
+            spool_rewind(spool);
+            replayed -= nrows + nbuckets;
+            break;
+        }
+        spool_commit(spool);
+    }
+
+    double secs = (double)(platform_now_ns() - start_ns) / 1e9;
+    db_status.replayed += replayed;
+    if (replayed && secs > 0) db_status.replay_records_per_s = (double)replayed / secs;
+    if (replayed) {
+        printf("[+] Replayed %llu spooled records in %.1f ms (%.0f records/s)%s\n",
+               (unsigned long long)replayed, secs * 1000.0, db_status.replay_records_per_s,
+               rc == STATS_DB_OK ? "" : "; the rest waits for the next connection");
+    }
+    return rc;
+}
+
+static void spool_report(void) {
+    SpoolStats ss;
+    spool_get_stats(spool, &ss);
+    if (ss.records) {
+        printf("[!] %llu records (%.1f KB) left in %s; replayed on the next connection\n",
+               (unsigned long long)ss.records, (double)ss.bytes / 1024.0, spool_path);
+    }
+    if (ss.dropped) {
+        printf("[!] Spool full: %llu records dropped (STATS_SPOOL_MAX_MB)\n", (unsigned long long)ss.dropped);
+    }
+}
+
+void stats_db_status(StatsDbStatus *out) {
+    *out = db_status;
+    out->enabled = db_enabled;
+    out->connected = pg_conn != NULL;
+    if (spool) {
+        SpoolStats ss;
+        spool_get_stats(spool, &ss);
+        out->spool_bytes = ss.bytes;
+        out->spool_records = ss.records;
+        out->spool_max_bytes = ss.max_bytes;
+        out->spooled = ss.appended;
+        out->spool_dropped = ss.dropped;
+        out->spool_corrupt = ss.corrupt;
+    }
+}
+
+// ---------------------------
+// Metrics
+// ---------------------------
+void stats_collect_metrics(MetricsBuf *mb, void *arg) {
+    (void)arg;
+    static StatsSnapshot snap;       // Metrics thread only
+    char labels[64];
+    stats_take_snapshot(&snap);
+
+    metrics_family(mb, "sniffer_protocol_packets_total", "counter", "Packets counted per protocol layer since startup");
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        snprintf(labels, sizeof(labels), "protocol=\"%s\"", proto_names[p]);
+        metrics_sample_u64(mb, "sniffer_protocol_packets_total", labels, snap.since_start.counters[p]);
     }
+    metrics_family(mb, "sniffer_protocol_bytes_total", "counter",
+                   "Bytes of the packets counted per protocol layer since startup (wire or captured length)");
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",length=\"wire\"", proto_names[p]);
+        metrics_sample_u64(mb, "sniffer_protocol_bytes_total", labels, snap.since_start.wire_bytes[p]);
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",length=\"captured\"", proto_names[p]);
+        metrics_sample_u64(mb, "sniffer_protocol_bytes_total", labels, snap.since_start.cap_bytes[p]);
+    }
+    metrics_family(mb, "sniffer_parse_problems_total", "counter",
+                   "Packets per protocol layer whose headers were cut short by the capture or invalid");
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",problem=\"truncated\"", proto_names[p]);
+        metrics_sample_u64(mb, "sniffer_parse_problems_total", labels, snap.since_start.truncated[p]);
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",problem=\"malformed\"", proto_names[p]);
+        metrics_sample_u64(mb, "sniffer_parse_problems_total", labels, snap.since_start.malformed[p]);
+    }
+
+    // Per-second rates: the last second, and the busiest one in the window
+    // (catches bursts shorter than the scrape interval)
+    StatsRates rates;
+    stats_rates(&rates);
+    metrics_family(mb, "sniffer_protocol_packets_per_second", "gauge",
+                   "Packets per second per protocol layer: last second and peak second of the rate window");
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",second=\"last\"", proto_names[p]);
+        metrics_sample(mb, "sniffer_protocol_packets_per_second", labels, rates.proto[p].pps);
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",second=\"peak\"", proto_names[p]);
+        metrics_sample(mb, "sniffer_protocol_packets_per_second", labels, rates.proto[p].peak_pps);
+    }
+    metrics_family(mb, "sniffer_protocol_bits_per_second", "gauge",
+                   "Wire bits per second per protocol layer: last second and peak second of the rate window");
+    for (int p = 0; p < PROTO_COUNT; p++) {
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",second=\"last\"", proto_names[p]);
+        metrics_sample(mb, "sniffer_protocol_bits_per_second", labels, rates.proto[p].bps);
+        snprintf(labels, sizeof(labels), "protocol=\"%s\",second=\"peak\"", proto_names[p]);
+        metrics_sample(mb, "sniffer_protocol_bits_per_second", labels, rates.proto[p].peak_bps);
+    }
+    metrics_family(mb, "sniffer_rate_window_seconds", "gauge", "One-second buckets in the rate window");
+    metrics_sample_u64(mb, "sniffer_rate_window_seconds", NULL, rates.buckets);
+
+    metrics_family(mb, "sniffer_http_responses_total", "counter", "HTTP responses by status code (0 = invalid)");
+    for (int c = 0; c < STATS_HTTP_STATUS_MAX; c++) {
+        if (!snap.since_start.http_status[c]) continue;
+        snprintf(labels, sizeof(labels), "code=\"%d\"", c);
+        metrics_sample_u64(mb, "sniffer_http_responses_total", labels, snap.since_start.http_status[c]);
+    }
+
+    metrics_family(mb, "sniffer_capture_latency_seconds", "histogram",
+                   "Live packets: capture timestamp to dequeue by a worker, and to the end of analysis");
+    for (int l = 0; l < STATS_LATENCY_COUNT; l++) {
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", latency_names[l]);
+        metrics_histogram(mb, "sniffer_capture_latency_seconds", labels, &snap.latency[l], 1e-6);
+    }
+
+    metrics_family(mb, "sniffer_interval_distinct", "gauge",
+                   "Distinct keys in the last flush interval (HyperLogLog estimate)");
+    for (int d = 0; d < STATS_DISTINCT_COUNT; d++) {
+        snprintf(labels, sizeof(labels), "dimension=\"%s\"", distinct_names[d]);
+        metrics_sample_u64(mb, "sniffer_interval_distinct", labels, distinct_estimate[d]);
+    }
+
+    StatsDbStatus db;
+    stats_db_status(&db);
+    metrics_family(mb, "sniffer_db_enabled", "gauge", "Postgres writer configured");
+    metrics_sample_u64(mb, "sniffer_db_enabled", NULL, (uint64_t)db.enabled);
+    metrics_family(mb, "sniffer_db_connected", "gauge", "Postgres connection up");
+    metrics_sample_u64(mb, "sniffer_db_connected", NULL, (uint64_t)db.connected);
+    metrics_family(mb, "sniffer_db_flushes_total", "counter", "Periodic Postgres flushes by outcome");
+    metrics_sample_u64(mb, "sniffer_db_flushes_total", "result=\"ok\"", db.flushes);
+    metrics_sample_u64(mb, "sniffer_db_flushes_total", "result=\"failed\"", db.flush_failures);
+    metrics_family(mb, "sniffer_db_last_flush_timestamp_seconds", "gauge", "Last successful Postgres flush (Unix time, 0 = none)");
+    metrics_sample(mb, "sniffer_db_last_flush_timestamp_seconds", NULL, (double)db.last_flush_us / 1e6);
+    metrics_family(mb, "sniffer_db_reconnect_attempts_total", "counter", "Background reconnect attempts");
+    metrics_sample_u64(mb, "sniffer_db_reconnect_attempts_total", NULL, db.reconnect_attempts);
+    metrics_family(mb, "sniffer_db_spool_bytes", "gauge", "Rows waiting in the spool file");
+    metrics_sample_u64(mb, "sniffer_db_spool_bytes", NULL, db.spool_bytes);
+    metrics_family(mb, "sniffer_db_spool_records", "gauge", "Records waiting in the spool file");
+    metrics_sample_u64(mb, "sniffer_db_spool_records", NULL, db.spool_records);
+    metrics_family(mb, "sniffer_db_spool_records_total", "counter", "Spool records by fate");
+    metrics_sample_u64(mb, "sniffer_db_spool_records_total", "fate=\"spooled\"", db.spooled);
+    metrics_sample_u64(mb, "sniffer_db_spool_records_total", "fate=\"replayed\"", db.replayed);
+    metrics_sample_u64(mb, "sniffer_db_spool_records_total", "fate=\"dropped\"", db.spool_dropped);
+    metrics_sample_u64(mb, "sniffer_db_spool_records_total", "fate=\"corrupt\"", db.spool_corrupt);
+}
+
+// The live cumulative row (timestamp from the column default)
+static int insert_protocol_row(const ProtocolStats *s) {
+    ProtocolStats stats = *s;
 
     // Prepare parameter strings
     char buf_total[32], buf_eth[32], buf_ipv4[32], buf_ipv6[32], buf_tcp[32], buf_udp[32],
@@ -380,24 +1964,91 @@ int stats_save_postgres(const char *conninfo) {
     return STATS_DB_OK;
 }
 
+// Save stats to Postgres using persistent connection. While it is down
+// (the batch thread reconnects in the background) the protocol_stats row
+// and the delta buckets go to the spool; the name and status tables hold
+// totals since startup, so the next successful flush catches them up.
+int stats_save_postgres(const char *conninfo, const StatsSnapshot *snap) {
+    (void)conninfo; // ignored, using persistent pg_conn
+
+    // Skip if database is disabled
+    if (!db_enabled) {
+        return STATS_DB_OK;
+    }
+
+    SpoolProtocolRow row;
+    row.ts_us = snap->taken_us;
+    row.stats = snap->totals;
+    if (!pg_connected()) {
+        spool_rows(&row);
+        return STATS_DB_CONN_FAIL;
+    }
+
+    // Older rows first, then this flush
+    int rc = replay_spool();
+    if (rc == STATS_DB_OK) rc = insert_protocol_row(&row.stats);
+    if (rc != STATS_DB_OK) {
+        spool_rows(&row);
+        return rc;
+    }
+    DeltaSpan span = { delta_ring, DELTA_MAX_BUCKETS, delta_head, delta_len };
+    rc = write_deltas_postgres(&span);
+    if (rc != STATS_DB_OK) {
+        spool_rows(NULL);        // The protocol row is in; keep the buckets
+        return rc;
+    }
+    delta_head = 0;
+    delta_len = 0;
+
+    rc = save_http_status_postgres(snap);
+    if (rc == STATS_DB_OK) rc = save_latency_postgres(snap);
+    if (rc == STATS_DB_OK) rc = save_heavy_postgres();
+    if (rc == STATS_DB_OK) rc = save_distinct_postgres();
+    if (rc == STATS_DB_OK) rc = save_overload_postgres();
+    for (int set = 0; set < STATS_NAMES_COUNT && rc == STATS_DB_OK; set++) {
+        rc = save_names_postgres((stats_names_t)set);
+    }
+    return rc;
+}
+
 // Batch thread for periodic flush using event-based shutdown
-static DWORD WINAPI stats_batch_thread(LPVOID lpParam) {
-    (void)lpParam;
-    
+static thread_ret_t THREAD_CALL stats_batch_thread(void *param) {
+    (void)param;
+    static StatsSnapshot snap;
+
+    uint64_t next_flush_us = platform_wall_us() + (uint64_t)BATCH_INTERVAL_MS * 1000;
     while (1) {
-        // Wait for shutdown event or timeout
-        DWORD wait_result = WaitForSingleObject(shutdown_event, BATCH_INTERVAL_MS);
-        
-        if (wait_result == WAIT_OBJECT_0) {
+        // Wake on the next whole interval so buckets line up with the wall clock
+        uint64_t now_us = platform_wall_us();
+        uint32_t wait_ms = DELTA_INTERVAL_MS - (uint32_t)(now_us / 1000 % DELTA_INTERVAL_MS);
+        if (event_wait(&shutdown_event, wait_ms)) {
             // Shutdown event signaled
             break;
         }
-        
-        // Timeout - perform periodic save
+
+        // One snapshot per tick feeds the deltas, Postgres and stats.json
+        stats_take_snapshot(&snap);
+        now_us = snap.taken_us;
+        stats_sample_rates(&snap);
         if (db_enabled) {
-            stats_save_postgres(postgres_conninfo);
+            stats_sample_deltas(&snap);
+            // Back online: replay the spool now rather than at the next flush
+            if (poll_reconnect(now_us)) next_flush_us = now_us;
+        }
+        if (now_us < next_flush_us) continue;
+        next_flush_us = now_us + (uint64_t)BATCH_INTERVAL_MS * 1000;
+        heavy_rotate(0);
+
+        // Periodic save
+        if (db_enabled) {
+            if (stats_save_postgres(postgres_conninfo, &snap) == STATS_DB_OK) {
+                db_status.flushes++;
+                db_status.last_flush_us = now_us;
+            } else {
+                db_status.flush_failures++;
+            }
         }
-        stats_save_json(JSON_FILE);
+        stats_save_json(JSON_FILE, &snap);
     }
     
     return 0;
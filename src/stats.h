@@ -2,14 +2,34 @@
 #ifndef STATS_H
 #define STATS_H
 
-#include <windows.h>
 #include <stdint.h>  // For fixed-width types like uint32_t
+#include "platform.h"
+#include "metrics.h"
+#include "histogram.h"
+#include "heavy.h"
+#include "hll.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Structure to store protocol-wise statistics
+// Protocol IDs used as counter indices (order matches ProtocolStats below)
+typedef enum {
+    PROTO_ETHERNET = 0,
+    PROTO_IPV4,
+    PROTO_IPV6,
+    PROTO_TCP,
+    PROTO_UDP,
+    PROTO_ICMP,
+    PROTO_ARP,
+    PROTO_DNS,
+    PROTO_HTTP,
+    PROTO_HTTPS,
+    PROTO_DHCP,
+    PROTO_COUNT
+} proto_id_t;
+
+// Aggregated protocol-wise statistics (a snapshot, see stats_snapshot)
 // Using 64-bit counters to prevent overflow on long-running captures
 typedef struct {
     uint64_t total_packets;
@@ -26,22 +46,273 @@ typedef struct {
     uint64_t dhcp;
 } ProtocolStats;
 
-// Global stats object (thread-safe via atomic operations)
-extern ProtocolStats stats;
+#define STATS_NAME_LEN 256          // Longer names (server names, hosts) are cut
+#define STATS_HTTP_STATUS_MAX 600   // Status codes 100-599; anything else counts as 0
+
+// Named counter sets, each merged across shards by stats_top_names
+typedef enum {
+    STATS_NAMES_TLS_SNI = 0,        // TLS connections per server name
+    STATS_NAMES_HTTP_HOST,          // HTTP requests per Host header
+    STATS_NAMES_DNS_QNAME,          // DNS queries per qname
+    STATS_NAMES_DNS_LATENCY,        // Answered DNS queries per qname, total = latency in us (ranked by total)
+    STATS_NAMES_COUNT
+} stats_names_t;
+
+// Capture-to-analysis latency of live packets, measured from the packet's
+// capture timestamp (pcap_pkthdr.ts) in microseconds. Replayed files are
+// not recorded: their timestamps are not "now".
+typedef enum {
+    STATS_LATENCY_CAPTURE_TO_DEQUEUE = 0,   // Until a worker took it off its queue
+    STATS_LATENCY_CAPTURE_TO_ANALYZED,      // Until analyze_packet returned
+    STATS_LATENCY_COUNT
+} stats_latency_t;
+
+// Heavy-hitter dimensions: per-interval top talkers from constant-memory
+// sketches (heavy.h), one per dimension in every counting thread's shard
+typedef enum {
+    STATS_HEAVY_SRC_IP = 0,
+    STATS_HEAVY_DST_IP,
+    STATS_HEAVY_DST_PORT,           // Transport protocol and port of whole datagrams
+    STATS_HEAVY_IP_PAIR,            // Source -> destination
+    STATS_HEAVY_COUNT
+} stats_heavy_t;
+
+// Distinct keys per interval (HyperLogLog, hll.h), kept next to the
+// heavy-hitter sketches and fed from the same key hashes
+typedef enum {
+    STATS_DISTINCT_SRC_IPS = 0,
+    STATS_DISTINCT_DST_IPS,
+    STATS_DISTINCT_DST_PORTS,       // Transport protocol and port
+    STATS_DISTINCT_FLOWS,           // TCP/UDP 5-tuples, both directions as one
+    STATS_DISTINCT_COUNT
+} stats_distinct_t;
+
+// Counters copied out of a shard, consistent at a packet boundary
+typedef struct {
+    uint64_t counters[PROTO_COUNT];
+    uint64_t wire_bytes[PROTO_COUNT];        // header->len of the packets counted per layer
+    uint64_t cap_bytes[PROTO_COUNT];         // header->caplen of the same packets
+    uint64_t http_status[STATS_HTTP_STATUS_MAX];
+    uint64_t truncated[PROTO_COUNT];         // Headers or lengths cut short by the capture (snaplen)
+    uint64_t malformed[PROTO_COUNT];         // Header fields no valid packet carries
+} StatsCounters;
+
+// Per-thread counter block. Each counting thread owns one shard on its own
+// cache lines and increments it without atomics; readers sum all shards.
+// seq is odd while the owner is inside a packet (stats_packet_begin/end),
+// so a reader that sees the same even value before and after copying has
+// every packet either fully counted or not at all. A reader that keeps
+// losing that race to a busy owner bumps snap_req instead, and the owner
+// copies its own counters into snap at its next packet end.
+typedef struct {
+    CACHE_ALIGNED volatile uint64_t counters[PROTO_COUNT];
+    volatile uint64_t wire_bytes[PROTO_COUNT];
+    volatile uint64_t cap_bytes[PROTO_COUNT];
+    uint32_t pkt_weight;             // Current packet, set by stats_packet_begin (owner only)
+    uint32_t pkt_wire_len;           // Lengths times the weight
+    uint32_t pkt_cap_len;
+    volatile uint64_t seq;
+    volatile uint64_t snap_req;      // Written by the reader
+    volatile uint64_t snap_ack;      // Written by the owner once snap holds request snap_req
+    volatile uint64_t heavy_req;     // Written by the reader: retire the sketches in use
+    volatile uint64_t heavy_ack;     // Written by the owner once it has switched to the other set
+    struct HeavyShard *volatile heavy;   // Allocated on the thread's first use
+    struct NameTable *volatile names[STATS_NAMES_COUNT];   // Allocated on the thread's first use
+    volatile uint64_t http_status[STATS_HTTP_STATUS_MAX];  // HTTP responses by status code
+    volatile uint64_t truncated[PROTO_COUNT];  // Parse problems by layer, counted instead of printed
+    volatile uint64_t malformed[PROTO_COUNT];
+    StatsCounters snap;
+    LatencyHist latency[STATS_LATENCY_COUNT];   // Owner records; readers merge a racy copy
+} StatsShard;
+
+// A coherent copy of every counter, taken once and handed to every sink
+// (stats.json, Postgres, per-second deltas, the exit report)
+typedef struct {
+    uint64_t taken_us;               // Wall clock
+    ProtocolStats totals;            // Baseline from stats.json plus everything counted since startup
+    StatsCounters since_start;       // Counted by this run only
+    LatencyHist latency[STATS_LATENCY_COUNT];   // Since startup (outside the seqlock)
+} StatsSnapshot;
+
+// One name, its count and (sets fed by stats_add_name) its value total
+typedef struct {
+    char name[STATS_NAME_LEN];
+    uint64_t count;
+    uint64_t total;
+} NameCount;
+
+// Current thread's shard (NULL until the thread first counts something)
+extern THREAD_LOCAL StatsShard *stats_tls_shard;
 
 // Initialization and cleanup
 void stats_init(const char *conninfo);   // <-- make sure it takes conninfo
 void stats_cleanup(void);
 
-// Increment stats (thread-safe)
-void stats_increment(const char *proto);
+// Claim a shard for the calling thread (done lazily by stats_increment)
+StatsShard *stats_register_thread(void);
+
+// Bracket the counting for one packet (analyze_packet): two plain stores
+// to the thread's own shard, plus loads to see if a reader is waiting.
+// Every layer counted in between is also charged the packet's wire and
+// captured lengths. weight is the number of packets this one stands for
+// (1, or the overload sample rate); counters, bytes and heavy hitters are
+// scaled by it.
+void stats_shard_publish(StatsShard *shard);
+
+static inline void stats_packet_begin(uint32_t wire_len, uint32_t cap_len, uint32_t weight) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    shard->pkt_weight = weight;
+    shard->pkt_wire_len = wire_len * weight;
+    shard->pkt_cap_len = cap_len * weight;
+    shard->seq++;
+    fence_release();
+}
+
+static inline void stats_packet_end(void) {
+    StatsShard *shard = stats_tls_shard;
+    fence_release();
+    shard->seq++;
+    if (shard->snap_req != shard->snap_ack || shard->heavy_req != shard->heavy_ack) stats_shard_publish(shard);
+}
+
+// A counting thread with nothing to parse (queue poll timeout): answer a
+// waiting reader, as stats_packet_end would
+void stats_thread_idle(void);
+
+// Count one protocol layer and the current packet's bytes: a TLS load
+// and three adds
+static inline void stats_increment(proto_id_t proto) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    shard->counters[proto] += shard->pkt_weight;
+    shard->wire_bytes[proto] += shard->pkt_wire_len;
+    shard->cap_bytes[proto] += shard->pkt_cap_len;
+}
+
+// Count one occurrence of name (a TLS server name, an HTTP host) in the
+// calling thread's shard. Non-printable bytes, quotes and backslashes are
+// stored as '?', so names can be written to JSON and SQL arrays as is.
+void stats_count_name(stats_names_t set, const char *name);
+
+// Count one occurrence of name and add value to its total (the time
+// spent waiting on a qname, ...)
+void stats_add_name(stats_names_t set, const char *name, uint64_t value);
+
+// Merge every shard's names of one set and return up to max of the
+// busiest, highest count first (highest total for STATS_NAMES_DNS_LATENCY). *other receives the count not covered by
+// the returned names (including names a full shard could not store).
+// Counts are since startup; they are not reloaded from stats.json.
+size_t stats_top_names(stats_names_t set, NameCount *out, size_t max, uint64_t *other);
 
-// Save/load stats to/from JSON file (thread-safe)
-int stats_save_json(const char *filename);
+// Feed the interval sketches (heavy hitters, distinct counts) with one
+// packet: its source, destination and pair (IP layer, fragments
+// included), and its ports (TCP/UDP, whole datagrams). src and dst point
+// to 4 or 16 bytes. Each key is hashed once, when the batch is applied.
+void stats_heavy_addrs(uint8_t family, const unsigned char *src, const unsigned char *dst);
+void stats_heavy_ports(uint8_t proto, uint16_t src_port, uint16_t dst_port);
+
+// Count one HTTP response
+static inline void stats_count_http_status(uint16_t status) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    shard->http_status[status < STATS_HTTP_STATUS_MAX && status >= 100 ? status : 0]++;
+}
+
+// Count a packet whose headers at this layer were cut short by the
+// capture (truncated) or could not be valid (malformed). Parsers count
+// these instead of printing them; the detail is DEBUG output only.
+static inline void stats_count_truncated(proto_id_t proto) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    shard->truncated[proto] += shard->pkt_weight;
+}
+
+static inline void stats_count_malformed(proto_id_t proto) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    shard->malformed[proto] += shard->pkt_weight;
+}
+
+// Record one live packet's capture-to-stage latency in microseconds
+static inline void stats_record_latency(stats_latency_t stage, uint64_t us) {
+    StatsShard *shard = stats_tls_shard;
+    if (!shard) shard = stats_register_thread();
+    hist_record(&shard->latency[stage], us);
+}
+
+const char *stats_latency_name(stats_latency_t stage);
+
+// Point-in-time copy of every shard's counters without pausing the
+// counting threads. total_packets counts every layer hit, as it always has.
+// Named counters are not included (see stats_top_names).
+void stats_take_snapshot(StatsSnapshot *out);
+
+#define STATS_RATE_WINDOW_S 300     // One-second rate buckets kept (5 minutes)
+
+// Rates of one protocol from the per-second buckets: the last complete
+// second, and the busiest second still in the window
+typedef struct {
+    double pps;
+    double bps;                      // Wire bits per second
+    double cap_bps;                  // Captured bits per second
+    double peak_pps;
+    double peak_bps;
+    uint64_t peak_pps_us;            // Start of the peak buckets (wall clock, 0 = none)
+    uint64_t peak_bps_us;
+} ProtoRate;
+
+typedef struct {
+    uint64_t updated_us;             // End of the last bucket (0 until the first one closes)
+    uint32_t buckets;                // Buckets in the window, up to STATS_RATE_WINDOW_S
+    ProtoRate proto[PROTO_COUNT];
+} StatsRates;
+
+// Rates as of the last closed bucket. The batch thread closes one per
+// second and works the figures out then, so this is a locked copy.
+void stats_rates(StatsRates *out);
+
+const char *stats_proto_name(proto_id_t proto);
+
+// Save/load stats to/from JSON file
+int stats_save_json(const char *filename, const StatsSnapshot *snap);
 int stats_load_json(const char *filename);
 
-// Save stats to PostgreSQL (thread-safe)
-int stats_save_postgres(const char *conninfo);
+// Save stats to PostgreSQL (batch thread, or stats_cleanup once it has stopped)
+int stats_save_postgres(const char *conninfo, const StatsSnapshot *snap);
+
+#define STATS_SPOOL_DEFAULT_FILE "stats_spool.bin"
+#define STATS_SPOOL_DEFAULT_MB   64
+
+// Where rows wait while Postgres is unreachable ("none" = nowhere) and the
+// file's size cap (0 = default). Call before stats_init.
+void stats_configure_spool(const char *path, unsigned max_mb);
+
+// Postgres writer health: connection, background reconnects and the spool
+typedef struct {
+    int enabled;                     // Postgres configured
+    int connected;
+    uint64_t reconnect_attempts;
+    uint64_t flushes;                // Periodic flushes that reached Postgres
+    uint64_t flush_failures;         // Periodic flushes that went to the spool (or failed) instead
+    uint64_t last_flush_us;          // Wall clock of the last successful flush, 0 = none yet
+    uint64_t spool_bytes;            // Spool depth
+    uint64_t spool_records;
+    uint64_t spool_max_bytes;
+    uint64_t spooled;                // Records written to the spool since startup
+    uint64_t spool_dropped;          // Records lost to a full spool
+    uint64_t spool_corrupt;          // Damaged records discarded
+    uint64_t replayed;               // Records replayed to Postgres since startup
+    double replay_records_per_s;     // Throughput of the last replay
+} StatsDbStatus;
+
+// Read by the batch thread's own writers; other threads get a racy but
+// harmless view
+void stats_db_status(StatsDbStatus *out);
+
+// Metrics collector (metrics_register): protocol counters, HTTP status
+// codes and Postgres writer health from a fresh snapshot
+void stats_collect_metrics(MetricsBuf *mb, void *arg);
 
 #ifdef __cplusplus
 }
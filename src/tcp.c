@@ -1,26 +1,30 @@
 #include "tcp.h"
-#include "http.h"
-#include "https.h"
+#include "dissect.h"
 #include "stats.h"
+#include "analyzer.h"
+#include "logger.h"
+#include "tracelog.h"
 #include <stdio.h>
-#include <winsock2.h>
+#include <string.h>
+#include "platform.h"
 
-static void print_flags(u_char f) {
-    printf(" [");
-    if (f & 0x80) printf("CWR ");
-    if (f & 0x40) printf("ECE ");
-    if (f & 0x20) printf("URG ");
-    if (f & 0x10) printf("ACK ");
-    if (f & 0x08) printf("PSH ");
-    if (f & 0x04) printf("RST ");
-    if (f & 0x02) printf("SYN ");
-    if (f & 0x01) printf("FIN ");
-    printf("]");
+// Render flags as "CWR ECE ... FIN " into buf (at least 33 bytes)
+static void format_flags(u_char f, char *buf) {
+    static const char *names[8] = { "FIN ", "SYN ", "RST ", "PSH ", "ACK ", "URG ", "ECE ", "CWR " };
+    char *p = buf;
+    for (int bit = 7; bit >= 0; bit--) {
+        if (f & (1 << bit)) {
+            memcpy(p, names[bit], 4);
+            p += 4;
+        }
+    }
+    *p = '\0';
 }
 
-void parse_tcp(const u_char *data, int size, const char *src_ip, const char *dst_ip) {
+void parse_tcp(packet_ctx_t *pkt, const u_char *data, int size) {
     if (size < (int)sizeof(tcp_header_t)) {
-        printf("TCP: Truncated header\n");
+        stats_count_truncated(PROTO_TCP);
+        LOG_DEBUG_SIMPLE("TCP: Truncated header\n");
         return;
     }
 
@@ -28,34 +32,37 @@ void parse_tcp(const u_char *data, int size, const char *src_ip, const char *dst
     int hdr_len = ((tcp->data_offset_reserved >> 4) & 0x0F) * 4;
     // Validate header length: minimum 20 bytes, maximum 60 bytes (15 * 4), and must not exceed packet size
     if (hdr_len < 20 || hdr_len > 60 || hdr_len > size) {
-        printf("TCP: Invalid header length %d (size=%d)\n", hdr_len, size);
+        if (hdr_len < 20) stats_count_malformed(PROTO_TCP);
+        else stats_count_truncated(PROTO_TCP);
+        LOG_DEBUG_SIMPLE("TCP: Invalid header length %d (size=%d)\n", hdr_len, size);
         return;
     }
 
     u_short src_port = ntohs(tcp->src_port);
     u_short dst_port = ntohs(tcp->dst_port);
+    pkt->tcp_seq = ntohl(tcp->seq_num);
+    pkt->tcp_flags = tcp->flags;
+    analyzer_track_flow(pkt, src_port, dst_port, tcp->flags);
+    stats_heavy_ports(6, src_port, dst_port);
 
-    printf("TCP: %s:%u -> %s:%u, Seq=%u Ack=%u, Win=%u",
-           src_ip, src_port,
-           dst_ip, dst_port,
-           ntohl(tcp->seq_num), ntohl(tcp->ack_num),
-           ntohs(tcp->window));
-    print_flags(tcp->flags);
-    printf("\n");
+    TRACE(TRACE_TCP, src_port, dst_port, ntohl(tcp->seq_num), ntohl(tcp->ack_num),
+          ntohs(tcp->window), tcp->flags);
+    if (PKT_VERBOSE(pkt)) {
+        char flags[40];
+        format_flags(tcp->flags, flags);
+        LOG_DEBUG_SIMPLE("TCP: %s:%u -> %s:%u, Seq=%u Ack=%u, Win=%u [%s]\n",
+                         pkt->src_ip, src_port,
+                         pkt->dst_ip, dst_port,
+                         ntohl(tcp->seq_num), ntohl(tcp->ack_num),
+                         ntohs(tcp->window), flags);
+    }
 
     // Extract payload
     const u_char *payload = data + hdr_len;
     int payload_size = size - hdr_len;
-    if (payload_size <= 0) return;
 
-    // Application layer checks
-    // Note: HTTP/HTTPS stats are incremented inside their respective parse functions
-    // to avoid double counting
-    if (src_port == 80 || dst_port == 80) {
-        parse_http(payload, payload_size, src_ip, dst_ip, src_port, dst_port);
-    }
-    else if (src_port == 443 || dst_port == 443) {
-        parse_https(payload, payload_size, src_ip, dst_ip, src_port, dst_port);
-    }
-    // Later you can add SMTP, IMAP, POP3, etc.
+    // Application layer: every segment, including the SYN that anchors the
+    // reassembled stream. Dissectors count their own protocol stats.
+    if (pkt->fast) dissect_count(DISSECT_TCP, pkt, payload_size);
+    else dissect_dispatch(DISSECT_TCP, pkt, payload, payload_size);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #define TCP_H
 
 #include <pcap.h>
+#include "packet.h"
 
 #pragma pack(push, 1)
 typedef struct {
@@ -19,6 +20,6 @@ typedef struct {
 #pragma pack(pop)
 
 // API
-void parse_tcp(const u_char *data, int size, const char *src_ip, const char *dst_ip);
+void parse_tcp(packet_ctx_t *pkt, const u_char *data, int size);
 
 #endif // TCP_H
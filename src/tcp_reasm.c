@@ -0,0 +1,203 @@
+// tcp_reasm.c - Per-flow TCP stream reassembly
+#include "tcp_reasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TCP_SYN 0x02
+
+// Sequence comparisons modulo 2^32
+#define SEQ_LT(a, b)  ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) <= 0)
+#define SEQ_GT(a, b)  SEQ_LT(b, a)
+
+struct TcpSegment {
+    TcpSegment *next;
+    uint32_t seq;
+    uint32_t len;
+    u_char data[TCP_REASM_SEG_DATA];
+};
+
+struct TcpReasm {
+    ObjPool buffers;
+    uint32_t max_buffered;
+    TcpReasmStats stats;
+};
+
+TcpReasm *tcp_reasm_create(uint32_t max_buffers, uint32_t max_buffered_per_dir) {
+    TcpReasm *r = (TcpReasm *)calloc(1, sizeof(TcpReasm));
+    if (!r) return NULL;
+    if (pool_init(&r->buffers, sizeof(TcpSegment), max_buffers) != 0) {
+        free(r);
+        return NULL;
+    }
+    r->max_buffered = max_buffered_per_dir ? max_buffered_per_dir : TCP_REASM_MAX_BUFFERED;
+    r->stats.buffers_capacity = max_buffers;
+    r->stats.memory_bytes = (uint64_t)r->buffers.obj_size * max_buffers;
+    return r;
+}
+
+void tcp_reasm_destroy(TcpReasm *r) {
+    if (!r) return;
+    pool_destroy(&r->buffers);
+    free(r);
+}
+
+// ---------------------------
+// Delivery
+// ---------------------------
+static void emit(TcpReasm *r, TcpHalfStream *hs, const u_char *data, uint32_t len,
+                 tcp_deliver_fn deliver, void *user) {
+    hs->next_seq += len;
+    r->stats.delivered_bytes += len;
+    deliver(user, data, len);
+}
+
+// Skip ahead to seq without the bytes in between
+static void emit_gap(TcpReasm *r, TcpHalfStream *hs, uint32_t seq,
+                     tcp_deliver_fn deliver, void *user) {
+    uint32_t gap = seq - hs->next_seq;
+    hs->next_seq = seq;
+    r->stats.gaps++;
+    r->stats.gap_bytes += gap;
+    deliver(user, NULL, gap);
+}
+
+// Deliver held data that the stream has caught up with
+static void drain(TcpReasm *r, TcpHalfStream *hs, tcp_deliver_fn deliver, void *user) {
+    while (hs->ooo && SEQ_LEQ(hs->ooo->seq, hs->next_seq)) {
+        TcpSegment *seg = hs->ooo;
+        hs->ooo = seg->next;
+        hs->buffered -= seg->len;
+        uint32_t end = seg->seq + seg->len;
+        if (SEQ_GT(end, hs->next_seq)) {
+            uint32_t off = hs->next_seq - seg->seq;
+            emit(r, hs, seg->data + off, seg->len - off, deliver, user);
+        }
+        pool_free(&r->buffers, seg);
+    }
+}
+
+static void release_half(TcpReasm *r, TcpHalfStream *hs) {
+    while (hs->ooo) {
+        TcpSegment *seg = hs->ooo;
+        hs->ooo = seg->next;
+        pool_free(&r->buffers, seg);
+    }
+    hs->buffered = 0;
+}
+
+// ---------------------------
+// Out-of-Order Buffering
+// ---------------------------
+// Copy [*seq, *seq + *len) into the hold list around what is already there
+// (held bytes win). Advances the cursor past everything consumed; returns
+// -1 if the pool ran dry with data left over.
+static int hold(TcpReasm *r, TcpHalfStream *hs, uint32_t *seq, const u_char **data, uint32_t *len) {
+    TcpSegment **link = &hs->ooo;
+    while (*len > 0) {
+        TcpSegment *cur = *link;
+        if (cur && SEQ_LEQ(cur->seq + cur->len, *seq)) {
+            link = &cur->next;
+            continue;
+        }
+        if (cur && SEQ_LEQ(cur->seq, *seq)) {
+            uint32_t dup = cur->seq + cur->len - *seq;
+            if (dup > *len) dup = *len;
+            r->stats.overlap_bytes += dup;
+            *seq += dup;
+            *data += dup;
+            *len -= dup;
+            link = &cur->next;
+            continue;
+        }
+
+        // Fill the space before cur (or the tail)
+        uint32_t take = *len;
+        if (cur && SEQ_LT(cur->seq, *seq + take)) take = cur->seq - *seq;
+        if (take > TCP_REASM_SEG_DATA) take = TCP_REASM_SEG_DATA;
+
+        TcpSegment *seg = (TcpSegment *)pool_alloc(&r->buffers);
+        if (!seg) return -1;
+        seg->seq = *seq;
+        seg->len = take;
+        memcpy(seg->data, *data, take);
+        seg->next = cur;
+        *link = seg;
+        link = &seg->next;
+        hs->buffered += take;
+
+        *seq += take;
+        *data += take;
+        *len -= take;
+    }
+    return 0;
+}
+
+// ---------------------------
+// Segment Entry Point
+// ---------------------------
+void tcp_reasm_segment(TcpReasm *r, TcpStream *s, int dir, uint32_t seq, uint8_t flags,
+                       const u_char *data, uint32_t len, tcp_deliver_fn deliver, void *user) {
+    TcpHalfStream *hs = &s->half[dir];
+
+    // SYN consumes one sequence number before the first data byte
+    if (flags & TCP_SYN) seq++;
+    if (!hs->synced) {
+        // Picked up mid-stream: start at the first segment seen
+        hs->next_seq = seq;
+        hs->synced = 1;
+    }
+    if (len == 0) return;
+    r->stats.segments++;
+
+    // Far ahead of anything plausible: give up on the old position
+    if (SEQ_GT(seq, hs->next_seq + TCP_REASM_WINDOW)) {
+        release_half(r, hs);
+        emit_gap(r, hs, seq, deliver, user);
+    }
+
+    if (SEQ_LEQ(seq + len, hs->next_seq)) {
+        r->stats.retransmits++;
+        return;
+    }
+    if (seq == hs->next_seq || SEQ_LT(seq, hs->next_seq)) r->stats.in_order++;
+    else r->stats.out_of_order++;
+
+    for (;;) {
+        if (SEQ_LEQ(seq + len, hs->next_seq)) return;  // Covered by data drained below
+        if (SEQ_LT(seq, hs->next_seq)) {
+            uint32_t dup = hs->next_seq - seq;
+            r->stats.overlap_bytes += dup;
+            seq += dup;
+            data += dup;
+            len -= dup;
+        }
+        if (seq == hs->next_seq) {
+            emit(r, hs, data, len, deliver, user);
+            drain(r, hs, deliver, user);
+            return;
+        }
+
+        if (hs->buffered + len <= r->max_buffered && hold(r, hs, &seq, &data, &len) == 0) return;
+
+        // Out of room: give up on the oldest hole so the stream keeps moving
+        if (hs->ooo && SEQ_LT(hs->ooo->seq, seq)) {
+            emit_gap(r, hs, hs->ooo->seq, deliver, user);
+            drain(r, hs, deliver, user);
+        } else {
+            emit_gap(r, hs, seq, deliver, user);
+        }
+    }
+}
+
+void tcp_reasm_release(TcpReasm *r, TcpStream *s) {
+    release_half(r, &s->half[0]);
+    release_half(r, &s->half[1]);
+}
+
+void tcp_reasm_get_stats(const TcpReasm *r, TcpReasmStats *out) {
+    *out = r->stats;
+    out->buffers_in_use = r->buffers.in_use;
+    out->buffers_peak = r->buffers.peak;
+}
@@ -0,0 +1,70 @@
+// tcp_reasm.h - Per-flow TCP stream reassembly
+//
+// Orders segments by sequence number and hands each direction to the
+// application as one contiguous byte stream. Data ahead of a hole is
+// copied into fixed-size buffers from a per-worker pool; retransmitted
+// and overlapping bytes are trimmed (bytes already accepted win). Memory
+// is bounded per direction and per worker: when either limit is hit the
+// oldest hole is skipped and reported to the application as a gap.
+#ifndef TCP_REASM_H
+#define TCP_REASM_H
+
+#include <pcap.h>
+#include <stdint.h>
+#include "pool.h"
+
+#define TCP_REASM_SEG_DATA      2032          // Payload bytes per pooled buffer (2 KiB object)
+#define TCP_REASM_MAX_BUFFERED  (64u * 1024)  // Default out-of-order bytes held per direction
+#define TCP_REASM_WINDOW        (1u << 24)    // Further ahead than this means the stream lost sync
+
+typedef struct TcpSegment TcpSegment;
+
+// One direction of a connection
+typedef struct {
+    uint32_t next_seq;       // Next byte the application expects
+    uint32_t buffered;       // Out-of-order bytes held
+    TcpSegment *ooo;         // Held data, ascending and non-overlapping
+    uint8_t synced;          // next_seq is valid (SYN or first segment seen)
+} TcpHalfStream;
+
+typedef struct {
+    TcpHalfStream half[2];   // Indexed by FLOW_DIR_*
+} TcpStream;
+
+// Receives in-order data for one direction. data == NULL reports a gap of
+// len bytes that will never be delivered.
+typedef void (*tcp_deliver_fn)(void *user, const u_char *data, uint32_t len);
+
+typedef struct {
+    uint64_t segments;        // Segments carrying payload
+    uint64_t in_order;
+    uint64_t out_of_order;    // Arrived ahead of a hole
+    uint64_t retransmits;     // Entirely already-delivered data
+    uint64_t overlap_bytes;   // Bytes trimmed from partial overlaps
+    uint64_t gaps;            // Holes given up on (limits or lost sync)
+    uint64_t gap_bytes;
+    uint64_t delivered_bytes;
+    uint32_t buffers_in_use;
+    uint32_t buffers_peak;
+    uint32_t buffers_capacity;
+    uint64_t memory_bytes;
+} TcpReasmStats;
+
+typedef struct TcpReasm TcpReasm;
+
+// max_buffers pooled buffers shared by all flows of one worker;
+// max_buffered_per_dir caps what a single direction may hold (0 = default)
+TcpReasm *tcp_reasm_create(uint32_t max_buffers, uint32_t max_buffered_per_dir);
+void tcp_reasm_destroy(TcpReasm *r);
+
+// Account one segment of direction dir. seq and flags are taken straight
+// from the TCP header; segments without payload only matter for SYN.
+void tcp_reasm_segment(TcpReasm *r, TcpStream *s, int dir, uint32_t seq, uint8_t flags,
+                       const u_char *data, uint32_t len, tcp_deliver_fn deliver, void *user);
+
+// Return every buffer held by the stream to the pool (flow ended)
+void tcp_reasm_release(TcpReasm *r, TcpStream *s);
+
+void tcp_reasm_get_stats(const TcpReasm *r, TcpReasmStats *out);
+
+#endif // TCP_REASM_H
@@ -0,0 +1,350 @@
+// tls.c - TLS ClientHello / ServerHello parsing and JA3/JA4 fingerprints
+#include "tls.h"
+#include "digest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Extension types used by the parser and the fingerprints
+#define TLS_EXT_SERVER_NAME         0x0000
+#define TLS_EXT_SUPPORTED_GROUPS    0x000a
+#define TLS_EXT_EC_POINT_FORMATS    0x000b
+#define TLS_EXT_SIGNATURE_ALGS      0x000d
+#define TLS_EXT_ALPN                0x0010
+#define TLS_EXT_SUPPORTED_VERSIONS  0x002b
+
+// RFC 8701: 0x0a0a, 0x1a1a, ... 0xfafa
+#define TLS_IS_GREASE(v) ((((v) & 0x0f0f) == 0x0a0a) && (((v) >> 8) == ((v) & 0xff)))
+
+// ---------------------------
+// Bounded Reader
+// ---------------------------
+// Every read checks the remaining length; after the first failure the
+// reader stays failed, so callers can check once at the end of a field.
+typedef struct {
+    const u_char *p;
+    uint32_t len;
+    uint32_t off;
+    int bad;
+} tls_reader_t;
+
+static uint32_t rd_left(const tls_reader_t *r) {
+    return r->bad ? 0 : r->len - r->off;
+}
+
+static int rd_need(tls_reader_t *r, uint32_t n) {
+    if (r->bad || r->len - r->off < n) {
+        r->bad = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static uint8_t rd_u8(tls_reader_t *r) {
+    if (!rd_need(r, 1)) return 0;
+    return r->p[r->off++];
+}
+
+static uint16_t rd_u16(tls_reader_t *r) {
+    if (!rd_need(r, 2)) return 0;
+    uint16_t v = (uint16_t)((r->p[r->off] << 8) | r->p[r->off + 1]);
+    r->off += 2;
+    return v;
+}
+
+static void rd_skip(tls_reader_t *r, uint32_t n) {
+    if (rd_need(r, n)) r->off += n;
+}
+
+// Carve a sub-reader of n bytes out of r (a length-prefixed vector)
+static tls_reader_t rd_sub(tls_reader_t *r, uint32_t n) {
+    tls_reader_t sub = { NULL, 0, 0, 1 };
+    if (rd_need(r, n)) {
+        sub.p = r->p + r->off;
+        sub.len = n;
+        sub.bad = 0;
+        r->off += n;
+    }
+    return sub;
+}
+
+// Printable copy for logs and stats keys; other bytes become '?'
+static void copy_printable(char *dst, size_t dst_size, const u_char *src, uint32_t len) {
+    size_t n = len < dst_size - 1 ? len : dst_size - 1;
+    for (size_t i = 0; i < n; i++) {
+        u_char c = src[i];
+        dst[i] = (c > 0x20 && c < 0x7f && c != '"' && c != '\\') ? (char)c : '?';
+    }
+    dst[n] = '\0';
+}
+
+// ---------------------------
+// Extensions
+// ---------------------------
+static void parse_sni(tls_reader_t *ext, TlsHello *out) {
+    tls_reader_t list = rd_sub(ext, rd_u16(ext));
+    while (rd_left(&list) >= 3) {
+        uint8_t name_type = rd_u8(&list);
+        uint16_t name_len = rd_u16(&list);
+        if (!rd_need(&list, name_len)) return;
+        if (name_type == 0 && out->sni[0] == '\0') {   // host_name
+            copy_printable(out->sni, sizeof(out->sni), list.p + list.off, name_len);
+        }
+        rd_skip(&list, name_len);
+    }
+}
+
+static void parse_alpn(tls_reader_t *ext, TlsHello *out) {
+    tls_reader_t list = rd_sub(ext, rd_u16(ext));
+    uint8_t proto_len = rd_u8(&list);
+    if (proto_len == 0 || !rd_need(&list, proto_len)) return;
+    const u_char *proto = list.p + list.off;
+    out->has_alpn = 1;
+    out->alpn_len = proto_len;
+    out->alpn_first = proto[0];
+    out->alpn_last = proto[proto_len - 1];
+    copy_printable(out->alpn, sizeof(out->alpn), proto, proto_len);
+}
+
+static void parse_u16_list(tls_reader_t *list, uint16_t *dst, uint16_t *count, uint16_t max,
+                           TlsHello *out) {
+    while (rd_left(list) >= 2) {
+        uint16_t v = rd_u16(list);
+        if (TLS_IS_GREASE(v)) continue;
+        if (*count < max) dst[(*count)++] = v;
+        else out->truncated = 1;
+    }
+}
+
+static void parse_extension(uint16_t type, tls_reader_t *ext, TlsHello *out) {
+    int client = out->type == TLS_HS_CLIENT_HELLO;
+    switch (type) {
+        case TLS_EXT_SERVER_NAME:
+            out->has_sni = 1;
+            if (client) parse_sni(ext, out);
+            break;
+        case TLS_EXT_ALPN:
+            parse_alpn(ext, out);
+            break;
+        case TLS_EXT_SUPPORTED_GROUPS:
+            if (client) {
+                tls_reader_t list = rd_sub(ext, rd_u16(ext));
+                parse_u16_list(&list, out->groups, &out->n_groups, TLS_MAX_GROUPS, out);
+            }
+            break;
+        case TLS_EXT_EC_POINT_FORMATS: {
+            tls_reader_t list = rd_sub(ext, rd_u8(ext));
+            while (rd_left(&list) >= 1) {
+                uint8_t v = rd_u8(&list);
+                if (out->n_point_formats < TLS_MAX_POINT_FORMATS) out->point_formats[out->n_point_formats++] = v;
+                else out->truncated = 1;
+            }
+            break;
+        }
+        case TLS_EXT_SIGNATURE_ALGS:
+            if (client) {
+                tls_reader_t list = rd_sub(ext, rd_u16(ext));
+                parse_u16_list(&list, out->sig_algs, &out->n_sig_algs, TLS_MAX_SIG_ALGS, out);
+            }
+            break;
+        case TLS_EXT_SUPPORTED_VERSIONS:
+            if (client) {
+                tls_reader_t list = rd_sub(ext, rd_u8(ext));
+                while (rd_left(&list) >= 2) {
+                    uint16_t v = rd_u16(&list);
+                    if (!TLS_IS_GREASE(v) && v > out->version) out->version = v;
+                }
+            } else if (rd_left(ext) >= 2) {
+                out->version = rd_u16(ext);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// ---------------------------
+// Hello Parser
+// ---------------------------
+int tls_parse_hello(const u_char *msg, uint32_t len, TlsHello *out) {
+    memset(out, 0, offsetof(TlsHello, ciphers));
+    out->alpn[0] = '\0';
+    out->sni[0] = '\0';
+    out->alpn_len = 0;
+
+    if (len < 4) return -1;
+    uint8_t type = msg[0];
+    uint32_t body_len = ((uint32_t)msg[1] << 16) | ((uint32_t)msg[2] << 8) | msg[3];
+    if ((type != TLS_HS_CLIENT_HELLO && type != TLS_HS_SERVER_HELLO) || body_len > len - 4) return -1;
+    out->type = type;
+
+    tls_reader_t r = { msg + 4, body_len, 0, 0 };
+    out->legacy_version = rd_u16(&r);
+    rd_skip(&r, 32);                       // random
+    rd_skip(&r, rd_u8(&r));                // session_id
+
+    if (type == TLS_HS_CLIENT_HELLO) {
+        tls_reader_t suites = rd_sub(&r, rd_u16(&r));
+        parse_u16_list(&suites, out->ciphers, &out->n_ciphers, TLS_MAX_CIPHERS, out);
+        rd_skip(&r, rd_u8(&r));            // compression_methods
+    } else {
+        out->ciphers[0] = rd_u16(&r);
+        out->n_ciphers = 1;
+        rd_skip(&r, 1);                    // compression_method
+    }
+    if (r.bad) return -1;
+
+    // Extensions are optional (SSL 3.0 / early TLS 1.0 hellos end here)
+    if (rd_left(&r) >= 2) {
+        tls_reader_t exts = rd_sub(&r, rd_u16(&r));
+        if (exts.bad) return -1;
+        while (rd_left(&exts) >= 4) {
+            uint16_t ext_type = rd_u16(&exts);
+            tls_reader_t ext = rd_sub(&exts, rd_u16(&exts));
+            if (ext.bad) return -1;
+            if (TLS_IS_GREASE(ext_type)) continue;
+            if (out->n_extensions < TLS_MAX_EXTENSIONS) out->extensions[out->n_extensions++] = ext_type;
+            else out->truncated = 1;
+            parse_extension(ext_type, &ext, out);
+        }
+    }
+
+    if (out->version == 0) out->version = out->legacy_version;
+    return 0;
+}
+
+// ---------------------------
+// Fingerprints
+// ---------------------------
+// Append "v-v-v" in decimal (JA3 lists)
+static size_t append_dec_list(char *buf, size_t pos, size_t size, const uint16_t *v, unsigned n) {
+    for (unsigned i = 0; i < n && pos < size; i++) {
+        int w = snprintf(buf + pos, size - pos, i ? "-%u" : "%u", v[i]);
+        if (w < 0) break;
+        pos += (size_t)w;
+    }
+    return pos < size ? pos : size - 1;
+}
+
+void tls_ja3(const TlsHello *h, char out[TLS_JA3_LEN]) {
+    char buf[2048];
+    size_t pos = (size_t)snprintf(buf, sizeof(buf), "%u,", h->legacy_version);
+    if (h->type == TLS_HS_CLIENT_HELLO) {
+        // SSLVersion,Ciphers,Extensions,EllipticCurves,EllipticCurvePointFormats
+        uint16_t formats[TLS_MAX_POINT_FORMATS];
+        for (unsigned i = 0; i < h->n_point_formats; i++) formats[i] = h->point_formats[i];
+        pos = append_dec_list(buf, pos, sizeof(buf), h->ciphers, h->n_ciphers);
+        pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos, ",");
+        pos = append_dec_list(buf, pos, sizeof(buf), h->extensions, h->n_extensions);
+        pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos, ",");
+        pos = append_dec_list(buf, pos, sizeof(buf), h->groups, h->n_groups);
+        pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos, ",");
+        pos = append_dec_list(buf, pos, sizeof(buf), formats, h->n_point_formats);
+    } else {
+        // JA3S: SSLVersion,Cipher,Extensions
+        pos += (size_t)snprintf(buf + pos, sizeof(buf) - pos, "%u,", h->ciphers[0]);
+        pos = append_dec_list(buf, pos, sizeof(buf), h->extensions, h->n_extensions);
+    }
+    if (pos >= sizeof(buf)) pos = sizeof(buf) - 1;
+
+    uint8_t digest[MD5_DIGEST_LEN];
+    md5(buf, pos, digest);
+    digest_hex(digest, MD5_DIGEST_LEN, out);
+}
+
+static int cmp_u16(const void *a, const void *b) {
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+// Append "hhhh,hhhh" (JA4 lists)
+static size_t append_hex_list(char *buf, size_t pos, size_t size, const uint16_t *v, unsigned n) {
+    for (unsigned i = 0; i < n && pos + 6 < size; i++) {
+        pos += (size_t)snprintf(buf + pos, size - pos, i ? ",%04x" : "%04x", v[i]);
+    }
+    return pos;
+}
+
+// First 12 hex digits of SHA-256, or twelve zeros for an empty list
+static void ja4_hash(const char *s, size_t len, char out[13]) {
+    if (len == 0) {
+        memcpy(out, "000000000000", 13);
+        return;
+    }
+    uint8_t digest[SHA256_DIGEST_LEN];
+    sha256(s, len, digest);
+    digest_hex(digest, 6, out);
+}
+
+static const char *ja4_version(uint16_t v) {
+    switch (v) {
+        case 0x0304: return "13";
+        case 0x0303: return "12";
+        case 0x0302: return "11";
+        case 0x0301: return "10";
+        case 0x0300: return "s3";
+        case 0x0002: return "s2";
+        case 0xfeff: return "d1";
+        case 0xfefd: return "d2";
+        case 0xfefc: return "d3";
+        default: return "00";
+    }
+}
+
+static int is_alnum(uint8_t c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+void tls_ja4(const TlsHello *h, char out[TLS_JA4_LEN]) {
+    static const char hex[] = "0123456789abcdef";
+
+    // ja4_a: protocol, version, SNI, counts (capped at 99), ALPN
+    char alpn[3] = "00";
+    if (h->has_alpn && h->alpn_len > 0) {
+        if (is_alnum(h->alpn_first) && is_alnum(h->alpn_last)) {
+            alpn[0] = (char)h->alpn_first;
+            alpn[1] = (char)h->alpn_last;
+        } else {
+            alpn[0] = hex[h->alpn_first >> 4];
+            alpn[1] = hex[h->alpn_last & 0x0F];
+        }
+    }
+    unsigned n_ciphers = h->n_ciphers > 99 ? 99 : h->n_ciphers;
+    unsigned n_ext = h->n_extensions > 99 ? 99 : h->n_extensions;
+
+    // ja4_b: sorted cipher suites
+    uint16_t sorted[TLS_MAX_CIPHERS > TLS_MAX_EXTENSIONS ? TLS_MAX_CIPHERS : TLS_MAX_EXTENSIONS];
+    char buf[1024];
+    char hash_b[13], hash_c[13];
+    memcpy(sorted, h->ciphers, h->n_ciphers * sizeof(uint16_t));
+    qsort(sorted, h->n_ciphers, sizeof(uint16_t), cmp_u16);
+    ja4_hash(buf, append_hex_list(buf, 0, sizeof(buf), sorted, h->n_ciphers), hash_b);
+
+    // ja4_c: sorted extensions without SNI and ALPN, then signature algorithms in wire order
+    unsigned n = 0;
+    for (unsigned i = 0; i < h->n_extensions; i++) {
+        if (h->extensions[i] != TLS_EXT_SERVER_NAME && h->extensions[i] != TLS_EXT_ALPN) {
+            sorted[n++] = h->extensions[i];
+        }
+    }
+    qsort(sorted, n, sizeof(uint16_t), cmp_u16);
+    size_t pos = append_hex_list(buf, 0, sizeof(buf), sorted, n);
+    if (h->n_sig_algs > 0) {
+        buf[pos++] = '_';
+        pos = append_hex_list(buf, pos, sizeof(buf), h->sig_algs, h->n_sig_algs);
+    }
+    ja4_hash(buf, n > 0 ? pos : 0, hash_c);
+
+    snprintf(out, TLS_JA4_LEN, "t%s%c%02u%02u%s_%s_%s",
+             ja4_version(h->version), h->has_sni ? 'd' : 'i', n_ciphers, n_ext, alpn, hash_b, hash_c);
+}
+
+const char *tls_version_name(uint16_t v) {
+    switch (v) {
+        case 0x0300: return "SSL 3.0";
+        case 0x0301: return "TLS 1.0";
+        case 0x0302: return "TLS 1.1";
+        case 0x0303: return "TLS 1.2";
+        case 0x0304: return "TLS 1.3";
+        default: return "Unknown";
+    }
+}
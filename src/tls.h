@@ -0,0 +1,67 @@
+// tls.h - TLS ClientHello / ServerHello parsing and JA3/JA4 fingerprints
+//
+// The parser reads one complete handshake message from a caller-supplied
+// buffer into a fixed-size TlsHello: every length is checked against the
+// enclosing field, nothing is allocated and nothing points back into the
+// packet. GREASE values (RFC 8701) are dropped while parsing, which is what
+// both fingerprint formats expect.
+#ifndef TLS_H
+#define TLS_H
+
+#include <pcap.h>
+#include <stdint.h>
+
+#define TLS_CONTENT_HANDSHAKE   22
+#define TLS_HS_CLIENT_HELLO     1
+#define TLS_HS_SERVER_HELLO     2
+
+#define TLS_MAX_CIPHERS         128   // Longer lists are cut and flagged as truncated
+#define TLS_MAX_EXTENSIONS      64
+#define TLS_MAX_GROUPS          64
+#define TLS_MAX_POINT_FORMATS   16
+#define TLS_MAX_SIG_ALGS        64
+#define TLS_SNI_MAX             255   // DNS names are at most 253 characters
+#define TLS_ALPN_MAX            31    // Longer protocol IDs are shown cut (JA4 still sees the real last byte)
+
+#define TLS_JA3_LEN             33    // 32 hex digits + NUL (also JA3S)
+#define TLS_JA4_LEN             37    // "t13d1516h2_8daaf6152771_e5627efa2ab1" + NUL
+
+typedef struct {
+    uint8_t  type;               // TLS_HS_CLIENT_HELLO or TLS_HS_SERVER_HELLO
+    uint8_t  truncated;          // A list overflowed its array; fingerprints cover the stored prefix
+    uint8_t  has_sni;            // server_name extension present (JA4 "d" vs "i")
+    uint8_t  has_alpn;
+    uint16_t legacy_version;     // Version field of the hello body (JA3)
+    uint16_t version;            // Highest supported_versions entry (client) or the selected one (server), else legacy_version
+    uint16_t n_ciphers;          // Offered suites (client) or 1 selected suite (server)
+    uint16_t n_extensions;
+    uint16_t n_groups;
+    uint16_t n_point_formats;
+    uint16_t n_sig_algs;
+    uint16_t ciphers[TLS_MAX_CIPHERS];
+    uint16_t extensions[TLS_MAX_EXTENSIONS];   // Wire order
+    uint16_t groups[TLS_MAX_GROUPS];
+    uint8_t  point_formats[TLS_MAX_POINT_FORMATS];
+    uint16_t sig_algs[TLS_MAX_SIG_ALGS];
+    uint8_t  alpn_len;           // Length of the first (client) or selected (server) protocol
+    uint8_t  alpn_first;         // Raw first and last byte of that protocol, for JA4
+    uint8_t  alpn_last;
+    char     alpn[TLS_ALPN_MAX + 1];           // Printable copy
+    char     sni[TLS_SNI_MAX + 1];             // First host_name entry, printable copy ("" if none)
+} TlsHello;
+
+// Parse a complete ClientHello or ServerHello starting at the 4-byte
+// handshake header. Returns 0 on success, -1 if the message is malformed,
+// not a hello, or longer than len.
+int tls_parse_hello(const u_char *msg, uint32_t len, TlsHello *out);
+
+// JA3 of a ClientHello, JA3S of a ServerHello (MD5, lowercase hex)
+void tls_ja3(const TlsHello *h, char out[TLS_JA3_LEN]);
+
+// JA4 (TLS over TCP) of a ClientHello
+void tls_ja4(const TlsHello *h, char out[TLS_JA4_LEN]);
+
+// "TLS 1.3" etc.; "Unknown" for anything else
+const char *tls_version_name(uint16_t v);
+
+#endif // TLS_H
@@ -0,0 +1,319 @@
+// tracelog.c - Asynchronous binary trace log
+#include "tracelog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_RING_RECORDS 16384     // Per thread (power of two): 1 MiB of 64-byte records
+#define TRACE_MAX_THREADS  128
+#define TRACE_BATCH        256       // Records drained from one ring before moving to the next
+#define TRACE_IDLE_MS      5         // Formatter sleep when every ring is empty
+#define TRACE_LINE_MAX     512
+
+// Per-thread single-producer/single-consumer ring (producer: the tracing
+// thread, consumer: the formatter). Same layout rules as PktRing.
+typedef struct {
+    CACHE_ALIGNED volatile uint64_t tail;
+    volatile uint64_t dropped;         // Producer-owned; read by the formatter
+    CACHE_ALIGNED volatile uint64_t head;
+    uint64_t dropped_reported;         // Formatter-owned
+    CACHE_ALIGNED TraceRecord records[TRACE_RING_RECORDS];
+} TraceRing;
+
+#define TRACE_FMT_ENTRY(id, nargs, fmt) fmt,
+static const char *const trace_formats[TRACE_FORMAT_COUNT] = { TRACE_FORMATS(TRACE_FMT_ENTRY) };
+#undef TRACE_FMT_ENTRY
+
+volatile int tracelog_active = 0;
+
+static TraceRing *volatile rings[TRACE_MAX_THREADS];
+static volatile int64_t ring_count = 0;
+static THREAD_LOCAL TraceRing *tls_ring = NULL;
+static THREAD_LOCAL int tls_ring_index = -1;
+
+static FILE *trace_out = NULL;
+static int trace_binary = 0;
+static uint64_t trace_start_ns = 0;
+static uint64_t records_written = 0;
+static thread_t formatter_thread;
+static event_t stop_event;
+
+// ---------------------------
+// Formatting (shared with tools/tracedump.c)
+// ---------------------------
+size_t tracelog_format(char *out, size_t out_size, const char *fmt,
+                       const uint64_t *args, unsigned nargs) {
+    size_t pos = 0;
+    unsigned arg = 0;
+    if (out_size == 0) return 0;
+
+#define TRACE_EMIT(...) \
+    do { \
+        int n_ = snprintf(out + pos, out_size - pos, __VA_ARGS__); \
+        if (n_ > 0) pos += ((size_t)n_ < out_size - pos) ? (size_t)n_ : out_size - pos - 1; \
+    } while (0)
+
+    for (const char *p = fmt; *p && pos + 1 < out_size; p++) {
+        if (*p != '%') {
+            out[pos++] = *p;
+            continue;
+        }
+        char conv = *++p;
+        if (conv == '\0') break;
+        if (conv == '%') {
+            out[pos++] = '%';
+            continue;
+        }
+        unsigned need = (conv == 'A') ? 2 : 1;
+        if (arg + need > nargs) {
+            TRACE_EMIT("?");
+            continue;
+        }
+        switch (conv) {
+            case 'u':
+                TRACE_EMIT("%llu", (unsigned long long)args[arg]);
+                break;
+            case 'x':
+                TRACE_EMIT("%llx", (unsigned long long)args[arg]);
+                break;
+            case 'a': {
+                uint32_t v = (uint32_t)args[arg];
+                unsigned char b[4];
+                memcpy(b, &v, 4);
+                TRACE_EMIT("%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+                break;
+            }
+            case 'A': {
+                unsigned char b[16];
+                memcpy(b, &args[arg], 8);
+                memcpy(b + 8, &args[arg + 1], 8);
+                for (int i = 0; i < 16; i += 2) {
+                    TRACE_EMIT(i ? ":%x" : "%x", (unsigned)((b[i] << 8) | b[i + 1]));
+                }
+                break;
+            }
+            default:
+                TRACE_EMIT("%%%c", conv);
+                need = 0;
+                break;
+        }
+        arg += need;
+    }
+#undef TRACE_EMIT
+
+    out[pos < out_size ? pos : out_size - 1] = '\0';
+    return pos;
+}
+
+uint64_t trace_ipv6_hi(const void *addr16) {
+    uint64_t v;
+    memcpy(&v, addr16, 8);
+    return v;
+}
+
+uint64_t trace_ipv6_lo(const void *addr16) {
+    uint64_t v;
+    memcpy(&v, (const unsigned char *)addr16 + 8, 8);
+    return v;
+}
+
+// ---------------------------
+// Producer Side (analysis threads)
+// ---------------------------
+static TraceRing *register_thread(void) {
+    int64_t idx = atomic_inc64(&ring_count) - 1;
+    if (idx >= TRACE_MAX_THREADS) return NULL;
+
+    TraceRing *ring = (TraceRing *)platform_aligned_alloc(sizeof(TraceRing), CACHE_LINE_SIZE);
+    if (!ring) {
+        fprintf(stderr, "[!] Trace: failed to allocate ring for thread %lld\n", (long long)idx);
+        return NULL;
+    }
+    memory_barrier();  // Ring is zeroed before the formatter can see it
+    rings[idx] = ring;
+    tls_ring = ring;
+    tls_ring_index = (int)idx;
+    return ring;
+}
+
+void tracelog_write(trace_fmt_t fmt, const uint64_t *args, unsigned nargs) {
+    TraceRing *ring = tls_ring;
+    if (!ring) {
+        if (tls_ring_index == -2) return;  // Registration already failed for this thread
+        ring = register_thread();
+        if (!ring) {
+            tls_ring_index = -2;
+            return;
+        }
+    }
+
+    uint64_t tail = ring->tail;
+    if (tail - atomic_load_acquire_u64(&ring->head) >= TRACE_RING_RECORDS) {
+        ring->dropped++;
+        return;
+    }
+
+    TraceRecord *rec = &ring->records[tail & (TRACE_RING_RECORDS - 1)];
+    if (nargs > TRACE_MAX_ARGS) nargs = TRACE_MAX_ARGS;
+    rec->fmt = (uint16_t)fmt;
+    rec->nargs = (uint8_t)nargs;
+    rec->thread = (uint8_t)tls_ring_index;
+    rec->reserved = 0;
+    rec->ts_ns = platform_now_ns();
+    memcpy(rec->args, args, nargs * sizeof(uint64_t));
+    atomic_store_release_u64(&ring->tail, tail + 1);
+}
+
+// ---------------------------
+// Consumer Side (formatter thread)
+// ---------------------------
+static void emit_record(const TraceRecord *rec) {
+    if (trace_binary) {
+        TraceRecord copy = *rec;
+        copy.ts_ns = rec->ts_ns - trace_start_ns;
+        fwrite(&copy, sizeof(copy), 1, trace_out);
+    } else {
+        char line[TRACE_LINE_MAX];
+        const char *fmt = rec->fmt < TRACE_FORMAT_COUNT ? trace_formats[rec->fmt] : "[trace] unknown format";
+        tracelog_format(line, sizeof(line), fmt, rec->args, rec->nargs);
+        fprintf(trace_out, "%12.6f T%-2u %s\n",
+                (double)(rec->ts_ns - trace_start_ns) / 1e9, rec->thread, line);
+    }
+    records_written++;
+}
+
+// Drain up to TRACE_BATCH records from one ring; returns the number drained
+static unsigned drain_ring(TraceRing *ring, unsigned index) {
+    uint64_t head = ring->head;
+    uint64_t tail = atomic_load_acquire_u64(&ring->tail);
+    unsigned n = 0;
+    while (head != tail && n < TRACE_BATCH) {
+        emit_record(&ring->records[head & (TRACE_RING_RECORDS - 1)]);
+        head++;
+        n++;
+    }
+    atomic_store_release_u64(&ring->head, head);
+
+    // Report drops in-stream so the gap is visible where it happened
+    uint64_t dropped = ring->dropped;
+    if (dropped != ring->dropped_reported) {
+        TraceRecord note;
+        memset(&note, 0, sizeof(note));
+        note.fmt = TRACE_DROPPED;
+        note.nargs = 1;
+        note.thread = (uint8_t)index;
+        note.ts_ns = platform_now_ns();
+        note.args[0] = dropped - ring->dropped_reported;
+        emit_record(&note);
+        ring->dropped_reported = dropped;
+    }
+    return n;
+}
+
+static unsigned drain_all(void) {
+    unsigned total = 0;
+    int64_t count = ring_count;
+    if (count > TRACE_MAX_THREADS) count = TRACE_MAX_THREADS;
+    for (int64_t i = 0; i < count; i++) {
+        TraceRing *ring = rings[i];
+        if (ring) total += drain_ring(ring, (unsigned)i);
+    }
+    return total;
+}
+
+static thread_ret_t THREAD_CALL tracelog_thread(void *param) {
+    (void)param;
+    for (;;) {
+        if (drain_all() > 0) continue;
+        fflush(trace_out);
+        if (event_wait(&stop_event, TRACE_IDLE_MS)) break;
+    }
+    // Producers have stopped: flush whatever is left
+    while (drain_all() > 0) {}
+    fflush(trace_out);
+    return 0;
+}
+
+static void write_file_header(void) {
+    TraceFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_FILE_VERSION;
+    hdr.byte_order = TRACE_BYTE_ORDER;
+    hdr.record_size = sizeof(TraceRecord);
+    hdr.format_count = TRACE_FORMAT_COUNT;
+    hdr.start_ns = trace_start_ns;
+    fwrite(&hdr, sizeof(hdr), 1, trace_out);
+
+    // Embed the format table so old files decode after formats change
+    for (uint16_t id = 0; id < TRACE_FORMAT_COUNT; id++) {
+        uint16_t len = (uint16_t)strlen(trace_formats[id]);
+        fwrite(&id, sizeof(id), 1, trace_out);
+        fwrite(&len, sizeof(len), 1, trace_out);
+        fwrite(trace_formats[id], 1, len, trace_out);
+    }
+}
+
+int tracelog_open(const char *path, int binary) {
+    if (tracelog_active) return 0;
+    if (strcmp(path, "-") == 0 && !binary) {
+        trace_out = stdout;
+    } else {
+        trace_out = fopen(path, binary ? "wb" : "w");
+        if (!trace_out) {
+            fprintf(stderr, "[!] Trace: cannot open %s for writing\n", path);
+            return -1;
+        }
+    }
+    trace_binary = binary;
+    trace_start_ns = platform_now_ns();
+    records_written = 0;
+    if (binary) write_file_header();
+
+    if (event_init(&stop_event) != 0) {
+        fprintf(stderr, "[!] Trace: failed to create stop event\n");
+        if (trace_out != stdout) fclose(trace_out);
+        trace_out = NULL;
+        return -1;
+    }
+    if (thread_create(&formatter_thread, tracelog_thread, NULL) != 0) {
+        fprintf(stderr, "[!] Trace: failed to create formatter thread\n");
+        event_destroy(&stop_event);
+        if (trace_out != stdout) fclose(trace_out);
+        trace_out = NULL;
+        return -1;
+    }
+    tracelog_active = 1;
+    printf("[+] Tracing to %s (%s)\n", strcmp(path, "-") == 0 ? "stdout" : path,
+           binary ? "binary, decode with tracedump" : "text");
+    return 0;
+}
+
+void tracelog_close(void) {
+    if (!tracelog_active) return;
+    tracelog_active = 0;
+    event_set(&stop_event);
+    thread_join_timeout(formatter_thread, PLATFORM_WAIT_INFINITE);
+    thread_close(formatter_thread);
+    event_destroy(&stop_event);
+
+    uint64_t dropped = 0;
+    int64_t count = ring_count;
+    if (count > TRACE_MAX_THREADS) count = TRACE_MAX_THREADS;
+    for (int64_t i = 0; i < count; i++) {
+        if (!rings[i]) continue;
+        dropped += rings[i]->dropped;
+        platform_aligned_free(rings[i]);
+        rings[i] = NULL;
+    }
+    if (ring_count > TRACE_MAX_THREADS) {
+        fprintf(stderr, "[!] Trace: %lld threads were not traced (limit %d)\n",
+                (long long)(ring_count - TRACE_MAX_THREADS), TRACE_MAX_THREADS);
+    }
+    ring_count = 0;
+
+    if (trace_out && trace_out != stdout) fclose(trace_out);
+    trace_out = NULL;
+    printf("[+] Trace: %llu records written, %llu dropped (ring full)\n",
+           (unsigned long long)records_written, (unsigned long long)dropped);
+}
@@ -0,0 +1,107 @@
+// tracelog.h - Asynchronous binary trace log for per-packet detail
+//
+// Analysis threads append fixed-size binary records (format ID, timestamp,
+// raw integer arguments) to their own lock-free ring; a background thread
+// formats them to text or writes them unformatted to a binary file that
+// tools/tracedump.c decodes later. A full ring drops and counts records,
+// it never blocks the analyzer.
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "platform.h"
+
+// Format strings understand a small set of conversions, each consuming
+// arguments in order:
+//   %u  unsigned decimal        %x  hex
+//   %a  IPv4 address (1 arg, network byte order as read from the header)
+//   %A  IPv6 address (2 args: first and last 8 bytes, see trace_ipv6_hi/lo)
+//   %%  literal percent
+#define TRACE_FORMATS(X) \
+    X(TRACE_DROPPED,  1, "[trace] %u records dropped (ring full)") \
+    X(TRACE_PACKET,   3, "Packet #%u: length %u bytes (captured: %u bytes)") \
+    X(TRACE_IPV4,     5, "IPv4: %a -> %a, TTL=%u, Proto=%u, Len=%u") \
+    X(TRACE_IPV4_FRAG, 2, "IPv4:   fragment MF=%u offset=%u") \
+    X(TRACE_IP_REASSEMBLED, 4, "IPv%u: reassembled proto=%u, %u bytes from %u fragments") \
+    X(TRACE_IPV6,     7, "IPv6: %A -> %A, HopLimit=%u, NextHdr=%u, PayloadLen=%u") \
+    X(TRACE_TCP,      6, "TCP: %u -> %u, Seq=%u Ack=%u, Win=%u, Flags=0x%x") \
+    X(TRACE_UDP,      3, "UDP: %u -> %u, Len=%u") \
+    X(TRACE_ICMP,     3, "ICMPv%u: Type=%u Code=%u") \
+    X(TRACE_ARP,      3, "ARP: op=%u %a -> %a") \
+    X(TRACE_DNS,      5, "DNS: ID=0x%x Flags=0x%x Questions=%u Answers=%u Len=%u") \
+    X(TRACE_DNS_LATENCY, 3, "DNS: ID=0x%x answered, rcode=%u, latency=%u us") \
+    X(TRACE_HTTP,     3, "HTTP: %u -> %u, %u payload bytes") \
+    X(TRACE_HTTP_GAP, 3, "HTTP: %u -> %u, stream gap of %u bytes (not captured or over the reassembly limit)") \
+    X(TRACE_TLS,      5, "HTTPS: %u -> %u, TLS record type=%u version=0x%x len=%u") \
+    X(TRACE_TLS_CLIENT_HELLO, 6, "TLS: ClientHello %u -> %u, version=0x%x, %u ciphers, %u extensions, SNI %u bytes") \
+    X(TRACE_TLS_SERVER_HELLO, 5, "TLS: ServerHello %u -> %u, version=0x%x, cipher=0x%x, %u extensions") \
+    X(TRACE_FLOW_END, 6, "Flow end reason=%u proto=%u %u -> %u, duration=%u us, tcp_state=%u") \
+    X(TRACE_FLOW_COUNTS, 4, "Flow counts: fwd %u pkts/%u bytes, rev %u pkts/%u bytes")
+
+#define TRACE_ENUM_ENTRY(id, nargs, fmt) id,
+typedef enum {
+    TRACE_FORMATS(TRACE_ENUM_ENTRY)
+    TRACE_FORMAT_COUNT
+} trace_fmt_t;
+#undef TRACE_ENUM_ENTRY
+
+#define TRACE_MAX_ARGS 7
+
+// One record is exactly one cache line
+typedef struct {
+    uint16_t fmt;
+    uint8_t  nargs;
+    uint8_t  thread;       // Ring index of the writing thread
+    uint32_t reserved;
+    uint64_t ts_ns;        // platform_now_ns()
+    uint64_t args[TRACE_MAX_ARGS];
+} TraceRecord;
+
+// Binary file: header, format table (id, length, text), then raw records
+#define TRACE_FILE_MAGIC   "PSTRACE1"
+#define TRACE_FILE_VERSION 1
+#define TRACE_BYTE_ORDER   0x01020304u   // Written natively; tells the decoder the writer's endianness
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t record_size;
+    uint32_t format_count;
+    uint64_t start_ns;     // Timestamps in records are relative to this
+} TraceFileHeader;
+
+// Nonzero while a trace sink is open (checked by TRACE before doing any work)
+extern volatile int tracelog_active;
+
+// Start the formatter thread. path "-" writes text to stdout; binary
+// writes the raw record stream. Returns 0 on success.
+int  tracelog_open(const char *path, int binary);
+
+// Drain every ring, stop the formatter and print written/dropped totals.
+// Call only after all tracing threads have stopped.
+void tracelog_close(void);
+
+// Append one record to the calling thread's ring (registered lazily)
+void tracelog_write(trace_fmt_t fmt, const uint64_t *args, unsigned nargs);
+
+// Render a record with fmt into out (always NUL-terminated); shared by
+// the formatter thread and the offline decoder. Returns the length.
+size_t tracelog_format(char *out, size_t out_size, const char *fmt,
+                       const uint64_t *args, unsigned nargs);
+
+// Split an IPv6 address into the two %A arguments
+uint64_t trace_ipv6_hi(const void *addr16);
+uint64_t trace_ipv6_lo(const void *addr16);
+
+// TRACE(TRACE_UDP, sport, dport, len): arguments are converted to uint64_t
+#define TRACE(id, ...) \
+    do { \
+        if (tracelog_active) { \
+            const uint64_t trace_args_[] = { __VA_ARGS__ }; \
+            tracelog_write((id), trace_args_, (unsigned)(sizeof(trace_args_) / sizeof(trace_args_[0]))); \
+        } \
+    } while (0)
+
+#endif // TRACELOG_H
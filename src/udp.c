@@ -1,29 +1,39 @@
 #include "udp.h"
-#include "dns.h"
-#include "dhcp.h"
+#include "dissect.h"
 #include "logger.h"
+#include "tracelog.h"
 #include <stdio.h>
-#include <winsock2.h>
+#include "platform.h"
 #include "stats.h"
-void parse_udp(const u_char *data, int size, const char *src_ip, const char *dst_ip) {
+#include "analyzer.h"
+
+void parse_udp(packet_ctx_t *pkt, const u_char *data, int size) {
     if (size < (int)sizeof(udp_header_t)) {
-        LOG_WARN_SIMPLE("UDP: Truncated header\n");
+        stats_count_truncated(PROTO_UDP);
+        LOG_DEBUG_SIMPLE("UDP: Truncated header\n");
         return;
     }
 
     const udp_header_t *udp = (const udp_header_t *)data;
     int ulen = ntohs(udp->len); // header + payload
     if (ulen < (int)sizeof(udp_header_t) || ulen > size) {
-        // Clamp or just warn; some drivers may not deliver full payload
-        LOG_WARN_SIMPLE("UDP: Invalid length field (%d), available=%d\n", ulen, size);
+        // Clamp; some drivers may not deliver full payload
+        if (ulen < (int)sizeof(udp_header_t)) stats_count_malformed(PROTO_UDP);
+        else stats_count_truncated(PROTO_UDP);
+        LOG_DEBUG_SIMPLE("UDP: Invalid length field (%d), available=%d\n", ulen, size);
         ulen = size;
     }
 
     u_short src_port = ntohs(udp->src_port);
     u_short dst_port = ntohs(udp->dst_port);
+    analyzer_track_flow(pkt, src_port, dst_port, 0);
+    stats_heavy_ports(17, src_port, dst_port);
 
-    LOG_DEBUG_SIMPLE("UDP: %s:%u -> %s:%u, Len=%d\n",
-           src_ip, src_port, dst_ip, dst_port, ulen);
+    TRACE(TRACE_UDP, src_port, dst_port, ulen);
+    if (PKT_VERBOSE(pkt)) {
+        LOG_DEBUG_SIMPLE("UDP: %s:%u -> %s:%u, Len=%d\n",
+               pkt->src_ip, src_port, pkt->dst_ip, dst_port, ulen);
+    }
 
     const u_char *payload = data + sizeof(udp_header_t);
     int payload_size = ulen - sizeof(udp_header_t);
@@ -33,14 +43,6 @@ void parse_udp(const u_char *data, int size, const char *src_ip, const char *dst
         return;
     }
 
-    // Check for DNS traffic (port 53)
-    if (src_port == 53 || dst_port == 53) {
-        stats_increment("DNS");
-        parse_dns(payload, payload_size);
-    }
-    // Check for DHCP traffic (ports 67 and 68)
-    else if (src_port == DHCP_SERVER_PORT || dst_port == DHCP_SERVER_PORT ||
-             src_port == DHCP_CLIENT_PORT || dst_port == DHCP_CLIENT_PORT) {
-        parse_dhcp(payload, payload_size, src_ip, dst_ip, src_port, dst_port);
-    }
+    if (pkt->fast) dissect_count(DISSECT_UDP, pkt, payload_size);
+    else dissect_dispatch(DISSECT_UDP, pkt, payload, payload_size);
 }
@@ -3,6 +3,7 @@
 #define UDP_H
 
 #include <pcap.h>
+#include "packet.h"
 
 #pragma pack(push, 1)
 typedef struct {
@@ -14,6 +15,6 @@ typedef struct {
 #pragma pack(pop)
 
 // API
-void parse_udp(const u_char *data, int size, const char *src_ip, const char *dst_ip);
+void parse_udp(packet_ctx_t *pkt, const u_char *data, int size);
 
 #endif // UDP_H
@@ -0,0 +1,113 @@
+// tracedump.c - Decode binary trace files written by `sniffer -T <file>`
+//
+// Build: gcc tools/tracedump.c src/tracelog.c src/platform.c -Isrc -o tracedump -lpthread
+// Usage: tracedump <trace.bin> [-s]    (-s prints a per-format record count summary)
+//
+// Formats come from the table embedded in the file, so traces decode even
+// after TRACE_FORMATS in tracelog.h has changed.
+#include "tracelog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FORMATS 1024
+
+static char *formats[MAX_FORMATS];
+static unsigned long long format_counts[MAX_FORMATS];
+
+static int read_exact(FILE *fp, void *buf, size_t len) {
+    return fread(buf, 1, len, fp) == len ? 0 : -1;
+}
+
+static int read_format_table(FILE *fp, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t id, len;
+        if (read_exact(fp, &id, sizeof(id)) != 0 || read_exact(fp, &len, sizeof(len)) != 0) {
+            fprintf(stderr, "[!] Truncated format table\n");
+            return -1;
+        }
+        char *text = (char *)malloc((size_t)len + 1);
+        if (!text || read_exact(fp, text, len) != 0) {
+            fprintf(stderr, "[!] Truncated format table\n");
+            free(text);
+            return -1;
+        }
+        text[len] = '\0';
+        if (id < MAX_FORMATS) {
+            free(formats[id]);
+            formats[id] = text;
+        } else {
+            free(text);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "-s") != 0)) {
+        fprintf(stderr, "Usage: %s <trace.bin> [-s]\n", argv[0]);
+        return 1;
+    }
+    int summary = argc == 3;
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (!fp) {
+        fprintf(stderr, "[!] Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    TraceFileHeader hdr;
+    if (read_exact(fp, &hdr, sizeof(hdr)) != 0 ||
+        memcmp(hdr.magic, TRACE_FILE_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "[!] %s is not a sniffer trace file\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+    if (hdr.byte_order != TRACE_BYTE_ORDER) {
+        fprintf(stderr, "[!] Trace was written on a machine with different byte order\n");
+        fclose(fp);
+        return 1;
+    }
+    if (hdr.version != TRACE_FILE_VERSION || hdr.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "[!] Unsupported trace version %u (record size %u)\n",
+                hdr.version, hdr.record_size);
+        fclose(fp);
+        return 1;
+    }
+    if (read_format_table(fp, hdr.format_count) != 0) {
+        fclose(fp);
+        return 1;
+    }
+
+    TraceRecord rec;
+    char line[512];
+    unsigned long long records = 0, dropped = 0;
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        records++;
+        unsigned nargs = rec.nargs <= TRACE_MAX_ARGS ? rec.nargs : TRACE_MAX_ARGS;
+        const char *fmt = rec.fmt < MAX_FORMATS ? formats[rec.fmt] : NULL;
+        if (rec.fmt == TRACE_DROPPED && nargs >= 1) dropped += rec.args[0];
+        if (rec.fmt < MAX_FORMATS) format_counts[rec.fmt]++;
+        if (summary) continue;
+
+        if (fmt) {
+            tracelog_format(line, sizeof(line), fmt, rec.args, nargs);
+        } else {
+            snprintf(line, sizeof(line), "[trace] unknown format %u", rec.fmt);
+        }
+        printf("%12.6f T%-2u %s\n", (double)rec.ts_ns / 1e9, rec.thread, line);
+    }
+    fclose(fp);
+
+    if (summary) {
+        printf("%-8s %12s  %s\n", "Format", "Records", "Text");
+        for (unsigned i = 0; i < MAX_FORMATS; i++) {
+            if (format_counts[i] == 0) continue;
+            printf("%-8u %12llu  %s\n", i, format_counts[i], formats[i] ? formats[i] : "(unknown)");
+        }
+    }
+    fprintf(stderr, "[+] %llu records, %llu dropped by the writer\n", records, dropped);
+
+    for (unsigned i = 0; i < MAX_FORMATS; i++) free(formats[i]);
+    return 0;
+}